@@ -23,6 +23,7 @@
 #include "core_commands8.h"
 #include "core_display.h"
 #include "core_helpers.h"
+#include "core_linalg1.h"
 #include "core_main.h"
 #include "core_math1.h"
 #include "core_sto_rcl.h"
@@ -118,6 +119,27 @@ int docmd_chs(arg_struct *arg) {
     return ERR_NONE;
 }
 
+/* The type check for * and /, which also accept sparse matrices; the
+ * rttypes mask in cmd_array can't express those.
+ */
+static int mul_div_types() {
+    for (int i = 0; i < 2; i++)
+        switch (stack[sp - i]->type) {
+            case TYPE_REAL:
+            case TYPE_COMPLEX:
+            case TYPE_REALMATRIX:
+            case TYPE_COMPLEXMATRIX:
+            case TYPE_UNIT:
+            case TYPE_SPARSEMATRIX:
+                break;
+            case TYPE_STRING:
+                return ERR_ALPHA_DATA_IS_INVALID;
+            default:
+                return ERR_INVALID_TYPE;
+        }
+    return ERR_NONE;
+}
+
 static int docmd_div_completion(int error, vartype *res) {
     if (error != ERR_NONE)
         return error;
@@ -125,6 +147,9 @@ static int docmd_div_completion(int error, vartype *res) {
 }
 
 int docmd_div(arg_struct *arg) {
+    int err = mul_div_types();
+    if (err != ERR_NONE)
+        return err;
     return generic_div(stack[sp], stack[sp - 1], docmd_div_completion);
 }
 
@@ -135,6 +160,9 @@ static int docmd_mul_completion(int error, vartype *res) {
 }
 
 int docmd_mul(arg_struct *arg) {
+    int err = mul_div_types();
+    if (err != ERR_NONE)
+        return err;
     return generic_mul(stack[sp], stack[sp - 1], docmd_mul_completion);
 }
 
@@ -698,12 +726,8 @@ int docmd_clsigma(arg_struct *arg) {
     size = r->rows * r->columns;
     if (last > size)
         return ERR_SIZE_ERROR;
-    for (i = first; i < last; i++) {
-        if (r->array->is_string[i] == 2)
-            free(*(void **) &r->array->data[i]);
-        r->array->is_string[i] = 0;
-        r->array->data[i] = 0;
-    }
+    for (i = first; i < last; i++)
+        put_matrix_phloat(r, i, 0);
     flags.f.log_fit_invalid = 0;
     flags.f.exp_fit_invalid = 0;
     flags.f.pwr_fit_invalid = 0;
@@ -771,6 +795,7 @@ int docmd_clrg(arg_struct *arg) {
             rm->array->data[i] = 0;
         for (i = 0; i < sz; i++)
             rm->array->is_string[i] = 0;
+        rm->array->strings = 0;
         return ERR_NONE;
     } else if (regs->type == TYPE_COMPLEXMATRIX) {
         vartype_complexmatrix *cm;
@@ -846,6 +871,8 @@ int docmd_clall(arg_struct *arg) {
     /* Clear all programs and variables */
     clear_all_rtns();
     current_prgm.set(-1, 0);
+    lu_cache_clear();
+    clear_find_indexes();
 
     delete root;
     root = new directory(2);
@@ -352,7 +352,7 @@ int docmd_delr(arg_struct *arg) {
     vartype_realmatrix *rm;
     vartype_complexmatrix *cm;
     vartype_list *list;
-    int4 rows, columns, i, j, n, newi;
+    int4 rows, columns, i, n, newi;
     int err, refcount;
     int interactive;
 
@@ -374,6 +374,8 @@ int docmd_delr(arg_struct *arg) {
         list = (vartype_list *) m;
         rows = list->size;
         columns = 1;
+        if (list->array->owner != NULL && !disentangle(m))
+            return ERR_INSUFFICIENT_MEMORY;
         refcount = list->array->refcount;
     }
 
@@ -419,68 +421,29 @@ int docmd_delr(arg_struct *arg) {
     }
 
     if (refcount == 1) {
-        /* We have this array to ourselves so we can modify it in place
-         * We shuffle the array elements around so that if the reallocation
-         * succeeds, everything is in the right place, but if it fails, we
-         * still have all the data so we can roll everything back. And best
-         * of all, no temporary memory allocations needed!
+        /* We have this array to ourselves so we can modify it in place.
+         * Shrinking an unshared matrix never fails; the space is kept as
+         * spare capacity, so a following INSR doesn't have to reallocate.
+         * We release the strings in the row being deleted, slide the rows
+         * below it up in one block move, and clear the now-duplicated last
+         * row, so dimension_array_ref() doesn't free its strings again.
          */
         if (m->type == TYPE_REALMATRIX) {
-            for (j = 0; j < columns; j++) {
-                phloat tempd = rm->array->data[matedit_i * columns + j];
-                char tempc = rm->array->is_string[matedit_i * columns + j];
-                for (i = matedit_i; i < rows - 1; i++) {
-                    rm->array->data[i * columns + j] =
-                                rm->array->data[(i + 1) * columns + j];
-                    rm->array->is_string[i * columns + j] =
-                                rm->array->is_string[(i + 1) * columns + j];
-                }
-                rm->array->data[(rows - 1) * columns + j] = tempd;
-                rm->array->is_string[(rows - 1) * columns + j] = tempc;
-            }
-            err = dimension_array_ref(m, rows - 1, columns);
-            if (err != ERR_NONE) {
-                /* Dang! Now we have to rotate everything back to where
-                 * it was before. */
-                for (j = 0; j < columns; j++) {
-                    phloat tempd = rm->array->data[(rows - 1) * columns + j];
-                    char tempc = rm->array->is_string[(rows - 1) * columns + j];
-                    for (i = rows - 1; i > matedit_i; i--) {
-                        rm->array->data[i * columns + j] =
-                                    rm->array->data[(i - 1) * columns + j];
-                        rm->array->is_string[i * columns + j] =
-                                    rm->array->is_string[(i - 1) * columns + j];
-                    }
-                    rm->array->data[matedit_i * columns + j] = tempd;
-                    rm->array->is_string[matedit_i * columns + j] = tempc;
-                }
-                if (interactive)
-                    free_vartype(newx);
-                return err;
+            int4 pos = matedit_i * columns;
+            int4 tail = (rows - matedit_i - 1) * columns;
+            if (rm->array->strings != 0) {
+                rm->array->strings -= count_strings(rm->array->is_string + pos, columns);
+                free_long_strings(rm->array->is_string + pos, rm->array->data + pos, columns);
             }
+            memmove((void *) (rm->array->data + pos), rm->array->data + pos + columns, tail * sizeof(phloat));
+            memmove(rm->array->is_string + pos, rm->array->is_string + pos + columns, tail);
+            memset(rm->array->is_string + (rows - 1) * columns, 0, columns);
+            dimension_array_ref(m, rows - 1, columns);
         } else if (m->type == TYPE_COMPLEXMATRIX) {
-            for (j = 0; j < 2 * columns; j++) {
-                phloat tempd = cm->array->data[matedit_i * 2 * columns + j];
-                for (i = matedit_i; i < rows - 1; i++)
-                    cm->array->data[i * 2 * columns + j] =
-                                cm->array->data[(i + 1) * 2 * columns + j];
-                cm->array->data[(rows - 1) * 2 * columns + j] = tempd;
-            }
-            err = dimension_array_ref(m, rows - 1, columns);
-            if (err != ERR_NONE) {
-                /* Dang! Now we have to rotate everything back to where
-                 * it was before. */
-                for (j = 0; j < 2 * columns; j++) {
-                    phloat tempd = cm->array->data[(rows - 1) * 2 * columns + j];
-                    for (i = rows - 1; i > matedit_i; i--)
-                        cm->array->data[i * 2 * columns + j] =
-                                    cm->array->data[(i - 1) * 2 * columns + j];
-                    cm->array->data[matedit_i * 2 * columns + j] = tempd;
-                }
-                if (interactive)
-                    free_vartype(newx);
-                return err;
-            }
+            int4 pos = 2 * matedit_i * columns;
+            int4 tail = 2 * (rows - matedit_i - 1) * columns;
+            memmove((void *) (cm->array->data + pos), cm->array->data + pos + 2 * columns, tail * sizeof(phloat));
+            dimension_array_ref(m, rows - 1, columns);
         } else /* m->type == TYPE_LIST */ {
             /* This one is easy because shrinking an unshared list always succeeds. */
             vartype *tmp = list->array->data[matedit_i];
@@ -516,17 +479,28 @@ int docmd_delr(arg_struct *arg) {
                 free(array);
                 return ERR_INSUFFICIENT_MEMORY;
             }
-            for (i = 0; i < matedit_i * columns; i++) {
-                array->is_string[i] = rm->array->is_string[i];
-                array->data[i] = rm->array->data[i];
-            }
-            for (i = matedit_i * columns; i < (matedit_i + 1) * columns; i++)
-                if (array->is_string[i] == 2)
-                    free(*(void **) &array->data[i]);
-            for (i = matedit_i * columns; i < newsize; i++) {
-                array->is_string[i] = rm->array->is_string[i + columns];
-                array->data[i] = rm->array->data[i + columns];
+            for (i = 0; i < newsize; i++) {
+                int4 src = i < matedit_i * columns ? i : i + columns;
+                array->is_string[i] = rm->array->is_string[src];
+                if (array->is_string[i] == 2) {
+                    int4 *sp = *(int4 **) &rm->array->data[src];
+                    int4 *dp = (int4 *) malloc(*sp + 4);
+                    if (dp == NULL) {
+                        free_long_strings(array->is_string, array->data, i);
+                        if (interactive)
+                            free_vartype(newx);
+                        free(array->is_string);
+                        free(array->data);
+                        free(array);
+                        return ERR_INSUFFICIENT_MEMORY;
+                    }
+                    memcpy(dp, sp, *sp + 4);
+                    *(int4 **) &array->data[i] = dp;
+                } else
+                    array->data[i] = rm->array->data[src];
             }
+            array->strings = count_strings(array->is_string, newsize);
+            array->capacity = newsize;
             array->refcount = 1;
             rm->array->refcount--;
             rm->array = array;
@@ -550,6 +524,7 @@ int docmd_delr(arg_struct *arg) {
                 array->data[i] = cm->array->data[i];
             for (i = 2 * matedit_i * columns; i < 2 * newsize; i++)
                 array->data[i] = cm->array->data[i + 2 * columns];
+            array->capacity = newsize;
             array->refcount = 1;
             cm->array->refcount--;
             cm->array = array;
@@ -580,7 +555,9 @@ int docmd_delr(arg_struct *arg) {
                     return ERR_INSUFFICIENT_MEMORY;
                 }
             }
+            array->capacity = newsize;
             array->refcount = 1;
+            array->owner = NULL;
             list->array->refcount--;
             list->array = array;
             list->size--;
@@ -680,15 +657,17 @@ int docmd_dot(arg_struct *arg) {
         vartype_realmatrix *rm1 = (vartype_realmatrix *) stack[sp];
         vartype_realmatrix *rm2 = (vartype_realmatrix *) stack[sp - 1];
         int4 size = rm1->rows * rm1->columns;
-        int4 i;
         phloat dot = 0;
         int inf;
         if (size != rm2->rows * rm2->columns)
             return ERR_DIMENSION_ERROR;
         if (contains_strings(rm1) || contains_strings(rm2))
             return ERR_ALPHA_DATA_IS_INVALID;
-        for (i = 0; i < size; i++)
-            dot += rm1->array->data[i] * rm2->array->data[i];
+        #ifdef BCD_MATH
+            dot = dot_fma(rm1->array->data, rm2->array->data, size, dot);
+        #else
+            dot = vec_dot(rm1->array->data, rm2->array->data, size);
+        #endif
         if ((inf = p_isinf(dot)) != 0) {
             if (flags.f.range_error_ignore)
                 dot = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
@@ -1093,16 +1072,31 @@ static int fnrm(vartype *m, phloat *norm) {
         data = cm->array->data;
     }
     int max_exp = INT_MIN;
+    phloat nrm = 0;
+    #ifndef BCD_MATH
+        /* Scaling by a power of two is exact, whether it is done by
+         * multiplication or by scalbn(), as long as that power of two
+         * is itself representable.
+         */
+        max_exp = ilogb(vec_abs_max(data, size));
+        if (max_exp >= -1023 && max_exp <= 1074) {
+            nrm = vec_sum_squares(data, size, scalbn(1.0, -max_exp));
+            goto scale_back;
+        }
+        max_exp = INT_MIN;
+    #endif
     for (int4 i = 0; i < size; i++) {
         int s = ilogb(data[i]);
         if (s > max_exp)
             max_exp = s;
     }
-    phloat nrm = 0;
     for (int4 i = 0; i < size; i++) {
         phloat x = scalbn(data[i], -max_exp);
         nrm += x * x;
     }
+    #ifndef BCD_MATH
+        scale_back:
+    #endif
     nrm = scalbn(sqrt(nrm), max_exp);
     if (p_isinf(nrm)) {
         if (flags.f.range_error_ignore)
@@ -1179,6 +1173,8 @@ int docmd_getm(arg_struct *arg) {
                     dst->array->data[n2] = src->array->data[n1];
                 }
                 dst->array->is_string[n2] = src->array->is_string[n1];
+                if (dst->array->is_string[n2] != 0)
+                    dst->array->strings++;
             }
         return binary_result((vartype *) dst);
     } else /* m->type == TYPE_COMPLEXMATRIX */ {
@@ -79,6 +79,8 @@ int docmd_insr(arg_struct *arg) {
         list = (vartype_list *) m;
         rows = list->size;
         columns = 1;
+        if (list->array->owner != NULL && !disentangle(m))
+            return ERR_INSUFFICIENT_MEMORY;
         refcount = list->array->refcount;
         if (interactive) {
             newx = new_real(0);
@@ -102,18 +104,18 @@ int docmd_insr(arg_struct *arg) {
         }
         rows++;
         if (m->type == TYPE_REALMATRIX) {
-            for (i = rows * columns - 1; i >= (matedit_i + 1) * columns; i--) {
-                rm->array->is_string[i] = rm->array->is_string[i - columns];
-                rm->array->data[i] = rm->array->data[i - columns];
-            }
-            for (i = matedit_i * columns; i < (matedit_i + 1) * columns; i++) {
+            int4 pos = matedit_i * columns;
+            int4 tail = (rows - matedit_i - 1) * columns;
+            memmove((void *) (rm->array->data + pos + columns), rm->array->data + pos, tail * sizeof(phloat));
+            memmove(rm->array->is_string + pos + columns, rm->array->is_string + pos, tail);
+            for (i = pos; i < pos + columns; i++) {
                 rm->array->is_string[i] = 0;
                 rm->array->data[i] = 0;
             }
         } else if (m->type == TYPE_COMPLEXMATRIX) {
-            for (i = 2 * rows * columns - 1;
-                            i >= 2 * (matedit_i + 1) * columns; i--)
-                cm->array->data[i] = cm->array->data[i - 2 * columns];
+            int4 pos = 2 * matedit_i * columns;
+            int4 tail = 2 * (rows - matedit_i - 1) * columns;
+            memmove((void *) (cm->array->data + pos + 2 * columns), cm->array->data + pos, tail * sizeof(phloat));
             for (i = 2 * matedit_i * columns;
                             i < 2 * (matedit_i + 1) * columns; i++)
                 cm->array->data[i] = 0;
@@ -165,18 +167,33 @@ int docmd_insr(arg_struct *arg) {
                 free(array);
                 return ERR_INSUFFICIENT_MEMORY;
             }
-            for (i = 0; i < matedit_i * columns; i++) {
-                array->is_string[i] = rm->array->is_string[i];
-                array->data[i] = rm->array->data[i];
-            }
-            for (i = matedit_i * columns; i < (matedit_i + 1) * columns; i++) {
-                array->is_string[i] = 0;
-                array->data[i] = 0;
-            }
-            for (i = (matedit_i + 1) * columns; i < newsize; i++) {
-                array->is_string[i] = rm->array->is_string[i - columns];
-                array->data[i] = rm->array->data[i - columns];
+            for (i = 0; i < newsize; i++) {
+                if (i >= matedit_i * columns && i < (matedit_i + 1) * columns) {
+                    array->is_string[i] = 0;
+                    array->data[i] = 0;
+                    continue;
+                }
+                int4 src = i < matedit_i * columns ? i : i - columns;
+                array->is_string[i] = rm->array->is_string[src];
+                if (array->is_string[i] == 2) {
+                    int4 *sp = *(int4 **) &rm->array->data[src];
+                    int4 *dp = (int4 *) malloc(*sp + 4);
+                    if (dp == NULL) {
+                        free_long_strings(array->is_string, array->data, i);
+                        if (interactive)
+                            free_vartype(newx);
+                        free(array->is_string);
+                        free(array->data);
+                        free(array);
+                        return ERR_INSUFFICIENT_MEMORY;
+                    }
+                    memcpy(dp, sp, *sp + 4);
+                    *(int4 **) &array->data[i] = dp;
+                } else
+                    array->data[i] = rm->array->data[src];
             }
+            array->strings = rm->array->strings;
+            array->capacity = newsize;
             array->refcount = 1;
             rm->array->refcount--;
             rm->array = array;
@@ -203,6 +220,7 @@ int docmd_insr(arg_struct *arg) {
                 array->data[i] = 0;
             for (i = 2 * (matedit_i + 1) * columns; i < 2 * newsize; i++)
                 array->data[i] = cm->array->data[i - 2 * columns];
+            array->capacity = newsize;
             array->refcount = 1;
             cm->array->refcount--;
             cm->array = array;
@@ -235,7 +253,9 @@ int docmd_insr(arg_struct *arg) {
                     return ERR_INSUFFICIENT_MEMORY;
                 }
             }
+            array->capacity = newsize;
             array->refcount = 1;
+            array->owner = NULL;
             list->array->refcount--;
             list->array = array;
             list->size++;
@@ -279,11 +299,8 @@ int docmd_j_add(arg_struct *arg) {
             if (matedit_i == list->size - 1 && flags.f.grow) {
                 if (!disentangle((vartype *) list))
                     return ERR_INSUFFICIENT_MEMORY;
-                int4 newsize = list->size + 1;
-                vartype **newdata = (vartype **) realloc(list->array->data, newsize * sizeof(vartype *));
-                if (newdata == NULL)
+                if (!list_reserve(list, list->size + 1))
                     return ERR_INSUFFICIENT_MEMORY;
-                list->array->data = newdata;
                 vartype *zero = new_real(0);
                 if (zero == NULL)
                     return ERR_INSUFFICIENT_MEMORY;
@@ -494,6 +511,7 @@ int docmd_putm(arg_struct *arg) {
                 char tc = dst->array->is_string[n2];
                 dst->array->is_string[n2] = src->array->is_string[n1];
                 src->array->is_string[n1] = tc;
+                dst->array->strings += (dst->array->is_string[n2] != 0) - (tc != 0);
                 phloat tp = dst->array->data[n2];
                 dst->array->data[n2] = src->array->data[n1];
                 src->array->data[n1] = tp;
@@ -591,13 +609,17 @@ int docmd_rnrm(arg_struct *arg) {
         phloat max = 0;
         for (int4 i = 0; i < rm->rows; i++) {
             phloat nrm = 0;
-            for (int4 j = 0; j < rm->columns; j++) {
-                phloat x = rm->array->data[i * rm->columns + j];
-                if (x >= 0)
-                    nrm += x;
-                else
-                    nrm -= x;
-            }
+            #ifdef BCD_MATH
+                for (int4 j = 0; j < rm->columns; j++) {
+                    phloat x = rm->array->data[i * rm->columns + j];
+                    if (x >= 0)
+                        nrm += x;
+                    else
+                        nrm -= x;
+                }
+            #else
+                nrm = vec_abs_sum(rm->array->data + i * rm->columns, rm->columns);
+            #endif
             if (p_isinf(nrm)) {
                 if (flags.f.range_error_ignore)
                     max = POS_HUGE_PHLOAT;
@@ -655,8 +677,12 @@ int docmd_rsum(arg_struct *arg) {
         for (int4 i = 0; i < rm->rows; i++) {
             phloat sum = 0;
             int inf;
-            for (int4 j = 0; j < rm->columns; j++)
-                sum += rm->array->data[i * rm->columns + j];
+            #ifdef BCD_MATH
+                for (int4 j = 0; j < rm->columns; j++)
+                    sum += rm->array->data[i * rm->columns + j];
+            #else
+                sum = vec_sum(rm->array->data + i * rm->columns, rm->columns);
+            #endif
             if ((inf = p_isinf(sum)) != 0) {
                 if (flags.f.range_error_ignore)
                     sum = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
@@ -836,10 +862,7 @@ int docmd_stoel(arg_struct *arg) {
         vartype_realmatrix *rm = (vartype_realmatrix *) m;
         int4 n = matedit_i * rm->columns + matedit_j;
         if (stack[sp]->type == TYPE_REAL) {
-            if (rm->array->is_string[n] == 2)
-                free(*(void **) &rm->array->data[n]);
-            rm->array->is_string[n] = 0;
-            rm->array->data[n] = ((vartype_real *) stack[sp])->x;
+            put_matrix_phloat(rm, n, ((vartype_real *) stack[sp])->x);
             return ERR_NONE;
         } else if (stack[sp]->type == TYPE_STRING) {
             vartype_string *s = (vartype_string *) stack[sp];
@@ -971,33 +994,94 @@ int docmd_tanh(arg_struct *arg) {
     return err;
 }
 
+/* Cache-oblivious transpose: the block is halved along its longer side
+ * until it is small enough for both its source rows and its destination
+ * columns to stay in the cache, whatever the cache size is. Elements are w
+ * phloats wide, so this handles real and complex matrices alike.
+ */
+#define TRANS_TILE 16
+
+static void trans_phloats(const phloat *src, phloat *dst, int4 rows,
+                          int4 columns, int w, int4 i0, int4 i1,
+                          int4 j0, int4 j1) {
+    while (i1 - i0 > TRANS_TILE || j1 - j0 > TRANS_TILE) {
+        if (i1 - i0 >= j1 - j0) {
+            int4 im = i0 + (i1 - i0) / 2;
+            trans_phloats(src, dst, rows, columns, w, i0, im, j0, j1);
+            i0 = im;
+        } else {
+            int4 jm = j0 + (j1 - j0) / 2;
+            trans_phloats(src, dst, rows, columns, w, i0, i1, j0, jm);
+            j0 = jm;
+        }
+    }
+    for (int4 i = i0; i < i1; i++) {
+        const phloat *s = src + ((int8) i * columns + j0) * w;
+        phloat *d = dst + ((int8) j0 * rows + i) * w;
+        for (int4 j = j0; j < j1; j++) {
+            d[0] = s[0];
+            if (w == 2)
+                d[1] = s[1];
+            s += w;
+            d += (int8) rows * w;
+        }
+    }
+}
+
+static void trans_chars(const char *src, char *dst, int4 rows, int4 columns,
+                        int4 i0, int4 i1, int4 j0, int4 j1) {
+    while (i1 - i0 > TRANS_TILE || j1 - j0 > TRANS_TILE) {
+        if (i1 - i0 >= j1 - j0) {
+            int4 im = i0 + (i1 - i0) / 2;
+            trans_chars(src, dst, rows, columns, i0, im, j0, j1);
+            i0 = im;
+        } else {
+            int4 jm = j0 + (j1 - j0) / 2;
+            trans_chars(src, dst, rows, columns, i0, i1, j0, jm);
+            j0 = jm;
+        }
+    }
+    for (int4 i = i0; i < i1; i++)
+        for (int4 j = j0; j < j1; j++)
+            dst[(int8) j * rows + i] = src[(int8) i * columns + j];
+}
+
 int docmd_trans(arg_struct *arg) {
     if (stack[sp]->type == TYPE_REALMATRIX) {
         vartype_realmatrix *src = (vartype_realmatrix *) stack[sp];
         vartype_realmatrix *dst;
         int4 rows = src->rows;
         int4 columns = src->columns;
-        int4 i, j;
         dst = (vartype_realmatrix *) new_realmatrix(columns, rows);
         if (dst == NULL)
             return ERR_INSUFFICIENT_MEMORY;
-        for (i = 0; i < rows; i++)
-            for (j = 0; j < columns; j++) {
-                int4 n1 = i * columns + j;
-                int4 n2 = j * rows + i;
-                dst->array->is_string[n2] = src->array->is_string[n1];
-                if (dst->array->is_string[n2] == 2) {
-                    int4 *sp = *(int4 **) &src->array->data[n1];
-                    int4 *dp = (int4 *) malloc(*sp + 4);
-                    if (dp == NULL) {
-                        free_vartype((vartype *) dst);
-                        return ERR_INSUFFICIENT_MEMORY;
-                    }
-                    memcpy(dp, sp, *sp + 4);
-                    *(int4 **) &dst->array->data[n2] = dp;
-                } else
-                    dst->array->data[n2] = src->array->data[n1];
+        trans_phloats(src->array->data, dst->array->data, rows, columns, 1,
+                      0, rows, 0, columns);
+        if (src->array->strings != 0) {
+            trans_chars(src->array->is_string, dst->array->is_string,
+                        rows, columns, 0, rows, 0, columns);
+            /* The long strings were copied by reference; give the
+             * transpose its own copies.
+             */
+            int4 sz = rows * columns;
+            for (int4 n = 0; n < sz; n++) {
+                if (dst->array->is_string[n] != 2)
+                    continue;
+                int4 *sp = *(int4 **) &dst->array->data[n];
+                int4 *dp = (int4 *) malloc(*sp + 4);
+                if (dp == NULL) {
+                    /* Don't let free_vartype() free the source's strings */
+                    for (; n < sz; n++)
+                        if (dst->array->is_string[n] == 2)
+                            dst->array->is_string[n] = 0;
+                    free_vartype((vartype *) dst);
+                    return ERR_INSUFFICIENT_MEMORY;
+                }
+                memcpy(dp, sp, *sp + 4);
+                *(int4 **) &dst->array->data[n] = dp;
             }
+            dst->array->strings = src->array->strings;
+        }
         unary_result((vartype *) dst);
         return ERR_NONE;
     } else {
@@ -1005,17 +1089,11 @@ int docmd_trans(arg_struct *arg) {
         vartype_complexmatrix *dst;
         int4 rows = src->rows;
         int4 columns = src->columns;
-        int4 i, j;
         dst = (vartype_complexmatrix *) new_complexmatrix(columns, rows);
         if (dst == NULL)
             return ERR_INSUFFICIENT_MEMORY;
-        for (i = 0; i < rows; i++)
-            for (j = 0; j < columns; j++) {
-                int4 n1 = 2 * (i * columns + j);
-                int4 n2 = 2 * (j * rows + i);
-                dst->array->data[n2] = src->array->data[n1];
-                dst->array->data[n2 + 1] = src->array->data[n1 + 1];
-            }
+        trans_phloats(src->array->data, dst->array->data, rows, columns, 2,
+                      0, rows, 0, columns);
         unary_result((vartype *) dst);
         return ERR_NONE;
     }
@@ -1168,12 +1246,9 @@ static int matedit_move_list(vartype_list *list, int direction) {
             }
             if (!disentangle((vartype *) list))
                 goto nomem2;
-            int4 newsize = list->size + 1;
-            vartype **newdata = (vartype **) realloc(list->array->data, newsize * sizeof(vartype *));
-            if (newdata == NULL)
+            if (!list_reserve(list, list->size + 1))
                 goto nomem2;
-            newdata[list->size] = zero1;
-            list->array->data = newdata;
+            list->array->data[list->size] = zero1;
             new_i = list->size++;
             new_x = zero2;
             edge_flag = true;
@@ -1345,10 +1420,7 @@ static int matedit_move(int direction) {
         if (!changed) {
             /* There's nothing to store, so leave cell unchanged */
         } else if (stack[sp]->type == TYPE_REAL) {
-            if (rm->array->is_string[old_n] == 2)
-                free(*(void **) &rm->array->data[old_n]);
-            rm->array->is_string[old_n] = 0;
-            rm->array->data[old_n] = ((vartype_real *) stack[sp])->x;
+            put_matrix_phloat(rm, old_n, ((vartype_real *) stack[sp])->x);
         } else {
             vartype_string *s = (vartype_string *) stack[sp];
             if (!put_matrix_string(rm, old_n, s->txt(), s->length)) {
@@ -1745,6 +1817,15 @@ int docmd_find(arg_struct *arg) {
         if (stack[sp]->type == TYPE_COMPLEX)
             return ERR_NO;
         rm = (vartype_realmatrix *) m;
+        p = indexed_find(m, stack[sp], 0);
+        if (p != -2) {
+            if (p == -1)
+                return ERR_NO;
+            matedit_i = p / rm->columns;
+            matedit_j = p % rm->columns;
+            return ERR_YES;
+        }
+        p = 0;
         if (stack[sp]->type == TYPE_REAL) {
             phloat d = ((vartype_real *) stack[sp])->x;
             for (i = 0; i < rm->rows; i++)
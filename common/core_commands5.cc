@@ -86,8 +86,84 @@ static struct sum_struct {
     phloat lnxlny;
     phloat xlny;
     phloat ylnx;
+    /* True if 'stats' matches the summation registers */
+    bool stable;
 } sum;
 
+/* Alongside the HP-42S summation registers, which hold plain power sums,
+ * SIGMA+ and SIGMA- keep the means of x and y, and the sums of squared and
+ * cross deviations from those means, updated in the manner of Welford and
+ * Chan et al. MEAN, SDEV, CORR, and the linear model use those instead of
+ * the power sums, which lose most of their precision to cancellation when
+ * the spread of the data is small compared to their magnitude.
+ * The registers can be changed by other means than SIGMA+ and SIGMA-, so
+ * 'regs' holds their contents as of the last update, and the statistics
+ * are only used while all six still match; when they don't, the power sums
+ * are used as before. Tracking restarts whenever SIGMA+ or SIGMA- finds the
+ * registers all zero, as they are after CLSIGMA.
+ * The means are kept relative to the first point, or the mean of the first
+ * batch of points, so that data with a large offset doesn't lose precision
+ * in the means themselves.
+ */
+static struct stats_struct {
+    bool valid;
+    phloat n;
+    phloat kx;
+    phloat ky;
+    phloat mx;
+    phloat my;
+    phloat sxx;
+    phloat syy;
+    phloat sxy;
+    phloat regs[6];
+} stats;
+
+static bool stats_match(const phloat *sigmaregs) {
+    if (!stats.valid)
+        return false;
+    for (int i = 0; i < 6; i++)
+        if (stats.regs[i] != sigmaregs[i])
+            return false;
+    return true;
+}
+
+bool persist_stats() {
+    if (!write_bool(stats.valid))
+        return false;
+    if (!stats.valid)
+        return true;
+    if (!write_phloat(stats.n) || !write_phloat(stats.kx)
+            || !write_phloat(stats.ky) || !write_phloat(stats.mx)
+            || !write_phloat(stats.my) || !write_phloat(stats.sxx)
+            || !write_phloat(stats.syy) || !write_phloat(stats.sxy))
+        return false;
+    for (int i = 0; i < 6; i++)
+        if (!write_phloat(stats.regs[i]))
+            return false;
+    return true;
+}
+
+bool unpersist_stats(int ver) {
+    stats.valid = false;
+    if (ver < 62)
+        return true;
+    bool valid;
+    if (!read_bool(&valid))
+        return false;
+    if (!valid)
+        return true;
+    if (!read_phloat(&stats.n) || !read_phloat(&stats.kx)
+            || !read_phloat(&stats.ky) || !read_phloat(&stats.mx)
+            || !read_phloat(&stats.my) || !read_phloat(&stats.sxx)
+            || !read_phloat(&stats.syy) || !read_phloat(&stats.sxy))
+        return false;
+    for (int i = 0; i < 6; i++)
+        if (!read_phloat(&stats.regs[i]))
+            return false;
+    stats.valid = true;
+    return true;
+}
+
 static int get_summation() {
     /* Check if summation registers are OK */
     int4 first = mode_sigma_reg;
@@ -123,6 +199,7 @@ static int get_summation() {
         sum.xlny = sigmaregs[11];
         sum.ylnx = sigmaregs[12];
     }
+    sum.stable = stats_match(sigmaregs);
     return ERR_NONE;
 }
 
@@ -136,6 +213,8 @@ static struct model_struct {
     int ln_before;
     int exp_after;
     int valid;
+    /* True for the linear model when 'stats' can be used */
+    bool stable;
     phloat slope;
     phloat yint;
 } model;
@@ -195,6 +274,7 @@ static int get_model_summation(int modl) {
         model.y2 = sum.y2;
     }
     model.n = sum.n;
+    model.stable = modl == MODEL_LIN && sum.stable;
     return ERR_NONE;
 }
 
@@ -205,9 +285,15 @@ static int corr_helper(int modl, phloat *r) {
         return err;
     if (model.n == 0 || model.n == 1)
         return ERR_STAT_MATH_ERROR;
-    cov = model.xy - model.x * model.y / model.n;
-    varx = model.x2 - model.x * model.x / model.n;
-    vary = model.y2 - model.y * model.y / model.n;
+    if (model.stable) {
+        cov = stats.sxy;
+        varx = stats.sxx;
+        vary = stats.syy;
+    } else {
+        cov = model.xy - model.x * model.y / model.n;
+        varx = model.x2 - model.x * model.x / model.n;
+        vary = model.y2 - model.y * model.y / model.n;
+    }
     if (varx <= 0 || vary <= 0)
         return ERR_STAT_MATH_ERROR;
     v = varx * vary;
@@ -230,15 +316,25 @@ static int slope_yint_helper() {
     int inf;
     if (model.n == 0 || model.n == 1)
         return ERR_STAT_MATH_ERROR;
-    cov = model.xy - model.x * model.y / model.n;
-    varx = model.x2 - model.x * model.x / model.n;
+    if (model.stable) {
+        cov = stats.sxy;
+        varx = stats.sxx;
+    } else {
+        cov = model.xy - model.x * model.y / model.n;
+        varx = model.x2 - model.x * model.x / model.n;
+    }
     if (varx == 0)
         return ERR_STAT_MATH_ERROR;
     model.slope = cov / varx;
     if ((inf = p_isinf(model.slope)) != 0)
         model.slope = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
-    meanx = model.x / model.n;
-    meany = model.y / model.n;
+    if (model.stable) {
+        meanx = stats.kx + stats.mx;
+        meany = stats.ky + stats.my;
+    } else {
+        meanx = model.x / model.n;
+        meany = model.y / model.n;
+    }
     model.yint = meany - model.slope * meanx;
     if ((inf = p_isinf(model.yint)) != 0)
         model.yint = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
@@ -383,13 +479,13 @@ int docmd_mean(arg_struct *arg) {
         return err;
     if (sum.n == 0)
         return ERR_STAT_MATH_ERROR;
-    m = sum.x / sum.n;
+    m = sum.stable ? stats.kx + stats.mx : sum.x / sum.n;
     if ((inf = p_isinf(m)) != 0)
         m = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
     mx = new_real(m);
     if (mx == NULL)
         return ERR_INSUFFICIENT_MEMORY;
-    m = sum.y / sum.n;
+    m = sum.stable ? stats.ky + stats.my : sum.y / sum.n;
     if ((inf = p_isinf(m)) != 0)
         m = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
     my = new_real(m);
@@ -413,7 +509,10 @@ int docmd_sdev(arg_struct *arg) {
         return err;
     if (sum.n == 0 || sum.n == 1)
         return ERR_STAT_MATH_ERROR;
-    var = (sum.x2 - (sum.x * sum.x / sum.n)) / (sum.n - 1);
+    if (sum.stable)
+        var = stats.sxx / (sum.n - 1);
+    else
+        var = (sum.x2 - (sum.x * sum.x / sum.n)) / (sum.n - 1);
     if (var < 0)
         return ERR_STAT_MATH_ERROR;
     if (p_isinf(var))
@@ -422,7 +521,10 @@ int docmd_sdev(arg_struct *arg) {
         sx = new_real(sqrt(var));
     if (sx == NULL)
         return ERR_INSUFFICIENT_MEMORY;
-    var = (sum.y2 - (sum.y * sum.y / sum.n)) / (sum.n - 1);
+    if (sum.stable)
+        var = stats.syy / (sum.n - 1);
+    else
+        var = (sum.y2 - (sum.y * sum.y / sum.n)) / (sum.n - 1);
     if (var < 0)
         return ERR_STAT_MATH_ERROR;
     if (p_isinf(var))
@@ -2047,38 +2149,58 @@ static void accum(phloat *sum, phloat term, int weight) {
     *sum = s;
 }
 
-static phloat sigma_helper_2(phloat *sigmaregs,
-                             phloat x, phloat y, int weight) {
+/* Neumaier's compensated sum. SIGMA+ and SIGMA- add up all the terms
+ * contributed by their x and y values this way, and then add the totals to
+ * the registers, so a matrix of data is summed accurately no matter how
+ * many rows it has.
+ */
+struct ksum_struct {
+    phloat s;
+    phloat c;
+};
+
+static void kadd(ksum_struct *k, phloat term) {
+    phloat s = k->s + term;
+    if (fabs(k->s) >= fabs(term))
+        k->c += (k->s - s) + term;
+    else
+        k->c += (term - s) + k->s;
+    k->s = s;
+}
+
+static phloat ktotal(const ksum_struct *k) {
+    return p_isinf(k->s) ? k->s : k->s + k->c;
+}
 
-    accum(&sigmaregs[0], x, weight);
-    accum(&sigmaregs[1], x * x, weight);
-    accum(&sigmaregs[2], y, weight);
-    accum(&sigmaregs[3], y * y, weight);
-    accum(&sigmaregs[4], x * y, weight);
-    accum(&sigmaregs[5], 1, weight);
+static void sigma_terms(ksum_struct *k, phloat x, phloat y) {
+    kadd(&k[0], x);
+    kadd(&k[1], x * x);
+    kadd(&k[2], y);
+    kadd(&k[3], y * y);
+    kadd(&k[4], x * y);
 
     if (flags.f.all_sigma) {
         if (x > 0) {
             phloat lnx = log(x);
             if (y > 0) {
                 phloat lny = log(y);
-                accum(&sigmaregs[8], lny, weight);
-                accum(&sigmaregs[9], lny * lny, weight);
-                accum(&sigmaregs[10], lnx * lny, weight);
-                accum(&sigmaregs[11], x * lny, weight);
+                kadd(&k[8], lny);
+                kadd(&k[9], lny * lny);
+                kadd(&k[10], lnx * lny);
+                kadd(&k[11], x * lny);
             } else {
                 flags.f.exp_fit_invalid = 1;
                 flags.f.pwr_fit_invalid = 1;
             }
-            accum(&sigmaregs[6], lnx, weight);
-            accum(&sigmaregs[7], lnx * lnx, weight);
-            accum(&sigmaregs[12], lnx * y, weight);
+            kadd(&k[6], lnx);
+            kadd(&k[7], lnx * lnx);
+            kadd(&k[12], lnx * y);
         } else {
             if (y > 0) {
                 phloat lny = log(y);
-                accum(&sigmaregs[8], lny, weight);
-                accum(&sigmaregs[9], lny * lny, weight);
-                accum(&sigmaregs[11], x * lny, weight);
+                kadd(&k[8], lny);
+                kadd(&k[9], lny * lny);
+                kadd(&k[11], x * lny);
             } else
                 flags.f.exp_fit_invalid = 1;
             flags.f.log_fit_invalid = 1;
@@ -2089,6 +2211,143 @@ static phloat sigma_helper_2(phloat *sigmaregs,
         flags.f.exp_fit_invalid = 1;
         flags.f.pwr_fit_invalid = 1;
     }
+}
+
+/* Called before the registers are updated; returns true if 'stats' should
+ * be updated as well.
+ */
+static bool stats_begin(const phloat *sigmaregs) {
+    if (stats_match(sigmaregs))
+        return true;
+    for (int i = 0; i < 6; i++)
+        if (sigmaregs[i] != 0) {
+            stats.valid = false;
+            return false;
+        }
+    stats.n = 0;
+    stats.kx = 0;
+    stats.ky = 0;
+    stats.mx = 0;
+    stats.my = 0;
+    stats.sxx = 0;
+    stats.syy = 0;
+    stats.sxy = 0;
+    return true;
+}
+
+/* Merges a batch of nb points, with means mx and my, and sums of squared
+ * and cross deviations sxx, syy, and sxy, into 'stats', or takes them out
+ * of it when weight is -1; called after the registers have been updated.
+ */
+static void stats_end(const phloat *sigmaregs, phloat nb, phloat mx,
+                      phloat my, phloat sxx, phloat syy, phloat sxy,
+                      int weight) {
+    phloat n;
+    if (stats.n == 0) {
+        stats.kx = mx;
+        stats.ky = my;
+    }
+    mx -= stats.kx;
+    my -= stats.ky;
+    if (weight == 1) {
+        n = stats.n + nb;
+        phloat dx = mx - stats.mx;
+        phloat dy = my - stats.my;
+        phloat f = stats.n * nb / n;
+        stats.mx += dx * nb / n;
+        stats.my += dy * nb / n;
+        stats.sxx += sxx + dx * dx * f;
+        stats.syy += syy + dy * dy * f;
+        stats.sxy += sxy + dx * dy * f;
+    } else {
+        n = stats.n - nb;
+        if (n < 0) {
+            /* More points removed than were ever added */
+            stats.valid = false;
+            return;
+        }
+        if (n == 0) {
+            stats.mx = 0;
+            stats.my = 0;
+            stats.sxx = 0;
+            stats.syy = 0;
+            stats.sxy = 0;
+        } else {
+            phloat rx = stats.mx - (mx - stats.mx) * nb / n;
+            phloat ry = stats.my - (my - stats.my) * nb / n;
+            phloat dx = mx - rx;
+            phloat dy = my - ry;
+            phloat f = n * nb / stats.n;
+            stats.mx = rx;
+            stats.my = ry;
+            stats.sxx -= sxx + dx * dx * f;
+            stats.syy -= syy + dy * dy * f;
+            stats.sxy -= sxy + dx * dy * f;
+            if (stats.sxx < 0)
+                stats.sxx = 0;
+            if (stats.syy < 0)
+                stats.syy = 0;
+        }
+    }
+    stats.n = n;
+    phloat v[7] = { stats.kx, stats.ky, stats.mx, stats.my,
+                    stats.sxx, stats.syy, stats.sxy };
+    for (int i = 0; i < 7; i++)
+        if (p_isinf(v[i]) || p_isnan(v[i])) {
+            stats.valid = false;
+            return;
+        }
+    for (int i = 0; i < 6; i++)
+        stats.regs[i] = sigmaregs[i];
+    stats.valid = true;
+}
+
+/* Adds or subtracts 'rows' points to or from the summation registers. The
+ * x and y values are read from xp and yp, 'stride' elements apart, so any
+ * two columns of a matrix can be used in place.
+ */
+static phloat sigma_helper_2(phloat *sigmaregs, const phloat *xp,
+                             const phloat *yp, int4 stride, int4 rows,
+                             int weight) {
+    ksum_struct k[13];
+    int i;
+    int4 r;
+    for (i = 0; i < 13; i++) {
+        k[i].s = 0;
+        k[i].c = 0;
+    }
+    for (r = 0; r < rows; r++)
+        sigma_terms(k, xp[(int8) r * stride], yp[(int8) r * stride]);
+
+    bool track = stats_begin(sigmaregs);
+    int nregs = flags.f.all_sigma ? 13 : 6;
+    for (i = 0; i < nregs; i++)
+        if (i == 5)
+            accum(&sigmaregs[5], rows, weight);
+        else
+            accum(&sigmaregs[i], ktotal(&k[i]), weight);
+
+    if (track) {
+        /* The deviations are summed in a second pass over the data, from
+         * the batch's own means; for a single point, they are all zero.
+         */
+        phloat mx = ktotal(&k[0]) / rows;
+        phloat my = ktotal(&k[2]) / rows;
+        for (i = 0; i < 3; i++) {
+            k[i].s = 0;
+            k[i].c = 0;
+        }
+        if (rows > 1)
+            for (r = 0; r < rows; r++) {
+                phloat dx = xp[(int8) r * stride] - mx;
+                phloat dy = yp[(int8) r * stride] - my;
+                kadd(&k[0], dx * dx);
+                kadd(&k[1], dy * dy);
+                kadd(&k[2], dx * dy);
+            }
+        stats_end(sigmaregs, rows, mx, my, ktotal(&k[0]), ktotal(&k[1]),
+                  ktotal(&k[2]), weight);
+    }
 
     return sigmaregs[5];
 }
@@ -2100,7 +2359,6 @@ static int sigma_helper_1(int weight) {
     int4 size, i;
     vartype *regs = recall_var("REGS", 4);
     vartype_realmatrix *r;
-    phloat *sigmaregs;
     if (regs == NULL)
         return ERR_SIZE_ERROR;
     if (regs->type != TYPE_REALMATRIX)
@@ -2112,53 +2370,48 @@ static int sigma_helper_1(int weight) {
     for (i = first; i < last; i++)
         if (r->array->is_string[i] != 0)
             return ERR_ALPHA_DATA_IS_INVALID;
-    sigmaregs = r->array->data + first;
 
     /* All summation registers present, real-valued, non-string. */
+    const phloat *xp, *yp;
+    phloat xy[2];
+    int4 rows;
     if (stack[sp]->type == TYPE_REALMATRIX) {
         vartype_realmatrix *rm = (vartype_realmatrix *) stack[sp];
-        vartype_real *x;
-        int4 i;
         if (rm->columns != 2)
             return ERR_DIMENSION_ERROR;
-        for (i = 0; i < rm->rows * 2; i++)
-            if (rm->array->is_string[i] != 0)
-                return ERR_ALPHA_DATA_IS_INVALID;
-        x = (vartype_real *) new_real(0);
-        if (x == NULL)
-            return ERR_INSUFFICIENT_MEMORY;
-        for (i = 0; i < rm->rows; i++)
-            x->x = sigma_helper_2(sigmaregs,
-                                    rm->array->data[i * 2],
-                                    rm->array->data[i * 2 + 1],
-                                    weight);
-        free_vartype(lastx);
-        lastx = stack[sp];
-        stack[sp] = (vartype *) x;
-        mode_disable_stack_lift = true;
-        return ERR_NONE;
+        if (contains_strings(rm))
+            return ERR_ALPHA_DATA_IS_INVALID;
+        xp = rm->array->data;
+        yp = xp + 1;
+        rows = rm->rows;
     } else {
         // stack[sp]->type == TYPE_REAL
         if (sp == 0 || stack[sp - 1]->type == TYPE_REAL) {
-            vartype_real *x = (vartype_real *) new_real(0);
-            if (x == NULL)
-                return ERR_INSUFFICIENT_MEMORY;
-            phloat y = sp == 0 ? 0 : ((vartype_real *) stack[sp - 1])->x;
-            x->x = sigma_helper_2(sigmaregs,
-                                    ((vartype_real *) stack[sp])->x,
-                                    y,
-                                    weight);
-            free_vartype(lastx);
-            lastx = stack[sp];
-            stack[sp] = (vartype *) x;
-            mode_disable_stack_lift = true;
-            return ERR_NONE;
+            xy[0] = ((vartype_real *) stack[sp])->x;
+            xy[1] = sp == 0 ? 0 : ((vartype_real *) stack[sp - 1])->x;
+            xp = xy;
+            yp = xy + 1;
+            rows = 1;
         } else if (stack[sp - 1]->type == TYPE_STRING) {
             return ERR_ALPHA_DATA_IS_INVALID;
         } else {
             return ERR_INVALID_TYPE;
         }
     }
+
+    vartype_real *x = (vartype_real *) new_real(0);
+    if (x == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    if (!disentangle(regs)) {
+        free_vartype((vartype *) x);
+        return ERR_INSUFFICIENT_MEMORY;
+    }
+    x->x = sigma_helper_2(r->array->data + first, xp, yp, 2, rows, weight);
+    free_vartype(lastx);
+    lastx = stack[sp];
+    stack[sp] = (vartype *) x;
+    mode_disable_stack_lift = true;
+    return ERR_NONE;
 }
 
 int docmd_sigmaadd(arg_struct *arg) {
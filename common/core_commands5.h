@@ -21,6 +21,9 @@
 #include "free42.h"
 #include "core_globals.h"
 
+bool persist_stats();
+bool unpersist_stats(int ver);
+
 int docmd_linf(arg_struct *arg);
 int docmd_logf(arg_struct *arg);
 int docmd_expf(arg_struct *arg);
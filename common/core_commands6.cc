@@ -619,7 +619,7 @@ int docmd_sqrt(arg_struct *arg) {
         return ERR_NONE;
     } else {
         vartype *v;
-        int err = map_unary(stack[sp], &v, mappable_sqrt_r, math_sqrt);
+        int err = map_unary_vec(stack[sp], &v, mappable_sqrt_r, math_sqrt, VEC_SQRT);
         if (err != ERR_NONE)
             return err;
         unary_result(v);
@@ -668,7 +668,7 @@ int docmd_square(arg_struct *arg) {
     if (x->type == TYPE_UNIT)
         err = unit_mul(x, x, &v);
     else
-        err = map_unary(x, &v, mappable_square_r, mappable_square_c);
+        err = map_unary_vec(x, &v, mappable_square_r, mappable_square_c, VEC_SQUARE);
     if (err == ERR_NONE)
         unary_result(v);
     return err;
@@ -698,7 +698,7 @@ int docmd_inv(arg_struct *arg) {
         err = unit_div(x, one, &v);
         free_vartype(one);
     } else
-        err = map_unary(stack[sp], &v, mappable_inv_r, math_inv);
+        err = map_unary_vec(stack[sp], &v, mappable_inv_r, math_inv, VEC_INV);
     if (err == ERR_NONE)
         unary_result(v);
     return err;
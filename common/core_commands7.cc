@@ -25,6 +25,7 @@
 #include "core_display.h"
 #include "core_globals.h"
 #include "core_helpers.h"
+#include "core_linalg2.h"
 #include "core_main.h"
 #include "core_sto_rcl.h"
 #include "shell.h"
@@ -1206,10 +1207,7 @@ int docmd_putmi(arg_struct *arg) {
     if (v->type == TYPE_REALMATRIX) {
         vartype_realmatrix *rm = (vartype_realmatrix *) v;
         if (stack[sp]->type == TYPE_REAL) {
-            if (rm->array->is_string[n] == 2)
-                free(*(void **) &rm->array->data[n]);
-            rm->array->is_string[n] = 0;
-            rm->array->data[n] = ((vartype_real *) stack[sp])->x;
+            put_matrix_phloat(rm, n, ((vartype_real *) stack[sp])->x);
         } else if (stack[sp]->type == TYPE_STRING) {
             vartype_string *s = (vartype_string *) stack[sp];
             if (!put_matrix_string(rm, n, s->txt(), s->length))
@@ -1279,22 +1277,18 @@ int docmd_putli(arg_struct *arg) {
         free_vartype(list->array->data[item]);
         list->array->data[item] = v;
     } else {
-        vartype **new_data = (vartype **) realloc(list->array->data, (item + 1) * sizeof(vartype *));
-        if (new_data == NULL)
+        if (!list_reserve(list, item + 1))
             goto fail;
+        vartype **data = list->array->data;
         for (int i = list->size; i < item; i++) {
-            new_data[i] = new_real(0);
-            if (new_data[i] == NULL) {
+            data[i] = new_real(0);
+            if (data[i] == NULL) {
                 while (--i >= list->size)
-                    free_vartype(new_data[i]);
-                new_data = (vartype **) realloc(new_data, list->size * sizeof(vartype *));
-                if (new_data != NULL || list->size == 0)
-                    list->array->data = new_data;
+                    free_vartype(data[i]);
                 goto fail;
             }
         }
-        new_data[item] = v;
-        list->array->data = new_data;
+        data[item] = v;
         list->size = item + 1;
     }
 
@@ -1782,11 +1776,41 @@ static int concat(bool extend) {
             len = reg_alpha_length;
         }
         vartype_string *s = (vartype_string *) stack[sp - 1];
-        vartype *v = new_string(NULL, s->length + len);
+        int4 oldlen = s->length;
+        int4 newlen = oldlen + len;
+        if (oldlen > SSLENV) {
+            // Y is a long string; extend it in place, using the spare room
+            // new_string() leaves at the end, or growing it if necessary.
+            // Nothing is lost if this fails: the text beyond the old length
+            // is simply ignored.
+            bool ok = true;
+            if (newlen > string_capacity(oldlen)) {
+                char *p = (char *) realloc(s->t.ptr, string_capacity(newlen));
+                if (p == NULL)
+                    ok = false;
+                else
+                    s->t.ptr = p;
+            }
+            if (ok) {
+                memcpy(s->t.ptr + oldlen, text, len);
+                s->length = newlen;
+            }
+            if (text == reg_alpha) {
+                memcpy(reg_alpha, buf, templen);
+                reg_alpha_length = templen;
+            }
+            if (!ok)
+                return ERR_INSUFFICIENT_MEMORY;
+            int err = binary_result_in_place();
+            if (err != ERR_NONE)
+                s->length = oldlen;
+            return err;
+        }
+        vartype *v = new_string(NULL, newlen);
         if (v != NULL) {
             vartype_string *s2 = (vartype_string *) v;
-            memcpy(s2->txt(), s->txt(), s->length);
-            memcpy(s2->txt() + s->length, text, len);
+            memcpy(s2->txt(), s->txt(), oldlen);
+            memcpy(s2->txt() + oldlen, text, len);
         }
         if (text == reg_alpha) {
             memcpy(reg_alpha, buf, templen);
@@ -1810,26 +1834,20 @@ static int concat(bool extend) {
                 goto nomem;
             vartype_list *list2 = (vartype_list *) v;
             if (list2->size > 0) {
-                vartype **new_data = (vartype **) realloc(list->array->data, (list->size + list2->size) * sizeof(vartype *));
-                if (new_data == NULL)
+                if (!list_reserve(list, list->size + list2->size))
                     goto nomem;
-                list->array->data = new_data;
-                // Call binary_result() before doing the actual data transfer.
-                // The reason is that binary_result() can fail, because of the
-                // T duplication, and we don't want to have to roll back all this.
-                stack[sp - 1] = NULL;
-                int err = binary_result((vartype *) list);
+                // binary_result_in_place() can fail, because of the T
+                // duplication, but rolling back is easy: list2 still owns its
+                // elements until we free it below. If it does fail, we simply
+                // hang on to the extra capacity.
+                int4 oldsize = list->size;
+                memcpy(list->array->data + list->size, list2->array->data, list2->size * sizeof(vartype *));
+                list->size += list2->size;
+                int err = binary_result_in_place();
                 if (err != ERR_NONE) {
-                    // Try to shrink the data array back down. No worries if this
-                    // fails, we just hold on to the resized one in that case.
-                    new_data = (vartype **) realloc(list->array->data, list->size * sizeof(vartype *));
-                    if (new_data != NULL || list->size == 0)
-                        list->array->data = new_data;
-                    stack[sp - 1] = (vartype *) list;
+                    list->size = oldsize;
                     goto nomem;
                 }
-                memcpy(list->array->data + list->size, list2->array->data, list2->size * sizeof(vartype *));
-                list->size += list2->size;
                 // At this point we're done with list2. Since it's a disentangled
                 // copy, the refcount is 1 and it is going to be completely deleted.
                 // We're doing it manually rather than through free_vartype(), so
@@ -1839,34 +1857,21 @@ static int concat(bool extend) {
                 free(list2);
             } else {
                 // Joining an empty list to the list in Y. This is not quite a
-                // no-op, since the binary_result() causes T duplication, which
-                // can fail.
-                stack[sp - 1] = NULL;
-                int err = binary_result((vartype *) list);
-                if (err != ERR_NONE) {
-                    stack[sp - 1] = (vartype *) list;
+                // no-op, since the binary_result_in_place() causes T
+                // duplication, which can fail.
+                int err = binary_result_in_place();
+                if (err != ERR_NONE)
                     goto nomem;
-                }
                 free_vartype(v);
             }
             return ERR_NONE;
         }
-        vartype **new_data = (vartype **) realloc(list->array->data, (list->size + 1) * sizeof(vartype *));
-        if (new_data == NULL)
+        if (!list_reserve(list, list->size + 1))
             goto nomem;
-        list->array->data = new_data;
         list->array->data[list->size++] = v;
-        // Call binary_result() before doing the actual data transfer.
-        // The reason is that binary_result() can fail, because of the
-        // T duplication, and we don't want to have to roll back all this.
-        stack[sp - 1] = NULL;
-        int err = binary_result((vartype *) list);
+        int err = binary_result_in_place();
         if (err != ERR_NONE) {
-            // Unlike the 'extend' case, we don't try to shrink the data array
-            // back down here. We're only wasting the space of one pointer,
-            // so, *shrug*.
             list->array->data[--list->size] = NULL;
-            stack[sp - 1] = (vartype *) list;
             goto nomem;
         }
         // Not freeing v because it is now owned by the target list.
@@ -1951,18 +1956,11 @@ int docmd_substr(arg_struct *arg) {
         if (v == NULL)
             return ERR_INSUFFICIENT_MEMORY;
     } else {
-        vartype_list *list = (vartype_list *) s;
-        vartype_list *r = (vartype_list *) new_list(newlen);
-        if (r == NULL)
+        // The sublist is a slice of the original list's array, so this takes
+        // constant time; see list_slice().
+        v = list_slice((vartype_list *) s, begin, newlen);
+        if (v == NULL)
             return ERR_INSUFFICIENT_MEMORY;
-        for (int i = 0; i < newlen; i++) {
-            r->array->data[i] = dup_vartype(list->array->data[begin + i]);
-            if (r->array->data[i] == NULL) {
-                free_vartype((vartype *) r);
-                return ERR_INSUFFICIENT_MEMORY;
-            }
-        }
-        v = (vartype *) r;
     }
     if (e == NULL)
         return binary_result(v);
@@ -2062,10 +2060,9 @@ int docmd_head(arg_struct *arg) {
                 vartype_list *list = (vartype_list *) s;
                 if (list->size == 0)
                     return ERR_NO;
-                if (!disentangle(s))
+                v = list_take_first(list);
+                if (v == NULL)
                     return ERR_INSUFFICIENT_MEMORY;
-                v = list->array->data[0];
-                memmove(list->array->data, list->array->data + 1, --list->size * sizeof(vartype *));
                 err = recall_result(v);
                 return err == ERR_NONE ? ERR_YES : err;
             } else {
@@ -2158,11 +2155,14 @@ int docmd_pos(arg_struct *arg) {
         if (startpos == -2)
             return ERR_INVALID_DATA;
         vartype_list *list = (vartype_list *) stack[list_sp];
-        pos = -1;
-        for (int4 i = startpos; i < list->size; i++) {
-            if (vartype_equals(list->array->data[i], stack[sp])) {
-                pos = i;
-                break;
+        pos = indexed_find((vartype *) list, stack[sp], startpos);
+        if (pos == -2) {
+            pos = -1;
+            for (int4 i = startpos; i < list->size; i++) {
+                if (vartype_equals(list->array->data[i], stack[sp])) {
+                    pos = i;
+                    break;
+                }
             }
         }
     } else {
@@ -2353,3 +2353,506 @@ int docmd_from_list(arg_struct *arg) {
     print_trace();
     return ERR_NONE;
 }
+
+int docmd_sparse(arg_struct *arg) {
+    vartype *v;
+    int err = sparse_from_dense((vartype_realmatrix *) stack[sp], &v);
+    if (err != ERR_NONE)
+        return err;
+    unary_result(v);
+    return ERR_NONE;
+}
+
+int docmd_dense(arg_struct *arg) {
+    if (stack[sp]->type != TYPE_SPARSEMATRIX)
+        return stack[sp]->type == TYPE_STRING ? ERR_ALPHA_DATA_IS_INVALID
+                                              : ERR_INVALID_TYPE;
+    vartype *v;
+    int err = sparse_to_dense((vartype_sparsematrix *) stack[sp], &v);
+    if (err != ERR_NONE)
+        return err;
+    unary_result(v);
+    return ERR_NONE;
+}
+
+int docmd_spmat(arg_struct *arg) {
+    /* Z: rows, Y: columns, X: n x 3 matrix of [ row column value ] */
+    if (stack[sp]->type != TYPE_REALMATRIX)
+        return stack[sp]->type == TYPE_STRING ? ERR_ALPHA_DATA_IS_INVALID
+                                              : ERR_INVALID_TYPE;
+    for (int i = 1; i <= 2; i++)
+        if (stack[sp - i]->type != TYPE_REAL)
+            return stack[sp - i]->type == TYPE_STRING ? ERR_ALPHA_DATA_IS_INVALID
+                                                      : ERR_INVALID_TYPE;
+    int4 rows, columns;
+    if (!dim_to_int4(stack[sp - 2], &rows) || !dim_to_int4(stack[sp - 1], &columns))
+        return ERR_DIMENSION_ERROR;
+    vartype *v;
+    int err = sparse_from_triples(rows + 1, columns + 1,
+                                  (vartype_realmatrix *) stack[sp], &v);
+    if (err != ERR_NONE)
+        return err;
+    return ternary_result(v);
+}
+
+static int eig_completion(int error, vartype *values, vartype *vectors) {
+    if (error != ERR_NONE)
+        return error;
+    /* Y: eigenvectors, as columns; X: eigenvalues, as a column vector */
+    return unary_two_results(values, vectors);
+}
+
+int docmd_eig(arg_struct *arg) {
+    return linalg_eig(stack[sp], eig_completion);
+}
+
+static int svd_completion(int error, vartype *s, vartype *u, vartype *vt) {
+    if (error != ERR_NONE)
+        return error;
+    /* Z: U, Y: V transposed, X: singular values, as a column vector */
+    return unary_three_results(s, vt, u);
+}
+
+int docmd_svd(arg_struct *arg) {
+    return linalg_svd(stack[sp], svd_completion);
+}
+
+/////////////////////////
+///// SORT commands /////
+/////////////////////////
+
+/* SORT, SORTK, and SORTI all work by sorting an array of element or row
+ * indexes, using a stable merge sort. The elements are not moved until the
+ * order is known, so a failing comparison or allocation leaves the stack
+ * untouched.
+ * Keys are 1-based column numbers, negative for descending order; lists
+ * have only one column. Numbers sort before strings; numbers with units are
+ * compared using generic_comparison(), and strings are compared by
+ * character code.
+ */
+
+#define SORT_RUN 16
+#define SORT_PARALLEL_MIN 8192
+
+struct sort_struct {
+    const vartype *v;
+    const int4 *keys;
+    int4 nkeys;
+    int4 *idx;
+    int4 *tmp;
+    int4 *bounds;
+};
+
+static int sort_compare_strings(const char *a, int4 alen, const char *b, int4 blen) {
+    int c = memcmp(a, b, alen < blen ? alen : blen);
+    if (c != 0)
+        return c;
+    return alen < blen ? -1 : alen > blen ? 1 : 0;
+}
+
+static int sort_compare_values(const vartype *a, const vartype *b) {
+    bool astr = a->type == TYPE_STRING;
+    bool bstr = b->type == TYPE_STRING;
+    if (astr != bstr)
+        return astr ? 1 : -1;
+    if (astr) {
+        const vartype_string *sa = (const vartype_string *) a;
+        const vartype_string *sb = (const vartype_string *) b;
+        return sort_compare_strings(sa->txt(), sa->length, sb->txt(), sb->length);
+    }
+    if (a->type == TYPE_REAL && b->type == TYPE_REAL) {
+        phloat x = ((const vartype_real *) a)->x;
+        phloat y = ((const vartype_real *) b)->x;
+        return x < y ? -1 : x > y ? 1 : 0;
+    }
+    /* The units were checked for compatibility before sorting started */
+    if (generic_comparison(a, b, 'L') == ERR_YES)
+        return -1;
+    if (generic_comparison(a, b, 'G') == ERR_YES)
+        return 1;
+    return 0;
+}
+
+static int sort_compare(const sort_struct *s, int4 a, int4 b) {
+    if (s->v->type == TYPE_LIST) {
+        vartype **data = ((const vartype_list *) s->v)->array->data;
+        int c = sort_compare_values(data[a], data[b]);
+        return s->keys[0] < 0 ? -c : c;
+    }
+    const vartype_realmatrix *rm = (const vartype_realmatrix *) s->v;
+    const phloat *data = rm->array->data;
+    const char *is_string = rm->array->is_string;
+    for (int k = 0; k < s->nkeys; k++) {
+        int4 key = s->keys[k];
+        int4 col = key < 0 ? -key - 1 : key - 1;
+        int4 i = a * rm->columns + col;
+        int4 j = b * rm->columns + col;
+        int c;
+        if (is_string[i] != is_string[j] && (is_string[i] == 0 || is_string[j] == 0)) {
+            c = is_string[i] == 0 ? -1 : 1;
+        } else if (is_string[i] == 0) {
+            c = data[i] < data[j] ? -1 : data[i] > data[j] ? 1 : 0;
+        } else {
+            const char *ti, *tj;
+            int4 li, lj;
+            get_matrix_string(rm, i, &ti, &li);
+            get_matrix_string(rm, j, &tj, &lj);
+            c = sort_compare_strings(ti, li, tj, lj);
+        }
+        if (c != 0)
+            return key < 0 ? -c : c;
+    }
+    return 0;
+}
+
+static void sort_merge(const sort_struct *s, const int4 *src, int4 *dst,
+                       int4 lo, int4 mid, int4 hi) {
+    int4 i = lo, j = mid, k = lo;
+    if (mid < hi && sort_compare(s, src[mid], src[mid - 1]) >= 0) {
+        /* Already in order */
+        memcpy(dst + lo, src + lo, (hi - lo) * sizeof(int4));
+        return;
+    }
+    while (i < mid && j < hi)
+        dst[k++] = sort_compare(s, src[j], src[i]) < 0 ? src[j++] : src[i++];
+    while (i < mid)
+        dst[k++] = src[i++];
+    while (j < hi)
+        dst[k++] = src[j++];
+}
+
+/* Sort idx[from..to), using tmp[from..to) as scratch space */
+static void sort_range(const sort_struct *s, int4 from, int4 to) {
+    int4 *a = s->idx;
+    for (int4 lo = from; lo < to; lo += SORT_RUN) {
+        int4 hi = lo + SORT_RUN < to ? lo + SORT_RUN : to;
+        for (int4 i = lo + 1; i < hi; i++) {
+            int4 t = a[i];
+            int4 j = i;
+            while (j > lo && sort_compare(s, t, a[j - 1]) < 0) {
+                a[j] = a[j - 1];
+                j--;
+            }
+            a[j] = t;
+        }
+    }
+    int4 *src = s->idx;
+    int4 *dst = s->tmp;
+    for (int4 width = SORT_RUN; width < to - from; width *= 2) {
+        for (int4 lo = from; lo < to; lo += 2 * width) {
+            int4 mid = lo + width < to ? lo + width : to;
+            int4 hi = mid + width < to ? mid + width : to;
+            sort_merge(s, src, dst, lo, mid, hi);
+        }
+        int4 *t = src;
+        src = dst;
+        dst = t;
+    }
+    if (src != s->idx)
+        memcpy(s->idx + from, src + from, (to - from) * sizeof(int4));
+}
+
+static int sort_chunks(void *ctx, int4 from, int4 to) {
+    sort_struct *s = (sort_struct *) ctx;
+    for (int4 c = from; c < to; c++)
+        sort_range(s, s->bounds[c], s->bounds[c + 1]);
+    return ERR_NONE;
+}
+
+static int sort_merge_pairs(void *ctx, int4 from, int4 to) {
+    /* Merges runs 2*p and 2*p+1 from idx into tmp */
+    sort_struct *s = (sort_struct *) ctx;
+    for (int4 p = from; p < to; p++)
+        sort_merge(s, s->idx, s->tmp, s->bounds[2 * p],
+                   s->bounds[2 * p + 1], s->bounds[2 * p + 2]);
+    return ERR_NONE;
+}
+
+/* Large arrays are cut into one chunk per thread; the chunks are sorted in
+ * parallel, and then merged pairwise, each round of merges also in parallel.
+ * Since each merge is stable, the result is the same as the serial sort's.
+ */
+static void sort_parallel(sort_struct *s, int4 n) {
+    int4 bounds[2 * 8 + 1];
+    int4 nruns = linalg_threads();
+    if (nruns > 8)
+        nruns = 8;
+    for (int4 i = 0; i <= nruns; i++)
+        bounds[i] = (int4) ((int8) n * i / nruns);
+    s->bounds = bounds;
+    linalg_parallel(nruns, 1, sort_chunks, s);
+    while (nruns > 1) {
+        int4 pairs = nruns / 2;
+        linalg_parallel(pairs, 1, sort_merge_pairs, s);
+        if (nruns % 2 != 0) {
+            int4 lo = bounds[nruns - 1];
+            memcpy(s->tmp + lo, s->idx + lo, (n - lo) * sizeof(int4));
+        }
+        for (int4 i = 1; i <= pairs; i++)
+            bounds[i] = bounds[2 * i];
+        if (nruns % 2 != 0)
+            bounds[++pairs] = n;
+        nruns = pairs;
+        int4 *t = s->idx;
+        s->idx = s->tmp;
+        s->tmp = t;
+    }
+}
+
+/* Returns the sorted index array in *res, which the caller must free().
+ * For lists, keys must be 1 or -1; for matrices, the caller must have
+ * checked that they are within range.
+ */
+static int sort_indexes(const vartype *v, const int4 *keys, int4 nkeys, int4 **res) {
+    int4 n;
+    bool units = false;
+    if (v->type == TYPE_LIST) {
+        const vartype_list *list = (const vartype_list *) v;
+        n = list->size;
+        const vartype *num = NULL;
+        for (int4 i = 0; i < n; i++) {
+            const vartype *e = list->array->data[i];
+            if (e->type == TYPE_STRING)
+                continue;
+            if (e->type != TYPE_REAL && e->type != TYPE_UNIT)
+                return ERR_INVALID_TYPE;
+            if (e->type == TYPE_UNIT)
+                units = true;
+            if (num == NULL)
+                num = e;
+        }
+        if (units) {
+            /* Make sure all the numbers are mutually comparable, so the
+             * comparisons done while sorting can't fail.
+             */
+            for (int4 i = 0; i < n; i++) {
+                const vartype *e = list->array->data[i];
+                if (e->type == TYPE_STRING)
+                    continue;
+                int err = generic_comparison(num, e, 'E');
+                if (err != ERR_YES && err != ERR_NO)
+                    return err;
+            }
+        }
+    } else {
+        n = ((const vartype_realmatrix *) v)->rows;
+    }
+    int4 *idx = (int4 *) malloc((n == 0 ? 1 : n) * sizeof(int4));
+    if (idx == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    int4 *tmp = (int4 *) malloc((n == 0 ? 1 : n) * sizeof(int4));
+    if (tmp == NULL) {
+        free(idx);
+        return ERR_INSUFFICIENT_MEMORY;
+    }
+    for (int4 i = 0; i < n; i++)
+        idx[i] = i;
+    sort_struct s;
+    s.v = v;
+    s.keys = keys;
+    s.nkeys = nkeys;
+    s.idx = idx;
+    s.tmp = tmp;
+    /* Comparing numbers with units involves unit conversions, which
+     * temporarily change the flags, so those lists are always sorted on this
+     * thread.
+     */
+    if (n >= SORT_PARALLEL_MIN && !units && linalg_threads() > 1)
+        sort_parallel(&s, n);
+    else
+        sort_range(&s, 0, n);
+    free(s.tmp);
+    *res = s.idx;
+    return ERR_NONE;
+}
+
+/* Parses the sort key(s) in X: a column number, or a list of them */
+static int sort_keys(const vartype *spec, const vartype *v, int4 **keys, int4 *nkeys) {
+    int4 columns = v->type == TYPE_LIST ? 1 : ((const vartype_realmatrix *) v)->columns;
+    int4 n;
+    vartype **data;
+    if (spec->type == TYPE_REAL) {
+        n = 1;
+        data = (vartype **) &spec;
+    } else if (spec->type == TYPE_LIST) {
+        n = ((const vartype_list *) spec)->size;
+        data = ((const vartype_list *) spec)->array->data;
+        if (n == 0)
+            return ERR_INVALID_DATA;
+    } else if (spec->type == TYPE_STRING)
+        return ERR_ALPHA_DATA_IS_INVALID;
+    else
+        return ERR_INVALID_TYPE;
+    int4 *k = (int4 *) malloc(n * sizeof(int4));
+    if (k == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    for (int4 i = 0; i < n; i++) {
+        if (data[i]->type != TYPE_REAL) {
+            free(k);
+            return ERR_INVALID_TYPE;
+        }
+        phloat d = ((vartype_real *) data[i])->x;
+        if (d <= -2147483648.0 || d >= 2147483648.0) {
+            free(k);
+            return ERR_DIMENSION_ERROR;
+        }
+        k[i] = to_int4(d);
+        if (k[i] == 0 || k[i] > columns || k[i] < -columns) {
+            free(k);
+            return ERR_DIMENSION_ERROR;
+        }
+    }
+    *keys = k;
+    *nkeys = n;
+    return ERR_NONE;
+}
+
+static int sort_helper(const vartype *v, const int4 *keys, int4 nkeys,
+                       bool perm, vartype **res) {
+    int4 *idx = NULL;
+    int err = sort_indexes(v, keys, nkeys, &idx);
+    if (err != ERR_NONE)
+        return err;
+    vartype *r;
+    if (v->type == TYPE_LIST) {
+        const vartype_list *src = (const vartype_list *) v;
+        int4 n = src->size;
+        r = new_list(n);
+        if (r == NULL)
+            goto nomem;
+        vartype **d = ((vartype_list *) r)->array->data;
+        for (int4 i = 0; i < n; i++) {
+            d[i] = perm ? new_real(idx[i] + 1) : dup_vartype(src->array->data[idx[i]]);
+            if (d[i] == NULL) {
+                free_vartype(r);
+                goto nomem;
+            }
+        }
+    } else {
+        const vartype_realmatrix *src = (const vartype_realmatrix *) v;
+        int4 n = src->rows;
+        if (perm) {
+            r = new_realmatrix(n, 1);
+            if (r == NULL)
+                goto nomem;
+            phloat *d = ((vartype_realmatrix *) r)->array->data;
+            for (int4 i = 0; i < n; i++)
+                d[i] = idx[i] + 1;
+        } else {
+            int4 columns = src->columns;
+            r = new_realmatrix(n, columns);
+            if (r == NULL)
+                goto nomem;
+            realmatrix_data *s = src->array;
+            realmatrix_data *d = ((vartype_realmatrix *) r)->array;
+            for (int4 i = 0; i < n; i++) {
+                int4 si = idx[i] * columns;
+                int4 di = i * columns;
+                if (s->strings == 0) {
+                    memcpy((void *) (d->data + di), s->data + si, columns * sizeof(phloat));
+                    continue;
+                }
+                for (int4 j = 0; j < columns; j++) {
+                    if (s->is_string[si + j] == 2) {
+                        int4 *sp = *(int4 **) &s->data[si + j];
+                        int4 len = *sp + 4;
+                        int4 *dp = (int4 *) malloc(len);
+                        if (dp == NULL) {
+                            free_vartype(r);
+                            goto nomem;
+                        }
+                        memcpy(dp, sp, len);
+                        *(int4 **) &d->data[di + j] = dp;
+                    } else {
+                        d->data[di + j] = s->data[si + j];
+                    }
+                    d->is_string[di + j] = s->is_string[si + j];
+                }
+            }
+            d->strings = s->strings;
+        }
+    }
+    free(idx);
+    *res = r;
+    return ERR_NONE;
+    nomem:
+    free(idx);
+    return ERR_INSUFFICIENT_MEMORY;
+}
+
+int docmd_sort(arg_struct *arg) {
+    // SORT: sort the list in X, or the rows of the matrix in X by their
+    // first column, in ascending order
+    int4 key = 1;
+    vartype *v;
+    int err = sort_helper(stack[sp], &key, 1, false, &v);
+    if (err != ERR_NONE)
+        return err;
+    unary_result(v);
+    return ERR_NONE;
+}
+
+static int sortk_helper(bool perm) {
+    // Y: the list or matrix to sort; X: the key column, or a list of key
+    // columns, most significant first; negative columns sort descending
+    vartype *y = stack[sp - 1];
+    if (y->type == TYPE_STRING)
+        return ERR_ALPHA_DATA_IS_INVALID;
+    if (y->type != TYPE_LIST && y->type != TYPE_REALMATRIX)
+        return ERR_INVALID_TYPE;
+    int4 *keys, nkeys;
+    int err = sort_keys(stack[sp], y, &keys, &nkeys);
+    if (err != ERR_NONE)
+        return err;
+    vartype *v;
+    err = sort_helper(y, keys, nkeys, perm, &v);
+    free(keys);
+    if (err != ERR_NONE)
+        return err;
+    return binary_result(v);
+}
+
+int docmd_sortk(arg_struct *arg) {
+    return sortk_helper(false);
+}
+
+int docmd_sorti(arg_struct *arg) {
+    // SORTI: like SORTK, but returns the 1-based indexes of the elements or
+    // rows of Y in sorted order, instead of the sorted list or matrix
+    return sortk_helper(true);
+}
+
+//////////////////////////////
+///// Fourier transforms /////
+//////////////////////////////
+
+int docmd_fft(arg_struct *arg) {
+    // FFT: discrete Fourier transform of the vector in X; for a matrix
+    // that isn't a vector, the 2-D transform
+    vartype *v;
+    int err = linalg_fft(stack[sp], false, &v);
+    if (err != ERR_NONE)
+        return err;
+    unary_result(v);
+    return ERR_NONE;
+}
+
+int docmd_ifft(arg_struct *arg) {
+    // IFFT: inverse of FFT, including the division by the number of
+    // elements
+    vartype *v;
+    int err = linalg_fft(stack[sp], true, &v);
+    if (err != ERR_NONE)
+        return err;
+    unary_result(v);
+    return ERR_NONE;
+}
+
+int docmd_conv(arg_struct *arg) {
+    // CONV: linear convolution of the vectors in Y and X
+    vartype *v;
+    int err = linalg_conv(stack[sp - 1], stack[sp], &v);
+    if (err != ERR_NONE)
+        return err;
+    return binary_result(v);
+}
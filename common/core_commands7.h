@@ -131,5 +131,16 @@ int docmd_list_t(arg_struct *arg);
 int docmd_newlist(arg_struct *arg);
 int docmd_to_list(arg_struct *arg);
 int docmd_from_list(arg_struct *arg);
+int docmd_sparse(arg_struct *arg);
+int docmd_dense(arg_struct *arg);
+int docmd_spmat(arg_struct *arg);
+int docmd_eig(arg_struct *arg);
+int docmd_svd(arg_struct *arg);
+int docmd_sort(arg_struct *arg);
+int docmd_sortk(arg_struct *arg);
+int docmd_sorti(arg_struct *arg);
+int docmd_fft(arg_struct *arg);
+int docmd_ifft(arg_struct *arg);
+int docmd_conv(arg_struct *arg);
 
 #endif
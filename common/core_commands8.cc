@@ -137,6 +137,44 @@ int docmd_numeric(arg_struct *arg) {
     return ERR_NONE;
 }
 
+int docmd_scache(arg_struct *arg) {
+    phloat x = ((vartype_real *) stack[sp])->x;
+    if (x < 0 || x > 100 || x != floor(x))
+        return ERR_INVALID_DATA;
+    return set_root_cache_size(to_int(x));
+}
+
+int docmd_neval_t(arg_struct *arg) {
+    vartype *v = new_real(get_solve_evals());
+    if (v == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    return recall_result(v);
+}
+
+int docmd_table(arg_struct *arg) {
+    return start_table(stack[sp - 2], stack[sp - 1], stack[sp]);
+}
+
+int docmd_integn(arg_struct *arg) {
+    return start_cubature(stack[sp - 2], stack[sp - 1], stack[sp]);
+}
+
+int docmd_roots(arg_struct *arg) {
+    return start_root_scan(stack[sp - 2], stack[sp - 1], stack[sp]);
+}
+
+int docmd_map(arg_struct *arg) {
+    return start_map(MAP_MAP, stack[sp - 1], stack[sp]);
+}
+
+int docmd_filter(arg_struct *arg) {
+    return start_map(MAP_FILTER, stack[sp - 1], stack[sp]);
+}
+
+int docmd_reduce(arg_struct *arg) {
+    return start_map(MAP_REDUCE, stack[sp - 1], stack[sp]);
+}
+
 int docmd_gtol(arg_struct *arg) {
     int running = program_running();
     if (!running)
@@ -322,10 +360,7 @@ static int item_helper(arg_struct *arg, bool get) {
                     return ERR_INSUFFICIENT_MEMORY;
             } else {
                 if (stack[sp]->type == TYPE_REAL) {
-                    if (rm->array->is_string[n] == 2)
-                        free(*(void **) &rm->array->data[n]);
-                    rm->array->data[n] = ((vartype_real *) stack[sp])->x;
-                    rm->array->is_string[n] = 0;
+                    put_matrix_phloat(rm, n, ((vartype_real *) stack[sp])->x);
                 } else {
                     vartype_string *vs;
                     vs = (vartype_string *) stack[sp];
@@ -367,21 +402,17 @@ static int item_helper(arg_struct *arg, bool get) {
                 if (v2 == NULL)
                     goto put_fail;
                 if (n >= list->size) {
-                    vartype **new_data = (vartype **) realloc(list->array->data, (n + 1) * sizeof(vartype *));
-                    if (new_data == NULL)
+                    if (!list_reserve(list, n + 1))
                         goto put_fail;
+                    vartype **data = list->array->data;
                     for (int i = list->size; i < n; i++) {
-                        new_data[i] = new_real(0);
-                        if (new_data[i] == NULL) {
+                        data[i] = new_real(0);
+                        if (data[i] == NULL) {
                             while (--i >= list->size)
-                                free_vartype(new_data[i]);
-                            new_data = (vartype **) realloc(new_data, list->size * sizeof(vartype *));
-                            if (new_data != NULL || list->size == 0)
-                                list->array->data = new_data;
+                                free_vartype(data[i]);
                             goto put_fail;
                         }
                     }
-                    list->array->data = new_data;
                     list->size = n + 1;
                 } else {
                     free_vartype(list->array->data[n]);
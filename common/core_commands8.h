@@ -33,6 +33,14 @@ int docmd_std(arg_struct *arg);
 int docmd_comp(arg_struct *arg);
 int docmd_direct(arg_struct *arg);
 int docmd_numeric(arg_struct *arg);
+int docmd_scache(arg_struct *arg);
+int docmd_neval_t(arg_struct *arg);
+int docmd_table(arg_struct *arg);
+int docmd_integn(arg_struct *arg);
+int docmd_roots(arg_struct *arg);
+int docmd_map(arg_struct *arg);
+int docmd_filter(arg_struct *arg);
+int docmd_reduce(arg_struct *arg);
 int docmd_gtol(arg_struct *arg);
 int docmd_xeql(arg_struct *arg);
 int docmd_gsto(arg_struct *arg);
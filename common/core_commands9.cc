@@ -873,6 +873,15 @@ static int prall_worker(bool interrupted) {
                 string2buf(buf, 100, &p, "Ref", 3);
                 break;
             }
+            case TYPE_SPARSEMATRIX: {
+                string2buf(buf, 100, &p, "Sparse(", 7);
+                vartype_sparsematrix *sm = (vartype_sparsematrix *) var->value;
+                p += int2string(sm->rows, buf + p, 100 - p);
+                char2buf(buf, 100, &p, '\1');
+                p += int2string(sm->columns, buf + p, 100 - p);
+                char2buf(buf, 100, &p, ')');
+                break;
+            }
         }
     } else {
         if (prall_dir->parent == NULL) {
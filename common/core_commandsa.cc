@@ -120,10 +120,8 @@ struct PlotData {
         if (sz > PLOT_SIZE)
             sz = PLOT_SIZE;
         if (ppar->size < PLOT_SIZE) {
-            vartype **new_data = (vartype **) realloc(ppar->array->data, PLOT_SIZE * sizeof(vartype *));
-            if (new_data == NULL)
+            if (!list_reserve(ppar, PLOT_SIZE))
                 return;
-            ppar->array->data = new_data;
             while (ppar->size < PLOT_SIZE) {
                 ppar->array->data[ppar->size] = new_real(0);
                 if (ppar->array->data[ppar->size] == NULL)
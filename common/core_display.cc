@@ -2738,8 +2738,8 @@ static int ext_prgm_cat[] = {
 static int ext_str_cat[] = {
     CMD_APPEND,    CMD_C_TO_N, CMD_EXTEND, CMD_HEAD,    CMD_LENGTH, CMD_TO_LIST,
     CMD_FROM_LIST, CMD_LIST_T, CMD_LXASTO, CMD_NEWLIST, CMD_N_TO_C, CMD_N_TO_S,
-    CMD_NN_TO_S,   CMD_POS,    CMD_REV,    CMD_SUBSTR,  CMD_S_TO_N, CMD_XASTO,
-    CMD_XSTR,      CMD_XVIEW,  CMD_NULL,   CMD_NULL,    CMD_NULL,   CMD_NULL
+    CMD_NN_TO_S,   CMD_POS,    CMD_REV,    CMD_SORT,    CMD_SORTI,  CMD_SORTK,
+    CMD_SUBSTR,    CMD_S_TO_N, CMD_XASTO,  CMD_XSTR,    CMD_XVIEW,  CMD_NULL
 };
 
 static int ext_stk_cat[] = {
@@ -2750,8 +2750,9 @@ static int ext_stk_cat[] = {
 
 static int ext_eqn_cat[] = {
     CMD_COMP,    CMD_DIRECT, CMD_EDITEQN, CMD_EQN_T,   CMD_EQNINT, CMD_EQNMENU,
-    CMD_EQNMNU1, CMD_EQNSLV, CMD_EQNVAR,  CMD_EVAL,    CMD_EVALN,  CMD_NEWEQN,
-    CMD_NUMERIC, CMD_PARSE,  CMD_STD,     CMD_UNPARSE, CMD_NULL,   CMD_NULL
+    CMD_EQNMNU1, CMD_EQNSLV, CMD_EQNVAR,  CMD_EVAL,    CMD_EVALN,  CMD_FILTER,
+    CMD_INTEGN,  CMD_MAP,    CMD_NEVAL_T, CMD_NEWEQN,  CMD_NUMERIC, CMD_PARSE,
+    CMD_REDUCE,  CMD_ROOTS,  CMD_SCACHE,  CMD_STD,     CMD_TABLE,  CMD_UNPARSE
 };
 
 static int ext_unit_cat[] = {
@@ -2784,9 +2785,10 @@ static int ext_misc_cat[] = {
     CMD_MIXED,   CMD_PCOMPLX, CMD_PLOT_M,   CMD_PRREG,       CMD_PUTLI,  CMD_PUTMI,
     CMD_RCOMPLX, CMD_SPFV,    CMD_SPPV,     CMD_STATIC,      CMD_STRACE, CMD_TVM,
     CMD_UNLOCK,  CMD_USFV,    CMD_USPV,     CMD_X2LINE,      CMD_ACCEL,  CMD_LOCAT,
-    CMD_HEADING, CMD_FPTEST,  CMD_NULL,     CMD_NULL,        CMD_NULL,   CMD_NULL
+    CMD_HEADING, CMD_FPTEST,  CMD_DENSE,    CMD_SPARSE,      CMD_SPMAT,  CMD_EIG,
+    CMD_SVD,     CMD_FFT,     CMD_IFFT,     CMD_CONV,        CMD_NULL,   CMD_NULL
 };
-#define MISC_CAT_ROWS 6
+#define MISC_CAT_ROWS 7
 #else
 static int ext_misc_cat[] = {
     CMD_A2LINE,  CMD_A2PLINE, CMD_C_LN_1_X, CMD_C_E_POW_X_1, CMD_CAPS,   CMD_DYNAMIC,
@@ -2794,9 +2796,10 @@ static int ext_misc_cat[] = {
     CMD_MIXED,   CMD_PCOMPLX, CMD_PLOT_M,   CMD_PRREG,       CMD_PUTLI,  CMD_PUTMI,
     CMD_RCOMPLX, CMD_SPFV,    CMD_SPPV,     CMD_STATIC,      CMD_STRACE, CMD_TVM,
     CMD_UNLOCK,  CMD_USFV,    CMD_USPV,     CMD_X2LINE,      CMD_ACCEL,  CMD_LOCAT,
-    CMD_HEADING, CMD_NULL,    CMD_NULL,     CMD_NULL,        CMD_NULL,   CMD_NULL
+    CMD_HEADING, CMD_DENSE,   CMD_SPARSE,   CMD_SPMAT,       CMD_EIG,    CMD_SVD,
+    CMD_FFT,     CMD_IFFT,    CMD_CONV,     CMD_NULL,        CMD_NULL,   CMD_NULL
 };
-#define MISC_CAT_ROWS 6
+#define MISC_CAT_ROWS 7
 #endif
 #else
 #ifdef FREE42_FPTEST
@@ -2805,18 +2808,21 @@ static int ext_misc_cat[] = {
     CMD_FMA,     CMD_GETLI,   CMD_GETMI,    CMD_IDENT,       CMD_LINE,   CMD_LOCK,
     CMD_MIXED,   CMD_PCOMPLX, CMD_PLOT_M,   CMD_PRREG,       CMD_PUTLI,  CMD_PUTMI,
     CMD_RCOMPLX, CMD_SPFV,    CMD_SPPV,     CMD_STATIC,      CMD_STRACE, CMD_TVM,
-    CMD_UNLOCK,  CMD_USFV,    CMD_USPV,     CMD_X2LINE,      CMD_FPTEST, CMD_NULL
+    CMD_UNLOCK,  CMD_USFV,    CMD_USPV,     CMD_X2LINE,      CMD_FPTEST, CMD_DENSE,
+    CMD_SPARSE,  CMD_SPMAT,   CMD_EIG,      CMD_SVD,         CMD_FFT,    CMD_IFFT,
+    CMD_CONV,    CMD_NULL,    CMD_NULL,     CMD_NULL,        CMD_NULL,   CMD_NULL
 };
-#define MISC_CAT_ROWS 5
+#define MISC_CAT_ROWS 7
 #else
 static int ext_misc_cat[] = {
     CMD_A2LINE,  CMD_A2PLINE, CMD_C_LN_1_X, CMD_C_E_POW_X_1, CMD_CAPS,   CMD_DYNAMIC,
     CMD_FMA,     CMD_GETLI,   CMD_GETMI,    CMD_IDENT,       CMD_LINE,   CMD_LOCK,
     CMD_MIXED,   CMD_PCOMPLX, CMD_PLOT_M,   CMD_PRREG,       CMD_PUTLI,  CMD_PUTMI,
     CMD_RCOMPLX, CMD_SPFV,    CMD_SPPV,     CMD_STATIC,      CMD_STRACE, CMD_TVM,
-    CMD_UNLOCK,  CMD_USFV,    CMD_USPV,     CMD_X2LINE,      CMD_NULL,   CMD_NULL
+    CMD_UNLOCK,  CMD_USFV,    CMD_USPV,     CMD_X2LINE,      CMD_DENSE,  CMD_SPARSE,
+    CMD_SPMAT,   CMD_EIG,     CMD_SVD,      CMD_FFT,         CMD_IFFT,   CMD_CONV
 };
-#define MISC_CAT_ROWS 5
+#define MISC_CAT_ROWS 6
 #endif
 #endif
 
@@ -3048,7 +3054,7 @@ static void draw_catalog() {
             case CATSECT_EXT_PRGM: subcat = ext_prgm_cat; subcat_rows = 4; break;
             case CATSECT_EXT_STR: subcat = ext_str_cat; subcat_rows = 4; break;
             case CATSECT_EXT_STK: subcat = ext_stk_cat; subcat_rows = 3; break;
-            case CATSECT_EXT_EQN: subcat = ext_eqn_cat; subcat_rows = 3; break;
+            case CATSECT_EXT_EQN: subcat = ext_eqn_cat; subcat_rows = 4; break;
             case CATSECT_EXT_UNIT: subcat = ext_unit_cat; subcat_rows = 2; break;
             case CATSECT_EXT_STAT: subcat = ext_stat_cat; subcat_rows = 3; break;
             case CATSECT_EXT_DIR: subcat = ext_dir_cat; subcat_rows = 2; break;
@@ -3243,6 +3249,7 @@ static void draw_catalog() {
                 show_type[TYPE_DIR_REF] = true;
                 show_type[TYPE_PGM_REF] = true;
                 show_type[TYPE_VAR_REF] = true;
+                show_type[TYPE_SPARSEMATRIX] = true;
                 break;
             case CATSECT_LIST_STR_ONLY:
                 show_type[TYPE_STRING] = true;
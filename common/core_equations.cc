@@ -845,10 +845,8 @@ static void save() {
             selected_row = 0;
             num_eqns = 1;
         } else {
-            vartype **new_data = (vartype **) realloc(eqns->array->data, (num_eqns + 1) * sizeof(vartype *));
-            if (new_data == NULL)
+            if (!list_reserve(eqns, num_eqns + 1))
                 goto nomem;
-            eqns->array->data = new_data;
             eqns->size++;
             num_eqns++;
             selected_row++;
@@ -1287,10 +1285,8 @@ void eqn_paste(const char *buf) {
                     return;
                 }
             } else {
-                vartype **new_data = (vartype **) realloc(eqns->array->data, (num_eqns + 1) * sizeof(vartype *));
-                if (new_data == NULL)
+                if (!list_reserve(eqns, num_eqns + 1))
                     goto nomem;
-                eqns->array->data = new_data;
                 eqns->size++;
             }
             int n = selected_row + 1;
@@ -2199,9 +2195,6 @@ static bool delete_eqn() {
             screen_row--;
         }
     }
-    vartype **new_data = (vartype **) realloc(eqns->array->data, num_eqns * sizeof(vartype *));
-    if (new_data != NULL || num_eqns == 0)
-        eqns->array->data = new_data;
     return true;
 }
 
@@ -3205,13 +3198,11 @@ static int keydown_list(int key, bool shift, int *repeat) {
                     error_eqn_id = -1;
                     goto no_eqn;
                 }
-                vartype **new_data = (vartype **) realloc(eqns->array->data, (num_eqns + 1) * sizeof(vartype *));
-                if (new_data == NULL) {
+                if (!list_reserve(eqns, num_eqns + 1)) {
                     error_eqn_id = -1;
                     free_vartype(eq);
                     goto no_eqn;
                 }
-                eqns->array->data = new_data;
                 eqns->size++;
                 eqns->array->data[num_eqns] = eq;
                 idx = num_eqns;
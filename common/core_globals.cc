@@ -24,11 +24,13 @@
 #include "core_globals.h"
 #include "core_commands2.h"
 #include "core_commands4.h"
+#include "core_commands5.h"
 #include "core_commands7.h"
 #include "core_commandsa.h"
 #include "core_display.h"
 #include "core_equations.h"
 #include "core_helpers.h"
+#include "core_linalg1.h"
 #include "core_main.h"
 #include "core_math1.h"
 #include "core_parser.h"
@@ -1201,8 +1203,16 @@ bool no_keystrokes_yet;
  * Version 52: 1.3    BASE enhancements (menu additions)
  * Version 53: 1.3    BASE enhancements (carry; display modes)
  * Version 54: 1.3.3  CAPS/Mixed and STATIC/DYNAMIC for menus
+ * Version 55: 1.3.8  SOLVE: Newton steps using program derivatives
+ * Version 56: 1.3.8  SOLVE root cache; SCACHE and NEVAL?
+ * Version 57: 1.3.8  TABLE
+ * Version 58: 1.3.8  INTEGN
+ * Version 59: 1.3.8  ROOTS
+ * Version 60: 1.3.8  Sparse matrices
+ * Version 61: 1.3.8  MAP, FILTER, and REDUCE
+ * Version 62: 1.3.8  Stable summation statistics
  */
-#define PLUS42_VERSION 54
+#define PLUS42_VERSION 62
 
 
 /*******************/
@@ -1481,6 +1491,42 @@ bool persist_vartype(vartype *v) {
                 return false;
             return fwrite(r->name, 1, r->length, gfile) == r->length;
         }
+        case TYPE_SPARSEMATRIX: {
+            vartype_sparsematrix *sm = (vartype_sparsematrix *) v;
+            sparsematrix_data *sd = sm->array;
+            int4 rows = sm->rows;
+            int4 columns = sm->columns;
+            bool must_write = true;
+            if (sd->refcount > 1) {
+                int n = shared_data_search(sd);
+                if (n == -1) {
+                    // A negative row count signals a new shared matrix
+                    rows = -rows;
+                    if (!shared_data_grow())
+                        return false;
+                    shared_data[shared_data_count++] = sd;
+                } else {
+                    // A zero row count means this matrix shares its data
+                    // with a previously written matrix
+                    rows = 0;
+                    columns = n;
+                    must_write = false;
+                }
+            }
+            write_int4(rows);
+            write_int4(columns);
+            if (must_write) {
+                if (!write_int4(sd->nnz))
+                    return false;
+                for (int4 i = 1; i <= sm->rows; i++)
+                    if (!write_int4(sd->rowptr[i]))
+                        return false;
+                for (int4 i = 0; i < sd->nnz; i++)
+                    if (!write_int4(sd->col[i]) || !write_phloat(sd->val[i]))
+                        return false;
+            }
+            return true;
+        }
         default:
             /* Should not happen */
             return false;
@@ -1662,6 +1708,7 @@ bool unpersist_vartype(vartype **v) {
                         break;
                 } else {
                     rm->array->is_string[i] = 1;
+                    rm->array->strings++;
                     // 4-byte length followed by n bytes of text
                     int4 len;
                     if (!read_int4(&len))
@@ -1890,6 +1937,50 @@ bool unpersist_vartype(vartype **v) {
             *v = new_var_ref(dir, name, length);
             return *v != NULL;
         }
+        case TYPE_SPARSEMATRIX: {
+            int4 rows, columns, nnz;
+            if (!read_int4(&rows) || !read_int4(&columns))
+                return false;
+            if (rows == 0) {
+                // Shared matrix
+                vartype *m = dup_vartype((vartype *) shared_data[columns]);
+                if (m == NULL)
+                    return false;
+                else {
+                    *v = m;
+                    return true;
+                }
+            }
+            bool shared = rows < 0;
+            if (shared)
+                rows = -rows;
+            if (!read_int4(&nnz))
+                return false;
+            vartype_sparsematrix *sm = (vartype_sparsematrix *) new_sparsematrix(rows, columns, nnz);
+            if (sm == NULL)
+                return false;
+            sparsematrix_data *sd = sm->array;
+            sd->rowptr[0] = 0;
+            for (int4 i = 1; i <= rows; i++)
+                if (!read_int4(&sd->rowptr[i]))
+                    goto sparse_fail;
+            if (sd->rowptr[rows] != nnz)
+                goto sparse_fail;
+            for (int4 i = 0; i < nnz; i++)
+                if (!read_int4(&sd->col[i]) || !read_phloat(&sd->val[i]))
+                    goto sparse_fail;
+            if (shared) {
+                if (!shared_data_grow())
+                    goto sparse_fail;
+                shared_data[shared_data_count++] = sm;
+            }
+            *v = (vartype *) sm;
+            return true;
+
+            sparse_fail:
+            free_vartype((vartype *) sm);
+            return false;
+        }
         default:
             return false;
     }
@@ -4184,6 +4275,7 @@ int push_func_state(int n) {
     vartype **tmpstk = tlist->array->data;
     int4 tmpdepth = tlist->size;
     tlist->array->data = stack;
+    tlist->array->capacity = stack_capacity;
     tlist->size = sp + 1;
     stack = tmpstk;
     stack_capacity = 4;
@@ -4276,6 +4368,7 @@ int push_stack_state(bool big) {
             vartype **tmpstk = tlist->array->data;
             int4 tmpdepth = tlist->size;
             tlist->array->data = stack;
+            tlist->array->capacity = stack_capacity;
             tlist->size = sp + 1;
             stack = tmpstk;
             stack_capacity = tmpdepth;
@@ -4302,14 +4395,7 @@ int push_stack_state(bool big) {
  * capacity.
  */
 static bool ensure_list_capacity_4(vartype_list *list) {
-    int4 size = list->size;
-    if (size < 4) {
-        vartype **newdata = (vartype **) realloc(list->array->data, 4 * sizeof(vartype *));
-        if (newdata == NULL)
-            return false;
-        list->array->data = newdata;
-    }
-    return true;
+    return list_reserve(list, 4);
 }
 
 int pop_func_state(bool error) {
@@ -4360,10 +4446,12 @@ int pop_func_state(bool error) {
             }
             vartype **tmpstk = stack;
             int tmpsize = sp + 1;
+            int4 tmpcap = stack_capacity;
             stack = tlist->array->data;
-            stack_capacity = tlist->size;
-            sp = stack_capacity - 1;
+            stack_capacity = tlist->array->capacity;
+            sp = tlist->size - 1;
             tlist->array->data = tmpstk;
+            tlist->array->capacity = tmpcap;
             tlist->size = tmpsize;
         } else if (!big && flags.f.big_stack) {
             if (sp < 3) {
@@ -4404,12 +4492,12 @@ int pop_func_state(bool error) {
 
         vartype **tmpstk = stack;
         int tmpsize = sp + 1;
+        int4 tmpcap = stack_capacity;
         stack = tlist->array->data;
-        stack_capacity = tlist->size;
-        sp = stack_capacity - 1;
-        if (stack_capacity < 4)
-            stack_capacity = 4;
+        stack_capacity = tlist->array->capacity;
+        sp = tlist->size - 1;
         tlist->array->data = tmpstk;
+        tlist->array->capacity = tmpcap;
         tlist->size = tmpsize;
 
         if (error)
@@ -4654,6 +4742,10 @@ int rtn(int err) {
             case -3: return return_to_integ(stop);
             case -4: return return_to_eqn_edit(ERR_NONE);
             case -5: return return_to_plot(false, stop);
+            case -6: return return_to_table(stop);
+            case -7: return return_to_cubature(stop);
+            case -8: return return_to_root_scan(stop);
+            case -9: return return_to_map(stop);
             default: return ERR_INTERNAL_ERROR;
         }
     } else {
@@ -4848,6 +4940,29 @@ bool integ_active() {
     return rtn_integ_active;
 }
 
+static bool rtn_stack_contains(int prgm) {
+    for (int i = 0; i < rtn_level; i++)
+        if (rtn_stack[i].get_prgm() == prgm)
+            return true;
+    return false;
+}
+
+bool table_active() {
+    return rtn_stack_contains(-6);
+}
+
+bool cubature_active() {
+    return rtn_stack_contains(-7);
+}
+
+bool root_scan_active() {
+    return rtn_stack_contains(-8);
+}
+
+bool map_active() {
+    return rtn_stack_contains(-9);
+}
+
 bool solve_or_plot_active() {
     return rtn_solve_active || rtn_plot_active;
 }
@@ -5422,6 +5537,8 @@ static bool load_state2(bool *clear, bool *too_new) {
         return false;
     if (!unpersist_math(ver))
         return false;
+    if (!unpersist_stats(ver))
+        return false;
     pc = line2pc(pc);
     incomplete_saved_pc = line2pc(incomplete_saved_pc);
 
@@ -5472,6 +5589,8 @@ bool load_state(bool *clear, bool *too_new) {
     shared_data = NULL;
 
     loading_state = true;
+    lu_cache_clear();
+    clear_find_indexes();
     bool ret = load_state2(clear, too_new);
     loading_state = false;
 
@@ -5586,6 +5705,8 @@ static void save_state2(bool *success) {
         return;
     if (!persist_math())
         return;
+    if (!persist_stats())
+        return;
 
     if (!write_int4(PLUS42_MAGIC)) return;
     if (!write_int4(PLUS42_VERSION)) return;
@@ -5630,6 +5751,8 @@ void hard_reset(int reason) {
 
     /* Clear RTN stack, variables, and programs */
     clear_rtns_vars_and_prgms();
+    lu_cache_clear();
+    clear_find_indexes();
 
     /* Reinitialize RTN stack */
     if (rtn_stack != NULL)
@@ -740,6 +740,10 @@ void save_csld();
 bool is_csld();
 bool solve_active();
 bool integ_active();
+bool table_active();
+bool cubature_active();
+bool root_scan_active();
+bool map_active();
 bool solve_or_plot_active();
 bool unwind_stack_until_solve_or_plot(int *which);
 
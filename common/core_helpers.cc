@@ -288,6 +288,31 @@ int unary_two_results(vartype *x, vartype *y) {
     return ERR_NONE;
 }
 
+int unary_three_results(vartype *x, vartype *y, vartype *z) {
+    if (flags.f.big_stack) {
+        if (!ensure_stack_capacity(2)) {
+            free_vartype(x);
+            free_vartype(y);
+            free_vartype(z);
+            return ERR_INSUFFICIENT_MEMORY;
+        }
+        free_vartype(lastx);
+        lastx = stack[sp];
+        sp += 2;
+    } else {
+        free_vartype(stack[REG_T]);
+        free_vartype(stack[REG_Z]);
+        stack[REG_T] = stack[REG_Y];
+        free_vartype(lastx);
+        lastx = stack[REG_X];
+    }
+    stack[sp - 2] = z;
+    stack[sp - 1] = y;
+    stack[sp] = x;
+    print_trace();
+    return ERR_NONE;
+}
+
 int unary_no_result() {
     if (!flags.f.big_stack) {
         vartype *t = dup_vartype(stack[REG_T]);
@@ -329,6 +354,31 @@ int binary_result(vartype *x) {
     return ERR_NONE;
 }
 
+/* Like binary_result(), for functions that have modified the object in Y in
+ * place, and leave it on the stack as their result. Unlike binary_result(),
+ * this leaves the stack unchanged if it fails, so the caller can undo its
+ * changes to Y.
+ */
+int binary_result_in_place() {
+    vartype *t = NULL;
+    if (!flags.f.big_stack) {
+        t = dup_vartype(stack[REG_T]);
+        if (t == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+    }
+    free_vartype(lastx);
+    lastx = stack[sp];
+    if (flags.f.big_stack) {
+        sp--;
+    } else {
+        stack[REG_X] = stack[REG_Y];
+        stack[REG_Y] = stack[REG_Z];
+        stack[REG_Z] = t;
+    }
+    print_trace();
+    return ERR_NONE;
+}
+
 void binary_two_results(vartype *x, vartype *y) {
     if (flags.f.big_stack) {
         while (sp < 1)
@@ -529,7 +579,8 @@ bool vartype_equals(const vartype *v1, const vartype *v2) {
             if (x->array == y->array)
                 return true;
             int4 sz, i;
-            if (x->rows != y->rows || x->columns != y->columns)
+            if (x->rows != y->rows || x->columns != y->columns
+                    || x->array->strings != y->array->strings)
                 return false;
             sz = x->rows * x->columns;
             for (i = 0; i < sz; i++) {
@@ -609,12 +660,261 @@ bool vartype_equals(const vartype *v1, const vartype *v2) {
             return x->dir == y->dir
                 && string_equals(x->name, x->length, y->name, y->length);
         }
+        case TYPE_SPARSEMATRIX: {
+            const vartype_sparsematrix *x = (const vartype_sparsematrix *) v1;
+            const vartype_sparsematrix *y = (const vartype_sparsematrix *) v2;
+            if (x->array == y->array)
+                return true;
+            if (x->rows != y->rows || x->columns != y->columns
+                    || x->array->nnz != y->array->nnz)
+                return false;
+            int4 i;
+            for (i = 0; i <= x->rows; i++)
+                if (x->array->rowptr[i] != y->array->rowptr[i])
+                    return false;
+            for (i = 0; i < x->array->nnz; i++)
+                if (x->array->col[i] != y->array->col[i]
+                        || x->array->val[i] != y->array->val[i])
+                    return false;
+            return true;
+        }
         default:
             /* Looks like someone added a type that we're not handling yet! */
             return false;
     }
 }
 
+/* Lookup indexes for FIND and POS: once the same list or real matrix has
+ * been searched twice in a row, a hash table is built that maps each real
+ * or string value to the first position where it occurs, and a chain links
+ * each position to the next one with the same value. Like the LU cache in
+ * core_linalg1.cc, each index holds a reference to the list or matrix it
+ * was built from, so copy-on-write guarantees that its data array can't
+ * change while the index exists, and comparing array identities is all we
+ * need to do to tell whether an index is still valid.
+ * Lists containing numbers with units are never indexed, because
+ * vartype_equals() considers those equal to plain numbers after unit
+ * conversion, and that can't be hashed.
+ */
+
+#define FIND_INDEX_SLOTS 4
+#define FIND_INDEX_MIN 64
+
+struct find_key {
+    bool is_string;
+    phloat x;
+    const char *text;
+    int4 length;
+};
+
+struct find_index {
+    vartype *src;
+    const void *array;
+    int4 size;
+    int4 mask;
+    int4 *table;
+    int4 *next;
+    uint4 last_used;
+};
+
+static find_index find_indexes[FIND_INDEX_SLOTS];
+static const void *find_candidate = NULL;
+static int4 find_candidate_size;
+static uint4 find_clock = 0;
+
+static bool get_find_key(const vartype *v, find_key *k) {
+    if (v->type == TYPE_REAL) {
+        k->is_string = false;
+        k->x = ((const vartype_real *) v)->x;
+        return true;
+    } else if (v->type == TYPE_STRING) {
+        const vartype_string *s = (const vartype_string *) v;
+        k->is_string = true;
+        k->text = s->txt();
+        k->length = s->length;
+        return true;
+    } else
+        return false;
+}
+
+static bool get_find_key(const vartype *hs, int4 p, find_key *k) {
+    if (hs->type == TYPE_LIST)
+        return get_find_key(((const vartype_list *) hs)->array->data[p], k);
+    const vartype_realmatrix *rm = (const vartype_realmatrix *) hs;
+    if (rm->array->is_string[p] == 0) {
+        k->is_string = false;
+        k->x = rm->array->data[p];
+    } else {
+        k->is_string = true;
+        get_matrix_string(rm, p, &k->text, &k->length);
+    }
+    return true;
+}
+
+static bool find_keys_equal(const find_key *a, const find_key *b) {
+    if (a->is_string != b->is_string)
+        return false;
+    if (a->is_string)
+        return string_equals(a->text, a->length, b->text, b->length);
+    else
+        return a->x == b->x;
+}
+
+static uint4 find_hash(const find_key *k) {
+    uint4 h = 2166136261U;
+    if (k->is_string) {
+        for (int4 i = 0; i < k->length; i++)
+            h = (h ^ (unsigned char) k->text[i]) * 16777619U;
+        return h;
+    }
+    /* Hash the value as a double, so that equal numbers with different
+     * representations, like 0 and -0, or the members of a decimal cohort,
+     * end up in the same bucket.
+     */
+    double d = to_double(k->x);
+    if (d == 0)
+        d = 0;
+    uint8 bits;
+    memcpy(&bits, &d, sizeof(bits));
+    bits ^= bits >> 29;
+    bits *= 0xbf58476d1ce4e5b9ULL;
+    bits ^= bits >> 32;
+    return (uint4) bits;
+}
+
+static void free_find_index(find_index *fi) {
+    free_vartype(fi->src);
+    free(fi->table);
+    free(fi->next);
+    fi->src = NULL;
+    fi->array = NULL;
+    fi->table = NULL;
+    fi->next = NULL;
+}
+
+/* Drops all indexes, and the references they hold; called on CLALL,
+ * Memory Clear, state load, and core cleanup.
+ */
+void clear_find_indexes() {
+    for (int i = 0; i < FIND_INDEX_SLOTS; i++)
+        free_find_index(find_indexes + i);
+    find_candidate = NULL;
+}
+
+static find_index *build_find_index(const vartype *hs, const void *array, int4 size) {
+    if (hs->type == TYPE_LIST) {
+        vartype **data = ((const vartype_list *) hs)->array->data;
+        for (int4 i = 0; i < size; i++)
+            if (data[i]->type == TYPE_UNIT)
+                return NULL;
+    }
+    int4 tsize = 1;
+    while (tsize < size * 2)
+        tsize <<= 1;
+    int4 *table = (int4 *) malloc(tsize * sizeof(int4));
+    int4 *next = (int4 *) malloc(size * sizeof(int4));
+    vartype *src = dup_vartype(hs);
+    if (table == NULL || next == NULL || src == NULL) {
+        free(table);
+        free(next);
+        free_vartype(src);
+        return NULL;
+    }
+    int4 mask = tsize - 1;
+    for (int4 i = 0; i < tsize; i++)
+        table[i] = -1;
+    /* Going backwards, so each bucket ends up pointing to the first
+     * occurrence of its value, and the chains are in ascending order.
+     */
+    for (int4 p = size - 1; p >= 0; p--) {
+        find_key k, k2;
+        next[p] = -1;
+        if (!get_find_key(hs, p, &k))
+            continue;
+        uint4 h = find_hash(&k) & mask;
+        while (table[h] != -1) {
+            get_find_key(hs, table[h], &k2);
+            if (find_keys_equal(&k, &k2)) {
+                next[p] = table[h];
+                break;
+            }
+            h = (h + 1) & mask;
+        }
+        table[h] = p;
+    }
+
+    find_index *fi = find_indexes;
+    for (int i = 1; i < FIND_INDEX_SLOTS; i++)
+        if (find_indexes[i].last_used < fi->last_used)
+            fi = find_indexes + i;
+    free_find_index(fi);
+    fi->src = src;
+    fi->array = array;
+    fi->size = size;
+    fi->mask = mask;
+    fi->table = table;
+    fi->next = next;
+    return fi;
+}
+
+/* Finds the first position >= start where the list or real matrix 'hs'
+ * holds a value equal to 'needle', in the sense of vartype_equals(). Returns
+ * -1 if there is no such position, or -2 if there is no index, in which case
+ * the caller should perform a linear search.
+ */
+int4 indexed_find(const vartype *hs, const vartype *needle, int4 start) {
+    find_key k;
+    if (!get_find_key(needle, &k))
+        return -2;
+    const void *array;
+    int4 size;
+    if (hs->type == TYPE_LIST) {
+        array = ((const vartype_list *) hs)->array;
+        size = ((const vartype_list *) hs)->size;
+    } else if (hs->type == TYPE_REALMATRIX) {
+        const vartype_realmatrix *rm = (const vartype_realmatrix *) hs;
+        array = rm->array;
+        size = rm->rows * rm->columns;
+    } else
+        return -2;
+    if (size < FIND_INDEX_MIN)
+        return -2;
+
+    find_index *fi = NULL;
+    for (int i = 0; i < FIND_INDEX_SLOTS; i++)
+        if (find_indexes[i].array == array && find_indexes[i].size == size) {
+            fi = find_indexes + i;
+            break;
+        }
+    if (fi == NULL) {
+        if (find_candidate != array || find_candidate_size != size) {
+            /* First search of this array; don't index it yet */
+            find_candidate = array;
+            find_candidate_size = size;
+            return -2;
+        }
+        fi = build_find_index(hs, array, size);
+        find_candidate = NULL;
+        if (fi == NULL)
+            return -2;
+    }
+    fi->last_used = ++find_clock;
+
+    uint4 h = find_hash(&k) & fi->mask;
+    int4 p;
+    while ((p = fi->table[h]) != -1) {
+        find_key k2;
+        get_find_key(hs, p, &k2);
+        if (find_keys_equal(&k, &k2)) {
+            while (p != -1 && p < start)
+                p = fi->next[p];
+            return p;
+        }
+        h = (h + 1) & fi->mask;
+    }
+    return -1;
+}
+
 int generic_comparison(const vartype *x, const vartype *y, char which) {
     /* x and y are both guaranteed to be TYPE_REAL or TYPE_UNIT */
     if (x->type == TYPE_REAL && y->type == TYPE_REAL) {
@@ -1619,6 +1919,17 @@ phloat cos_grad(phloat x) {
     return sin_or_cos_grad(x, false);
 }
 
+/* Returns the capacity, in elements, to use when a matrix that currently
+ * has room for 'cap' elements needs to hold 'size' elements: 1.5 times the
+ * old capacity, but at least 'size', and never so much that the array would
+ * be larger than the 2 GB that new_realmatrix() allows.
+ */
+static int4 grow_capacity(int4 cap, int4 size, int elsize) {
+    int4 max = (int4) (2147483647 / elsize);
+    int4 newcap = cap > max / 3 * 2 ? max : cap + cap / 2;
+    return newcap < size ? size : newcap;
+}
+
 int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
     int4 size = rows * columns;
     if (matrix->type == TYPE_REALMATRIX) {
@@ -1626,6 +1937,7 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
         if (oldmatrix->rows == rows && oldmatrix->columns == columns)
             return ERR_NONE;
         if (oldmatrix->array->refcount == 1) {
+            realmatrix_data *array = oldmatrix->array;
             int4 oldsize = oldmatrix->rows * oldmatrix->columns;
             if (size == oldsize) {
                 /* Easy case! */
@@ -1634,47 +1946,65 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
                 return ERR_NONE;
             } else if (size < oldsize) {
                 /* Also pretty easy, shrinking means we don't have to worry
-                 * about allocation failures. We do deal with realloc()
-                 * failures, because technically, realloc() can fail even when
-                 * shrinking, but that is easy to handle by simply hanging onto
-                 * the existing block.
+                 * about allocation failures. The freed space is kept around,
+                 * so shrinking and growing again (DELR followed by INSR, or
+                 * GROW mode data entry after a shrink) doesn't reallocate,
+                 * unless most of the array would be unused. We do deal with
+                 * realloc() failures, because technically, realloc() can
+                 * fail even when shrinking, but that is easy to handle by
+                 * simply hanging onto the existing block.
                  */
-                free_long_strings(oldmatrix->array->is_string + size, oldmatrix->array->data + size, oldsize - size);
-                char *new_is_string = (char *) realloc(oldmatrix->array->is_string, size);
-                if (new_is_string != NULL)
-                    oldmatrix->array->is_string = new_is_string;
-                phloat *new_data = (phloat *) realloc((void *) oldmatrix->array->data, size * sizeof(phloat));
-                if (new_data != NULL)
-                    oldmatrix->array->data = new_data;
+                free_long_strings(array->is_string + size, array->data + size, oldsize - size);
+                if (array->strings != 0)
+                    array->strings -= count_strings(array->is_string + size, oldsize - size);
+                if (size < array->capacity / 4) {
+                    int4 s = size == 0 ? 1 : size;
+                    char *new_is_string = (char *) realloc(array->is_string, s);
+                    if (new_is_string != NULL)
+                        array->is_string = new_is_string;
+                    phloat *new_data = (phloat *) realloc((void *) array->data, s * sizeof(phloat));
+                    if (new_data != NULL)
+                        array->data = new_data;
+                    /* If either realloc() failed, that block is simply
+                     * larger than it needs to be, so this is still safe.
+                     */
+                    array->capacity = s;
+                }
                 oldmatrix->rows = rows;
                 oldmatrix->columns = columns;
                 return ERR_NONE;
             }
-            /* Since there are no shared references to this array,
-             * I can modify it in place using a realloc(). However, I
-             * only use realloc() on the 'data' array, not on the
-             * 'is_string' array -- if I used it on both, and the second
-             * call fails, I might be unable to roll back the first.
-             * So, playing safe -- shouldn't be too big a handicap since
-             * 'is_string' is a lot smaller than 'data', so the transient
-             * memory overhead is only about 12.5%.
-             */
-            char *new_is_string = (char *) malloc(size);
-            if (new_is_string == NULL)
-                return ERR_INSUFFICIENT_MEMORY;
-            phloat *new_data = (phloat *) realloc((void *) oldmatrix->array->data, size * sizeof(phloat));
-            if (new_data == NULL) {
-                free(new_is_string);
-                return ERR_INSUFFICIENT_MEMORY;
-            }
-            memcpy(new_is_string, oldmatrix->array->is_string, oldsize);
-            for (int4 i = oldsize; i < size; i++) {
-                new_is_string[i] = 0;
-                new_data[i] = 0;
+            if (size > array->capacity) {
+                /* Since there are no shared references to this array,
+                 * I can modify it in place using a realloc(). However, I
+                 * only use realloc() on the 'data' array, not on the
+                 * 'is_string' array -- if I used it on both, and the second
+                 * call fails, I might be unable to roll back the first.
+                 * So, playing safe -- shouldn't be too big a handicap since
+                 * 'is_string' is a lot smaller than 'data', so the transient
+                 * memory overhead is only about 12.5%.
+                 * The capacity is grown geometrically, so that adding rows
+                 * one at a time takes amortized constant time per element,
+                 * instead of copying the whole matrix every time.
+                 */
+                int4 cap = grow_capacity(array->capacity, size, sizeof(phloat));
+                char *new_is_string = (char *) malloc(cap);
+                if (new_is_string == NULL)
+                    return ERR_INSUFFICIENT_MEMORY;
+                phloat *new_data = (phloat *) realloc((void *) array->data, cap * sizeof(phloat));
+                if (new_data == NULL) {
+                    free(new_is_string);
+                    return ERR_INSUFFICIENT_MEMORY;
+                }
+                memcpy(new_is_string, array->is_string, oldsize);
+                free(array->is_string);
+                array->is_string = new_is_string;
+                array->data = new_data;
+                array->capacity = cap;
             }
-            free(oldmatrix->array->is_string);
-            oldmatrix->array->is_string = new_is_string;
-            oldmatrix->array->data = new_data;
+            memset(array->is_string + oldsize, 0, size - oldsize);
+            for (int4 i = oldsize; i < size; i++)
+                array->data[i] = 0;
             oldmatrix->rows = rows;
             oldmatrix->columns = columns;
             return ERR_NONE;
@@ -1724,6 +2054,9 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
                 new_array->is_string[i] = 0;
                 new_array->data[i] = 0;
             }
+            new_array->strings = s == oldsize ? oldmatrix->array->strings
+                                    : count_strings(new_array->is_string, s);
+            new_array->capacity = size;
             new_array->refcount = 1;
             oldmatrix->array->refcount--;
             oldmatrix->array = new_array;
@@ -1737,17 +2070,32 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
             return ERR_NONE;
         if (oldmatrix->array->refcount == 1) {
             /* Since there are no shared references to this array,
-             * I can modify it in place using a realloc().
+             * I can modify it in place using a realloc(). As with real
+             * matrices, the capacity grows geometrically, and is only
+             * given back when most of it would be unused.
              */
+            complexmatrix_data *array = oldmatrix->array;
             int4 i, oldsize;
-            phloat *new_data = (phloat *)
-                    realloc((void *) oldmatrix->array->data, 2 * size * sizeof(phloat));
-            if (new_data == NULL)
-                return ERR_INSUFFICIENT_MEMORY;
             oldsize = oldmatrix->rows * oldmatrix->columns;
+            if (size > array->capacity) {
+                int4 cap = grow_capacity(array->capacity, size, 2 * sizeof(phloat));
+                phloat *new_data = (phloat *)
+                        realloc((void *) array->data, 2 * cap * sizeof(phloat));
+                if (new_data == NULL)
+                    return ERR_INSUFFICIENT_MEMORY;
+                array->data = new_data;
+                array->capacity = cap;
+            } else if (size < array->capacity / 4) {
+                int4 s = size == 0 ? 1 : size;
+                phloat *new_data = (phloat *)
+                        realloc((void *) array->data, 2 * s * sizeof(phloat));
+                if (new_data != NULL) {
+                    array->data = new_data;
+                    array->capacity = s;
+                }
+            }
             for (i = 2 * oldsize; i < 2 * size; i++)
-                new_data[i] = 0;
-            oldmatrix->array->data = new_data;
+                array->data[i] = 0;
             oldmatrix->rows = rows;
             oldmatrix->columns = columns;
             return ERR_NONE;
@@ -1775,6 +2123,7 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
                 new_array->data[i] = oldmatrix->array->data[i];
             for (i = 2 * s; i < 2 * size; i++)
                 new_array->data[i] = 0;
+            new_array->capacity = size;
             new_array->refcount = 1;
             oldmatrix->array->refcount--;
             oldmatrix->array = new_array;
@@ -1788,41 +2137,45 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
         vartype_list *oldlist = (vartype_list *) matrix;
         if (oldlist->size == size)
             return ERR_NONE;
+        if (oldlist->array->owner != NULL && !disentangle(matrix))
+            return ERR_INSUFFICIENT_MEMORY;
         if (oldlist->array->refcount == 1) {
             /* Since there are no shared references to this array,
-             * I can modify it in place using a realloc().
+             * I can modify it in place, using the spare capacity, or a
+             * realloc() if there isn't enough.
              */
             if (oldlist->size > size) {
                 for (int4 i = size; i < oldlist->size; i++) {
                     free_vartype(oldlist->array->data[i]);
                     oldlist->array->data[i] = NULL;
                 }
-                vartype **new_data = (vartype **) realloc(oldlist->array->data, size * sizeof(vartype *));
-                /* Note: If the realloc() fails to shrink the array, we just keep
-                 * using the existing one, basically pretending that it succeeded.
-                 */
-                if (new_data != NULL)
-                    oldlist->array->data = new_data;
+                if (size < oldlist->array->capacity / 4) {
+                    vartype **new_data = (vartype **) realloc(oldlist->array->data, size * sizeof(vartype *));
+                    /* Note: If the realloc() fails to shrink the array, we just keep
+                     * using the existing one, basically pretending that it succeeded.
+                     */
+                    if (new_data != NULL || size == 0) {
+                        oldlist->array->data = new_data;
+                        oldlist->array->capacity = size;
+                    }
+                }
                 oldlist->size = size;
                 return ERR_NONE;
             } else {
-                vartype **new_data = (vartype **) realloc(oldlist->array->data, size * sizeof(vartype *));
-                if (new_data == NULL)
+                if (!list_reserve(oldlist, size))
                     return ERR_INSUFFICIENT_MEMORY;
+                vartype **data = oldlist->array->data;
                 for (int4 i = oldlist->size; i < size; i++) {
-                    new_data[i] = new_real(0);
-                    if (new_data[i] == NULL) {
+                    data[i] = new_real(0);
+                    if (data[i] == NULL) {
                         /* Argh. Roll back everything and give up. */
                         for (int4 j = oldlist->size; j < i; j++) {
-                            free_vartype(new_data[j]);
-                            new_data[j] = NULL;
+                            free_vartype(data[j]);
+                            data[j] = NULL;
                         }
-                        vartype **reverted_data = (vartype **) realloc(new_data, oldlist->size * sizeof(vartype *));
-                        oldlist->array->data = reverted_data == NULL ? new_data : reverted_data;
                         return ERR_INSUFFICIENT_MEMORY;
                     }
                 }
-                oldlist->array->data = new_data;
                 oldlist->size = size;
                 return ERR_NONE;
             }
@@ -1851,7 +2204,9 @@ int dimension_array_ref(vartype *matrix, int4 rows, int4 columns) {
                     return ERR_INSUFFICIENT_MEMORY;
                 }
             }
+            new_array->capacity = size;
             new_array->refcount = 1;
+            new_array->owner = NULL;
             oldlist->array->refcount--;
             oldlist->array = new_array;
             oldlist->size = size;
@@ -2063,6 +2418,20 @@ int vartype2string(const vartype *v, char *buf, int buflen, int max_mant_digits)
             return chars_so_far;
         }
 
+        case TYPE_SPARSEMATRIX: {
+            vartype_sparsematrix *m = (vartype_sparsematrix *) v;
+            int i;
+            int chars_so_far = 0;
+            string2buf(buf, buflen, &chars_so_far, "[ ", 2);
+            i = int2string(m->rows, buf + chars_so_far, buflen - chars_so_far);
+            chars_so_far += i;
+            char2buf(buf, buflen, &chars_so_far, 'x');
+            i = int2string(m->columns, buf + chars_so_far, buflen - chars_so_far);
+            chars_so_far += i;
+            string2buf(buf, buflen, &chars_so_far, " Sparse ]", 9);
+            return chars_so_far;
+        }
+
         case TYPE_STRING: {
             vartype_string *s = (vartype_string *) v;
             int i;
@@ -2462,3 +2831,276 @@ void switch_30_and_94(char *text, int length) {
             text[i] = 30;
     }
 }
+
+
+#ifndef BCD_MATH
+
+/* Kernels for operations on arrays of doubles, used by the element-wise
+ * matrix operations and the matrix reductions in the binary build.
+ * With GCC and Clang they are written using vector extensions, and on
+ * x86-64, an AVX2 version is compiled as well, which is used if the CPU
+ * supports it. Other compilers get plain loops that do the same arithmetic.
+ * The element-wise kernels don't check for errors one element at a time;
+ * they just note whether any result was infinite or NaN, and if so, return
+ * false, and the caller should then start over using the regular code, so
+ * that errors are still reported, or range errors ignored, exactly as
+ * before. The reductions accumulate four interleaved partial sums, which are
+ * added together at the end.
+ */
+
+#if defined(__GNUC__) || defined(__clang__)
+#define VEC_EXT 1
+typedef double vec4d __attribute__((vector_size(32)));
+typedef int8 vec4i __attribute__((vector_size(32)));
+#define VEC_ABS(v) ((vec4d) ((vec4i) (v) & 0x7fffffffffffffffLL))
+#define VEC_LOAD(v, p) memcpy(&(v), (p), sizeof(vec4d))
+#define VEC_STORE(p, v) memcpy((p), &(v), sizeof(vec4d))
+#endif
+
+#if defined(VEC_EXT) && defined(__x86_64__)
+#define VEC_AVX2 1
+#define VEC_BODY static inline __attribute__((always_inline))
+
+static bool vec_avx2() {
+    static int avx2 = -1;
+    if (avx2 == -1) {
+        __builtin_cpu_init();
+        avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+    return avx2 == 1;
+}
+
+/* Each kernel is compiled twice, once for AVX2 and once for the baseline
+ * instruction set. The AVX2 version clears the upper halves of the vector
+ * registers before returning, so the surrounding SSE code doesn't pay for
+ * the transition.
+ */
+#define VEC_DISPATCH(type, name, params, args)                 \
+    __attribute__((target("avx2")))                           \
+    static type name##_avx2 params {                          \
+        type r = name##_body args;                            \
+        __builtin_ia32_vzeroupper();                          \
+        return r;                                             \
+    }                                                         \
+    type name params {                                        \
+        if (vec_avx2())                                       \
+            return name##_avx2 args;                          \
+        return name##_body args;                              \
+    }
+#else
+#define VEC_BODY static inline
+#define VEC_DISPATCH(type, name, params, args)                 \
+    type name params {                                        \
+        return name##_body args;                              \
+    }
+#endif
+
+VEC_BODY phloat vec_op(int op, phloat x, phloat y) {
+    switch (op) {
+        case VEC_ADD: return y + x;
+        case VEC_SUB: return y - x;
+        case VEC_MUL: return y * x;
+        case VEC_DIV: return y / x;
+        case VEC_SQRT: return sqrt(x);
+        case VEC_SQUARE: return x * x;
+        default: return 1 / x;
+    }
+}
+
+/* z = y op x, element by element, like add_rr() etc. in core_sto_rcl.cc.
+ * Either x or y may be a scalar, indicated by xv or yv being false.
+ */
+VEC_BODY bool vec_binary_body(int op, const phloat *x, bool xv,
+                              const phloat *y, bool yv, phloat *z, int4 n) {
+    int4 i = 0;
+    phloat bad = 0;
+    #ifdef VEC_EXT
+        vec4d a, b, r;
+        vec4d xs = { x[0], x[0], x[0], x[0] };
+        vec4d ys = { y[0], y[0], y[0], y[0] };
+        vec4d bad4 = { 0, 0, 0, 0 };
+        for (; i + 4 <= n; i += 4) {
+            if (xv)
+                VEC_LOAD(a, x + i);
+            else
+                a = xs;
+            if (yv)
+                VEC_LOAD(b, y + i);
+            else
+                b = ys;
+            switch (op) {
+                case VEC_ADD: r = b + a; break;
+                case VEC_SUB: r = b - a; break;
+                case VEC_MUL: r = b * a; break;
+                default: r = b / a; break;
+            }
+            bad4 += r * 0.0;
+            VEC_STORE(z + i, r);
+        }
+        bad = (bad4[0] + bad4[1]) + (bad4[2] + bad4[3]);
+    #endif
+    for (; i < n; i++) {
+        phloat r = vec_op(op, x[xv ? i : 0], y[yv ? i : 0]);
+        bad += r * 0;
+        z[i] = r;
+    }
+    /* r * 0 is NaN if r is infinite or NaN, and zero otherwise */
+    return bad == 0;
+}
+
+VEC_BODY bool vec_unary_body(int op, const phloat *x, phloat *z, int4 n) {
+    int4 i = 0;
+    phloat bad = 0;
+    #ifdef VEC_EXT
+        if (op != VEC_SQRT) {
+            vec4d a, r;
+            vec4d bad4 = { 0, 0, 0, 0 };
+            for (; i + 4 <= n; i += 4) {
+                VEC_LOAD(a, x + i);
+                if (op == VEC_SQUARE)
+                    r = a * a;
+                else
+                    r = 1.0 / a;
+                bad4 += r * 0.0;
+                VEC_STORE(z + i, r);
+            }
+            bad = (bad4[0] + bad4[1]) + (bad4[2] + bad4[3]);
+        }
+    #endif
+    for (; i < n; i++) {
+        phloat r = vec_op(op, x[i], 0);
+        bad += r * 0;
+        z[i] = r;
+    }
+    return bad == 0;
+}
+
+VEC_BODY phloat vec_sum_body(const phloat *x, int4 n) {
+    int4 i = 0;
+    phloat s[4] = { 0, 0, 0, 0 };
+    #ifdef VEC_EXT
+        vec4d a, s4 = { 0, 0, 0, 0 };
+        for (; i + 4 <= n; i += 4) {
+            VEC_LOAD(a, x + i);
+            s4 += a;
+        }
+        VEC_STORE(s, s4);
+    #else
+        for (; i + 4 <= n; i += 4)
+            for (int j = 0; j < 4; j++)
+                s[j] += x[i + j];
+    #endif
+    phloat sum = (s[0] + s[1]) + (s[2] + s[3]);
+    for (; i < n; i++)
+        sum += x[i];
+    return sum;
+}
+
+VEC_BODY phloat vec_abs_sum_body(const phloat *x, int4 n) {
+    int4 i = 0;
+    phloat s[4] = { 0, 0, 0, 0 };
+    #ifdef VEC_EXT
+        vec4d a, s4 = { 0, 0, 0, 0 };
+        for (; i + 4 <= n; i += 4) {
+            VEC_LOAD(a, x + i);
+            s4 += VEC_ABS(a);
+        }
+        VEC_STORE(s, s4);
+    #else
+        for (; i + 4 <= n; i += 4)
+            for (int j = 0; j < 4; j++)
+                s[j] += fabs(x[i + j]);
+    #endif
+    phloat sum = (s[0] + s[1]) + (s[2] + s[3]);
+    for (; i < n; i++)
+        sum += fabs(x[i]);
+    return sum;
+}
+
+VEC_BODY phloat vec_dot_body(const phloat *x, const phloat *y, int4 n) {
+    int4 i = 0;
+    phloat s[4] = { 0, 0, 0, 0 };
+    #ifdef VEC_EXT
+        vec4d a, b, s4 = { 0, 0, 0, 0 };
+        for (; i + 4 <= n; i += 4) {
+            VEC_LOAD(a, x + i);
+            VEC_LOAD(b, y + i);
+            s4 += a * b;
+        }
+        VEC_STORE(s, s4);
+    #else
+        for (; i + 4 <= n; i += 4)
+            for (int j = 0; j < 4; j++)
+                s[j] += x[i + j] * y[i + j];
+    #endif
+    phloat sum = (s[0] + s[1]) + (s[2] + s[3]);
+    for (; i < n; i++)
+        sum += x[i] * y[i];
+    return sum;
+}
+
+VEC_BODY phloat vec_abs_max_body(const phloat *x, int4 n) {
+    int4 i = 0;
+    phloat m[4] = { 0, 0, 0, 0 };
+    #ifdef VEC_EXT
+        vec4d a, m4 = { 0, 0, 0, 0 };
+        for (; i + 4 <= n; i += 4) {
+            VEC_LOAD(a, x + i);
+            a = VEC_ABS(a);
+            vec4i gt = a > m4;
+            m4 = (vec4d) (((vec4i) a & gt) | ((vec4i) m4 & ~gt));
+        }
+        VEC_STORE(m, m4);
+    #endif
+    phloat max = m[0];
+    for (int j = 1; j < 4; j++)
+        if (m[j] > max)
+            max = m[j];
+    for (; i < n; i++)
+        if (fabs(x[i]) > max)
+            max = fabs(x[i]);
+    return max;
+}
+
+/* Sum of (x[i] * scale)^2 */
+VEC_BODY phloat vec_sum_squares_body(const phloat *x, int4 n, phloat scale) {
+    int4 i = 0;
+    phloat s[4] = { 0, 0, 0, 0 };
+    #ifdef VEC_EXT
+        vec4d a, s4 = { 0, 0, 0, 0 };
+        for (; i + 4 <= n; i += 4) {
+            VEC_LOAD(a, x + i);
+            a *= scale;
+            s4 += a * a;
+        }
+        VEC_STORE(s, s4);
+    #else
+        for (; i + 4 <= n; i += 4)
+            for (int j = 0; j < 4; j++) {
+                phloat a = x[i + j] * scale;
+                s[j] += a * a;
+            }
+    #endif
+    phloat sum = (s[0] + s[1]) + (s[2] + s[3]);
+    for (; i < n; i++) {
+        phloat a = x[i] * scale;
+        sum += a * a;
+    }
+    return sum;
+}
+
+VEC_DISPATCH(bool, vec_binary,
+             (int op, const phloat *x, bool xv, const phloat *y, bool yv,
+              phloat *z, int4 n),
+             (op, x, xv, y, yv, z, n))
+VEC_DISPATCH(bool, vec_unary, (int op, const phloat *x, phloat *z, int4 n),
+             (op, x, z, n))
+VEC_DISPATCH(phloat, vec_sum, (const phloat *x, int4 n), (x, n))
+VEC_DISPATCH(phloat, vec_abs_sum, (const phloat *x, int4 n), (x, n))
+VEC_DISPATCH(phloat, vec_dot, (const phloat *x, const phloat *y, int4 n),
+             (x, y, n))
+VEC_DISPATCH(phloat, vec_abs_max, (const phloat *x, int4 n), (x, n))
+VEC_DISPATCH(phloat, vec_sum_squares,
+             (const phloat *x, int4 n, phloat scale), (x, n, scale))
+
+#endif
@@ -39,8 +39,10 @@ int recall_result(vartype *v);
 int recall_two_results(vartype *x, vartype *y);
 void unary_result(vartype *x);
 int unary_two_results(vartype *x, vartype *y);
+int unary_three_results(vartype *x, vartype *y, vartype *z);
 int unary_no_result();
 int binary_result(vartype *x);
+int binary_result_in_place();
 void binary_two_results(vartype *x, vartype *y);
 int ternary_result(vartype *x);
 bool ensure_stack_capacity(int n);
@@ -57,6 +59,8 @@ void string_copy(char *dst, int *dstlen, const char *src, int srclen);
 bool string_equals(const char *s1, int s1len, const char *s2, int s2len);
 int string_pos(const char *ntext, int nlen, const vartype *hs, int startpos);
 bool vartype_equals(const vartype *v1, const vartype *v2);
+int4 indexed_find(const vartype *hs, const vartype *needle, int4 start);
+void clear_find_indexes();
 int generic_comparison(const vartype *x, const vartype *y, char which);
 int anum(const char *text, int len, phloat *res);
 void fix_thousands_separators(char *buf, int *bufptr);
@@ -136,5 +140,28 @@ void leave_matrix_editor();
 
 void switch_30_and_94(char *text, int length);
 
+/******************/
+/* Vector kernels */
+/******************/
+
+#define VEC_ADD 0
+#define VEC_SUB 1
+#define VEC_MUL 2
+#define VEC_DIV 3
+#define VEC_SQRT 4
+#define VEC_SQUARE 5
+#define VEC_INV 6
+
+#ifndef BCD_MATH
+bool vec_binary(int op, const phloat *x, bool xv, const phloat *y, bool yv,
+                phloat *z, int4 n);
+bool vec_unary(int op, const phloat *x, phloat *z, int4 n);
+phloat vec_sum(const phloat *x, int4 n);
+phloat vec_abs_sum(const phloat *x, int4 n);
+phloat vec_dot(const phloat *x, const phloat *y, int4 n);
+phloat vec_abs_max(const phloat *x, int4 n);
+phloat vec_sum_squares(const phloat *x, int4 n, phloat scale);
+#endif
+
 
 #endif
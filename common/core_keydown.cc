@@ -3560,10 +3560,8 @@ void keydown_normal_mode(int shift, int key) {
                                 if (vartype_equals(list->array->data[pos], v))
                                     break;
                             if (pos == list->size) {
-                                vartype **newdata = (vartype **) realloc(list->array->data, (list->size + 1) * sizeof(vartype *));
-                                if (newdata == NULL)
+                                if (!list_reserve(list, list->size + 1))
                                     goto nomem;
-                                list->array->data = newdata;
                                 list->array->data[list->size++] = v;
                             } else if (list->size == 2) {
                                 stack[sp] = list->array->data[1 - pos];
@@ -24,6 +24,100 @@
 #include "core_math2.h"
 #include "core_sto_rcl.h"
 #include "core_variables.h"
+#include "shell.h"
+
+
+/*****************************************/
+/***** Cached LU-decomposed matrices *****/
+/*****************************************/
+
+/* Matrix division, INVRT, and DET all start by LU-decomposing a square
+ * matrix, which takes O(n^3) operations, while the back-substitution that
+ * follows only takes O(n^2) per right-hand side. When the same matrix is
+ * used repeatedly, as when solving for several right-hand sides in SIMQ, we
+ * reuse the decomposition of the most recently decomposed matrix.
+ * The cache holds a reference to the matrix it was computed from. Matrix
+ * data is copy-on-write: STO into an element, PUTM, the matrix editor, INSR
+ * and DELR, and anything else that modifies a matrix whose data is shared,
+ * first give that matrix its own copy of the data; so while we hold our
+ * reference, the data array we're pointing to can't change, and comparing
+ * array identities is all we need to do to detect modifications.
+ * Decompositions performed with the 'singular matrix' error mode off may
+ * contain fudged pivots, so those are only reused in that same mode.
+ * CLALL, Memory Clear, loading state, and core_cleanup() drop the cache
+ * through lu_cache_clear(), so it doesn't keep a matrix alive after
+ * everything else has let go of it.
+ */
+
+static vartype *lu_cache_src = NULL;
+static vartype *lu_cache_lu;
+static int4 *lu_cache_perm;
+static phloat lu_cache_det_re, lu_cache_det_im;
+static bool lu_cache_exact;
+
+/* The matrix currently being decomposed, for lu_cache_store() */
+static const vartype *lu_cache_pending;
+
+static void *matrix_array(const vartype *m) {
+    if (m->type == TYPE_REALMATRIX)
+        return ((vartype_realmatrix *) m)->array;
+    else
+        return ((vartype_complexmatrix *) m)->array;
+}
+
+void lu_cache_clear() {
+    if (lu_cache_src == NULL)
+        return;
+    free_vartype(lu_cache_src);
+    free_vartype(lu_cache_lu);
+    free(lu_cache_perm);
+    lu_cache_src = NULL;
+}
+
+/* Returns true if the cache holds the decomposition of 'm'. If 'exact' is
+ * true, decompositions with fudged zero pivots don't count.
+ */
+static bool lu_cache_lookup(const vartype *m, bool exact) {
+    lu_cache_pending = m;
+    if (lu_cache_src != NULL
+            && lu_cache_src->type == m->type
+            && matrix_array(lu_cache_src) == matrix_array(m)
+            && (lu_cache_exact || !exact))
+        return true;
+    /* Not the matrix we have cached; get rid of the old decomposition now,
+     * before we start allocating memory for the new one.
+     */
+    lu_cache_clear();
+    return false;
+}
+
+static void lu_cache_store(vartype *lu, int4 *perm,
+                                    phloat det_re, phloat det_im) {
+    if (lu == lu_cache_lu && lu_cache_src != NULL)
+        return;
+    /* The decomposition of a singular complex matrix is not complete
+     * when the 'singular matrix' error mode is on; see lu_decomp_c().
+     */
+    if (det_re == 0 && det_im == 0)
+        return;
+    vartype *src = dup_vartype(lu_cache_pending);
+    if (src == NULL)
+        return;
+    lu_cache_clear();
+    lu_cache_src = src;
+    lu_cache_lu = lu;
+    lu_cache_perm = perm;
+    lu_cache_det_re = det_re;
+    lu_cache_det_im = det_im;
+    lu_cache_exact = core_settings.matrix_singularmatrix;
+}
+
+static void lu_cache_release(vartype *lu, int4 *perm) {
+    if (lu == lu_cache_lu && lu_cache_src != NULL)
+        return;
+    free_vartype(lu);
+    free(perm);
+}
 
 
 /**********************************/
@@ -34,6 +128,30 @@ static int (*linalg_div_completion)(int, vartype *);
 static const vartype *linalg_div_left;
 static vartype *linalg_div_result;
 
+#ifdef BCD_MATH
+/* Real systems of at least this order, with at most one right-hand side for
+ * every DIV_MIXED_RATIO unknowns, are solved by lu_solve_mixed() when
+ * core_settings.matrix_mixedprecision is set.
+ */
+#define DIV_MIXED_MIN 16
+#define DIV_MIXED_RATIO 8
+
+static const vartype *linalg_div_right;
+static bool linalg_div_decimal = false;
+
+static int div_mixed_completion(int error, vartype_realmatrix *x) {
+    if (error == ERR_NONE && x == NULL) {
+        /* The mixed-precision solver gave up; do it the slow way */
+        linalg_div_decimal = true;
+        error = linalg_div(linalg_div_left, linalg_div_right,
+                                                linalg_div_completion);
+        linalg_div_decimal = false;
+        return error;
+    }
+    return linalg_div_completion(error, (vartype *) x);
+}
+#endif
+
 static int div_rr_completion1(int error, vartype_realmatrix *a, int4 *perm,
                                     phloat det);
 static int div_rr_completion2(int error, vartype_realmatrix *a, int4 *perm,
@@ -67,6 +185,27 @@ int linalg_div(const vartype *left, const vartype *right,
                 return completion(ERR_DIMENSION_ERROR, NULL);
             if (denom->rows <= 2)
                 return small_div(left, right, completion);
+            if (lu_cache_lookup(right, core_settings.matrix_singularmatrix)) {
+                res = new_realmatrix(rows, columns);
+                if (res == NULL)
+                    return completion(ERR_INSUFFICIENT_MEMORY, NULL);
+                linalg_div_completion = completion;
+                linalg_div_left = left;
+                linalg_div_result = res;
+                return div_rr_completion1(ERR_NONE,
+                            (vartype_realmatrix *) lu_cache_lu, lu_cache_perm,
+                            lu_cache_det_re);
+            }
+            #ifdef BCD_MATH
+                if (core_settings.matrix_mixedprecision && !linalg_div_decimal
+                        && rows >= DIV_MIXED_MIN
+                        && (int8) columns * DIV_MIXED_RATIO <= rows) {
+                    linalg_div_completion = completion;
+                    linalg_div_left = left;
+                    linalg_div_right = right;
+                    return lu_solve_mixed(denom, num, div_mixed_completion);
+                }
+            #endif
             perm = (int4 *) malloc(rows * sizeof(int4));
             if (perm == NULL)
                 return completion(ERR_INSUFFICIENT_MEMORY, NULL);
@@ -98,6 +237,17 @@ int linalg_div(const vartype *left, const vartype *right,
                 return completion(ERR_DIMENSION_ERROR, NULL);
             if (denom->rows <= 2)
                 return small_div(left, right, completion);
+            if (lu_cache_lookup(right, core_settings.matrix_singularmatrix)) {
+                res = new_complexmatrix(rows, columns);
+                if (res == NULL)
+                    return completion(ERR_INSUFFICIENT_MEMORY, NULL);
+                linalg_div_completion = completion;
+                linalg_div_left = left;
+                linalg_div_result = res;
+                return div_rc_completion1(ERR_NONE,
+                            (vartype_complexmatrix *) lu_cache_lu, lu_cache_perm,
+                            lu_cache_det_re, lu_cache_det_im);
+            }
             perm = (int4 *) malloc(rows * sizeof(int4));
             if (perm == NULL)
                 return completion(ERR_INSUFFICIENT_MEMORY, NULL);
@@ -131,6 +281,17 @@ int linalg_div(const vartype *left, const vartype *right,
                 return completion(ERR_DIMENSION_ERROR, 0);
             if (denom->rows <= 2)
                 return small_div(left, right, completion);
+            if (lu_cache_lookup(right, core_settings.matrix_singularmatrix)) {
+                res = new_complexmatrix(rows, columns);
+                if (res == NULL)
+                    return completion(ERR_INSUFFICIENT_MEMORY, NULL);
+                linalg_div_completion = completion;
+                linalg_div_left = left;
+                linalg_div_result = res;
+                return div_cr_completion1(ERR_NONE,
+                            (vartype_realmatrix *) lu_cache_lu, lu_cache_perm,
+                            lu_cache_det_re);
+            }
             perm = (int4 *) malloc(rows * sizeof(int4));
             if (perm == NULL)
                 return completion(ERR_INSUFFICIENT_MEMORY, NULL);
@@ -162,6 +323,17 @@ int linalg_div(const vartype *left, const vartype *right,
                 return completion(ERR_DIMENSION_ERROR, NULL);
             if (denom->rows <= 2)
                 return small_div(left, right, completion);
+            if (lu_cache_lookup(right, core_settings.matrix_singularmatrix)) {
+                res = new_complexmatrix(rows, columns);
+                if (res == NULL)
+                    return completion(ERR_INSUFFICIENT_MEMORY, NULL);
+                linalg_div_completion = completion;
+                linalg_div_left = left;
+                linalg_div_result = res;
+                return div_cc_completion1(ERR_NONE,
+                            (vartype_complexmatrix *) lu_cache_lu, lu_cache_perm,
+                            lu_cache_det_re, lu_cache_det_im);
+            }
             perm = (int4 *) malloc(rows * sizeof(int4));
             if (perm == NULL)
                 return completion(ERR_INSUFFICIENT_MEMORY, NULL);
@@ -189,11 +361,11 @@ int linalg_div(const vartype *left, const vartype *right,
 static int div_rr_completion1(int error, vartype_realmatrix *a, int4 *perm,
                                          phloat det) {
     if (error != ERR_NONE) {
-        free_vartype((vartype *) a);
-        free(perm);
+        lu_cache_release((vartype *) a, perm);
         free_vartype(linalg_div_result);
         return error;
     } else {
+        lu_cache_store((vartype *) a, perm, det, 0);
         matrix_copy(linalg_div_result, linalg_div_left);
         return lu_backsubst_rr(a, perm,
                                 (vartype_realmatrix *) linalg_div_result,
@@ -205,19 +377,18 @@ static int div_rr_completion2(int error, vartype_realmatrix *a, int4 *perm,
                                           vartype_realmatrix *b) {
     if (error != ERR_NONE)
         free_vartype(linalg_div_result); /* Note: linalg_div_result == b */
-    free_vartype((vartype *) a);
-    free(perm);
+    lu_cache_release((vartype *) a, perm);
     return linalg_div_completion(error, linalg_div_result);
 }
 
 static int div_rc_completion1(int error, vartype_complexmatrix *a, int4 *perm,
                                          phloat det_re, phloat det_im) {
     if (error != ERR_NONE) {
-        free_vartype((vartype *) a);
-        free(perm);
+        lu_cache_release((vartype *) a, perm);
         free_vartype(linalg_div_result);
         return error;
     } else {
+        lu_cache_store((vartype *) a, perm, det_re, det_im);
         matrix_copy(linalg_div_result, linalg_div_left);
         return lu_backsubst_cc(a, perm,
                                 (vartype_complexmatrix *) linalg_div_result,
@@ -229,19 +400,18 @@ static int div_rc_completion2(int error, vartype_complexmatrix *a, int4 *perm,
                                           vartype_complexmatrix *b) {
     if (error != ERR_NONE)
         free_vartype(linalg_div_result); /* Note: linalg_div_result == b */
-    free_vartype((vartype *) a);
-    free(perm);
+    lu_cache_release((vartype *) a, perm);
     return linalg_div_completion(error, linalg_div_result);
 }
 
 static int div_cr_completion1(int error, vartype_realmatrix *a, int4 *perm,
                                     phloat det) {
     if (error != ERR_NONE) {
-        free_vartype((vartype *) a);
-        free(perm);
+        lu_cache_release((vartype *) a, perm);
         free_vartype(linalg_div_result);
         return error;
     } else {
+        lu_cache_store((vartype *) a, perm, det, 0);
         matrix_copy(linalg_div_result, linalg_div_left);
         return lu_backsubst_rc(a, perm,
                                 (vartype_complexmatrix *) linalg_div_result,
@@ -253,19 +423,18 @@ static int div_cr_completion2(int error, vartype_realmatrix *a, int4 *perm,
                                     vartype_complexmatrix *b) {
     if (error != ERR_NONE)
         free_vartype(linalg_div_result); /* Note: linalg_div_result == b */
-    free_vartype((vartype *) a);
-    free(perm);
+    lu_cache_release((vartype *) a, perm);
     return linalg_div_completion(error, linalg_div_result);
 }
 
 static int div_cc_completion1(int error, vartype_complexmatrix *a, int4 *perm,
                                     phloat det_re, phloat det_im) {
     if (error != ERR_NONE) {
-        free_vartype((vartype *) a);
-        free(perm);
+        lu_cache_release((vartype *) a, perm);
         free_vartype(linalg_div_result);
         return error;
     } else {
+        lu_cache_store((vartype *) a, perm, det_re, det_im);
         matrix_copy(linalg_div_result, linalg_div_left);
         return lu_backsubst_cc(a, perm,
                                 (vartype_complexmatrix *) linalg_div_result,
@@ -277,8 +446,7 @@ static int div_cc_completion2(int error, vartype_complexmatrix *a, int4 *perm,
                                     vartype_complexmatrix *b) {
     if (error != ERR_NONE)
         free_vartype(linalg_div_result); /* Note: linalg_div_result == b */
-    free_vartype((vartype *) a);
-    free(perm);
+    lu_cache_release((vartype *) a, perm);
     return linalg_div_completion(error, linalg_div_result);
 }
 
@@ -330,651 +498,393 @@ static int small_div(const vartype *left, const vartype *right, int (*completion
 /***** Matrix-matrix multiplication *****/
 /****************************************/
 
-struct mul_rr_data_struct {
-    vartype_realmatrix *left;
-    vartype_realmatrix *right;
+/* Matrix multiplication is done in blocks, so that the parts of the
+ * multiplicands being worked on fit in the CPU's L1 cache. The product is
+ * computed as a sum of products of submatrices of at most bs x bs
+ * elements, which are first copied into contiguous caches, with the
+ * right-hand block transposed, so that the inner loops run over
+ * consecutive elements of both. The sum for each element is still
+ * accumulated in order of increasing k, so the results are identical to
+ * those of the straightforward i, j, k algorithm.
+ * With block sizes of around 45, I have observed a speed-up factor of circa
+ * 1.7 on a Pentium MMX, and with block sizes of about 90, I have observed a
+ * speed-up factor of circa 3 on a Duron, so the optimum block size depends
+ * on the host; it is determined once, by calibrate_matrix_block_size(),
+ * which core_init() calls when core_settings.matrix_block_size hasn't been
+ * set yet. MUL_BLOCK is only used if that setting is out of range.
+ * Large products are computed in panels of rows, and the rows of each panel
+ * are divided among worker threads, each with its own caches; see
+ * linalg_parallel(). MUL_SLICE and MUL_PANEL are only the initial amounts
+ * of work per slice; linalg_slice_adjust() tunes them to the host.
+ */
+
+#define MUL_SLICE 1000
+#ifdef BCD_MATH
+#define MUL_BLOCK 32
+#else
+#define MUL_BLOCK 64
+#endif
+#define MUL_PAR_MIN 262144
+#define MUL_PANEL 262144
+
+struct mul_data_struct {
+    const phloat *l, *r;
+    bool lc, rc;
     vartype *result;
-    int4 i, j, k;
-    phloat sum;
+    phloat *p;
+    int4 m, n, q;
+    int4 bs, kb;
+    int4 i, j, k, ii;
+    bool par;
+    int4 slice;
+    phloat *lcache, *rcache;
     int (*completion)(int error, vartype *result);
 };
 
-static mul_rr_data_struct *mul_rr_data;
-
-static int matrix_mul_rr_worker(bool interrupted);
-
-static int matrix_mul_rr(vartype_realmatrix *left, vartype_realmatrix *right,
-                         int (*completion)(int, vartype *)) {
-
-    mul_rr_data_struct *dat;
-    int error;
-
-    if (left->columns != right->rows) {
-        error = ERR_DIMENSION_ERROR;
-        goto finished;
-    }
-
-    if (contains_strings(left) || contains_strings(right)) {
-        error = ERR_ALPHA_DATA_IS_INVALID;
-        goto finished;
-    }
-
-    dat = (mul_rr_data_struct *) malloc(sizeof(mul_rr_data_struct));
-    if (dat == NULL) {
-        error = ERR_INSUFFICIENT_MEMORY;
-        goto finished;
-    }
-
-    dat->result = new_realmatrix(left->rows, right->columns);
-    if (dat->result == NULL) {
-        free(dat);
-        error = ERR_INSUFFICIENT_MEMORY;
-        goto finished;
-    }
-
-    dat->left = left;
-    dat->right = right;
+static mul_data_struct *mul_data;
+
+static mul_data_struct *new_mul_data(const phloat *l, bool lc, const phloat *r, bool rc,
+                                     int4 m, int4 n, int4 q, vartype *result, int4 bs) {
+    mul_data_struct *dat = (mul_data_struct *) malloc(sizeof(mul_data_struct));
+    if (dat == NULL)
+        return NULL;
+    dat->l = l;
+    dat->r = r;
+    dat->lc = lc;
+    dat->rc = rc;
+    dat->result = result;
+    if (result == NULL)
+        dat->p = NULL;
+    else if (result->type == TYPE_COMPLEXMATRIX)
+        dat->p = ((vartype_complexmatrix *) result)->array->data;
+    else
+        dat->p = ((vartype_realmatrix *) result)->array->data;
+    dat->m = m;
+    dat->n = n;
+    dat->q = q;
+    dat->bs = bs;
+    dat->kb = q < bs ? q : bs;
     dat->i = 0;
     dat->j = 0;
     dat->k = 0;
-    dat->sum = 0;
-    dat->completion = completion;
-
-    mul_rr_data = dat;
-    mode_interruptible = matrix_mul_rr_worker;
-    mode_stoppable = false;
-    return ERR_INTERRUPTIBLE;
+    dat->ii = 0;
+    dat->par = false;
+    int4 lrows = m < bs ? m : bs;
+    int4 rcols = n < bs ? n : bs;
+    dat->lcache = (phloat *) malloc(lrows * dat->kb * (lc ? 2 : 1) * sizeof(phloat));
+    dat->rcache = (phloat *) malloc(rcols * dat->kb * (rc ? 2 : 1) * sizeof(phloat));
+    if (dat->lcache == NULL || dat->rcache == NULL) {
+        free(dat->lcache);
+        free(dat->rcache);
+        free(dat);
+        return NULL;
+    }
+    return dat;
+}
 
-    finished:
-    return completion(error, NULL);
+static void free_mul_data(mul_data_struct *dat) {
+    free(dat->lcache);
+    free(dat->rcache);
+    free(dat);
 }
 
-static int matrix_mul_rr_worker(bool interrupted) {
-    mul_rr_data_struct *dat = mul_rr_data;
-    int count = 0;
-    int inf;
-    phloat *l = dat->left->array->data;
-    phloat *r = dat->right->array->data;
-    phloat *p = ((vartype_realmatrix *) dat->result)->array->data;
-    int4 i = dat->i;
-    int4 j = dat->j;
-    int4 k = dat->k;
-    int4 m = dat->left->rows;
-    int4 n = dat->right->columns;
-    int4 q = dat->left->columns;
-    phloat sum = dat->sum;
-
-    if (interrupted) {
-        int err = dat->completion(ERR_INTERRUPTED, NULL);
-        free_vartype(dat->result);
-        free(dat);
-        return err;
+static void mul_fill_caches(mul_data_struct *dat) {
+    int lw = dat->lc ? 2 : 1;
+    int rw = dat->rc ? 2 : 1;
+    int4 bs = dat->bs, kb = dat->kb;
+    int4 iimax = dat->m - dat->i < bs ? dat->m - dat->i : bs;
+    int4 jjmax = dat->n - dat->j < bs ? dat->n - dat->j : bs;
+    int4 kkmax = dat->q - dat->k < bs ? dat->q - dat->k : bs;
+    for (int4 ii = 0; ii < iimax; ii++) {
+        const phloat *src = dat->l + ((dat->i + ii) * dat->q + dat->k) * lw;
+        phloat *dst = dat->lcache + ii * kb * lw;
+        for (int4 kk = 0; kk < kkmax * lw; kk++)
+            dst[kk] = src[kk];
     }
-
-    while (count++ < 1000) {
-        sum += l[i * q + k] * r[k * n + j];
-        if (++k < q)
-            continue;
-        k = 0;
-        if ((inf = p_isinf(sum)) != 0) {
-            if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
-                int err = dat->completion(ERR_OUT_OF_RANGE, NULL);
-                free_vartype(dat->result);
-                free(dat);
-                return err;
-            } else
-                sum = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
-        }
-        p[i * n + j] = sum;
-        sum = 0;
-        if (++j < n)
-            continue;
-        j = 0;
-        if (++i < m)
-            continue;
-        else {
-            int err = dat->completion(ERR_NONE, dat->result);
-            free(dat);
-            return err;
+    for (int4 jj = 0; jj < jjmax; jj++) {
+        phloat *dst = dat->rcache + jj * kb * rw;
+        for (int4 kk = 0; kk < kkmax; kk++) {
+            const phloat *src = dat->r + ((dat->k + kk) * dat->n + dat->j + jj) * rw;
+            dst[kk * rw] = src[0];
+            if (rw == 2)
+                dst[kk * 2 + 1] = src[1];
         }
     }
-
-    dat->i = i;
-    dat->j = j;
-    dat->k = k;
-    dat->sum = sum;
-    return ERR_INTERRUPTIBLE;
 }
 
-#if 0
-/* TODO: Blocked matrix multiplication
- * This commented-out function implements a working blocked matrix
- * multiplication algorithm. It works by breaking up the multiplication into
- * multiplications of submatrices of the multiplicands. If the submatrices are
- * sufficiently small, they can be made to fit entirely in the CPU's L1 cache.
- * With block sizes of around 45, I have observed a speed-up factor of circa
- * 1.7 on a Pentium MMX, and with block sizes of about 90, I have observed a
- * speed-up factor of circa 3 on a Duron. (Those were the optimum block sizes
- * observed for each processor.) These numbers suggest the Pentium MMX has a 32
- * kilobyte L1 cache, and the Duron has a 128 kilobyte L1 cache.
- * For production use, the block size should be a user-configurable parameter,
- * with a built-in tool to automatically determine the optimum value. Since the
- * UI for this kind of advanced configuration does not exist yet, and sice the
- * determination of optimum block size is a very slow process, and since I
- * expect most HP-42S users will not be very interested in using a calculator
- * to work with order-100+ matrices, and since even in the optimum case the
- * speed-up is not staggering, I'm putting full implementation of this feature
- * off until some later date.
+/* Handles overflow in a finished element of the product; returns false if
+ * it should be reported as an error.
  */
-static int matrix_mul_rr(vartype_realmatrix *left, vartype_realmatrix *right,
-                         vartype **result) {
-    phloat *cache = NULL;
-    phloat *leftcache, *rightcache;
-
-    phloat *l = left->array->data;
-    phloat *r = right->array->data;
-    phloat *p;
-    int inf;
-    int4 m, n, q;
-    int4 i, j, k;
-
-    q = left->columns;
-    if (q != right->rows)
-        return ERR_DIMENSION_ERROR;
-    m = left->rows;
-    n = right->columns;
-
-    if (contains_strings(left) || contains_strings(right))
-        return ERR_ALPHA_DATA_IS_INVALID;
-
-    *result = new_realmatrix(m, n);
-    if (*result == NULL)
-        return ERR_INSUFFICIENT_MEMORY;
-    p = ((vartype_realmatrix *) *result)->array->data;
-
-    if (BLOCK_SIZE > 0) {
-        int4 cachesize = 2 * BLOCK_SIZE * BLOCK_SIZE;
-        int4 alignment = CACHE_ALIGNMENT;
-        int4 misalgn;
-        if (alignment == 0)
-            alignment = 1;
-        misalgn = alignment % sizeof(phloat);
-        if (misalgn != 0)
-            alignment += sizeof(phloat) - misalgn;
-
-        cache = (phloat *) malloc(cachesize * sizeof(phloat) + alignment);
-        if (cache != NULL) {
-            misalgn = ((unsigned long) cache) % alignment;
-            if (misalgn == 0)
-                leftcache = cache;
-            else
-                leftcache = cache + (alignment - misalgn) / sizeof(phloat);
-            rightcache = leftcache + BLOCK_SIZE * BLOCK_SIZE;
-        }
-    }
+static bool mul_range(phloat *x) {
+    int inf = p_isinf(*x);
+    if (inf == 0)
+        return true;
+    if (core_settings.matrix_outofrange && !flags.f.range_error_ignore)
+        return false;
+    *x = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
+    return true;
+}
 
-    if (cache == NULL) {
-
-        /* Falling back on basic i,j,k algorithm */
-        for (i = 0; i < m; i++)
-            for (j = 0; j < n; j++) {
-                phloat sum = 0;
-                for (k = 0; k < q; k++)
-                    sum += l[i * q + k] * r[k * n + j];
-                if ((inf = p_isinf(sum)) != 0) {
-                    if (core_settings.matrix_outofrange
-                                            && !flags.f.range_error_ignore)
-                        return ERR_OUT_OF_RANGE;
-                    else
-                        sum = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
-                }
-                p[i * n + j] = sum;
+/* Perform about 'budget' multiply-adds, one block row at a time. Returns
+ * ERR_INTERRUPTIBLE if there's more to do, ERR_NONE when finished, or
+ * ERR_OUT_OF_RANGE.
+ */
+static int mul_slice(mul_data_struct *dat, int4 budget) {
+    int4 bs = dat->bs, kb = dat->kb;
+    int4 m = dat->m, n = dat->n, q = dat->q;
+    int lw = dat->lc ? 2 : 1;
+    int rw = dat->rc ? 2 : 1;
+    int pw = dat->lc || dat->rc ? 2 : 1;
+    phloat *p = dat->p;
+    int4 count = 0;
+
+    while (count < budget) {
+        int4 i = dat->i, j = dat->j, k = dat->k;
+        int4 iimax = m - i < bs ? m - i : bs;
+        int4 jjmax = n - j < bs ? n - j : bs;
+        int4 kkmax = q - k < bs ? q - k : bs;
+        bool last = k + kkmax == q;
+        if (dat->ii == 0)
+            mul_fill_caches(dat);
+        phloat *lrow = dat->lcache + dat->ii * kb * lw;
+        phloat *dst = p + ((i + dat->ii) * n + j) * pw;
+
+        if (!dat->lc && !dat->rc) {
+            for (int4 jj = 0; jj < jjmax; jj++) {
+                phloat *rcol = dat->rcache + jj * kb;
+                phloat sum = k == 0 ? phloat(0) : dst[jj];
+                #ifdef BCD_MATH
+                    sum = dot_fma(lrow, rcol, kkmax, sum);
+                #else
+                    for (int4 kk = 0; kk < kkmax; kk++)
+                        sum += lrow[kk] * rcol[kk];
+                #endif
+                if (last && !mul_range(&sum))
+                    return ERR_OUT_OF_RANGE;
+                dst[jj] = sum;
             }
-        return ERR_NONE;
-
-    } else {
-
-        /* Blocked i,j,k algorithm for optimal cache utilization */
-        int4 i, j, k, ii, jj, kk;
-        for (i = 0; i < m; i += BLOCK_SIZE) {
-            int4 iimax = m - i;
-            if (iimax > BLOCK_SIZE)
-                iimax = BLOCK_SIZE;
-            for (j = 0; j < n; j += BLOCK_SIZE) {
-                int4 jjmax = n - j;
-                if (jjmax > BLOCK_SIZE)
-                    jjmax = BLOCK_SIZE;
-                for (k = 0; k < q; k += BLOCK_SIZE) {
-                    int4 kkmax = q - k;
-                    if (kkmax > BLOCK_SIZE)
-                        kkmax = BLOCK_SIZE;
-                    for (ii = 0; ii < iimax; ii++)
-                        for (kk = 0; kk < kkmax; kk++)
-                            leftcache[ii * BLOCK_SIZE + kk]
-                                = l[(ii + i) * q + (kk + k)];
-                    for (kk = 0; kk < kkmax; kk++)
-                        for (jj = 0; jj < jjmax; jj++)
-                            rightcache[kk * BLOCK_SIZE + jj]
-                                = r[(kk + k) * n + (jj + j)];
-                    for (ii = 0; ii < iimax; ii++)
-                        for (jj = 0; jj < jjmax; jj++) {
-                            phloat sum = p[(ii + i) * n + (jj + j)];
-                            for (kk = 0; kk < kkmax; kk++)
-                                sum += leftcache[ii * BLOCK_SIZE + kk]
-                                        * rightcache[kk * BLOCK_SIZE + jj];
-                            if ((inf = p_isinf(sum)) != 0) {
-                                if (core_settings.matrix_outofrange
-                                            && !flags.f.range_error_ignore) {
-                                    free(cache);
-                                    return ERR_OUT_OF_RANGE;
-                                } else
-                                    sum = inf < 0 ? NEG_HUGE_PHLOAT
-                                                  : POS_HUGE_PHLOAT;
-                            }
-                            p[(ii + i) * n + (jj + j)] = sum;
-                        }
+        } else {
+            for (int4 jj = 0; jj < jjmax; jj++) {
+                phloat *rcol = dat->rcache + jj * kb * rw;
+                phloat sum_re = k == 0 ? phloat(0) : dst[2 * jj];
+                phloat sum_im = k == 0 ? phloat(0) : dst[2 * jj + 1];
+                if (!dat->lc) {
+                    for (int4 kk = 0; kk < kkmax; kk++) {
+                        phloat tmp = lrow[kk];
+                        sum_re += tmp * rcol[2 * kk];
+                        sum_im += tmp * rcol[2 * kk + 1];
+                    }
+                } else if (!dat->rc) {
+                    for (int4 kk = 0; kk < kkmax; kk++) {
+                        phloat tmp = rcol[kk];
+                        sum_re += tmp * lrow[2 * kk];
+                        sum_im += tmp * lrow[2 * kk + 1];
+                    }
+                } else {
+                    for (int4 kk = 0; kk < kkmax; kk++) {
+                        phloat l_re = lrow[2 * kk];
+                        phloat l_im = lrow[2 * kk + 1];
+                        phloat r_re = rcol[2 * kk];
+                        phloat r_im = rcol[2 * kk + 1];
+                        sum_re += l_re * r_re - l_im * r_im;
+                        sum_im += l_im * r_re + l_re * r_im;
+                    }
                 }
+                if (last && (!mul_range(&sum_re) || !mul_range(&sum_im)))
+                    return ERR_OUT_OF_RANGE;
+                dst[2 * jj] = sum_re;
+                dst[2 * jj + 1] = sum_im;
             }
         }
-        free(cache);
-        return ERR_NONE;
-
-    }
-}
-#endif
-
-struct mul_rc_data_struct {
-    vartype_realmatrix *left;
-    vartype_complexmatrix *right;
-    vartype *result;
-    int4 i, j, k;
-    phloat sum_re, sum_im;
-    int (*completion)(int error, vartype *result);
-};
 
-static mul_rc_data_struct *mul_rc_data;
-
-static int matrix_mul_rc_worker(bool interrupted);
-
-static int matrix_mul_rc(vartype_realmatrix *left, vartype_complexmatrix *right,
-                         int (*completion)(int, vartype *)) {
-
-    mul_rc_data_struct *dat;
-    int error;
-
-    if (left->columns != right->rows) {
-        error = ERR_DIMENSION_ERROR;
-        goto finished;
-    }
-
-    if (contains_strings(left)) {
-        error = ERR_ALPHA_DATA_IS_INVALID;
-        goto finished;
-    }
-
-    dat = (mul_rc_data_struct *) malloc(sizeof(mul_rc_data_struct));
-    if (dat == NULL) {
-        error = ERR_INSUFFICIENT_MEMORY;
-        goto finished;
-    }
-
-    dat->result = new_complexmatrix(left->rows, right->columns);
-    if (dat->result == NULL) {
-        free(dat);
-        error = ERR_INSUFFICIENT_MEMORY;
-        goto finished;
+        count += jjmax * kkmax;
+        if (++dat->ii < iimax)
+            continue;
+        dat->ii = 0;
+        if ((dat->k += bs) < q)
+            continue;
+        dat->k = 0;
+        if ((dat->j += bs) < n)
+            continue;
+        dat->j = 0;
+        if ((dat->i += bs) < m)
+            continue;
+        return ERR_NONE;
     }
-
-    dat->left = left;
-    dat->right = right;
-    dat->i = 0;
-    dat->j = 0;
-    dat->k = 0;
-    dat->sum_re = 0;
-    dat->sum_im = 0;
-    dat->completion = completion;
-
-    mul_rc_data = dat;
-    mode_interruptible = matrix_mul_rc_worker;
-    mode_stoppable = false;
     return ERR_INTERRUPTIBLE;
-
-    finished:
-    return completion(error, NULL);
 }
 
-static int matrix_mul_rc_worker(bool interrupted) {
-    mul_rc_data_struct *dat = mul_rc_data;
-    int count = 0;
-    int inf;
-    phloat *l = dat->left->array->data;
-    phloat *r = dat->right->array->data;
-    phloat *p = ((vartype_complexmatrix *) dat->result)->array->data;
-    int4 i = dat->i;
-    int4 j = dat->j;
-    int4 k = dat->k;
-    int4 m = dat->left->rows;
-    int4 n = dat->right->columns;
-    int4 q = dat->left->columns;
-    phloat sum_re = dat->sum_re;
-    phloat sum_im = dat->sum_im;
-
-    if (interrupted) {
-        int err = dat->completion(ERR_INTERRUPTED, NULL);
-        free_vartype(dat->result);
-        free(dat);
-        return err;
+/* Find the block size that gives the fastest multiplication on this host,
+ * by timing the multiplication of two square matrices with a few
+ * candidate sizes, and store it in core_settings.
+ */
+void calibrate_matrix_block_size() {
+    static const int4 candidates[] = { 16, 24, 32, 48, 64, 96, 128 };
+    #ifdef BCD_MATH
+        const int4 size = 64;
+    #else
+        const int4 size = 192;
+    #endif
+    int4 best = MUL_BLOCK;
+    vartype_realmatrix *a = (vartype_realmatrix *) new_realmatrix(size, size);
+    vartype_realmatrix *b = (vartype_realmatrix *) new_realmatrix(size, size);
+    vartype *c = new_realmatrix(size, size);
+    if (a == NULL || b == NULL || c == NULL)
+        goto done;
+    for (int4 i = 0; i < size * size; i++) {
+        a->array->data[i] = i % 7 - 3;
+        b->array->data[i] = i % 5 - 2;
     }
-
-    while (count++ < 1000) {
-        phloat tmp = l[i * q + k];
-        sum_re += tmp * r[2 * (k * n + j)];
-        sum_im += tmp * r[2 * (k * n + j) + 1];
-        if (++k < q)
-            continue;
-        k = 0;
-        if ((inf = p_isinf(sum_re)) != 0) {
-            if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
-                int err = dat->completion(ERR_OUT_OF_RANGE, NULL);
-                free_vartype(dat->result);
-                free(dat);
-                return err;
-            } else
-                sum_re = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
-        }
-        if ((inf = p_isinf(sum_im)) != 0) {
-            if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
-                int err = dat->completion(ERR_OUT_OF_RANGE, NULL);
-                free_vartype(dat->result);
-                free(dat);
-                return err;
-            } else
-                sum_im = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
-        }
-        p[2 * (i * n + j)] = sum_re;
-        p[2 * (i * n + j) + 1] = sum_im;
-        sum_re = 0;
-        sum_im = 0;
-        if (++j < n)
-            continue;
-        j = 0;
-        if (++i < m)
-            continue;
-        else {
-            int err = dat->completion(ERR_NONE, dat->result);
-            free(dat);
-            return err;
+    {
+        double best_time = 0;
+        for (size_t n = 0; n < sizeof(candidates) / sizeof(int4); n++) {
+            int4 bs = candidates[n];
+            if (bs > size)
+                break;
+            mul_data_struct *dat = new_mul_data(a->array->data, false, b->array->data, false,
+                                                size, size, size, c, bs);
+            if (dat == NULL)
+                break;
+            uint4 start = shell_milliseconds();
+            uint4 elapsed;
+            int reps = 0;
+            do {
+                dat->i = dat->j = dat->k = dat->ii = 0;
+                mul_slice(dat, 0x7fffffff);
+                reps++;
+                elapsed = shell_milliseconds() - start;
+            } while (elapsed < 10);
+            free_mul_data(dat);
+            double t = (double) elapsed / reps;
+            if (best_time == 0 || t < best_time) {
+                best_time = t;
+                best = bs;
+            }
         }
     }
-
-    dat->i = i;
-    dat->j = j;
-    dat->k = k;
-    dat->sum_re = sum_re;
-    dat->sum_im = sum_im;
-    return ERR_INTERRUPTIBLE;
+    done:
+    free_vartype((vartype *) a);
+    free_vartype((vartype *) b);
+    free_vartype(c);
+    core_settings.matrix_block_size = best;
 }
 
-struct mul_cr_data_struct {
-    vartype_complexmatrix *left;
-    vartype_realmatrix *right;
-    vartype *result;
-    int4 i, j, k;
-    phloat sum_re, sum_im;
-    int (*completion)(int error, vartype *result);
-};
-
-static mul_cr_data_struct *mul_cr_data;
-
-static int matrix_mul_cr_worker(bool interrupted);
+/* Compute rows from..to-1 of the current panel, which starts at row dat->i;
+ * called by linalg_parallel().
+ */
+static int mul_rows(void *ctx, int4 from, int4 to) {
+    mul_data_struct *dat = (mul_data_struct *) ctx;
+    int lw = dat->lc ? 2 : 1;
+    int pw = dat->lc || dat->rc ? 2 : 1;
+    int4 row = dat->i + from;
+    mul_data_struct *sub = new_mul_data(dat->l + row * dat->q * lw, dat->lc,
+                                        dat->r, dat->rc, to - from,
+                                        dat->n, dat->q, NULL, dat->bs);
+    if (sub == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    sub->p = dat->p + row * dat->n * pw;
+    int err = mul_slice(sub, 0x7fffffff);
+    free_mul_data(sub);
+    return err;
+}
 
-static int matrix_mul_cr(vartype_complexmatrix *left, vartype_realmatrix *right,
-                         int (*completion)(int, vartype *)) {
+static int mul_panel(mul_data_struct *dat) {
+    int w = dat->lc || dat->rc ? (dat->lc && dat->rc ? 4 : 2) : 1;
+    int4 rows = (int4) ((int8) dat->slice * linalg_threads()
+                                / ((int8) dat->n * dat->q * w));
+    if (rows < 1)
+        rows = 1;
+    if (rows > dat->m - dat->i)
+        rows = dat->m - dat->i;
+    int err = linalg_parallel(rows, 1, mul_rows, dat);
+    if (err != ERR_NONE)
+        return err;
+    dat->i += rows;
+    return dat->i < dat->m ? ERR_INTERRUPTIBLE : ERR_NONE;
+}
 
-    mul_cr_data_struct *dat;
-    int error;
+static int matrix_mul_worker(bool interrupted);
 
-    if (left->columns != right->rows) {
-        error = ERR_DIMENSION_ERROR;
-        goto finished;
-    }
+static int matrix_mul(const phloat *l, bool lc, const phloat *r, bool rc,
+                      int4 m, int4 n, int4 q, int (*completion)(int, vartype *)) {
+    vartype *result = lc || rc ? new_complexmatrix(m, n) : new_realmatrix(m, n);
+    if (result == NULL)
+        return completion(ERR_INSUFFICIENT_MEMORY, NULL);
 
-    if (contains_strings(right)) {
-        error = ERR_ALPHA_DATA_IS_INVALID;
-        goto finished;
-    }
+    int4 bs = core_settings.matrix_block_size;
+    if (bs < 4 || bs > 1024)
+        bs = MUL_BLOCK;
 
-    dat = (mul_cr_data_struct *) malloc(sizeof(mul_cr_data_struct));
+    mul_data_struct *dat = new_mul_data(l, lc, r, rc, m, n, q, result, bs);
     if (dat == NULL) {
-        error = ERR_INSUFFICIENT_MEMORY;
-        goto finished;
-    }
-
-    dat->result = new_complexmatrix(left->rows, right->columns);
-    if (dat->result == NULL) {
-        free(dat);
-        error = ERR_INSUFFICIENT_MEMORY;
-        goto finished;
+        free_vartype(result);
+        return completion(ERR_INSUFFICIENT_MEMORY, NULL);
     }
-
-    dat->left = left;
-    dat->right = right;
-    dat->i = 0;
-    dat->j = 0;
-    dat->k = 0;
-    dat->sum_re = 0;
-    dat->sum_im = 0;
     dat->completion = completion;
+    dat->par = (int8) m * n * q >= MUL_PAR_MIN && m > 1 && linalg_threads() > 1;
+    dat->slice = dat->par ? MUL_PANEL : MUL_SLICE;
 
-    mul_cr_data = dat;
-    mode_interruptible = matrix_mul_cr_worker;
+    mul_data = dat;
+    mode_interruptible = matrix_mul_worker;
     mode_stoppable = false;
     return ERR_INTERRUPTIBLE;
-
-    finished:
-    return completion(error, NULL);
 }
 
-static int matrix_mul_cr_worker(bool interrupted) {
-    mul_cr_data_struct *dat = mul_cr_data;
-    int count = 0;
-    int inf;
-    phloat *l = dat->left->array->data;
-    phloat *r = dat->right->array->data;
-    phloat *p = ((vartype_complexmatrix *) dat->result)->array->data;
-    int4 i = dat->i;
-    int4 j = dat->j;
-    int4 k = dat->k;
-    int4 m = dat->left->rows;
-    int4 n = dat->right->columns;
-    int4 q = dat->left->columns;
-    phloat sum_re = dat->sum_re;
-    phloat sum_im = dat->sum_im;
-
-    if (interrupted) {
-        int err = dat->completion(ERR_INTERRUPTED, NULL);
-        free_vartype(dat->result);
-        free(dat);
+static int matrix_mul_worker(bool interrupted) {
+    mul_data_struct *dat = mul_data;
+    uint4 start = shell_milliseconds();
+    int err = interrupted ? ERR_INTERRUPTED
+            : dat->par ? mul_panel(dat) : mul_slice(dat, dat->slice);
+    if (err == ERR_INTERRUPTIBLE) {
+        linalg_slice_adjust(&dat->slice, start);
         return err;
     }
-
-    while (count++ < 1000) {
-        phloat tmp = r[k * n + j];
-        sum_re += tmp * l[2 * (i * q + k)];
-        sum_im += tmp * l[2 * (i * q + k) + 1];
-        if (++k < q)
-            continue;
-        k = 0;
-        if ((inf = p_isinf(sum_re)) != 0) {
-            if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
-                int err = dat->completion(ERR_OUT_OF_RANGE, NULL);
-                free_vartype(dat->result);
-                free(dat);
-                return err;
-            } else
-                sum_re = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
-        }
-        if ((inf = p_isinf(sum_im)) != 0) {
-            if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
-                int err = dat->completion(ERR_OUT_OF_RANGE, NULL);
-                free_vartype(dat->result);
-                free(dat);
-                return err;
-            } else
-                sum_im = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
-        }
-        p[2 * (i * n + j)] = sum_re;
-        p[2 * (i * n + j) + 1] = sum_im;
-        sum_re = 0;
-        sum_im = 0;
-        if (++j < n)
-            continue;
-        j = 0;
-        if (++i < m)
-            continue;
-        else {
-            int err = dat->completion(ERR_NONE, dat->result);
-            free(dat);
-            return err;
-        }
+    vartype *result = dat->result;
+    int (*completion)(int, vartype *) = dat->completion;
+    free_mul_data(dat);
+    if (err != ERR_NONE) {
+        free_vartype(result);
+        result = NULL;
     }
-
-    dat->i = i;
-    dat->j = j;
-    dat->k = k;
-    dat->sum_re = sum_re;
-    dat->sum_im = sum_im;
-    return ERR_INTERRUPTIBLE;
+    return completion(err, result);
 }
 
-struct mul_cc_data_struct {
-    vartype_complexmatrix *left;
-    vartype_complexmatrix *right;
-    vartype *result;
-    int4 i, j, k;
-    phloat sum_re, sum_im;
-    int (*completion)(int error, vartype *result);
-};
-
-static mul_cc_data_struct *mul_cc_data;
-
-static int matrix_mul_cc_worker(bool interrupted);
-
-static int matrix_mul_cc(vartype_complexmatrix *left, vartype_complexmatrix *right,
+static int matrix_mul_rr(vartype_realmatrix *left, vartype_realmatrix *right,
                          int (*completion)(int, vartype *)) {
-
-    mul_cc_data_struct *dat;
-    int error;
-
-    if (left->columns != right->rows) {
-        error = ERR_DIMENSION_ERROR;
-        goto finished;
-    }
-
-    dat = (mul_cc_data_struct *) malloc(sizeof(mul_cc_data_struct));
-    if (dat == NULL) {
-        error = ERR_INSUFFICIENT_MEMORY;
-        goto finished;
-    }
-
-    dat->result = new_complexmatrix(left->rows, right->columns);
-    if (dat->result == NULL) {
-        free(dat);
-        error = ERR_INSUFFICIENT_MEMORY;
-        goto finished;
-    }
-
-    dat->left = left;
-    dat->right = right;
-    dat->i = 0;
-    dat->j = 0;
-    dat->k = 0;
-    dat->sum_re = 0;
-    dat->sum_im = 0;
-    dat->completion = completion;
-
-    mul_cc_data = dat;
-    mode_interruptible = matrix_mul_cc_worker;
-    mode_stoppable = false;
-    return ERR_INTERRUPTIBLE;
-
-    finished:
-    return completion(error, NULL);
+    if (left->columns != right->rows)
+        return completion(ERR_DIMENSION_ERROR, NULL);
+    if (contains_strings(left) || contains_strings(right))
+        return completion(ERR_ALPHA_DATA_IS_INVALID, NULL);
+    return matrix_mul(left->array->data, false, right->array->data, false,
+                      left->rows, right->columns, left->columns, completion);
 }
 
-static int matrix_mul_cc_worker(bool interrupted) {
-    mul_cc_data_struct *dat = mul_cc_data;
-    int count = 0;
-    int inf;
-    phloat *l = dat->left->array->data;
-    phloat *r = dat->right->array->data;
-    phloat *p = ((vartype_complexmatrix *) dat->result)->array->data;
-    int4 i = dat->i;
-    int4 j = dat->j;
-    int4 k = dat->k;
-    int4 m = dat->left->rows;
-    int4 n = dat->right->columns;
-    int4 q = dat->left->columns;
-    phloat sum_re = dat->sum_re;
-    phloat sum_im = dat->sum_im;
-
-    if (interrupted) {
-        int err = dat->completion(ERR_INTERRUPTED, NULL);
-        free_vartype(dat->result);
-        free(dat);
-        return err;
-    }
+static int matrix_mul_rc(vartype_realmatrix *left, vartype_complexmatrix *right,
+                         int (*completion)(int, vartype *)) {
+    if (left->columns != right->rows)
+        return completion(ERR_DIMENSION_ERROR, NULL);
+    if (contains_strings(left))
+        return completion(ERR_ALPHA_DATA_IS_INVALID, NULL);
+    return matrix_mul(left->array->data, false, right->array->data, true,
+                      left->rows, right->columns, left->columns, completion);
+}
 
-    while (count++ < 1000) {
-        phloat l_re = l[2 * (i * q + k)];
-        phloat l_im = l[2 * (i * q + k) + 1];
-        phloat r_re = r[2 * (k * n + j)];
-        phloat r_im = r[2 * (k * n + j) + 1];
-        sum_re += l_re * r_re - l_im * r_im;
-        sum_im += l_im * r_re + l_re * r_im;
-        if (++k < q)
-            continue;
-        k = 0;
-        if ((inf = p_isinf(sum_re)) != 0) {
-            if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
-                int err = dat->completion(ERR_OUT_OF_RANGE, NULL);
-                free_vartype(dat->result);
-                free(dat);
-                return err;
-            } else
-                sum_re = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
-        }
-        if ((inf = p_isinf(sum_im)) != 0) {
-            if (core_settings.matrix_outofrange && !flags.f.range_error_ignore){
-                int err = dat->completion(ERR_OUT_OF_RANGE, NULL);
-                free_vartype(dat->result);
-                free(dat);
-                return err;
-            } else
-                sum_im = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
-        }
-        p[2 * (i * n + j)] = sum_re;
-        p[2 * (i * n + j) + 1] = sum_im;
-        sum_re = 0;
-        sum_im = 0;
-        if (++j < n)
-            continue;
-        j = 0;
-        if (++i < m)
-            continue;
-        else {
-            int err = dat->completion(ERR_NONE, dat->result);
-            free(dat);
-            return err;
-        }
-    }
+static int matrix_mul_cr(vartype_complexmatrix *left, vartype_realmatrix *right,
+                         int (*completion)(int, vartype *)) {
+    if (left->columns != right->rows)
+        return completion(ERR_DIMENSION_ERROR, NULL);
+    if (contains_strings(right))
+        return completion(ERR_ALPHA_DATA_IS_INVALID, NULL);
+    return matrix_mul(left->array->data, true, right->array->data, false,
+                      left->rows, right->columns, left->columns, completion);
+}
 
-    dat->i = i;
-    dat->j = j;
-    dat->k = k;
-    dat->sum_re = sum_re;
-    dat->sum_im = sum_im;
-    return ERR_INTERRUPTIBLE;
+static int matrix_mul_cc(vartype_complexmatrix *left, vartype_complexmatrix *right,
+                         int (*completion)(int, vartype *)) {
+    if (left->columns != right->rows)
+        return completion(ERR_DIMENSION_ERROR, NULL);
+    return matrix_mul(left->array->data, true, right->array->data, true,
+                      left->rows, right->columns, left->columns, completion);
 }
 
 int linalg_mul(const vartype *left, const vartype *right,
@@ -1030,6 +940,16 @@ int linalg_inv(const vartype *src, int (*completion)(int, vartype *)) {
             return completion(ERR_ALPHA_DATA_IS_INVALID, NULL);
         if (n <= 2)
             return small_inv_r(ma, completion);
+        if (lu_cache_lookup(src, core_settings.matrix_singularmatrix)) {
+            inv = new_realmatrix(n, n);
+            if (inv == NULL)
+                return completion(ERR_INSUFFICIENT_MEMORY, NULL);
+            linalg_inv_completion = completion;
+            linalg_inv_result = inv;
+            return inv_r_completion1(ERR_NONE,
+                        (vartype_realmatrix *) lu_cache_lu, lu_cache_perm,
+                        lu_cache_det_re);
+        }
         lu = new_realmatrix(n, n);
         if (lu == NULL)
             return completion(ERR_INSUFFICIENT_MEMORY, NULL);
@@ -1056,6 +976,16 @@ int linalg_inv(const vartype *src, int (*completion)(int, vartype *)) {
             return completion(ERR_DIMENSION_ERROR, NULL);
         if (n <= 2)
             return small_inv_c(ma, completion);
+        if (lu_cache_lookup(src, core_settings.matrix_singularmatrix)) {
+            inv = new_complexmatrix(n, n);
+            if (inv == NULL)
+                return completion(ERR_INSUFFICIENT_MEMORY, NULL);
+            linalg_inv_completion = completion;
+            linalg_inv_result = inv;
+            return inv_c_completion1(ERR_NONE,
+                        (vartype_complexmatrix *) lu_cache_lu, lu_cache_perm,
+                        lu_cache_det_re, lu_cache_det_im);
+        }
         lu = new_complexmatrix(n, n);
         if (lu == NULL)
             return completion(ERR_INSUFFICIENT_MEMORY, NULL);
@@ -1082,11 +1012,11 @@ static int inv_r_completion1(int error, vartype_realmatrix *a, int4 *perm,
                                 phloat det) {
     if (error != ERR_NONE) {
         free_vartype(linalg_inv_result);
-        free_vartype((vartype *) a);
-        free(perm);
+        lu_cache_release((vartype *) a, perm);
         return linalg_inv_completion(error, NULL);
     } else {
         int4 i, n = a->rows;
+        lu_cache_store((vartype *) a, perm, det, 0);
         vartype_realmatrix *inv = (vartype_realmatrix *) linalg_inv_result;
         for (i = 0; i < n; i++)
             inv->array->data[i * (n + 1)] = 1;
@@ -1098,8 +1028,7 @@ static int inv_r_completion2(int error, vartype_realmatrix *a, int4 *perm,
                                 vartype_realmatrix *b) {
     if (error != ERR_NONE)
         free_vartype(linalg_inv_result); /* Note: linalg_inv_result == b */
-    free_vartype((vartype *) a);
-    free(perm);
+    lu_cache_release((vartype *) a, perm);
     return linalg_inv_completion(error, linalg_inv_result);
 }
 
@@ -1107,11 +1036,11 @@ static int inv_c_completion1(int error, vartype_complexmatrix *a, int4 *perm,
                                 phloat det_re, phloat det_im) {
     if (error != ERR_NONE) {
         free_vartype(linalg_inv_result);
-        free_vartype((vartype *) a);
-        free(perm);
+        lu_cache_release((vartype *) a, perm);
         return linalg_inv_completion(error, NULL);
     } else {
         int4 i, n = a->rows;
+        lu_cache_store((vartype *) a, perm, det_re, det_im);
         vartype_complexmatrix *inv =
                             (vartype_complexmatrix *) linalg_inv_result;
         for (i = 0; i < n; i++)
@@ -1124,8 +1053,7 @@ static int inv_c_completion2(int error, vartype_complexmatrix *a, int4 *perm,
                                 vartype_complexmatrix *b) {
     if (error != ERR_NONE)
         free_vartype(linalg_inv_result); /* Note: linalg_inv_result == b */
-    free_vartype((vartype *) a);
-    free(perm);
+    lu_cache_release((vartype *) a, perm);
     return linalg_inv_completion(error, linalg_inv_result);
 }
 
@@ -1284,6 +1212,12 @@ int linalg_det(const vartype *src, int (*completion)(int, vartype *)) {
                 return completion(ERR_INSUFFICIENT_MEMORY, NULL);
             return completion(ERR_NONE, v);
         }
+        if (lu_cache_lookup(src, true)) {
+            linalg_det_prev_sm_err = core_settings.matrix_singularmatrix;
+            linalg_det_completion = completion;
+            return det_r_completion(ERR_NONE, (vartype_realmatrix *) lu_cache_lu,
+                                    lu_cache_perm, lu_cache_det_re);
+        }
         ma = (vartype_realmatrix *) dup_vartype(src);
         if (ma == NULL)
             return completion(ERR_INSUFFICIENT_MEMORY, NULL);
@@ -1324,6 +1258,12 @@ int linalg_det(const vartype *src, int (*completion)(int, vartype *)) {
                 return completion(ERR_INSUFFICIENT_MEMORY, NULL);
             return completion(ERR_NONE, v);
         }
+        if (lu_cache_lookup(src, true)) {
+            linalg_det_prev_sm_err = core_settings.matrix_singularmatrix;
+            linalg_det_completion = completion;
+            return det_c_completion(ERR_NONE, (vartype_complexmatrix *) lu_cache_lu,
+                                    lu_cache_perm, lu_cache_det_re, lu_cache_det_im);
+        }
         ma = (vartype_complexmatrix *) dup_vartype(src);
         if (ma == NULL)
             return completion(ERR_INSUFFICIENT_MEMORY, NULL);
@@ -1357,10 +1297,11 @@ static int det_r_completion(int error, vartype_realmatrix *a, int4 *perm,
                                          phloat det) {
     vartype *det_v = NULL;
 
+    if (error == ERR_NONE)
+        lu_cache_store((vartype *) a, perm, det, 0);
     core_settings.matrix_singularmatrix = linalg_det_prev_sm_err;
 
-    free_vartype((vartype *) a);
-    free(perm);
+    lu_cache_release((vartype *) a, perm);
     if (error == ERR_SINGULAR_MATRIX) {
         det = 0;
         error = ERR_NONE;
@@ -1387,10 +1328,11 @@ static int det_c_completion(int error, vartype_complexmatrix *a, int4 *perm,
                                     phloat det_re, phloat det_im) {
     vartype *det_v = NULL;
 
+    if (error == ERR_NONE)
+        lu_cache_store((vartype *) a, perm, det_re, det_im);
     core_settings.matrix_singularmatrix = linalg_det_prev_sm_err;
 
-    free_vartype((vartype *) a);
-    free(perm);
+    lu_cache_release((vartype *) a, perm);
     if (error == ERR_SINGULAR_MATRIX) {
         det_re = 0;
         det_im = 0;
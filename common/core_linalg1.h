@@ -26,5 +26,7 @@ int linalg_mul(const vartype *left, const vartype *right,
                              int (*completion)(int, vartype *));
 int linalg_inv(const vartype *src, int (*completion)(int, vartype *));
 int linalg_det(const vartype *src, int (*completion)(int, vartype *));
+void calibrate_matrix_block_size();
+void lu_cache_clear();
 
 #endif
@@ -15,13 +15,23 @@
  * along with this program; if not, see http://www.gnu.org/licenses/.
  *****************************************************************************/
 
+#include <float.h>
+#include <math.h>
 #include <stdlib.h>
+#include <system_error>
+#include <thread>
 
 #include "core_linalg2.h"
 #include "core_globals.h"
 #include "core_main.h"
+#include "shell.h"
 
 
+/* The number of STATE() steps in a worker's first slice; after that,
+ * linalg_slice_adjust() takes over.
+ */
+#define STATE_SLICE 1000
+
 #define STATE(s)             \
         if (--count <= 0) {  \
             dat->state = s;  \
@@ -31,10 +41,105 @@
         ;
 
 
+/**************************/
+/***** Worker threads *****/
+/**************************/
+
+/* Large matrix operations split their work into panels, and each panel is
+ * divided among a few threads, which are started for that panel and joined
+ * before the worker function returns. That keeps the interactive thread in
+ * charge: it still gets to check for interruptions between panels, just
+ * like it does between slices of the single-threaded code.
+ * The way the work is divided never changes the order in which the terms
+ * of any one element are accumulated, so the results do not depend on the
+ * number of threads.
+ */
+
+#define LINALG_MAX_THREADS 8
+
+int linalg_threads() {
+    static int threads = 0;
+    if (threads == 0) {
+        unsigned int n = std::thread::hardware_concurrency();
+        threads = n == 0 ? 1 : n > LINALG_MAX_THREADS ? LINALG_MAX_THREADS : n;
+    }
+    return threads;
+}
+
+int linalg_parallel(int4 count, int4 grain,
+                    int (*fn)(void *ctx, int4 from, int4 to), void *ctx) {
+    int4 nt = linalg_threads();
+    if (grain < 1)
+        grain = 1;
+    if (nt > count / grain)
+        nt = count / grain;
+    if (nt <= 1)
+        return fn(ctx, 0, count);
+
+    std::thread *th[LINALG_MAX_THREADS];
+    int err[LINALG_MAX_THREADS];
+    for (int4 t = 1; t < nt; t++) {
+        int4 from = (int4) ((int8) count * t / nt);
+        int4 to = (int4) ((int8) count * (t + 1) / nt);
+        int *e = err + t;
+        try {
+            th[t] = new std::thread([=]() { *e = fn(ctx, from, to); });
+        } catch (std::bad_alloc &) {
+            th[t] = NULL;
+            *e = fn(ctx, from, to);
+        } catch (std::system_error &) {
+            th[t] = NULL;
+            *e = fn(ctx, from, to);
+        }
+    }
+    err[0] = fn(ctx, 0, (int4) ((int8) count / nt));
+    for (int4 t = 1; t < nt; t++) {
+        if (th[t] != NULL) {
+            th[t]->join();
+            delete th[t];
+        }
+    }
+    for (int4 t = 0; t < nt; t++)
+        if (err[t] != ERR_NONE)
+            return err[t];
+    return ERR_NONE;
+}
+
+
+/* The interruptible workers return to the shell after each slice of work,
+ * so it can check for STOP and EXIT. Instead of doing a fixed amount of
+ * work per slice, each worker keeps a budget, which is rescaled after every
+ * slice so that slices take about LINALG_SLICE_MS. That way, big jobs do
+ * not spend their time going around the event loop, and the calculator
+ * stays responsive no matter how fast or slow the host is.
+ */
+
+#define LINALG_SLICE_MS 20
+
+void linalg_slice_adjust(int4 *budget, uint4 start) {
+    uint4 elapsed = shell_milliseconds() - start;
+    int8 b = *budget;
+    if (elapsed < LINALG_SLICE_MS / 4)
+        b *= 4;
+    else
+        b = b * LINALG_SLICE_MS / elapsed;
+    if (b < 1)
+        b = 1;
+    else if (b > 0x3fffffff)
+        b = 0x3fffffff;
+    *budget = (int4) b;
+}
+
+
 /****************************/
 /***** LU decomposition *****/
 /****************************/
 
+/* Matrices of at least this order are factored by the blocked, multi-
+ * threaded code further down, when more than one thread is available.
+ */
+#define LU_BLOCKED_MIN 64
+
 struct lu_r_data_struct {
     vartype_realmatrix *a;
     int4 *perm;
@@ -42,6 +147,7 @@ struct lu_r_data_struct {
     int4 i, imax, j, k;
     phloat max, tmp, sum, *scale;
     int state;
+    int4 slice;
     int (*completion)(int, vartype_realmatrix *, int4 *, phloat);
 };
 
@@ -49,8 +155,23 @@ lu_r_data_struct *lu_r_data;
 
 static int lu_decomp_r_worker(bool interrupted);
 
+static int lu_decomp_blocked(vartype *a, int4 *perm,
+                int (*completion_r)(int, vartype_realmatrix *, int4 *, phloat),
+                int (*completion_c)(int, vartype_complexmatrix *,
+                                          int4 *, phloat, phloat));
+
+static int lu_crout_r(vartype_realmatrix *a, int4 *perm,
+                int (*completion)(int, vartype_realmatrix *, int4 *, phloat));
+
 int lu_decomp_r(vartype_realmatrix *a, int4 *perm,
                 int (*completion)(int, vartype_realmatrix *, int4 *, phloat)) {
+    if (a->rows >= LU_BLOCKED_MIN && linalg_threads() > 1)
+        return lu_decomp_blocked((vartype *) a, perm, completion, NULL);
+    return lu_crout_r(a, perm, completion);
+}
+
+static int lu_crout_r(vartype_realmatrix *a, int4 *perm,
+                int (*completion)(int, vartype_realmatrix *, int4 *, phloat)) {
     lu_r_data_struct *dat =
                 (lu_r_data_struct *) malloc(sizeof(lu_r_data_struct));
 
@@ -68,6 +189,7 @@ int lu_decomp_r(vartype_realmatrix *a, int4 *perm,
     dat->completion = completion;
 
     dat->state = 0;
+    dat->slice = STATE_SLICE;
 
     lu_r_data = dat;
     mode_interruptible = lu_decomp_r_worker;
@@ -83,7 +205,8 @@ static int lu_decomp_r_worker(bool interrupted) {
     int4 n = dat->a->rows;
     phloat *scale = dat->scale;
     int4 *perm = dat->perm;
-    int count = 1000;
+    int4 count = dat->slice;
+    uint4 start = shell_milliseconds();
     int err;
 
     int4 i = dat->i;
@@ -129,7 +252,11 @@ static int lu_decomp_r_worker(bool interrupted) {
         for (i = 0; i < j; i++) {
             sum = a[i * n + j];
             for (k = 0; k < i; k++) {
-                sum -= a[i * n + k] * a[k * n + j];
+                #ifdef BCD_MATH
+                    sum = fma(-a[i * n + k], a[k * n + j], sum);
+                #else
+                    sum -= a[i * n + k] * a[k * n + j];
+                #endif
                 STATE(2);
             }
             a[i * n + j] = sum;
@@ -140,7 +267,11 @@ static int lu_decomp_r_worker(bool interrupted) {
         for (i = j; i < n; i++) {
             sum = a[i * n + j];
             for (k = 0; k < j; k++) {
-                sum -= a[i * n + k] * a[k * n + j];
+                #ifdef BCD_MATH
+                    sum = fma(-a[i * n + k], a[k * n + j], sum);
+                #else
+                    sum -= a[i * n + k] * a[k * n + j];
+                #endif
                 STATE(3);
             }
             a[i * n  + j] = sum;
@@ -207,6 +338,7 @@ static int lu_decomp_r_worker(bool interrupted) {
     return err;
 
     suspend:
+    linalg_slice_adjust(&dat->slice, start);
     dat->i = i;
     dat->imax = imax;
     dat->j = j;
@@ -225,6 +357,7 @@ struct lu_c_data_struct {
     int4 i, imax, j, k;
     phloat max, tmp, tmp_re, tmp_im, sum_re, sum_im, s_re, s_im, *scale;
     int state;
+    int4 slice;
     int (*completion)(int, vartype_complexmatrix *, int4 *, phloat, phloat);
 };
 
@@ -232,9 +365,21 @@ lu_c_data_struct *lu_c_data;
 
 static int lu_decomp_c_worker(bool interrupted);
 
+static int lu_crout_c(vartype_complexmatrix *a, int4 *perm,
+                int (*completion)(int, vartype_complexmatrix *,
+                                          int4 *, phloat, phloat));
+
 int lu_decomp_c(vartype_complexmatrix *a, int4 *perm,
                 int (*completion)(int, vartype_complexmatrix *,
                                           int4 *, phloat, phloat)) {
+    if (a->rows >= LU_BLOCKED_MIN && linalg_threads() > 1)
+        return lu_decomp_blocked((vartype *) a, perm, NULL, completion);
+    return lu_crout_c(a, perm, completion);
+}
+
+static int lu_crout_c(vartype_complexmatrix *a, int4 *perm,
+                int (*completion)(int, vartype_complexmatrix *,
+                                          int4 *, phloat, phloat)) {
     lu_c_data_struct *dat =
                 (lu_c_data_struct *) malloc(sizeof(lu_c_data_struct));
 
@@ -252,6 +397,7 @@ int lu_decomp_c(vartype_complexmatrix *a, int4 *perm,
     dat->completion = completion;
 
     dat->state = 0;
+    dat->slice = STATE_SLICE;
 
     lu_c_data = dat;
     mode_interruptible = lu_decomp_c_worker;
@@ -267,7 +413,8 @@ static int lu_decomp_c_worker(bool interrupted) {
     int4 n = dat->a->rows;
     phloat *scale = dat->scale;
     int4 *perm = dat->perm;
-    int count = 1000;
+    int4 count = dat->slice;
+    uint4 start = shell_milliseconds();
     int err;
 
     int4 i = dat->i;
@@ -425,6 +572,7 @@ static int lu_decomp_c_worker(bool interrupted) {
     return err;
 
     suspend:
+    linalg_slice_adjust(&dat->slice, start);
     dat->i = i;
     dat->imax = imax;
     dat->j = j;
@@ -441,10 +589,599 @@ static int lu_decomp_c_worker(bool interrupted) {
 }
 
 
+/* Blocked LU decomposition, for large matrices. This is the same Crout
+ * algorithm as above, with the same pivoting, but reorganized: the columns
+ * are factored in panels of LU_PANEL, and once a panel is done, its
+ * contributions are subtracted from the rest of the matrix all at once.
+ * That trailing update is where nearly all the work is, and since every row
+ * can be updated independently, it is divided among worker threads. The
+ * terms of each element are still subtracted one by one, in order of
+ * increasing k, so the result is identical to that of the code above.
+ * The one case where the two would differ, a row that is all zeroes, is
+ * handed off to the code above instead.
+ */
+
+#define LU_PANEL 32
+#define LU_SLICE 262144
+
+/* s -= x * y, done the same way as in lu_decomp_r_worker() */
+#ifdef BCD_MATH
+#define LU_MSUB(s, x, y) s = fma(-(x), y, s)
+#else
+#define LU_MSUB(s, x, y) s -= (x) * (y)
+#endif
+
+struct lu_b_data_struct {
+    vartype *a;
+    bool cpx;
+    int4 *perm;
+    phloat *scale;
+    phloat det_re, det_im;
+    int4 j0, row;
+    int state;
+    int4 slice;
+    int (*completion_r)(int, vartype_realmatrix *, int4 *, phloat);
+    int (*completion_c)(int, vartype_complexmatrix *, int4 *, phloat, phloat);
+};
+
+static lu_b_data_struct *lu_b_data;
+
+static int lu_decomp_blocked_worker(bool interrupted);
+
+static int lu_b_finish(lu_b_data_struct *dat, int err) {
+    free(dat->scale);
+    if (!dat->cpx) {
+        phloat det = err == ERR_NONE ? dat->det_re : phloat(0);
+        err = dat->completion_r(err, (vartype_realmatrix *) dat->a, dat->perm, det);
+    } else {
+        phloat det_re = dat->det_re;
+        phloat det_im = dat->det_im;
+        if (err != ERR_NONE) {
+            /* Like lu_decomp_c_worker(), report a singular complex matrix
+             * by returning a determinant of zero.
+             */
+            if (err == ERR_SINGULAR_MATRIX)
+                err = ERR_NONE;
+            det_re = 0;
+            det_im = 0;
+        }
+        err = dat->completion_c(err, (vartype_complexmatrix *) dat->a,
+                                dat->perm, det_re, det_im);
+    }
+    free(dat);
+    return err;
+}
+
+static int lu_decomp_blocked(vartype *a, int4 *perm,
+                int (*completion_r)(int, vartype_realmatrix *, int4 *, phloat),
+                int (*completion_c)(int, vartype_complexmatrix *,
+                                          int4 *, phloat, phloat)) {
+    bool cpx = completion_r == NULL;
+    int4 n = cpx ? ((vartype_complexmatrix *) a)->rows
+                 : ((vartype_realmatrix *) a)->rows;
+    lu_b_data_struct *dat =
+                (lu_b_data_struct *) malloc(sizeof(lu_b_data_struct));
+    if (dat != NULL) {
+        dat->scale = (phloat *) malloc(n * sizeof(phloat));
+        if (dat->scale == NULL) {
+            free(dat);
+            dat = NULL;
+        }
+    }
+    if (dat == NULL) {
+        if (cpx)
+            return completion_c(ERR_INSUFFICIENT_MEMORY,
+                                (vartype_complexmatrix *) a, perm, 0, 0);
+        else
+            return completion_r(ERR_INSUFFICIENT_MEMORY,
+                                (vartype_realmatrix *) a, perm, 0);
+    }
+
+    dat->a = a;
+    dat->cpx = cpx;
+    dat->perm = perm;
+    dat->completion_r = completion_r;
+    dat->completion_c = completion_c;
+    dat->row = 0;
+    dat->state = 0;
+    dat->slice = LU_SLICE;
+
+    lu_b_data = dat;
+    mode_interruptible = lu_decomp_blocked_worker;
+    mode_stoppable = false;
+    return ERR_INTERRUPTIBLE;
+}
+
+struct lu_b_update {
+    phloat *a;
+    int4 n, k0, k1, c0, r0;
+    bool cpx;
+};
+
+/* Subtract the products of columns k0..k1-1 of the given rows and rows
+ * k0..k1-1 of columns c0..n-1 from those rows, one k at a time.
+ */
+static void lu_b_update_rows(const lu_b_update *u, int4 from, int4 to,
+                             int4 c0, int4 c1) {
+    phloat *a = u->a;
+    int4 n = u->n;
+    for (int4 i = from; i < to; i++) {
+        int4 kmax = i < u->k1 ? i : u->k1;
+        for (int4 k = u->k0; k < kmax; k++) {
+            if (!u->cpx) {
+                phloat x = a[i * n + k];
+                const phloat *y = a + k * n;
+                phloat *d = a + i * n;
+                for (int4 c = c0; c < c1; c++)
+                    LU_MSUB(d[c], x, y[c]);
+            } else {
+                phloat xre = a[2 * (i * n + k)];
+                phloat xim = a[2 * (i * n + k) + 1];
+                const phloat *y = a + 2 * k * n;
+                phloat *d = a + 2 * i * n;
+                for (int4 c = c0; c < c1; c++) {
+                    phloat yre = y[2 * c];
+                    phloat yim = y[2 * c + 1];
+                    d[2 * c] -= xre * yre - xim * yim;
+                    d[2 * c + 1] -= xim * yre + xre * yim;
+                }
+            }
+        }
+    }
+}
+
+/* The rows of the panel, to the right of it, in column stripes */
+static int lu_b_solve_panel(void *ctx, int4 from, int4 to) {
+    lu_b_update *u = (lu_b_update *) ctx;
+    lu_b_update_rows(u, u->k0, u->k1, u->c0 + from, u->c0 + to);
+    return ERR_NONE;
+}
+
+/* The rows below the panel, to the right of it */
+static int lu_b_update_trailing(void *ctx, int4 from, int4 to) {
+    lu_b_update *u = (lu_b_update *) ctx;
+    lu_b_update_rows(u, u->r0 + from, u->r0 + to, u->c0, u->n);
+    return ERR_NONE;
+}
+
+/* Factor columns j0..j1-1, given that the contributions of all the columns
+ * to their left have already been subtracted.
+ */
+static int lu_b_factor_panel(lu_b_data_struct *dat, phloat *a, int4 n,
+                             int4 j0, int4 j1) {
+    phloat *scale = dat->scale;
+    int4 *perm = dat->perm;
+    phloat tiniest = 1e20 / POS_HUGE_PHLOAT;
+    phloat tiny, tmp, max;
+    int4 i, imax, j, k;
+
+    for (j = j0; j < j1; j++) {
+        if (!dat->cpx) {
+            for (i = j0; i < j; i++) {
+                phloat sum = a[i * n + j];
+                for (k = j0; k < i; k++)
+                    LU_MSUB(sum, a[i * n + k], a[k * n + j]);
+                a[i * n + j] = sum;
+            }
+            max = 0;
+            imax = j;
+            for (i = j; i < n; i++) {
+                phloat sum = a[i * n + j];
+                for (k = j0; k < j; k++)
+                    LU_MSUB(sum, a[i * n + k], a[k * n + j]);
+                a[i * n + j] = sum;
+                tmp = (sum < 0 ? -sum : sum) / scale[i];
+                if (tmp > max) {
+                    imax = i;
+                    max = tmp;
+                }
+            }
+        } else {
+            for (i = j0; i < j; i++) {
+                phloat sum_re = a[2 * (i * n + j)];
+                phloat sum_im = a[2 * (i * n + j) + 1];
+                for (k = j0; k < i; k++) {
+                    phloat xre = a[2 * (i * n + k)];
+                    phloat xim = a[2 * (i * n + k) + 1];
+                    phloat yre = a[2 * (k * n + j)];
+                    phloat yim = a[2 * (k * n + j) + 1];
+                    sum_re -= xre * yre - xim * yim;
+                    sum_im -= xim * yre + xre * yim;
+                }
+                a[2 * (i * n + j)] = sum_re;
+                a[2 * (i * n + j) + 1] = sum_im;
+            }
+            max = 0;
+            imax = j;
+            for (i = j; i < n; i++) {
+                phloat sum_re = a[2 * (i * n + j)];
+                phloat sum_im = a[2 * (i * n + j) + 1];
+                for (k = j0; k < j; k++) {
+                    phloat xre = a[2 * (i * n + k)];
+                    phloat xim = a[2 * (i * n + k) + 1];
+                    phloat yre = a[2 * (k * n + j)];
+                    phloat yim = a[2 * (k * n + j) + 1];
+                    sum_re -= xre * yre - xim * yim;
+                    sum_im -= xim * yre + xre * yim;
+                }
+                a[2 * (i * n + j)] = sum_re;
+                a[2 * (i * n + j) + 1] = sum_im;
+                tmp = hypot(sum_re, sum_im) / scale[i];
+                if (tmp > max) {
+                    imax = i;
+                    max = tmp;
+                }
+            }
+        }
+
+        if (j != imax) {
+            int4 w = dat->cpx ? 2 : 1;
+            for (k = 0; k < n * w; k++) {
+                tmp = a[imax * n * w + k];
+                a[imax * n * w + k] = a[j * n * w + k];
+                a[j * n * w + k] = tmp;
+            }
+            dat->det_re = -dat->det_re;
+            dat->det_im = -dat->det_im;
+            scale[imax] = scale[j];
+        }
+
+        perm[j] = imax;
+        if (!dat->cpx) {
+            if (a[j * n + j] == 0) {
+                if (core_settings.matrix_singularmatrix)
+                    return ERR_SINGULAR_MATRIX;
+                tiny = pow(10, floor(log10(scale[j])) - 20);
+                if (tiny < tiniest)
+                    tiny = tiniest;
+                a[j * n + j] = tiny;
+            }
+            dat->det_re *= a[j * n + j];
+            if (j != n - 1) {
+                tmp = 1 / a[j * n + j];
+                for (i = j + 1; i < n; i++)
+                    a[i * n + j] *= tmp;
+            }
+        } else {
+            phloat tmp_re = a[2 * (j * n + j)];
+            phloat tmp_im = a[2 * (j * n + j) + 1];
+            if (tmp_re == 0 && tmp_im == 0) {
+                if (core_settings.matrix_singularmatrix)
+                    return ERR_SINGULAR_MATRIX;
+                tiny = pow(10, floor(log10(scale[j])) - 20);
+                if (tiny < tiniest)
+                    tiny = tiniest;
+                a[2 * (j * n + j)] = tmp_re = tiny;
+                a[2 * (j * n + j) + 1] = tmp_im = 0;
+            }
+            tmp = dat->det_re * tmp_re - dat->det_im * tmp_im;
+            dat->det_im = dat->det_im * tmp_re + dat->det_re * tmp_im;
+            dat->det_re = tmp;
+            if (j != n - 1) {
+                tmp = hypot(tmp_re, tmp_im);
+                phloat s_re = tmp_re / tmp / tmp;
+                phloat s_im = -tmp_im / tmp / tmp;
+                for (i = j + 1; i < n; i++) {
+                    tmp_re = a[2 * (i * n + j)];
+                    tmp_im = a[2 * (i * n + j) + 1];
+                    a[2 * (i * n + j)] = tmp_re * s_re - tmp_im * s_im;
+                    a[2 * (i * n + j) + 1] = tmp_im * s_re + tmp_re * s_im;
+                }
+            }
+        }
+    }
+    return ERR_NONE;
+}
+
+static int lu_decomp_blocked_worker(bool interrupted) {
+    lu_b_data_struct *dat = lu_b_data;
+    phloat *a;
+    int4 n;
+    if (dat->cpx) {
+        a = ((vartype_complexmatrix *) dat->a)->array->data;
+        n = ((vartype_complexmatrix *) dat->a)->rows;
+    } else {
+        a = ((vartype_realmatrix *) dat->a)->array->data;
+        n = ((vartype_realmatrix *) dat->a)->rows;
+    }
+    int4 w = dat->cpx ? 2 : 1;
+    uint4 start = shell_milliseconds();
+
+    if (interrupted)
+        return lu_b_finish(dat, ERR_INTERRUPTED);
+
+    if (dat->state == 0) {
+        /* Row scale factors, a few rows at a time */
+        int4 rows = dat->slice / (n * w * 4);
+        if (rows < 1)
+            rows = 1;
+        for (int4 i = dat->row; i < n && rows > 0; i++, rows--) {
+            phloat max = 0;
+            for (int4 j = 0; j < n; j++) {
+                phloat tmp;
+                if (dat->cpx)
+                    tmp = hypot(a[2 * (i * n + j)], a[2 * (i * n + j) + 1]);
+                else {
+                    tmp = a[i * n + j];
+                    if (tmp < 0)
+                        tmp = -tmp;
+                }
+                if (tmp > max)
+                    max = tmp;
+            }
+            if (max == 0) {
+                /* A row of zeroes; let the Crout code deal with it */
+                vartype *m = dat->a;
+                int4 *perm = dat->perm;
+                int (*completion_r)(int, vartype_realmatrix *, int4 *, phloat)
+                        = dat->completion_r;
+                int (*completion_c)(int, vartype_complexmatrix *, int4 *,
+                                    phloat, phloat) = dat->completion_c;
+                free(dat->scale);
+                free(dat);
+                if (completion_r != NULL)
+                    return lu_crout_r((vartype_realmatrix *) m, perm,
+                                      completion_r);
+                else
+                    return lu_crout_c((vartype_complexmatrix *) m, perm,
+                                      completion_c);
+            }
+            dat->scale[i] = max;
+            dat->row = i + 1;
+        }
+        if (dat->row < n) {
+            linalg_slice_adjust(&dat->slice, start);
+            return ERR_INTERRUPTIBLE;
+        }
+        dat->det_re = 1;
+        dat->det_im = 0;
+        dat->j0 = 0;
+        dat->state = 1;
+        return ERR_INTERRUPTIBLE;
+    }
+
+    int4 j0 = dat->j0;
+    int4 j1 = n - j0 < LU_PANEL ? n : j0 + LU_PANEL;
+    lu_b_update u;
+    u.a = a;
+    u.n = n;
+    u.k0 = j0;
+    u.k1 = j1;
+    u.c0 = j1;
+    u.cpx = dat->cpx;
+
+    if (dat->state == 1) {
+        int err = lu_b_factor_panel(dat, a, n, j0, j1);
+        if (err != ERR_NONE)
+            return lu_b_finish(dat, err);
+        if (j1 == n)
+            return lu_b_finish(dat, ERR_NONE);
+        linalg_parallel(n - j1, 16, lu_b_solve_panel, &u);
+        dat->row = j1;
+        dat->state = 2;
+        return ERR_INTERRUPTIBLE;
+    }
+
+    /* state 2: the trailing update, one band of rows at a time */
+    int4 rows = (int4) ((int8) dat->slice * linalg_threads()
+                                / ((int8) (n - j1) * (j1 - j0) * w * w));
+    if (rows < 1)
+        rows = 1;
+    if (rows > n - dat->row)
+        rows = n - dat->row;
+    u.r0 = dat->row;
+    linalg_parallel(rows, 1, lu_b_update_trailing, &u);
+    dat->row += rows;
+    if (dat->row == n) {
+        dat->j0 = j1;
+        dat->state = 1;
+    }
+    linalg_slice_adjust(&dat->slice, start);
+    return ERR_INTERRUPTIBLE;
+}
+
+
 /*****************************/
 /***** Back-substitution *****/
 /*****************************/
 
+/* With many right-hand sides, as when inverting a matrix, the columns of b
+ * are solved in parallel. Each column is computed exactly like the workers
+ * below do it, so this makes no difference to the results.
+ */
+
+#define BACKSUB_PAR_MIN 32
+#define BACKSUB_SLICE 262144
+
+struct backsub_p_data_struct {
+    vartype *a;
+    int4 *perm;
+    vartype *b;
+    bool ac, bc;
+    int4 n, q, k;
+    int4 slice;
+    int (*completion_rr)(int, vartype_realmatrix *, int4 *, vartype_realmatrix *);
+    int (*completion_rc)(int, vartype_realmatrix *, int4 *, vartype_complexmatrix *);
+    int (*completion_cc)(int, vartype_complexmatrix *, int4 *, vartype_complexmatrix *);
+};
+
+static backsub_p_data_struct *backsub_p_data;
+
+static bool backsub_range(phloat *t) {
+    if (p_isinf(*t) || p_isnan(*t)) {
+        if (core_settings.matrix_outofrange && !flags.f.range_error_ignore)
+            return false;
+        *t = p_isinf(*t) < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
+    }
+    return true;
+}
+
+static int backsub_columns(void *ctx, int4 from, int4 to) {
+    backsub_p_data_struct *dat = (backsub_p_data_struct *) ctx;
+    bool ac = dat->ac;
+    phloat *a = ac ? ((vartype_complexmatrix *) dat->a)->array->data
+                   : ((vartype_realmatrix *) dat->a)->array->data;
+    int4 n = dat->n;
+    int4 q = dat->q;
+    int4 *perm = dat->perm;
+
+    for (int4 k = dat->k + from; k < dat->k + to; k++) {
+        if (!dat->bc) {
+            phloat *b = ((vartype_realmatrix *) dat->b)->array->data;
+            int4 ii = -1;
+            for (int4 i = 0; i < n; i++) {
+                int4 ll = perm[i];
+                phloat sum = b[ll * q + k];
+                b[ll * q + k] = b[i * q + k];
+                if (ii != -1) {
+                    for (int4 j = ii; j < i; j++)
+                        sum -= a[i * n + j] * b[j * q + k];
+                } else if (sum != 0)
+                    ii = i;
+                b[i * q + k] = sum;
+            }
+            for (int4 i = n - 1; i >= 0; i--) {
+                phloat sum = b[i * q + k];
+                for (int4 j = i + 1; j < n; j++)
+                    sum -= a[i * n + j] * b[j * q + k];
+                phloat t = sum / a[i * n + i];
+                if (!backsub_range(&t))
+                    return ERR_OUT_OF_RANGE;
+                b[i * q + k] = t;
+            }
+            continue;
+        }
+
+        phloat *b = ((vartype_complexmatrix *) dat->b)->array->data;
+        phloat tmp, tmp_re, tmp_im, bre, bim, t_re, t_im;
+        int4 ii = -1;
+        for (int4 i = 0; i < n; i++) {
+            int4 ll = perm[i];
+            phloat sum_re = b[2 * (ll * q + k)];
+            phloat sum_im = b[2 * (ll * q + k) + 1];
+            b[2 * (ll * q + k)] = b[2 * (i * q + k)];
+            b[2 * (ll * q + k) + 1] = b[2 * (i * q + k) + 1];
+            if (ii != -1) {
+                for (int4 j = ii; j < i; j++) {
+                    if (!ac) {
+                        tmp = a[i * n + j];
+                        sum_re -= tmp * b[2 * (j * q + k)];
+                        sum_im -= tmp * b[2 * (j * q + k) + 1];
+                    } else {
+                        bre = b[2 * (j * q + k)];
+                        bim = b[2 * (j * q + k) + 1];
+                        tmp_re = a[2 * (i * n + j)];
+                        tmp_im = a[2 * (i * n + j) + 1];
+                        sum_re -= bre * tmp_re - bim * tmp_im;
+                        sum_im -= bim * tmp_re + bre * tmp_im;
+                    }
+                }
+            } else if (sum_re != 0 || sum_im != 0)
+                ii = i;
+            b[2 * (i * q + k)] = sum_re;
+            b[2 * (i * q + k) + 1] = sum_im;
+        }
+        for (int4 i = n - 1; i >= 0; i--) {
+            phloat sum_re = b[2 * (i * q + k)];
+            phloat sum_im = b[2 * (i * q + k) + 1];
+            for (int4 j = i + 1; j < n; j++) {
+                if (!ac) {
+                    tmp = a[i * n + j];
+                    sum_re -= tmp * b[2 * (j * q + k)];
+                    sum_im -= tmp * b[2 * (j * q + k) + 1];
+                } else {
+                    bre = b[2 * (j * q + k)];
+                    bim = b[2 * (j * q + k) + 1];
+                    tmp_re = a[2 * (i * n + j)];
+                    tmp_im = a[2 * (i * n + j) + 1];
+                    sum_re -= bre * tmp_re - bim * tmp_im;
+                    sum_im -= bim * tmp_re + bre * tmp_im;
+                }
+            }
+            if (!ac) {
+                tmp = a[i * n + i];
+                t_re = sum_re / tmp;
+                t_im = sum_im / tmp;
+            } else {
+                tmp_re = a[2 * (i * n + i)];
+                tmp_im = a[2 * (i * n + i) + 1];
+                tmp = hypot(tmp_re, tmp_im);
+                tmp_re = tmp_re / tmp / tmp;
+                tmp_im = -tmp_im / tmp / tmp;
+                t_re = sum_re * tmp_re - sum_im * tmp_im;
+                t_im = sum_im * tmp_re + sum_re * tmp_im;
+            }
+            if (!backsub_range(&t_re) || !backsub_range(&t_im))
+                return ERR_OUT_OF_RANGE;
+            b[2 * (i * q + k)] = t_re;
+            b[2 * (i * q + k) + 1] = t_im;
+        }
+    }
+    return ERR_NONE;
+}
+
+static int lu_backsubst_p_worker(bool interrupted) {
+    backsub_p_data_struct *dat = backsub_p_data;
+    int err;
+    if (interrupted)
+        err = ERR_INTERRUPTED;
+    else {
+        uint4 start = shell_milliseconds();
+        int w = dat->ac || dat->bc ? 4 : 1;
+        int4 cols = (int4) ((int8) dat->slice * linalg_threads()
+                                    / ((int8) dat->n * dat->n * w));
+        if (cols < 1)
+            cols = 1;
+        if (cols > dat->q - dat->k)
+            cols = dat->q - dat->k;
+        err = linalg_parallel(cols, 1, backsub_columns, dat);
+        if (err == ERR_OUT_OF_RANGE) {
+            free(dat);
+            return err;
+        }
+        dat->k += cols;
+        if (dat->k < dat->q) {
+            linalg_slice_adjust(&dat->slice, start);
+            return ERR_INTERRUPTIBLE;
+        }
+    }
+    if (dat->completion_rr != NULL)
+        err = dat->completion_rr(err, (vartype_realmatrix *) dat->a, dat->perm,
+                                      (vartype_realmatrix *) dat->b);
+    else if (dat->completion_rc != NULL)
+        err = dat->completion_rc(err, (vartype_realmatrix *) dat->a, dat->perm,
+                                      (vartype_complexmatrix *) dat->b);
+    else
+        err = dat->completion_cc(err, (vartype_complexmatrix *) dat->a, dat->perm,
+                                      (vartype_complexmatrix *) dat->b);
+    free(dat);
+    return err;
+}
+
+static int lu_backsubst_p(vartype *a, bool ac, int4 *perm, vartype *b, bool bc,
+                          int4 n, int4 q) {
+    backsub_p_data_struct *dat =
+            (backsub_p_data_struct *) malloc(sizeof(backsub_p_data_struct));
+    if (dat == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    dat->a = a;
+    dat->ac = ac;
+    dat->perm = perm;
+    dat->b = b;
+    dat->bc = bc;
+    dat->n = n;
+    dat->q = q;
+    dat->k = 0;
+    dat->slice = BACKSUB_SLICE;
+    dat->completion_rr = NULL;
+    dat->completion_rc = NULL;
+    dat->completion_cc = NULL;
+    backsub_p_data = dat;
+    mode_interruptible = lu_backsubst_p_worker;
+    mode_stoppable = false;
+    return ERR_INTERRUPTIBLE;
+}
+
 struct backsub_rr_data_struct {
     vartype_realmatrix *a;
     int4 *perm;
@@ -452,6 +1189,7 @@ struct backsub_rr_data_struct {
     int4 i, ii, j, ll, k;
     phloat sum;
     int state;
+    int4 slice;
     int (*completion)(int, vartype_realmatrix *, int4 *, vartype_realmatrix *);
 };
 
@@ -462,6 +1200,16 @@ static int lu_backsubst_rr_worker(bool interrupted);
 int lu_backsubst_rr(vartype_realmatrix *a, int4 *perm, vartype_realmatrix *b,
                     int (*completion)(int, vartype_realmatrix *,
                                     int4 *, vartype_realmatrix *)) {
+    if (b->columns > 1 && a->rows >= BACKSUB_PAR_MIN && linalg_threads() > 1) {
+        int err = lu_backsubst_p((vartype *) a, false, perm, (vartype *) b, false,
+                                 a->rows, b->columns);
+        if (err == ERR_INTERRUPTIBLE) {
+            backsub_p_data->completion_rr = completion;
+            return err;
+        }
+        return completion(err, a, perm, b);
+    }
+
     backsub_rr_data_struct *dat =
             (backsub_rr_data_struct *) malloc(sizeof(backsub_rr_data_struct));
 
@@ -474,6 +1222,7 @@ int lu_backsubst_rr(vartype_realmatrix *a, int4 *perm, vartype_realmatrix *b,
     dat->completion = completion;
 
     dat->state = 0;
+    dat->slice = STATE_SLICE;
 
     backsub_rr_data = dat;
     mode_interruptible = lu_backsubst_rr_worker;
@@ -488,7 +1237,8 @@ static int lu_backsubst_rr_worker(bool interrupted) {
     phloat *b = dat->b->array->data;
     int4 q = dat->b->columns;
     int4 *perm = dat->perm;
-    int count = 1000;
+    int4 count = dat->slice;
+    uint4 start = shell_milliseconds();
 
     int4 i = dat->i;
     int4 ii = dat->ii;
@@ -550,6 +1300,7 @@ static int lu_backsubst_rr_worker(bool interrupted) {
     return err;
 
     suspend:
+    linalg_slice_adjust(&dat->slice, start);
     dat->i = i;
     dat->ii = ii;
     dat->j = j;
@@ -566,6 +1317,7 @@ struct backsub_rc_data_struct {
     int4 i, ii, j, ll, k;
     phloat sum_re, sum_im;
     int state;
+    int4 slice;
     int (*completion)(int, vartype_realmatrix *, int4 *,
                                             vartype_complexmatrix *);
 };
@@ -577,6 +1329,16 @@ static int lu_backsubst_rc_worker(bool interrupted);
 int lu_backsubst_rc(vartype_realmatrix *a, int4 *perm, vartype_complexmatrix *b,
                     int (*completion)(int, vartype_realmatrix *,
                                 int4 *, vartype_complexmatrix *)) {
+    if (b->columns > 1 && a->rows >= BACKSUB_PAR_MIN && linalg_threads() > 1) {
+        int err = lu_backsubst_p((vartype *) a, false, perm, (vartype *) b, true,
+                                 a->rows, b->columns);
+        if (err == ERR_INTERRUPTIBLE) {
+            backsub_p_data->completion_rc = completion;
+            return err;
+        }
+        return completion(err, a, perm, b);
+    }
+
     backsub_rc_data_struct *dat =
             (backsub_rc_data_struct *) malloc(sizeof(backsub_rc_data_struct));
 
@@ -589,6 +1351,7 @@ int lu_backsubst_rc(vartype_realmatrix *a, int4 *perm, vartype_complexmatrix *b,
     dat->completion = completion;
 
     dat->state = 0;
+    dat->slice = STATE_SLICE;
 
     backsub_rc_data = dat;
     mode_interruptible = lu_backsubst_rc_worker;
@@ -603,7 +1366,8 @@ static int lu_backsubst_rc_worker(bool interrupted) {
     phloat *b = dat->b->array->data;
     int4 q = dat->b->columns;
     int4 *perm = dat->perm;
-    int count = 1000;
+    int4 count = dat->slice;
+    uint4 start = shell_milliseconds();
 
     int4 i = dat->i;
     int4 ii = dat->ii;
@@ -685,6 +1449,7 @@ static int lu_backsubst_rc_worker(bool interrupted) {
     return err;
 
     suspend:
+    linalg_slice_adjust(&dat->slice, start);
     dat->i = i;
     dat->ii = ii;
     dat->j = j;
@@ -702,6 +1467,7 @@ struct backsub_cc_data_struct {
     int4 i, ii, j, ll, k;
     phloat sum_re, sum_im;
     int state;
+    int4 slice;
     int (*completion)(int, vartype_complexmatrix *, int4 *,
                                             vartype_complexmatrix *);
 };
@@ -713,6 +1479,16 @@ static int lu_backsubst_cc_worker(bool interrupted);
 int lu_backsubst_cc(vartype_complexmatrix *a, int4 *perm, vartype_complexmatrix *b,
                     int (*completion)(int, vartype_complexmatrix *,
                                 int4 *, vartype_complexmatrix *)) {
+    if (b->columns > 1 && a->rows >= BACKSUB_PAR_MIN && linalg_threads() > 1) {
+        int err = lu_backsubst_p((vartype *) a, true, perm, (vartype *) b, true,
+                                 a->rows, b->columns);
+        if (err == ERR_INTERRUPTIBLE) {
+            backsub_p_data->completion_cc = completion;
+            return err;
+        }
+        return completion(err, a, perm, b);
+    }
+
     backsub_cc_data_struct *dat =
             (backsub_cc_data_struct *) malloc(sizeof(backsub_cc_data_struct));
 
@@ -725,6 +1501,7 @@ int lu_backsubst_cc(vartype_complexmatrix *a, int4 *perm, vartype_complexmatrix
     dat->completion = completion;
 
     dat->state = 0;
+    dat->slice = STATE_SLICE;
 
     backsub_cc_data = dat;
     mode_interruptible = lu_backsubst_cc_worker;
@@ -739,7 +1516,8 @@ static int lu_backsubst_cc_worker(bool interrupted) {
     phloat *b = dat->b->array->data;
     int4 q = dat->b->columns;
     int4 *perm = dat->perm;
-    int count = 1000;
+    int4 count = dat->slice;
+    uint4 start = shell_milliseconds();
 
     int4 i = dat->i;
     int4 ii = dat->ii;
@@ -832,6 +1610,7 @@ static int lu_backsubst_cc_worker(bool interrupted) {
     return err;
 
     suspend:
+    linalg_slice_adjust(&dat->slice, start);
     dat->i = i;
     dat->ii = ii;
     dat->j = j;
@@ -841,3 +1620,3377 @@ static int lu_backsubst_cc_worker(bool interrupted) {
     dat->sum_im = sum_im;
     return ERR_INTERRUPTIBLE;
 }
+
+
+/*******************************************/
+/***** Mixed-precision solver (decimal) *****/
+/*******************************************/
+
+#ifdef BCD_MATH
+
+/* In the decimal build, solving A X = B by decimal LU decomposition takes
+ * n^3/3 decimal multiply-adds, and those are slow. lu_solve_mixed() factors
+ * A in binary instead, and then refines each column of the solution
+ * iteratively: the residual B - A X is computed in full decimal precision,
+ * and the correction is solved for using the binary factorization. For a
+ * reasonably well-conditioned A, each iteration gains about 16 - log10(cond A)
+ * digits, and costs only n^2 decimal multiply-adds per column.
+ * When A or B can't be represented in binary, or the binary factorization is
+ * singular, or the refinement doesn't converge to full decimal precision, the
+ * completion is called with ERR_NONE and a NULL result, and the caller should
+ * fall back on the decimal solver.
+ */
+
+#define MIXED_SLICE 262144
+#define MIXED_MAX_ITER 10
+
+struct mixed_data_struct {
+    vartype_realmatrix *a, *b, *x;
+    int4 n, q;
+    double *lu, *w;
+    int4 *perm;
+    phloat *xc, *r;
+    phloat tol, prev;
+    int4 i, j;
+    int iter;
+    int state;
+    /* Budgets for the binary factorization and the decimal residuals */
+    int4 fslice, rslice;
+    int (*completion)(int, vartype_realmatrix *);
+};
+
+static mixed_data_struct *mixed_data;
+
+static void mixed_free(mixed_data_struct *dat) {
+    free(dat->lu);
+    free(dat->w);
+    free(dat->perm);
+    free(dat->xc);
+    free(dat->r);
+    free(dat);
+}
+
+static bool mixed_to_double(phloat p, double *d) {
+    if (p == 0) {
+        *d = 0;
+        return true;
+    }
+    double t = to_double(p);
+    if (isinf(t) || isnan(t) || fabs(t) < DBL_MIN)
+        return false;
+    *d = t;
+    return true;
+}
+
+/* Factors columns dat->j and on, until the slice's work is done */
+static bool mixed_factor(mixed_data_struct *dat) {
+    int4 n = dat->n;
+    double *a = dat->lu;
+    int8 work = 0;
+    while (dat->j < n && work < dat->fslice) {
+        int4 i, j, k = dat->j, imax = k;
+        double max = fabs(a[k * n + k]);
+        for (i = k + 1; i < n; i++) {
+            double t = fabs(a[i * n + k]);
+            if (t > max) {
+                max = t;
+                imax = i;
+            }
+        }
+        if (max == 0)
+            return false;
+        dat->perm[k] = imax;
+        if (imax != k)
+            for (j = 0; j < n; j++) {
+                double t = a[k * n + j];
+                a[k * n + j] = a[imax * n + j];
+                a[imax * n + j] = t;
+            }
+        double p = a[k * n + k];
+        for (i = k + 1; i < n; i++) {
+            double l = a[i * n + k] /= p;
+            if (l != 0)
+                for (j = k + 1; j < n; j++)
+                    a[i * n + j] -= l * a[k * n + j];
+        }
+        work += (int8) (n - k) * (n - k);
+        dat->j++;
+    }
+    return true;
+}
+
+/* Solves LU w = w in place */
+static bool mixed_solve(mixed_data_struct *dat) {
+    int4 n = dat->n;
+    double *a = dat->lu;
+    double *w = dat->w;
+    int4 i, k;
+    for (k = 0; k < n; k++) {
+        int4 p = dat->perm[k];
+        if (p != k) {
+            double t = w[k];
+            w[k] = w[p];
+            w[p] = t;
+        }
+    }
+    for (i = 1; i < n; i++) {
+        double s = w[i];
+        for (k = 0; k < i; k++)
+            s -= a[i * n + k] * w[k];
+        w[i] = s;
+    }
+    for (i = n - 1; i >= 0; i--) {
+        double s = w[i];
+        for (k = i + 1; k < n; k++)
+            s -= a[i * n + k] * w[k];
+        s /= a[i * n + i];
+        if (isinf(s) || isnan(s))
+            return false;
+        w[i] = s;
+    }
+    return true;
+}
+
+static int lu_solve_mixed_worker(bool interrupted) {
+    mixed_data_struct *dat = mixed_data;
+    int4 n = dat->n;
+    int4 q = dat->q;
+    int4 i, j = dat->j;
+    phloat *a = dat->a->array->data;
+    phloat *b = dat->b->array->data;
+    uint4 start = shell_milliseconds();
+    int err;
+
+    if (interrupted) {
+        err = ERR_INTERRUPTED;
+        goto done;
+    }
+
+    switch (dat->state) {
+        case 0:
+            /* Binary factorization */
+            if (!mixed_factor(dat))
+                goto fail;
+            if (dat->j < n) {
+                linalg_slice_adjust(&dat->fslice, start);
+                return ERR_INTERRUPTIBLE;
+            }
+            dat->j = 0;
+            dat->state = 1;
+            return ERR_INTERRUPTIBLE;
+
+        case 1:
+            /* Binary solution for column j, the starting point for the
+             * refinement
+             */
+            for (i = 0; i < n; i++)
+                if (!mixed_to_double(b[i * q + j], dat->w + i))
+                    goto fail;
+            if (!mixed_solve(dat))
+                goto fail;
+            for (i = 0; i < n; i++)
+                dat->xc[i] = dat->w[i];
+            dat->iter = 0;
+            dat->i = 0;
+            dat->state = 2;
+            return ERR_INTERRUPTIBLE;
+
+        case 2: {
+            /* Decimal residual, a slice of rows at a time */
+            int4 rows = dat->rslice / 16 / n;
+            if (rows < 1)
+                rows = 1;
+            int4 end = dat->i + rows;
+            if (end > n)
+                end = n;
+            for (i = dat->i; i < end; i++)
+                dat->r[i] = -dot_fma(a + i * n, dat->xc, n, -b[i * q + j]);
+            dat->i = end;
+            if (end < n) {
+                linalg_slice_adjust(&dat->rslice, start);
+                return ERR_INTERRUPTIBLE;
+            }
+            dat->state = 3;
+            /* fall through */
+        }
+
+        case 3: {
+            /* Stop when the residual is as small as the rounding errors in
+             * computing it allow, i.e. when X is as good a solution as the
+             * decimal LU decomposition would have produced; give up when
+             * the refinement stops making progress before that.
+             */
+            phloat rmax = 0, xmax = 0;
+            for (i = 0; i < n; i++) {
+                phloat t = fabs(dat->r[i]);
+                if (t > rmax)
+                    rmax = t;
+                t = fabs(dat->xc[i]);
+                if (t > xmax)
+                    xmax = t;
+            }
+            if (p_isinf(xmax) || p_isnan(xmax) || p_isnan(rmax))
+                goto fail;
+            if (rmax > xmax * dat->tol) {
+                if (dat->iter > 0 && rmax > dat->prev / 2
+                        || dat->iter == MIXED_MAX_ITER)
+                    goto fail;
+                dat->iter++;
+                dat->prev = rmax;
+                /* The residual is scaled to [-1, 1] so it can't overflow
+                 * or underflow when converted to binary.
+                 */
+                for (i = 0; i < n; i++)
+                    dat->w[i] = to_double(dat->r[i] / rmax);
+                if (!mixed_solve(dat))
+                    goto fail;
+                for (i = 0; i < n; i++)
+                    dat->xc[i] += phloat(dat->w[i]) * rmax;
+                dat->i = 0;
+                dat->state = 2;
+                return ERR_INTERRUPTIBLE;
+            }
+            /* Converged */
+            for (i = 0; i < n; i++)
+                dat->x->array->data[i * q + j] = dat->xc[i];
+            if (++dat->j < q) {
+                dat->state = 1;
+                return ERR_INTERRUPTIBLE;
+            }
+            err = ERR_NONE;
+            goto done;
+        }
+    }
+
+    fail:
+    free_vartype((vartype *) dat->x);
+    dat->x = NULL;
+    err = ERR_NONE;
+
+    done:
+    if (err != ERR_NONE && dat->x != NULL) {
+        free_vartype((vartype *) dat->x);
+        dat->x = NULL;
+    }
+    vartype_realmatrix *x = dat->x;
+    int (*completion)(int, vartype_realmatrix *) = dat->completion;
+    mixed_free(dat);
+    return completion(err, x);
+}
+
+int lu_solve_mixed(vartype_realmatrix *a, vartype_realmatrix *b,
+                        int (*completion)(int, vartype_realmatrix *)) {
+    int4 n = a->rows;
+    int4 q = b->columns;
+    if (contains_strings(a) || contains_strings(b))
+        return completion(ERR_NONE, NULL);
+
+    mixed_data_struct *dat =
+            (mixed_data_struct *) malloc(sizeof(mixed_data_struct));
+    if (dat == NULL)
+        return completion(ERR_NONE, NULL);
+    dat->lu = (double *) malloc((size_t) n * n * sizeof(double));
+    dat->w = (double *) malloc(n * sizeof(double));
+    dat->perm = (int4 *) malloc(n * sizeof(int4));
+    dat->xc = (phloat *) malloc(n * sizeof(phloat));
+    dat->r = (phloat *) malloc(n * sizeof(phloat));
+    dat->x = (vartype_realmatrix *) new_realmatrix(n, q);
+    if (dat->lu == NULL || dat->w == NULL || dat->perm == NULL
+            || dat->xc == NULL || dat->r == NULL || dat->x == NULL) {
+        if (dat->x != NULL)
+            free_vartype((vartype *) dat->x);
+        mixed_free(dat);
+        return completion(ERR_NONE, NULL);
+    }
+    double anorm = 0;
+    for (int4 i = 0; i < n; i++) {
+        double rsum = 0;
+        for (int4 j = 0; j < n; j++) {
+            if (!mixed_to_double(a->array->data[i * n + j],
+                                 dat->lu + i * n + j)) {
+                free_vartype((vartype *) dat->x);
+                mixed_free(dat);
+                return completion(ERR_NONE, NULL);
+            }
+            rsum += fabs(dat->lu[i * n + j]);
+        }
+        if (rsum > anorm)
+            anorm = rsum;
+    }
+    /* Tolerance for the backward error |B - A X| / (|A| |X|) */
+    dat->tol = phloat(anorm * sqrt((double) n)) * phloat("1e-34");
+
+    dat->a = a;
+    dat->b = b;
+    dat->n = n;
+    dat->q = q;
+    dat->j = 0;
+    dat->state = 0;
+    dat->fslice = MIXED_SLICE;
+    dat->rslice = MIXED_SLICE;
+    dat->completion = completion;
+
+    mixed_data = dat;
+    mode_interruptible = lu_solve_mixed_worker;
+    mode_stoppable = false;
+    return ERR_INTERRUPTIBLE;
+}
+
+#endif
+
+
+/***************************/
+/***** Sparse matrices *****/
+/***************************/
+
+/* Handles overflow in an element of a sparse product or solution; returns
+ * false if it should be reported as an error.
+ */
+static bool sparse_range(phloat *x) {
+    int inf = p_isinf(*x);
+    if (inf == 0)
+        return true;
+    if (core_settings.matrix_outofrange && !flags.f.range_error_ignore)
+        return false;
+    *x = inf < 0 ? NEG_HUGE_PHLOAT : POS_HUGE_PHLOAT;
+    return true;
+}
+
+/* Sorts the elements of one row by column; rows are usually short, and
+ * often nearly sorted already, so insertion sort is fine here.
+ */
+static void sparse_sort_row(int4 *col, phloat *val, int4 n) {
+    for (int4 i = 1; i < n; i++) {
+        int4 c = col[i];
+        phloat v = val[i];
+        int4 j = i - 1;
+        while (j >= 0 && col[j] > c) {
+            col[j + 1] = col[j];
+            val[j + 1] = val[j];
+            j--;
+        }
+        col[j + 1] = c;
+        val[j + 1] = v;
+    }
+}
+
+/* Releases the unused tail of the col and val arrays, after elements were
+ * dropped because they turned out to be zero.
+ */
+static void sparse_shrink(sparsematrix_data *sd, int4 nnz) {
+    sd->nnz = nnz;
+    if (nnz == 0)
+        nnz = 1;
+    int4 *c = (int4 *) realloc(sd->col, nnz * sizeof(int4));
+    if (c != NULL)
+        sd->col = c;
+    phloat *v = (phloat *) realloc((void *) sd->val, nnz * sizeof(phloat));
+    if (v != NULL)
+        sd->val = v;
+}
+
+int sparse_from_dense(const vartype_realmatrix *m, vartype **res) {
+    if (contains_strings(m))
+        return ERR_ALPHA_DATA_IS_INVALID;
+    int4 rows = m->rows;
+    int4 columns = m->columns;
+    phloat *data = m->array->data;
+    int4 sz = rows * columns;
+    int4 nnz = 0;
+    int4 i, j, k;
+    for (i = 0; i < sz; i++)
+        if (data[i] != 0)
+            nnz++;
+    vartype_sparsematrix *sm = (vartype_sparsematrix *)
+                                new_sparsematrix(rows, columns, nnz);
+    if (sm == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    sparsematrix_data *sd = sm->array;
+    k = 0;
+    for (i = 0; i < rows; i++) {
+        sd->rowptr[i] = k;
+        for (j = 0; j < columns; j++) {
+            phloat x = data[i * columns + j];
+            if (x != 0) {
+                sd->col[k] = j;
+                sd->val[k++] = x;
+            }
+        }
+    }
+    sd->rowptr[rows] = k;
+    *res = (vartype *) sm;
+    return ERR_NONE;
+}
+
+static bool sparse_index(phloat p, int4 max, int4 *index) {
+    if (p < 1 || p >= max + 1)
+        return false;
+    *index = to_int4(p) - 1;
+    return true;
+}
+
+int sparse_from_triples(int4 rows, int4 columns, const vartype_realmatrix *t,
+                        vartype **res) {
+    if (t->columns != 3)
+        return ERR_DIMENSION_ERROR;
+    if (contains_strings(t))
+        return ERR_ALPHA_DATA_IS_INVALID;
+    int4 n = t->rows;
+    phloat *data = t->array->data;
+    int4 i, j = 0, k;
+
+    /* Bucket the triples by row, then sort each row by column, summing
+     * duplicates and dropping zeros
+     */
+    vartype_sparsematrix *sm = (vartype_sparsematrix *)
+                                new_sparsematrix(rows, columns, n);
+    int4 *next = (int4 *) malloc((rows + 1) * sizeof(int4));
+    if (sm == NULL || next == NULL) {
+        free_vartype((vartype *) sm);
+        free(next);
+        return ERR_INSUFFICIENT_MEMORY;
+    }
+    sparsematrix_data *sd = sm->array;
+    for (i = 0; i <= rows; i++)
+        next[i] = 0;
+    for (k = 0; k < n; k++) {
+        if (!sparse_index(data[3 * k], rows, &i)
+                || !sparse_index(data[3 * k + 1], columns, &j)) {
+            free_vartype((vartype *) sm);
+            free(next);
+            return ERR_DIMENSION_ERROR;
+        }
+        next[i + 1]++;
+    }
+    for (i = 0; i < rows; i++)
+        next[i + 1] += next[i];
+    for (i = 0; i <= rows; i++)
+        sd->rowptr[i] = next[i];
+    for (k = 0; k < n; k++) {
+        sparse_index(data[3 * k], rows, &i);
+        sparse_index(data[3 * k + 1], columns, &j);
+        int4 p = next[i]++;
+        sd->col[p] = j;
+        sd->val[p] = data[3 * k + 2];
+    }
+    free(next);
+
+    int4 nnz = 0;
+    int4 start = 0;
+    for (i = 0; i < rows; i++) {
+        int4 end = sd->rowptr[i + 1];
+        sparse_sort_row(sd->col + start, sd->val + start, end - start);
+        sd->rowptr[i] = nnz;
+        k = start;
+        while (k < end) {
+            j = sd->col[k];
+            phloat sum = sd->val[k++];
+            while (k < end && sd->col[k] == j)
+                sum += sd->val[k++];
+            if (!sparse_range(&sum)) {
+                free_vartype((vartype *) sm);
+                return ERR_OUT_OF_RANGE;
+            }
+            if (sum != 0) {
+                sd->col[nnz] = j;
+                sd->val[nnz++] = sum;
+            }
+        }
+        start = end;
+    }
+    sd->rowptr[rows] = nnz;
+    sparse_shrink(sd, nnz);
+    *res = (vartype *) sm;
+    return ERR_NONE;
+}
+
+int sparse_to_dense(const vartype_sparsematrix *sm, vartype **res) {
+    vartype_realmatrix *rm = (vartype_realmatrix *)
+                                new_realmatrix(sm->rows, sm->columns);
+    if (rm == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    sparsematrix_data *sd = sm->array;
+    phloat *data = rm->array->data;
+    int4 columns = sm->columns;
+    for (int4 i = 0; i < sm->rows; i++)
+        for (int4 k = sd->rowptr[i]; k < sd->rowptr[i + 1]; k++)
+            data[i * columns + sd->col[k]] = sd->val[k];
+    *res = (vartype *) rm;
+    return ERR_NONE;
+}
+
+/* Sparse times dense: only the stored elements of the left operand are
+ * visited, so an m x n matrix with nnz nonzeros costs nnz * q multiply-adds,
+ * instead of m * n * q.
+ */
+static int sparse_mul_sd(const vartype_sparsematrix *a,
+                         const vartype_realmatrix *b, vartype **res) {
+    int4 m = a->rows;
+    int4 q = b->columns;
+    sparsematrix_data *sd = a->array;
+    phloat *bd = b->array->data;
+    vartype_realmatrix *r = (vartype_realmatrix *) new_realmatrix(m, q);
+    if (r == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    phloat *rd = r->array->data;
+    for (int4 i = 0; i < m; i++) {
+        phloat *ri = rd + i * q;
+        for (int4 k = sd->rowptr[i]; k < sd->rowptr[i + 1]; k++) {
+            phloat v = sd->val[k];
+            phloat *bk = bd + sd->col[k] * q;
+            for (int4 j = 0; j < q; j++)
+                ri[j] += v * bk[j];
+        }
+        for (int4 j = 0; j < q; j++)
+            if (!sparse_range(ri + j)) {
+                free_vartype((vartype *) r);
+                return ERR_OUT_OF_RANGE;
+            }
+    }
+    *res = (vartype *) r;
+    return ERR_NONE;
+}
+
+/* Dense times sparse: row k of the right operand is scattered into the rows
+ * of the result, scaled by column k of the left operand.
+ */
+static int sparse_mul_ds(const vartype_realmatrix *a,
+                         const vartype_sparsematrix *b, vartype **res) {
+    int4 m = a->rows;
+    int4 n = a->columns;
+    int4 q = b->columns;
+    sparsematrix_data *sd = b->array;
+    phloat *ad = a->array->data;
+    vartype_realmatrix *r = (vartype_realmatrix *) new_realmatrix(m, q);
+    if (r == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    phloat *rd = r->array->data;
+    for (int4 i = 0; i < m; i++) {
+        phloat *ri = rd + i * q;
+        for (int4 k = 0; k < n; k++) {
+            phloat v = ad[i * n + k];
+            if (v == 0)
+                continue;
+            for (int4 p = sd->rowptr[k]; p < sd->rowptr[k + 1]; p++)
+                ri[sd->col[p]] += v * sd->val[p];
+        }
+        for (int4 j = 0; j < q; j++)
+            if (!sparse_range(ri + j)) {
+                free_vartype((vartype *) r);
+                return ERR_OUT_OF_RANGE;
+            }
+    }
+    *res = (vartype *) r;
+    return ERR_NONE;
+}
+
+/* Sparse times sparse, by Gustavson's algorithm: each row of the result is
+ * accumulated in a dense work row, after a symbolic pass has counted the
+ * elements it can have.
+ */
+static int sparse_mul_ss(const vartype_sparsematrix *a,
+                         const vartype_sparsematrix *b, vartype **res) {
+    int4 m = a->rows;
+    int4 q = b->columns;
+    sparsematrix_data *ad = a->array;
+    sparsematrix_data *bd = b->array;
+    int4 *mark = (int4 *) malloc(q * sizeof(int4));
+    phloat *acc = (phloat *) malloc(q * sizeof(phloat));
+    vartype_sparsematrix *r = NULL;
+    int4 i, j, k, p;
+    int err = ERR_INSUFFICIENT_MEMORY;
+    if (mark == NULL || acc == NULL)
+        goto done;
+
+    {
+        double count = 0;
+        for (j = 0; j < q; j++)
+            mark[j] = -1;
+        for (i = 0; i < m; i++)
+            for (k = ad->rowptr[i]; k < ad->rowptr[i + 1]; k++) {
+                int4 c = ad->col[k];
+                for (p = bd->rowptr[c]; p < bd->rowptr[c + 1]; p++)
+                    if (mark[bd->col[p]] != i) {
+                        mark[bd->col[p]] = i;
+                        count++;
+                    }
+            }
+        if (count * sizeof(phloat) >= 2147483648.0)
+            goto done;
+        r = (vartype_sparsematrix *) new_sparsematrix(m, q, (int4) count);
+        if (r == NULL)
+            goto done;
+    }
+
+    {
+        sparsematrix_data *rd = r->array;
+        int4 nnz = 0;
+        for (j = 0; j < q; j++)
+            mark[j] = -1;
+        for (i = 0; i < m; i++) {
+            int4 start = nnz;
+            rd->rowptr[i] = start;
+            for (k = ad->rowptr[i]; k < ad->rowptr[i + 1]; k++) {
+                phloat v = ad->val[k];
+                int4 c = ad->col[k];
+                for (p = bd->rowptr[c]; p < bd->rowptr[c + 1]; p++) {
+                    j = bd->col[p];
+                    if (mark[j] != i) {
+                        mark[j] = i;
+                        acc[j] = 0;
+                        rd->col[nnz++] = j;
+                    }
+                    acc[j] += v * bd->val[p];
+                }
+            }
+            /* The column list is sorted with dummy values, and then the
+             * values are gathered, dropping the ones that cancelled out
+             */
+            sparse_sort_row(rd->col + start, rd->val + start, nnz - start);
+            int4 end = nnz;
+            nnz = start;
+            for (p = start; p < end; p++) {
+                j = rd->col[p];
+                if (!sparse_range(acc + j)) {
+                    err = ERR_OUT_OF_RANGE;
+                    goto done;
+                }
+                if (acc[j] != 0) {
+                    rd->col[nnz] = j;
+                    rd->val[nnz++] = acc[j];
+                }
+            }
+        }
+        rd->rowptr[m] = nnz;
+        sparse_shrink(rd, nnz);
+        *res = (vartype *) r;
+        r = NULL;
+        err = ERR_NONE;
+    }
+
+    done:
+    free(mark);
+    free(acc);
+    free_vartype((vartype *) r);
+    return err;
+}
+
+int sparse_mul(const vartype *left, const vartype *right,
+               int (*completion)(int, vartype *)) {
+    int4 lcols, rrows;
+    if (left->type == TYPE_SPARSEMATRIX)
+        lcols = ((vartype_sparsematrix *) left)->columns;
+    else if (left->type == TYPE_REALMATRIX) {
+        if (contains_strings((vartype_realmatrix *) left))
+            return completion(ERR_ALPHA_DATA_IS_INVALID, NULL);
+        lcols = ((vartype_realmatrix *) left)->columns;
+    } else
+        return completion(ERR_INVALID_TYPE, NULL);
+    if (right->type == TYPE_SPARSEMATRIX)
+        rrows = ((vartype_sparsematrix *) right)->rows;
+    else if (right->type == TYPE_REALMATRIX) {
+        if (contains_strings((vartype_realmatrix *) right))
+            return completion(ERR_ALPHA_DATA_IS_INVALID, NULL);
+        rrows = ((vartype_realmatrix *) right)->rows;
+    } else
+        return completion(ERR_INVALID_TYPE, NULL);
+    if (lcols != rrows)
+        return completion(ERR_DIMENSION_ERROR, NULL);
+
+    vartype *res = NULL;
+    int err;
+    if (left->type == TYPE_REALMATRIX)
+        err = sparse_mul_ds((vartype_realmatrix *) left,
+                            (vartype_sparsematrix *) right, &res);
+    else if (right->type == TYPE_REALMATRIX)
+        err = sparse_mul_sd((vartype_sparsematrix *) left,
+                            (vartype_realmatrix *) right, &res);
+    else
+        err = sparse_mul_ss((vartype_sparsematrix *) left,
+                            (vartype_sparsematrix *) right, &res);
+    return completion(err, res);
+}
+
+/* Solving with a sparse coefficient matrix: the rows and columns are first
+ * permuted symmetrically into reverse Cuthill-McKee order, which gathers the
+ * nonzeros into a narrow band around the diagonal, and then the band is
+ * factored by Gaussian elimination with partial pivoting, LAPACK gbtrf
+ * style. Row interchanges widen the upper band by the width of the lower
+ * one, and fill-in stays within the band, so the cost is about
+ * n * kl * (kl + ku) multiply-adds and the storage n * (2 kl + ku + 1),
+ * where kl and ku are the lower and upper bandwidths after reordering. For
+ * a finite-difference matrix on a k x k grid, that is n k^2 and n k, instead
+ * of n^3 / 3 and n^2 for the dense decomposition.
+ */
+
+#define SPARSE_SLICE 262144
+#define RCM_ORDERED -2
+#define RCM_TRIES 5
+
+/* Breadth-first search from s over the nodes that haven't been ordered yet,
+ * writing the nodes to q in the order visited and marking them with 'stamp'.
+ * When 'sorted' is set, each node's neighbors are visited in order of
+ * increasing degree. Returns the number of nodes visited; *last is set to
+ * the index in q where the last level starts, and *depth to the number of
+ * levels minus one.
+ */
+static int4 rcm_bfs(const int4 *adjptr, const int4 *adj, int4 *mark,
+                    int4 stamp, int4 s, int4 *q, bool sorted,
+                    int4 *last, int4 *depth) {
+    int4 head = 0, tail = 0, level_end = 1;
+    q[tail++] = s;
+    mark[s] = stamp;
+    *last = 0;
+    *depth = 0;
+    while (head < tail) {
+        if (head == level_end) {
+            *last = head;
+            level_end = tail;
+            (*depth)++;
+        }
+        int4 v = q[head++];
+        int4 t0 = tail;
+        for (int4 k = adjptr[v]; k < adjptr[v + 1]; k++) {
+            int4 w = adj[k];
+            if (mark[w] != stamp && mark[w] != RCM_ORDERED) {
+                mark[w] = stamp;
+                q[tail++] = w;
+            }
+        }
+        if (sorted)
+            for (int4 i = t0 + 1; i < tail; i++) {
+                int4 w = q[i];
+                int4 dw = adjptr[w + 1] - adjptr[w];
+                int4 j = i - 1;
+                while (j >= t0 && adjptr[q[j] + 1] - adjptr[q[j]] > dw) {
+                    q[j + 1] = q[j];
+                    j--;
+                }
+                q[j + 1] = w;
+            }
+    }
+    return tail;
+}
+
+/* Computes the reverse Cuthill-McKee ordering of the structure of A + A^T;
+ * perm[new] = old. Each connected component is started from a
+ * pseudo-peripheral node, found by repeated searches from the node of
+ * lowest degree in the last level of the previous search.
+ */
+static bool sparse_rcm(const vartype_sparsematrix *a, int4 *perm) {
+    int4 n = a->rows;
+    sparsematrix_data *sd = a->array;
+    int4 *adjptr = (int4 *) malloc((n + 1) * sizeof(int4));
+    int4 *mark = (int4 *) malloc(n * sizeof(int4));
+    int4 *adj = NULL;
+    int4 i, k;
+    if (adjptr == NULL || mark == NULL)
+        goto fail;
+    for (i = 0; i <= n; i++)
+        adjptr[i] = 0;
+    for (i = 0; i < n; i++)
+        for (k = sd->rowptr[i]; k < sd->rowptr[i + 1]; k++) {
+            int4 j = sd->col[k];
+            if (j != i) {
+                adjptr[i + 1]++;
+                adjptr[j + 1]++;
+            }
+        }
+    for (i = 0; i < n; i++)
+        adjptr[i + 1] += adjptr[i];
+    adj = (int4 *) malloc((adjptr[n] == 0 ? 1 : adjptr[n]) * sizeof(int4));
+    if (adj == NULL)
+        goto fail;
+    /* Using mark as the fill pointers for now */
+    for (i = 0; i < n; i++)
+        mark[i] = adjptr[i];
+    for (i = 0; i < n; i++)
+        for (k = sd->rowptr[i]; k < sd->rowptr[i + 1]; k++) {
+            int4 j = sd->col[k];
+            if (j != i) {
+                adj[mark[i]++] = j;
+                adj[mark[j]++] = i;
+            }
+        }
+
+    {
+        for (i = 0; i < n; i++)
+            mark[i] = -1;
+        int4 head = 0, next = 0, stamp = 0;
+        while (head < n) {
+            while (mark[next] == RCM_ORDERED)
+                next++;
+            int4 s = next;
+            int4 last, depth;
+            int4 cnt = rcm_bfs(adjptr, adj, mark, stamp++, s, perm + head,
+                               false, &last, &depth);
+            for (int t = 0; t < RCM_TRIES; t++) {
+                int4 c = perm[head + last];
+                for (k = head + last + 1; k < head + cnt; k++) {
+                    int4 v = perm[k];
+                    if (adjptr[v + 1] - adjptr[v] < adjptr[c + 1] - adjptr[c])
+                        c = v;
+                }
+                int4 last2, depth2;
+                rcm_bfs(adjptr, adj, mark, stamp++, c, perm + head,
+                        false, &last2, &depth2);
+                if (depth2 <= depth)
+                    break;
+                s = c;
+                last = last2;
+                depth = depth2;
+            }
+            cnt = rcm_bfs(adjptr, adj, mark, stamp++, s, perm + head,
+                          true, &last, &depth);
+            for (k = head; k < head + cnt; k++)
+                mark[perm[k]] = RCM_ORDERED;
+            head += cnt;
+        }
+        for (i = 0; i < n / 2; i++) {
+            int4 t = perm[i];
+            perm[i] = perm[n - 1 - i];
+            perm[n - 1 - i] = t;
+        }
+    }
+
+    free(adjptr);
+    free(mark);
+    free(adj);
+    return true;
+
+    fail:
+    free(adjptr);
+    free(mark);
+    free(adj);
+    return false;
+}
+
+/* Lower and upper bandwidth of A with rows and columns renumbered by iperm,
+ * or as is if iperm is NULL
+ */
+static void sparse_bandwidth(const vartype_sparsematrix *a, const int4 *iperm,
+                             int4 *kl, int4 *ku) {
+    sparsematrix_data *sd = a->array;
+    *kl = 0;
+    *ku = 0;
+    for (int4 i = 0; i < a->rows; i++) {
+        int4 ii = iperm == NULL ? i : iperm[i];
+        for (int4 k = sd->rowptr[i]; k < sd->rowptr[i + 1]; k++) {
+            int4 jj = iperm == NULL ? sd->col[k] : iperm[sd->col[k]];
+            if (ii - jj > *kl)
+                *kl = ii - jj;
+            else if (jj - ii > *ku)
+                *ku = jj - ii;
+        }
+    }
+}
+
+struct sparse_solve_data {
+    int4 n, q, kl, ku, w;
+    phloat *band;
+    int4 *perm;
+    int4 *piv;
+    vartype_realmatrix *x;
+    phloat amax;
+    int4 k;
+    int state;
+    int4 slice;
+    int (*completion)(int, vartype *);
+};
+
+static sparse_solve_data *sparse_solve_dat;
+
+/* Element (i, j) of the band; row i holds columns i - kl through
+ * i + kl + ku.
+ */
+#define BAND(i, j) band[(int8) (i) * w + (j) - (i) + kl]
+
+static void sparse_solve_free(sparse_solve_data *dat) {
+    free(dat->band);
+    free(dat->perm);
+    free(dat->piv);
+    free_vartype((vartype *) dat->x);
+    free(dat);
+}
+
+/* Factors columns dat->k and on, until the slice's work is done */
+static int sparse_factor(sparse_solve_data *dat) {
+    int4 n = dat->n, kl = dat->kl, ku = dat->ku, w = dat->w;
+    phloat *band = dat->band;
+    int8 work = 0;
+    while (dat->k < n && work < dat->slice) {
+        int4 k = dat->k;
+        int4 last = k + kl < n - 1 ? k + kl : n - 1;
+        int4 jend = k + kl + ku < n - 1 ? k + kl + ku : n - 1;
+        int4 i, j, p = k;
+        phloat max = fabs(BAND(k, k));
+        for (i = k + 1; i <= last; i++) {
+            phloat t = fabs(BAND(i, k));
+            if (t > max) {
+                max = t;
+                p = i;
+            }
+        }
+        dat->piv[k] = p;
+        if (p != k)
+            for (j = k; j <= jend; j++) {
+                phloat t = BAND(k, j);
+                BAND(k, j) = BAND(p, j);
+                BAND(p, j) = t;
+            }
+        if (BAND(k, k) == 0) {
+            if (core_settings.matrix_singularmatrix)
+                return ERR_SINGULAR_MATRIX;
+            /* For a zero pivot, substitute a small positive number,
+             * as in lu_decomp_r().
+             */
+            phloat tiniest = 1e20 / POS_HUGE_PHLOAT;
+            phloat tiny;
+            if (dat->amax == 0)
+                tiny = tiniest;
+            else {
+                tiny = pow(10, floor(log10(dat->amax)) - 20);
+                if (tiny < tiniest)
+                    tiny = tiniest;
+            }
+            BAND(k, k) = tiny;
+        }
+        phloat d = BAND(k, k);
+        for (i = k + 1; i <= last; i++) {
+            phloat l = BAND(i, k);
+            if (l == 0)
+                continue;
+            l /= d;
+            BAND(i, k) = l;
+            for (j = k + 1; j <= jend; j++) {
+                #ifdef BCD_MATH
+                    BAND(i, j) = fma(-l, BAND(k, j), BAND(i, j));
+                #else
+                    BAND(i, j) -= l * BAND(k, j);
+                #endif
+            }
+        }
+        work += (int8) (last - k + 1) * (jend - k + 1);
+        dat->k++;
+    }
+    return ERR_NONE;
+}
+
+/* Solves for column c of X in place */
+static bool sparse_backsubst(sparse_solve_data *dat, int4 c) {
+    int4 n = dat->n, q = dat->q, kl = dat->kl, ku = dat->ku, w = dat->w;
+    phloat *band = dat->band;
+    phloat *x = dat->x->array->data + c;
+    int4 i, j, k;
+    for (k = 0; k < n; k++) {
+        int4 p = dat->piv[k];
+        if (p != k) {
+            phloat t = x[k * q];
+            x[k * q] = x[p * q];
+            x[p * q] = t;
+        }
+        phloat xk = x[k * q];
+        if (xk == 0)
+            continue;
+        int4 last = k + kl < n - 1 ? k + kl : n - 1;
+        for (i = k + 1; i <= last; i++)
+            x[i * q] -= BAND(i, k) * xk;
+    }
+    for (i = n - 1; i >= 0; i--) {
+        phloat s = x[i * q];
+        int4 jend = i + kl + ku < n - 1 ? i + kl + ku : n - 1;
+        for (j = i + 1; j <= jend; j++) {
+            #ifdef BCD_MATH
+                s = fma(-BAND(i, j), x[j * q], s);
+            #else
+                s -= BAND(i, j) * x[j * q];
+            #endif
+        }
+        s /= BAND(i, i);
+        if (!sparse_range(&s))
+            return false;
+        x[i * q] = s;
+    }
+    return true;
+}
+
+#undef BAND
+
+static int sparse_solve_worker(bool interrupted) {
+    sparse_solve_data *dat = sparse_solve_dat;
+    uint4 start = shell_milliseconds();
+    int err;
+    vartype_realmatrix *res = NULL;
+
+    if (interrupted) {
+        err = ERR_INTERRUPTED;
+        goto done;
+    }
+
+    switch (dat->state) {
+        case 0:
+            err = sparse_factor(dat);
+            if (err != ERR_NONE)
+                goto done;
+            if (dat->k < dat->n) {
+                linalg_slice_adjust(&dat->slice, start);
+                return ERR_INTERRUPTIBLE;
+            }
+            dat->k = 0;
+            dat->state = 1;
+            return ERR_INTERRUPTIBLE;
+
+        case 1: {
+            int4 cols = dat->slice / dat->w / dat->n;
+            if (cols < 1)
+                cols = 1;
+            int4 end = dat->k + cols;
+            if (end > dat->q)
+                end = dat->q;
+            for (; dat->k < end; dat->k++)
+                if (!sparse_backsubst(dat, dat->k)) {
+                    err = ERR_OUT_OF_RANGE;
+                    goto done;
+                }
+            if (dat->k < dat->q) {
+                linalg_slice_adjust(&dat->slice, start);
+                return ERR_INTERRUPTIBLE;
+            }
+
+            /* Undo the reordering */
+            int4 n = dat->n, q = dat->q;
+            res = (vartype_realmatrix *) new_realmatrix(n, q);
+            if (res == NULL) {
+                err = ERR_INSUFFICIENT_MEMORY;
+                goto done;
+            }
+            for (int4 i = 0; i < n; i++) {
+                phloat *src = dat->x->array->data + i * q;
+                phloat *dst = res->array->data + dat->perm[i] * q;
+                for (int4 j = 0; j < q; j++)
+                    dst[j] = src[j];
+            }
+            err = ERR_NONE;
+            goto done;
+        }
+    }
+    err = ERR_INTERNAL_ERROR;
+
+    done:
+    int (*completion)(int, vartype *) = dat->completion;
+    sparse_solve_free(dat);
+    return completion(err, (vartype *) res);
+}
+
+static int sparse_solve(const vartype_sparsematrix *a,
+                        const vartype_realmatrix *b,
+                        int (*completion)(int, vartype *)) {
+    int4 n = a->rows;
+    int4 q = b->columns;
+    sparsematrix_data *sd = a->array;
+    int4 i, k;
+
+    sparse_solve_data *dat = (sparse_solve_data *)
+                                malloc(sizeof(sparse_solve_data));
+    if (dat == NULL)
+        return completion(ERR_INSUFFICIENT_MEMORY, NULL);
+    dat->band = NULL;
+    dat->piv = (int4 *) malloc(n * sizeof(int4));
+    dat->perm = (int4 *) malloc(n * sizeof(int4));
+    int4 *iperm = (int4 *) calloc(n, sizeof(int4));
+    dat->x = (vartype_realmatrix *) new_realmatrix(n, q);
+    if (dat->piv == NULL || dat->perm == NULL || iperm == NULL
+            || dat->x == NULL || !sparse_rcm(a, dat->perm)) {
+        nomem:
+        free(iperm);
+        sparse_solve_free(dat);
+        return completion(ERR_INSUFFICIENT_MEMORY, NULL);
+    }
+
+    /* Keep the original order if the reordering doesn't help */
+    int4 kl, ku;
+    for (i = 0; i < n; i++)
+        iperm[dat->perm[i]] = i;
+    sparse_bandwidth(a, iperm, &kl, &ku);
+    int4 kl0, ku0;
+    sparse_bandwidth(a, NULL, &kl0, &ku0);
+    if (kl0 + ku0 <= kl + ku) {
+        kl = kl0;
+        ku = ku0;
+        for (i = 0; i < n; i++)
+            dat->perm[i] = iperm[i] = i;
+    }
+    int4 w = 2 * kl + ku + 1;
+    double d_bytes = ((double) n) * w * sizeof(phloat);
+    if (d_bytes >= 2147483648.0)
+        goto nomem;
+    dat->band = (phloat *) malloc((size_t) n * w * sizeof(phloat));
+    if (dat->band == NULL)
+        goto nomem;
+    int8 sz = (int8) n * w;
+    for (int8 p = 0; p < sz; p++)
+        dat->band[p] = 0;
+
+    phloat amax = 0;
+    for (i = 0; i < n; i++) {
+        int4 ii = iperm[i];
+        for (k = sd->rowptr[i]; k < sd->rowptr[i + 1]; k++) {
+            int4 jj = iperm[sd->col[k]];
+            phloat v = sd->val[k];
+            dat->band[(int8) ii * w + jj - ii + kl] = v;
+            v = fabs(v);
+            if (v > amax)
+                amax = v;
+        }
+    }
+    for (i = 0; i < n; i++) {
+        phloat *src = b->array->data + dat->perm[i] * q;
+        phloat *dst = dat->x->array->data + i * q;
+        for (k = 0; k < q; k++)
+            dst[k] = src[k];
+    }
+    free(iperm);
+
+    dat->n = n;
+    dat->q = q;
+    dat->kl = kl;
+    dat->ku = ku;
+    dat->w = w;
+    dat->amax = amax;
+    dat->k = 0;
+    dat->state = 0;
+    dat->slice = SPARSE_SLICE;
+    dat->completion = completion;
+
+    sparse_solve_dat = dat;
+    mode_interruptible = sparse_solve_worker;
+    mode_stoppable = false;
+    return ERR_INTERRUPTIBLE;
+}
+
+static vartype *sparse_div_b;
+static int (*sparse_div_completion)(int, vartype *);
+
+static int sparse_div_completion_2(int err, vartype *res) {
+    free_vartype(sparse_div_b);
+    return sparse_div_completion(err, res);
+}
+
+int sparse_div(const vartype *left, const vartype *right,
+               int (*completion)(int, vartype *)) {
+    if (right->type != TYPE_SPARSEMATRIX)
+        return completion(ERR_INVALID_TYPE, NULL);
+    const vartype_sparsematrix *a = (const vartype_sparsematrix *) right;
+    if (a->rows != a->columns)
+        return completion(ERR_DIMENSION_ERROR, NULL);
+    if (left->type == TYPE_REALMATRIX) {
+        const vartype_realmatrix *b = (const vartype_realmatrix *) left;
+        if (contains_strings(b))
+            return completion(ERR_ALPHA_DATA_IS_INVALID, NULL);
+        if (b->rows != a->rows)
+            return completion(ERR_DIMENSION_ERROR, NULL);
+        return sparse_solve(a, b, completion);
+    } else if (left->type == TYPE_SPARSEMATRIX) {
+        const vartype_sparsematrix *bs = (const vartype_sparsematrix *) left;
+        if (bs->rows != a->rows)
+            return completion(ERR_DIMENSION_ERROR, NULL);
+        vartype *b;
+        int err = sparse_to_dense(bs, &b);
+        if (err != ERR_NONE)
+            return completion(err, NULL);
+        sparse_div_b = b;
+        sparse_div_completion = completion;
+        return sparse_solve(a, (vartype_realmatrix *) b, sparse_div_completion_2);
+    } else
+        return completion(ERR_INVALID_TYPE, NULL);
+}
+
+
+/*******************************************/
+/***** Eigenvalues and singular values *****/
+/*******************************************/
+
+/* EIG and SVD use the classic EISPACK-style algorithms, in the form given
+ * in JAMA: for a real symmetric matrix, Householder tridiagonalization
+ * followed by the implicit QL method; for a general real matrix, Householder
+ * reduction to Hessenberg form followed by Francis' double-shift QR, after
+ * which the 2x2 blocks of the real Schur form are split to get a complex
+ * triangular matrix; for a complex matrix, complex Householder reduction to
+ * Hessenberg form followed by shifted complex QR; and for the SVD,
+ * Golub-Kahan bidiagonalization followed by implicit QR on the bidiagonal.
+ * The eigenvectors of the non-symmetric cases are found by back-substitution
+ * on the triangular Schur form. Every phase is broken up into steps that can
+ * be resumed, so the whole thing runs as an interruptible worker.
+ */
+
+#define EIG_SLICE 65536
+#define EIG_MAX_ITER 60
+
+#define EIG_TRED2 0
+#define EIG_TRED2_ACC 1
+#define EIG_TQL2 2
+#define EIG_ORTHES 3
+#define EIG_ORTHES_ACC 4
+#define EIG_HQR2 5
+#define EIG_CORTH 6
+#define EIG_COMQR 7
+#define EIG_VECTORS 8
+#define SVD_BIDIAG 9
+#define SVD_GEN_U 10
+#define SVD_GEN_V 11
+#define SVD_QR 12
+#define EIG_DONE 13
+
+struct eig_data_struct {
+    bool svd;
+    bool cinput;        // EIG of a complex matrix
+    bool complex;       // a and z hold interleaved complex numbers
+    bool trans;         // SVD of the transpose
+    int4 m, n;
+    phloat *a;          // the matrix being reduced
+    phloat *z;          // accumulated transformations; V for the SVD
+    phloat *u;          // U for the SVD
+    phloat *d, *e;      // eigenvalues or singular values, and off-diagonal
+    phloat *w;          // eigenvectors, or scratch space for the SVD
+    phloat *y;          // scratch space
+    phloat eps, tiny, norm, shift, tst1;
+    int4 k, l, hi, p, nct, nrt, iter;
+    int state;
+    int4 slice;
+    int (*eig_completion)(int, vartype *, vartype *);
+    int (*svd_completion)(int, vartype *, vartype *, vartype *);
+};
+
+static eig_data_struct *eig_data;
+
+#define A(i, j) a[(int8) (i) * n + (j)]
+#define V(i, j) v[(int8) (i) * n + (j)]
+#define U(i, j) u[(int8) (i) * n + (j)]
+#define AR(i, j) a[2 * ((int8) (i) * n + (j))]
+#define AI(i, j) a[2 * ((int8) (i) * n + (j)) + 1]
+#define VR(i, j) v[2 * ((int8) (i) * n + (j))]
+#define VI(i, j) v[2 * ((int8) (i) * n + (j)) + 1]
+
+static void eig_free(eig_data_struct *dat) {
+    free(dat->a);
+    free(dat->z);
+    free(dat->u);
+    free(dat->d);
+    free(dat->e);
+    free(dat->w);
+    free(dat->y);
+    free(dat);
+}
+
+static phloat *eig_alloc(int8 count) {
+    if ((double) count * sizeof(phloat) >= 2147483648.0)
+        return NULL;
+    return (phloat *) malloc((size_t) (count == 0 ? 1 : count) * sizeof(phloat));
+}
+
+static void eig_cdiv(phloat ar, phloat ai, phloat br, phloat bi,
+                     phloat *cr, phloat *ci) {
+    phloat r, den;
+    if (fabs(br) >= fabs(bi)) {
+        r = bi / br;
+        den = br + bi * r;
+        *cr = (ar + ai * r) / den;
+        *ci = (ai - ar * r) / den;
+    } else {
+        r = br / bi;
+        den = bi + br * r;
+        *cr = (ar * r + ai) / den;
+        *ci = (ai * r - ar) / den;
+    }
+}
+
+static void eig_csqrt(phloat ar, phloat ai, phloat *cr, phloat *ci) {
+    if (ar == 0 && ai == 0) {
+        *cr = 0;
+        *ci = 0;
+        return;
+    }
+    phloat t = sqrt((fabs(ar) + hypot(ar, ai)) / 2);
+    if (ar >= 0) {
+        *cr = t;
+        *ci = ai / (2 * t);
+    } else {
+        *cr = fabs(ai) / (2 * t);
+        *ci = ai < 0 ? -t : t;
+    }
+}
+
+/* Symmetric Householder reduction to tridiagonal form; one step per row,
+ * from the bottom up.
+ */
+static void eig_tred2(eig_data_struct *dat, int8 *work) {
+    int4 n = dat->n;
+    phloat *v = dat->z, *d = dat->d, *e = dat->e;
+    int4 i = dat->k, j, k;
+    phloat scale = 0, h = 0, f, g, hh;
+    for (k = 0; k < i; k++)
+        scale += fabs(d[k]);
+    if (scale == 0) {
+        e[i] = d[i - 1];
+        for (j = 0; j < i; j++) {
+            d[j] = V(i - 1, j);
+            V(i, j) = 0;
+            V(j, i) = 0;
+        }
+    } else {
+        for (k = 0; k < i; k++) {
+            d[k] /= scale;
+            h += d[k] * d[k];
+        }
+        f = d[i - 1];
+        g = sqrt(h);
+        if (f > 0)
+            g = -g;
+        e[i] = scale * g;
+        h = h - f * g;
+        d[i - 1] = f - g;
+        for (j = 0; j < i; j++)
+            e[j] = 0;
+        for (j = 0; j < i; j++) {
+            f = d[j];
+            V(j, i) = f;
+            g = e[j] + V(j, j) * f;
+            for (k = j + 1; k <= i - 1; k++) {
+                g += V(k, j) * d[k];
+                e[k] += V(k, j) * f;
+            }
+            e[j] = g;
+        }
+        f = 0;
+        for (j = 0; j < i; j++) {
+            e[j] /= h;
+            f += e[j] * d[j];
+        }
+        hh = f / (h + h);
+        for (j = 0; j < i; j++)
+            e[j] -= hh * d[j];
+        for (j = 0; j < i; j++) {
+            f = d[j];
+            g = e[j];
+            for (k = j; k <= i - 1; k++)
+                V(k, j) -= f * e[k] + g * d[k];
+            d[j] = V(i - 1, j);
+            V(i, j) = 0;
+        }
+    }
+    d[i] = h;
+    *work += (int8) i * i;
+}
+
+/* Accumulates the tridiagonalizing transformations; one step per column */
+static void eig_tred2_acc(eig_data_struct *dat, int8 *work) {
+    int4 n = dat->n;
+    phloat *v = dat->z, *d = dat->d;
+    int4 i = dat->k, j, k;
+    V(n - 1, i) = V(i, i);
+    V(i, i) = 1;
+    phloat h = d[i + 1];
+    if (h != 0) {
+        for (k = 0; k <= i; k++)
+            d[k] = V(k, i + 1) / h;
+        for (j = 0; j <= i; j++) {
+            phloat g = 0;
+            for (k = 0; k <= i; k++)
+                g += V(k, i + 1) * V(k, j);
+            for (k = 0; k <= i; k++)
+                V(k, j) -= g * d[k];
+        }
+    }
+    for (k = 0; k <= i; k++)
+        V(k, i + 1) = 0;
+    *work += (int8) 2 * (i + 1) * (i + 1);
+}
+
+/* Symmetric tridiagonal QL; one step per iteration. Returns false if an
+ * eigenvalue fails to converge.
+ */
+static bool eig_tql2(eig_data_struct *dat, int8 *work) {
+    int4 n = dat->n;
+    phloat *v = dat->z, *d = dat->d, *e = dat->e;
+    int4 l = dat->l, m, i, k;
+    phloat eps = dat->eps;
+
+    phloat t = fabs(d[l]) + fabs(e[l]);
+    if (t > dat->tst1)
+        dat->tst1 = t;
+    for (m = l; m < n; m++)
+        if (fabs(e[m]) <= eps * dat->tst1)
+            break;
+    if (m > l) {
+        if (++dat->iter > EIG_MAX_ITER)
+            return false;
+        phloat g = d[l];
+        phloat p = (d[l + 1] - g) / (2 * e[l]);
+        phloat r = hypot(p, 1);
+        if (p < 0)
+            r = -r;
+        d[l] = e[l] / (p + r);
+        d[l + 1] = e[l] * (p + r);
+        phloat dl1 = d[l + 1];
+        phloat h = g - d[l];
+        for (i = l + 2; i < n; i++)
+            d[i] -= h;
+        dat->shift += h;
+
+        p = d[m];
+        phloat c = 1, c2 = 1, c3 = 1;
+        phloat el1 = e[l + 1];
+        phloat s = 0, s2 = 0;
+        for (i = m - 1; i >= l; i--) {
+            c3 = c2;
+            c2 = c;
+            s2 = s;
+            g = c * e[i];
+            h = c * p;
+            r = hypot(p, e[i]);
+            e[i + 1] = s * r;
+            s = e[i] / r;
+            c = p / r;
+            p = c * d[i] - s * g;
+            d[i + 1] = h + s * (c * g + s * d[i]);
+            for (k = 0; k < n; k++) {
+                h = V(k, i + 1);
+                V(k, i + 1) = s * V(k, i) + c * h;
+                V(k, i) = c * V(k, i) - s * h;
+            }
+        }
+        p = -s * s2 * c3 * el1 * e[l] / dl1;
+        e[l] = s * p;
+        d[l] = c * p;
+        *work += (int8) (m - l) * n * 2;
+        if (fabs(e[l]) > eps * dat->tst1)
+            return true;
+    }
+    d[l] += dat->shift;
+    e[l] = 0;
+    dat->l++;
+    dat->iter = 0;
+    *work += n;
+    return true;
+}
+
+/* Nonsymmetric Householder reduction to Hessenberg form; one step per
+ * column. Column m - 1 keeps its original elements below the subdiagonal,
+ * which, together with ort[m], make up the Householder vector for
+ * eig_orthes_acc().
+ */
+static void eig_orthes(eig_data_struct *dat, int8 *work) {
+    int4 n = dat->n;
+    phloat *a = dat->a, *ort = dat->y;
+    int4 m = dat->k, i, j;
+    phloat scale = 0;
+    for (i = m; i < n; i++)
+        scale += fabs(A(i, m - 1));
+    if (scale != 0) {
+        phloat h = 0;
+        for (i = n - 1; i >= m; i--) {
+            ort[i] = A(i, m - 1) / scale;
+            h += ort[i] * ort[i];
+        }
+        phloat g = sqrt(h);
+        if (ort[m] > 0)
+            g = -g;
+        h = h - ort[m] * g;
+        ort[m] = ort[m] - g;
+        for (j = m; j < n; j++) {
+            phloat f = 0;
+            for (i = n - 1; i >= m; i--)
+                f += ort[i] * A(i, j);
+            f = f / h;
+            for (i = m; i < n; i++)
+                A(i, j) -= f * ort[i];
+        }
+        for (i = 0; i < n; i++) {
+            phloat f = 0;
+            for (j = n - 1; j >= m; j--)
+                f += ort[j] * A(i, j);
+            f = f / h;
+            for (j = m; j < n; j++)
+                A(i, j) -= f * ort[j];
+        }
+        ort[m] = scale * ort[m];
+        A(m, m - 1) = scale * g;
+    }
+    *work += (int8) 4 * n * (n - m);
+}
+
+/* Accumulates the Hessenberg transformations; one step per column, from
+ * the right.
+ */
+static void eig_orthes_acc(eig_data_struct *dat, int8 *work) {
+    int4 n = dat->n;
+    phloat *a = dat->a, *v = dat->z, *ort = dat->y;
+    int4 m = dat->k, i, j;
+    if (A(m, m - 1) != 0) {
+        for (i = m + 1; i < n; i++)
+            ort[i] = A(i, m - 1);
+        for (j = m; j < n; j++) {
+            phloat g = 0;
+            for (i = m; i < n; i++)
+                g += ort[i] * V(i, j);
+            g = (g / ort[m]) / A(m, m - 1);
+            for (i = m; i < n; i++)
+                V(i, j) += g * ort[i];
+        }
+    }
+    for (i = m + 1; i < n; i++)
+        A(i, m - 1) = 0;
+    *work += (int8) 2 * (n - m) * (n - m);
+}
+
+/* Francis double-shift QR on the Hessenberg matrix, accumulating the
+ * transformations, until it is in real Schur form; one step per iteration
+ * or deflation. The real parts of the eigenvalues go in d, the imaginary
+ * parts in e. Returns false if an eigenvalue fails to converge.
+ */
+static bool eig_hqr2(eig_data_struct *dat, int8 *work) {
+    int4 n = dat->n;
+    phloat *a = dat->a, *v = dat->z, *d = dat->d, *e = dat->e;
+    phloat eps = dat->eps, norm = dat->norm;
+    int4 hi = dat->hi, l, m, i, j, k;
+    phloat p = 0, q = 0, r = 0, s, x, y, z, w;
+
+    l = hi;
+    while (l > 0) {
+        s = fabs(A(l - 1, l - 1)) + fabs(A(l, l));
+        if (s == 0)
+            s = norm;
+        if (fabs(A(l, l - 1)) < eps * s)
+            break;
+        l--;
+    }
+
+    if (l == hi) {
+        /* One root found */
+        A(hi, hi) += dat->shift;
+        d[hi] = A(hi, hi);
+        e[hi] = 0;
+        if (hi > 0)
+            A(hi, hi - 1) = 0;
+        dat->hi--;
+        dat->iter = 0;
+        *work += hi + 1;
+        return true;
+    }
+
+    if (l == hi - 1) {
+        /* Two roots found */
+        w = A(hi, hi - 1) * A(hi - 1, hi);
+        p = (A(hi - 1, hi - 1) - A(hi, hi)) / 2;
+        q = p * p + w;
+        z = sqrt(fabs(q));
+        A(hi, hi) += dat->shift;
+        A(hi - 1, hi - 1) += dat->shift;
+        x = A(hi, hi);
+        if (q >= 0) {
+            /* Real pair */
+            z = p >= 0 ? p + z : p - z;
+            d[hi - 1] = x + z;
+            d[hi] = d[hi - 1];
+            if (z != 0)
+                d[hi] = x - w / z;
+            e[hi - 1] = 0;
+            e[hi] = 0;
+            x = A(hi, hi - 1);
+            s = fabs(x) + fabs(z);
+            p = x / s;
+            q = z / s;
+            r = sqrt(p * p + q * q);
+            p = p / r;
+            q = q / r;
+            for (j = hi - 1; j < n; j++) {
+                z = A(hi - 1, j);
+                A(hi - 1, j) = q * z + p * A(hi, j);
+                A(hi, j) = q * A(hi, j) - p * z;
+            }
+            for (i = 0; i <= hi; i++) {
+                z = A(i, hi - 1);
+                A(i, hi - 1) = q * z + p * A(i, hi);
+                A(i, hi) = q * A(i, hi) - p * z;
+            }
+            for (i = 0; i < n; i++) {
+                z = V(i, hi - 1);
+                V(i, hi - 1) = q * z + p * V(i, hi);
+                V(i, hi) = q * V(i, hi) - p * z;
+            }
+            A(hi, hi - 1) = 0;
+        } else {
+            /* Complex pair */
+            d[hi - 1] = x + p;
+            d[hi] = x + p;
+            e[hi - 1] = z;
+            e[hi] = -z;
+        }
+        if (hi > 1)
+            A(hi - 1, hi - 2) = 0;
+        dat->hi -= 2;
+        dat->iter = 0;
+        *work += 6 * n;
+        return true;
+    }
+
+    /* No convergence yet */
+    if (++dat->iter > EIG_MAX_ITER)
+        return false;
+    x = A(hi, hi);
+    y = A(hi - 1, hi - 1);
+    w = A(hi, hi - 1) * A(hi - 1, hi);
+    if (dat->iter == 11) {
+        /* Wilkinson's original ad hoc shift */
+        dat->shift += x;
+        for (i = 0; i <= hi; i++)
+            A(i, i) -= x;
+        s = fabs(A(hi, hi - 1)) + fabs(A(hi - 1, hi - 2));
+        x = y = phloat(0.75) * s;
+        w = phloat(-0.4375) * s * s;
+    } else if (dat->iter == 31) {
+        /* MATLAB's ad hoc shift */
+        s = (y - x) / 2;
+        s = s * s + w;
+        if (s > 0) {
+            s = sqrt(s);
+            if (y < x)
+                s = -s;
+            s = x - w / ((y - x) / 2 + s);
+            for (i = 0; i <= hi; i++)
+                A(i, i) -= s;
+            dat->shift += s;
+            x = y = w = phloat(0.964);
+        }
+    }
+
+    /* Look for two consecutive small subdiagonal elements */
+    m = hi - 2;
+    while (m >= l) {
+        z = A(m, m);
+        r = x - z;
+        s = y - z;
+        p = (r * s - w) / A(m + 1, m) + A(m, m + 1);
+        q = A(m + 1, m + 1) - z - r - s;
+        r = A(m + 2, m + 1);
+        s = fabs(p) + fabs(q) + fabs(r);
+        p = p / s;
+        q = q / s;
+        r = r / s;
+        if (m == l)
+            break;
+        if (fabs(A(m, m - 1)) * (fabs(q) + fabs(r)) <
+                eps * (fabs(p) * (fabs(A(m - 1, m - 1)) + fabs(z)
+                                                  + fabs(A(m + 1, m + 1)))))
+            break;
+        m--;
+    }
+    for (i = m + 2; i <= hi; i++) {
+        A(i, i - 2) = 0;
+        if (i > m + 2)
+            A(i, i - 3) = 0;
+    }
+
+    /* Double QR step involving rows l through hi and columns m through hi */
+    for (k = m; k <= hi - 1; k++) {
+        bool notlast = k != hi - 1;
+        if (k != m) {
+            p = A(k, k - 1);
+            q = A(k + 1, k - 1);
+            r = notlast ? A(k + 2, k - 1) : phloat(0);
+            x = fabs(p) + fabs(q) + fabs(r);
+            if (x == 0)
+                continue;
+            p = p / x;
+            q = q / x;
+            r = r / x;
+        }
+        s = sqrt(p * p + q * q + r * r);
+        if (p < 0)
+            s = -s;
+        if (s != 0) {
+            if (k != m)
+                A(k, k - 1) = -s * x;
+            else if (l != m)
+                A(k, k - 1) = -A(k, k - 1);
+            p = p + s;
+            x = p / s;
+            y = q / s;
+            z = r / s;
+            q = q / p;
+            r = r / p;
+            for (j = k; j < n; j++) {
+                p = A(k, j) + q * A(k + 1, j);
+                if (notlast) {
+                    p = p + r * A(k + 2, j);
+                    A(k + 2, j) -= p * z;
+                }
+                A(k, j) -= p * x;
+                A(k + 1, j) -= p * y;
+            }
+            int4 last = hi < k + 3 ? hi : k + 3;
+            for (i = 0; i <= last; i++) {
+                p = x * A(i, k) + y * A(i, k + 1);
+                if (notlast) {
+                    p = p + z * A(i, k + 2);
+                    A(i, k + 2) -= p * r;
+                }
+                A(i, k) -= p;
+                A(i, k + 1) -= p * q;
+            }
+            for (i = 0; i < n; i++) {
+                p = x * V(i, k) + y * V(i, k + 1);
+                if (notlast) {
+                    p = p + z * V(i, k + 2);
+                    V(i, k + 2) -= p * r;
+                }
+                V(i, k) -= p;
+                V(i, k + 1) -= p * q;
+            }
+        }
+    }
+    *work += (int8) 10 * n * (hi - m + 1);
+    return true;
+}
+
+/* Turns the real Schur form into a complex triangular one, by rotating each
+ * 2x2 block belonging to a complex pair, and switches a and z over to
+ * complex storage for eig_vectors(). This is the method used by MATLAB's
+ * rsf2csf.
+ */
+static bool eig_rsf2csf(eig_data_struct *dat) {
+    int4 n = dat->n;
+    int8 nn = (int8) n * n;
+    phloat *ra = dat->a, *rv = dat->z;
+    phloat *a = eig_alloc(2 * nn);
+    phloat *v = eig_alloc(2 * nn);
+    if (a == NULL || v == NULL) {
+        free(a);
+        free(v);
+        return false;
+    }
+    int4 i, j, k;
+    for (i = 0; i < n; i++)
+        for (j = 0; j < n; j++) {
+            int8 p = (int8) i * n + j;
+            AR(i, j) = j >= i || (j == i - 1 && dat->e[j] > 0) ? ra[p] : phloat(0);
+            AI(i, j) = 0;
+            VR(i, j) = rv[p];
+            VI(i, j) = 0;
+        }
+    free(ra);
+    free(rv);
+    dat->a = a;
+    dat->z = v;
+    dat->complex = true;
+
+    for (k = 0; k < n - 1; k++) {
+        if (dat->e[k] <= 0)
+            continue;
+        phloat t = AR(k + 1, k);
+        phloat mur = dat->d[k] - AR(k + 1, k + 1);
+        phloat mui = dat->e[k];
+        phloat r = hypot(hypot(mur, mui), t);
+        phloat cr = mur / r, ci = mui / r, s = t / r;
+        for (j = k; j < n; j++) {
+            phloat xr = AR(k, j), xi = AI(k, j);
+            phloat yr = AR(k + 1, j), yi = AI(k + 1, j);
+            AR(k, j) = cr * xr + ci * xi + s * yr;
+            AI(k, j) = cr * xi - ci * xr + s * yi;
+            AR(k + 1, j) = cr * yr - ci * yi - s * xr;
+            AI(k + 1, j) = cr * yi + ci * yr - s * xi;
+        }
+        for (i = 0; i <= k + 1; i++) {
+            phloat xr = AR(i, k), xi = AI(i, k);
+            phloat yr = AR(i, k + 1), yi = AI(i, k + 1);
+            AR(i, k) = xr * cr - xi * ci + s * yr;
+            AI(i, k) = xr * ci + xi * cr + s * yi;
+            AR(i, k + 1) = yr * cr + yi * ci - s * xr;
+            AI(i, k + 1) = yi * cr - yr * ci - s * xi;
+        }
+        for (i = 0; i < n; i++) {
+            phloat xr = VR(i, k), xi = VI(i, k);
+            phloat yr = VR(i, k + 1), yi = VI(i, k + 1);
+            VR(i, k) = xr * cr - xi * ci + s * yr;
+            VI(i, k) = xr * ci + xi * cr + s * yi;
+            VR(i, k + 1) = yr * cr + yi * ci - s * xr;
+            VI(i, k + 1) = yi * cr - yr * ci - s * xi;
+        }
+        AR(k + 1, k) = 0;
+        AI(k + 1, k) = 0;
+    }
+    return true;
+}
+
+/* Complex Householder reduction to Hessenberg form; one step per column */
+static void eig_corth(eig_data_struct *dat, int8 *work) {
+    int4 n = dat->n;
+    phloat *a = dat->a, *v = dat->z, *u = dat->y;
+    int4 m = dat->k, i, j;
+    phloat scale = 0;
+    for (i = m; i < n; i++)
+        scale += fabs(AR(i, m - 1)) + fabs(AI(i, m - 1));
+    if (scale != 0) {
+        phloat h = 0;
+        for (i = m; i < n; i++) {
+            u[2 * i] = AR(i, m - 1) / scale;
+            u[2 * i + 1] = AI(i, m - 1) / scale;
+            h += u[2 * i] * u[2 * i] + u[2 * i + 1] * u[2 * i + 1];
+        }
+        phloat g = sqrt(h);
+        phloat f = hypot(u[2 * m], u[2 * m + 1]);
+        phloat pr, pi;
+        if (f == 0) {
+            pr = 1;
+            pi = 0;
+        } else {
+            pr = u[2 * m] / f;
+            pi = u[2 * m + 1] / f;
+        }
+        u[2 * m] += pr * g;
+        u[2 * m + 1] += pi * g;
+        h = h + f * g;
+        /* H = P H P, with P = I - u u* / h */
+        for (j = m; j < n; j++) {
+            phloat sr = 0, si = 0;
+            for (i = m; i < n; i++) {
+                sr += u[2 * i] * AR(i, j) + u[2 * i + 1] * AI(i, j);
+                si += u[2 * i] * AI(i, j) - u[2 * i + 1] * AR(i, j);
+            }
+            sr /= h;
+            si /= h;
+            for (i = m; i < n; i++) {
+                AR(i, j) -= u[2 * i] * sr - u[2 * i + 1] * si;
+                AI(i, j) -= u[2 * i] * si + u[2 * i + 1] * sr;
+            }
+        }
+        for (int pass = 0; pass < 2; pass++) {
+            phloat *b = pass == 0 ? a : v;
+            for (i = 0; i < n; i++) {
+                phloat *row = b + 2 * (int8) i * n;
+                phloat sr = 0, si = 0;
+                for (j = m; j < n; j++) {
+                    sr += row[2 * j] * u[2 * j] - row[2 * j + 1] * u[2 * j + 1];
+                    si += row[2 * j] * u[2 * j + 1] + row[2 * j + 1] * u[2 * j];
+                }
+                sr /= h;
+                si /= h;
+                for (j = m; j < n; j++) {
+                    row[2 * j] -= sr * u[2 * j] + si * u[2 * j + 1];
+                    row[2 * j + 1] -= si * u[2 * j] - sr * u[2 * j + 1];
+                }
+            }
+        }
+        AR(m, m - 1) = -pr * g * scale;
+        AI(m, m - 1) = -pi * g * scale;
+        for (i = m + 1; i < n; i++) {
+            AR(i, m - 1) = 0;
+            AI(i, m - 1) = 0;
+        }
+    }
+    *work += (int8) 12 * n * (n - m);
+}
+
+/* Shifted complex QR on the Hessenberg matrix, accumulating the
+ * transformations, until it is triangular; one step per iteration or
+ * deflation. Returns false if an eigenvalue fails to converge.
+ */
+static bool eig_comqr(eig_data_struct *dat, int8 *work) {
+    int4 n = dat->n;
+    phloat *a = dat->a, *v = dat->z, *g = dat->y;
+    phloat eps = dat->eps;
+    int4 hi = dat->hi, l, i, j, k;
+
+    l = hi;
+    while (l > 0) {
+        phloat s = fabs(AR(l - 1, l - 1)) + fabs(AI(l - 1, l - 1))
+                 + fabs(AR(l, l)) + fabs(AI(l, l));
+        if (s == 0)
+            s = dat->norm;
+        if (fabs(AR(l, l - 1)) + fabs(AI(l, l - 1)) < eps * s) {
+            AR(l, l - 1) = 0;
+            AI(l, l - 1) = 0;
+            break;
+        }
+        l--;
+    }
+    if (l == hi) {
+        dat->hi--;
+        dat->iter = 0;
+        *work += 1;
+        return true;
+    }
+    if (++dat->iter > EIG_MAX_ITER)
+        return false;
+
+    /* The eigenvalue of the trailing 2x2 block closest to its last
+     * diagonal element, or an exceptional shift every ten iterations
+     */
+    phloat mur, mui;
+    if (dat->iter % 10 == 0) {
+        mur = AR(hi, hi) + fabs(AR(hi, hi - 1))
+                + (hi > 1 ? fabs(AR(hi - 1, hi - 2)) : phloat(0));
+        mui = AI(hi, hi);
+    } else {
+        phloat hr = (AR(hi - 1, hi - 1) - AR(hi, hi)) / 2;
+        phloat hii = (AI(hi - 1, hi - 1) - AI(hi, hi)) / 2;
+        phloat bcr = AR(hi - 1, hi) * AR(hi, hi - 1)
+                   - AI(hi - 1, hi) * AI(hi, hi - 1);
+        phloat bci = AR(hi - 1, hi) * AI(hi, hi - 1)
+                   + AI(hi - 1, hi) * AR(hi, hi - 1);
+        phloat sr, si;
+        eig_csqrt(hr * hr - hii * hii + bcr, 2 * hr * hii + bci, &sr, &si);
+        /* d + h - sqrt(h^2 + bc) is the root closer to d when
+         * Re(conj(h) * sqrt(...)) >= 0
+         */
+        if (hr * sr + hii * si < 0) {
+            sr = -sr;
+            si = -si;
+        }
+        mur = AR(hi, hi) + hr - sr;
+        mui = AI(hi, hi) + hii - si;
+    }
+
+    for (i = l; i <= hi; i++) {
+        AR(i, i) -= mur;
+        AI(i, i) -= mui;
+    }
+    for (k = l; k < hi; k++) {
+        phloat xr = AR(k, k), xi = AI(k, k);
+        phloat yr = AR(k + 1, k), yi = AI(k + 1, k);
+        phloat ax = hypot(xr, xi);
+        phloat nrm = hypot(ax, hypot(yr, yi));
+        phloat c, sr, si;
+        if (nrm == 0) {
+            c = 1;
+            sr = si = 0;
+        } else if (ax == 0) {
+            c = 0;
+            sr = yr / nrm;
+            si = -yi / nrm;
+        } else {
+            c = ax / nrm;
+            phloat pr = xr / ax, pi = xi / ax;
+            sr = (pr * yr + pi * yi) / nrm;
+            si = (pi * yr - pr * yi) / nrm;
+        }
+        g[3 * k] = c;
+        g[3 * k + 1] = sr;
+        g[3 * k + 2] = si;
+        for (j = k; j < n; j++) {
+            xr = AR(k, j);
+            xi = AI(k, j);
+            yr = AR(k + 1, j);
+            yi = AI(k + 1, j);
+            AR(k, j) = c * xr + sr * yr - si * yi;
+            AI(k, j) = c * xi + sr * yi + si * yr;
+            AR(k + 1, j) = c * yr - sr * xr - si * xi;
+            AI(k + 1, j) = c * yi - sr * xi + si * xr;
+        }
+    }
+    for (k = l; k < hi; k++) {
+        phloat c = g[3 * k], sr = g[3 * k + 1], si = g[3 * k + 2];
+        int4 last = k + 2 < hi ? k + 2 : hi;
+        for (int pass = 0; pass < 2; pass++) {
+            phloat *b = pass == 0 ? a : v;
+            int4 rows = pass == 0 ? last + 1 : n;
+            for (i = 0; i < rows; i++) {
+                phloat *row = b + 2 * (int8) i * n;
+                phloat xr = row[2 * k], xi = row[2 * k + 1];
+                phloat yr = row[2 * k + 2], yi = row[2 * k + 3];
+                row[2 * k] = c * xr + sr * yr + si * yi;
+                row[2 * k + 1] = c * xi + sr * yi - si * yr;
+                row[2 * k + 2] = c * yr - sr * xr + si * xi;
+                row[2 * k + 3] = c * yi - sr * xi - si * xr;
+            }
+        }
+    }
+    for (i = l; i <= hi; i++) {
+        AR(i, i) += mur;
+        AI(i, i) += mui;
+    }
+    *work += (int8) 12 * n * (hi - l + 1);
+    return true;
+}
+
+/* Finds eigenvector k of the triangular Schur form by back-substitution,
+ * and transforms it back; the result is scaled to unit length, with its
+ * largest element real and positive.
+ */
+static void eig_vector(eig_data_struct *dat, int8 *work) {
+    int4 n = dat->n;
+    phloat *a = dat->a, *v = dat->z, *y = dat->y;
+    int4 k = dat->k, i, j;
+    phloat lr = AR(k, k), li = AI(k, k);
+    phloat smin = dat->eps * (fabs(lr) + fabs(li));
+    if (smin < dat->eps * dat->norm)
+        smin = dat->eps * dat->norm;
+    if (smin < POS_TINY_PHLOAT)
+        smin = POS_TINY_PHLOAT;
+    phloat big = 1e100;
+
+    y[2 * k] = 1;
+    y[2 * k + 1] = 0;
+    for (j = k - 1; j >= 0; j--) {
+        phloat sr = 0, si = 0;
+        for (i = j + 1; i <= k; i++) {
+            sr += AR(j, i) * y[2 * i] - AI(j, i) * y[2 * i + 1];
+            si += AR(j, i) * y[2 * i + 1] + AI(j, i) * y[2 * i];
+        }
+        phloat dr = AR(j, j) - lr, di = AI(j, j) - li;
+        if (fabs(dr) + fabs(di) < smin) {
+            dr = smin;
+            di = 0;
+        }
+        eig_cdiv(-sr, -si, dr, di, &y[2 * j], &y[2 * j + 1]);
+        phloat t = fabs(y[2 * j]) + fabs(y[2 * j + 1]);
+        if (t > big)
+            for (i = j; i <= k; i++) {
+                y[2 * i] /= t;
+                y[2 * i + 1] /= t;
+            }
+    }
+
+    phloat *x = dat->w;
+    phloat nrm = 0, max = -1, pr = 1, pi = 0;
+    for (i = 0; i < n; i++) {
+        phloat sr = 0, si = 0;
+        for (j = 0; j <= k; j++) {
+            sr += VR(i, j) * y[2 * j] - VI(i, j) * y[2 * j + 1];
+            si += VR(i, j) * y[2 * j + 1] + VI(i, j) * y[2 * j];
+        }
+        x[2 * ((int8) i * n + k)] = sr;
+        x[2 * ((int8) i * n + k) + 1] = si;
+        phloat t = hypot(sr, si);
+        nrm = hypot(nrm, t);
+        if (t > max) {
+            max = t;
+            pr = sr;
+            pi = si;
+        }
+    }
+    /* Dividing by the largest element first avoids overflow */
+    phloat t = hypot(pr, pi);
+    if (t != 0) {
+        nrm /= t;
+        for (i = 0; i < n; i++) {
+            phloat *p = x + 2 * ((int8) i * n + k);
+            eig_cdiv(p[0], p[1], pr, pi, &p[0], &p[1]);
+            p[0] /= nrm;
+            p[1] /= nrm;
+        }
+    }
+    *work += (int8) 4 * n * (k + 1);
+}
+
+/* Golub-Kahan bidiagonalization; one step per column */
+static void svd_bidiag(eig_data_struct *dat, int8 *work) {
+    int4 m = dat->m, n = dat->n, nct = dat->nct, nrt = dat->nrt;
+    phloat *a = dat->a, *u = dat->u, *v = dat->z;
+    phloat *s = dat->d, *e = dat->e, *wk = dat->w;
+    int4 k = dat->k, i, j;
+    if (k < nct) {
+        s[k] = 0;
+        for (i = k; i < m; i++)
+            s[k] = hypot(s[k], A(i, k));
+        if (s[k] != 0) {
+            if (A(k, k) < 0)
+                s[k] = -s[k];
+            for (i = k; i < m; i++)
+                A(i, k) /= s[k];
+            A(k, k) += 1;
+        }
+        s[k] = -s[k];
+    }
+    for (j = k + 1; j < n; j++) {
+        if (k < nct && s[k] != 0) {
+            phloat t = 0;
+            for (i = k; i < m; i++)
+                t += A(i, k) * A(i, j);
+            t = -t / A(k, k);
+            for (i = k; i < m; i++)
+                A(i, j) += t * A(i, k);
+        }
+        e[j] = A(k, j);
+    }
+    if (k < nct)
+        for (i = k; i < m; i++)
+            U(i, k) = A(i, k);
+    if (k < nrt) {
+        e[k] = 0;
+        for (i = k + 1; i < n; i++)
+            e[k] = hypot(e[k], e[i]);
+        if (e[k] != 0) {
+            if (e[k + 1] < 0)
+                e[k] = -e[k];
+            for (i = k + 1; i < n; i++)
+                e[i] /= e[k];
+            e[k + 1] += 1;
+        }
+        e[k] = -e[k];
+        if (k + 1 < m && e[k] != 0) {
+            for (i = k + 1; i < m; i++)
+                wk[i] = 0;
+            for (j = k + 1; j < n; j++)
+                for (i = k + 1; i < m; i++)
+                    wk[i] += e[j] * A(i, j);
+            for (j = k + 1; j < n; j++) {
+                phloat t = -e[j] / e[k + 1];
+                for (i = k + 1; i < m; i++)
+                    A(i, j) += t * wk[i];
+            }
+        }
+        for (i = k + 1; i < n; i++)
+            V(i, k) = e[i];
+    }
+    *work += (int8) 4 * (m - k) * (n - k);
+}
+
+/* Generates column k of U */
+static void svd_gen_u(eig_data_struct *dat, int8 *work) {
+    int4 m = dat->m, n = dat->n;
+    phloat *u = dat->u, *s = dat->d;
+    int4 k = dat->k, i, j;
+    if (k < dat->nct && s[k] != 0) {
+        for (j = k + 1; j < n; j++) {
+            phloat t = 0;
+            for (i = k; i < m; i++)
+                t += U(i, k) * U(i, j);
+            t = -t / U(k, k);
+            for (i = k; i < m; i++)
+                U(i, j) += t * U(i, k);
+        }
+        for (i = k; i < m; i++)
+            U(i, k) = -U(i, k);
+        U(k, k) = 1 + U(k, k);
+        for (i = 0; i < k; i++)
+            U(i, k) = 0;
+    } else {
+        for (i = 0; i < m; i++)
+            U(i, k) = 0;
+        U(k, k) = 1;
+    }
+    *work += (int8) 2 * (m - k) * (n - k);
+}
+
+/* Generates column k of V */
+static void svd_gen_v(eig_data_struct *dat, int8 *work) {
+    int4 n = dat->n;
+    phloat *v = dat->z, *e = dat->e;
+    int4 k = dat->k, i, j;
+    if (k < dat->nrt && e[k] != 0) {
+        for (j = k + 1; j < n; j++) {
+            phloat t = 0;
+            for (i = k + 1; i < n; i++)
+                t += V(i, k) * V(i, j);
+            t = -t / V(k + 1, k);
+            for (i = k + 1; i < n; i++)
+                V(i, j) += t * V(i, k);
+        }
+    }
+    for (i = 0; i < n; i++)
+        V(i, k) = 0;
+    V(k, k) = 1;
+    *work += (int8) 2 * (n - k) * (n - k);
+}
+
+static void svd_rot(phloat *b, int4 rows, int4 n, int4 j, int4 k,
+                    phloat cs, phloat sn) {
+    for (int4 i = 0; i < rows; i++) {
+        phloat *row = b + (int8) i * n;
+        phloat t = cs * row[j] + sn * row[k];
+        row[k] = -sn * row[j] + cs * row[k];
+        row[j] = t;
+    }
+}
+
+/* Implicit QR on the bidiagonal; one step per deflation, split, or
+ * iteration. Returns false if a singular value fails to converge.
+ */
+static bool svd_qr(eig_data_struct *dat, int8 *work) {
+    int4 m = dat->m, n = dat->n, p = dat->p;
+    phloat *u = dat->u, *v = dat->z, *s = dat->d, *e = dat->e;
+    phloat eps = dat->eps, tiny = dat->tiny;
+    int4 i, j, k, kase;
+
+    /* kase = 1 if s[p - 1] and e[k - 1] are negligible and k < p
+     * kase = 2 if s[k] is negligible and k < p
+     * kase = 3 if e[k - 1] is negligible, k < p, and s[k] through
+     *          s[p - 1] are not negligible (QR step)
+     * kase = 4 if e[p - 2] is negligible (convergence)
+     */
+    for (k = p - 2; k >= 0; k--)
+        if (fabs(e[k]) <= tiny + eps * (fabs(s[k]) + fabs(s[k + 1]))) {
+            e[k] = 0;
+            break;
+        }
+    if (k == p - 2)
+        kase = 4;
+    else {
+        int4 ks;
+        for (ks = p - 1; ks > k; ks--) {
+            phloat t = (ks != p ? fabs(e[ks]) : phloat(0))
+                     + (ks != k + 1 ? fabs(e[ks - 1]) : phloat(0));
+            if (fabs(s[ks]) <= tiny + eps * t) {
+                s[ks] = 0;
+                break;
+            }
+        }
+        if (ks == k)
+            kase = 3;
+        else if (ks == p - 1)
+            kase = 1;
+        else {
+            kase = 2;
+            k = ks;
+        }
+    }
+    k++;
+
+    switch (kase) {
+        case 1: {
+            /* Deflate negligible s[p - 1] */
+            phloat f = e[p - 2];
+            e[p - 2] = 0;
+            for (j = p - 2; j >= k; j--) {
+                phloat t = hypot(s[j], f);
+                phloat cs = s[j] / t;
+                phloat sn = f / t;
+                s[j] = t;
+                if (j != k) {
+                    f = -sn * e[j - 1];
+                    e[j - 1] = cs * e[j - 1];
+                }
+                svd_rot(v, n, n, j, p - 1, cs, sn);
+            }
+            *work += (int8) 4 * n * (p - k);
+            break;
+        }
+        case 2: {
+            /* Split at negligible s[k - 1] */
+            phloat f = e[k - 1];
+            e[k - 1] = 0;
+            for (j = k; j < p; j++) {
+                phloat t = hypot(s[j], f);
+                phloat cs = s[j] / t;
+                phloat sn = f / t;
+                s[j] = t;
+                f = -sn * e[j];
+                e[j] = cs * e[j];
+                svd_rot(u, m, n, j, k - 1, cs, sn);
+            }
+            *work += (int8) 4 * m * (p - k);
+            break;
+        }
+        case 3: {
+            /* One QR step */
+            if (++dat->iter > EIG_MAX_ITER)
+                return false;
+            phloat scale = fabs(s[p - 1]);
+            phloat t;
+            if ((t = fabs(s[p - 2])) > scale)
+                scale = t;
+            if ((t = fabs(e[p - 2])) > scale)
+                scale = t;
+            if ((t = fabs(s[k])) > scale)
+                scale = t;
+            if ((t = fabs(e[k])) > scale)
+                scale = t;
+            phloat sp = s[p - 1] / scale;
+            phloat spm1 = s[p - 2] / scale;
+            phloat epm1 = e[p - 2] / scale;
+            phloat sk = s[k] / scale;
+            phloat ek = e[k] / scale;
+            phloat b = ((spm1 + sp) * (spm1 - sp) + epm1 * epm1) / 2;
+            phloat c = (sp * epm1) * (sp * epm1);
+            phloat shift = 0;
+            if (b != 0 || c != 0) {
+                shift = sqrt(b * b + c);
+                if (b < 0)
+                    shift = -shift;
+                shift = c / (b + shift);
+            }
+            phloat f = (sk + sp) * (sk - sp) + shift;
+            phloat g = sk * ek;
+            for (j = k; j < p - 1; j++) {
+                t = hypot(f, g);
+                phloat cs = f / t;
+                phloat sn = g / t;
+                if (j != k)
+                    e[j - 1] = t;
+                f = cs * s[j] + sn * e[j];
+                e[j] = cs * e[j] - sn * s[j];
+                g = sn * s[j + 1];
+                s[j + 1] = cs * s[j + 1];
+                svd_rot(v, n, n, j, j + 1, cs, sn);
+                t = hypot(f, g);
+                cs = f / t;
+                sn = g / t;
+                s[j] = t;
+                f = cs * e[j] + sn * s[j + 1];
+                s[j + 1] = -sn * e[j] + cs * s[j + 1];
+                g = sn * e[j + 1];
+                e[j + 1] = cs * e[j + 1];
+                if (j < m - 1)
+                    svd_rot(u, m, n, j, j + 1, cs, sn);
+            }
+            e[p - 2] = f;
+            *work += (int8) 4 * (m + n) * (p - k);
+            break;
+        }
+        case 4: {
+            /* Convergence; make the singular value positive, and move it
+             * into place
+             */
+            if (s[k] <= 0) {
+                s[k] = s[k] < 0 ? -s[k] : phloat(0);
+                for (i = 0; i < n; i++)
+                    V(i, k) = -V(i, k);
+            }
+            while (k < n - 1) {
+                if (s[k] >= s[k + 1])
+                    break;
+                phloat t = s[k];
+                s[k] = s[k + 1];
+                s[k + 1] = t;
+                for (i = 0; i < n; i++) {
+                    t = V(i, k + 1);
+                    V(i, k + 1) = V(i, k);
+                    V(i, k) = t;
+                }
+                for (i = 0; i < m; i++) {
+                    t = U(i, k + 1);
+                    U(i, k + 1) = U(i, k);
+                    U(i, k) = t;
+                }
+                k++;
+            }
+            dat->iter = 0;
+            dat->p--;
+            *work += m + n;
+            break;
+        }
+    }
+    return true;
+}
+
+/* Performs one step of whichever phase the decomposition is in */
+static int eig_step(eig_data_struct *dat, int8 *work) {
+    int4 n = dat->n;
+    switch (dat->state) {
+        case EIG_TRED2:
+            if (dat->k > 0) {
+                eig_tred2(dat, work);
+                dat->k--;
+                return ERR_NONE;
+            }
+            dat->state = EIG_TRED2_ACC;
+            return ERR_NONE;
+        case EIG_TRED2_ACC:
+            if (dat->k < n - 1) {
+                eig_tred2_acc(dat, work);
+                dat->k++;
+                return ERR_NONE;
+            } else {
+                phloat *v = dat->z, *d = dat->d, *e = dat->e;
+                for (int4 j = 0; j < n; j++) {
+                    d[j] = V(n - 1, j);
+                    V(n - 1, j) = 0;
+                }
+                V(n - 1, n - 1) = 1;
+                for (int4 i = 1; i < n; i++)
+                    e[i - 1] = e[i];
+                e[n - 1] = 0;
+                dat->l = 0;
+                dat->shift = 0;
+                dat->tst1 = 0;
+                dat->iter = 0;
+                dat->state = EIG_TQL2;
+                return ERR_NONE;
+            }
+        case EIG_TQL2:
+            if (dat->l < n) {
+                if (!eig_tql2(dat, work))
+                    return ERR_NO_SOLUTION_FOUND;
+                return ERR_NONE;
+            } else {
+                /* Sort the eigenvalues in ascending order */
+                phloat *v = dat->z, *d = dat->d;
+                for (int4 i = 0; i < n - 1; i++) {
+                    int4 k = i;
+                    phloat p = d[i];
+                    for (int4 j = i + 1; j < n; j++)
+                        if (d[j] < p) {
+                            k = j;
+                            p = d[j];
+                        }
+                    if (k != i) {
+                        d[k] = d[i];
+                        d[i] = p;
+                        for (int4 j = 0; j < n; j++) {
+                            p = V(j, i);
+                            V(j, i) = V(j, k);
+                            V(j, k) = p;
+                        }
+                    }
+                }
+                *work += (int8) n * n;
+                dat->state = EIG_DONE;
+                return ERR_NONE;
+            }
+        case EIG_ORTHES:
+            if (dat->k < n - 1) {
+                eig_orthes(dat, work);
+                dat->k++;
+                return ERR_NONE;
+            } else {
+                phloat *v = dat->z;
+                for (int4 i = 0; i < n; i++)
+                    for (int4 j = 0; j < n; j++)
+                        V(i, j) = i == j ? 1 : 0;
+                dat->k = n - 2;
+                dat->state = EIG_ORTHES_ACC;
+                return ERR_NONE;
+            }
+        case EIG_ORTHES_ACC:
+            if (dat->k >= 1) {
+                eig_orthes_acc(dat, work);
+                dat->k--;
+                return ERR_NONE;
+            } else {
+                phloat *a = dat->a;
+                phloat norm = 0;
+                for (int4 i = 0; i < n; i++)
+                    for (int4 j = i > 0 ? i - 1 : 0; j < n; j++)
+                        norm += fabs(A(i, j));
+                dat->norm = norm;
+                dat->shift = 0;
+                dat->hi = n - 1;
+                dat->iter = 0;
+                dat->state = EIG_HQR2;
+                return ERR_NONE;
+            }
+        case EIG_HQR2:
+            if (dat->hi >= 0) {
+                if (!eig_hqr2(dat, work))
+                    return ERR_NO_SOLUTION_FOUND;
+                return ERR_NONE;
+            }
+            if (!eig_rsf2csf(dat))
+                return ERR_INSUFFICIENT_MEMORY;
+            *work += (int8) 4 * n * n;
+            goto vectors;
+        case EIG_CORTH:
+            if (dat->k < n - 1) {
+                eig_corth(dat, work);
+                dat->k++;
+                return ERR_NONE;
+            } else {
+                phloat *a = dat->a;
+                phloat norm = 0;
+                for (int4 i = 0; i < n; i++)
+                    for (int4 j = i > 0 ? i - 1 : 0; j < n; j++)
+                        norm += fabs(AR(i, j)) + fabs(AI(i, j));
+                dat->norm = norm;
+                dat->hi = n - 1;
+                dat->iter = 0;
+                dat->state = EIG_COMQR;
+                return ERR_NONE;
+            }
+        case EIG_COMQR:
+            if (dat->hi >= 0) {
+                if (!eig_comqr(dat, work))
+                    return ERR_NO_SOLUTION_FOUND;
+                return ERR_NONE;
+            }
+            vectors: {
+                /* Eigenvalues from the diagonal, in the order found */
+                phloat *a = dat->a;
+                phloat norm = 0;
+                for (int4 i = 0; i < n; i++) {
+                    dat->d[i] = AR(i, i);
+                    dat->e[i] = AI(i, i);
+                    for (int4 j = i; j < n; j++)
+                        norm += fabs(AR(i, j)) + fabs(AI(i, j));
+                }
+                dat->norm = norm;
+                dat->k = 0;
+                dat->state = EIG_VECTORS;
+                return ERR_NONE;
+            }
+        case EIG_VECTORS:
+            eig_vector(dat, work);
+            if (++dat->k == n)
+                dat->state = EIG_DONE;
+            return ERR_NONE;
+        case SVD_BIDIAG: {
+            int4 m = dat->m;
+            int4 kmax = dat->nct > dat->nrt ? dat->nct : dat->nrt;
+            if (dat->k < kmax) {
+                svd_bidiag(dat, work);
+                dat->k++;
+                return ERR_NONE;
+            }
+            phloat *a = dat->a, *s = dat->d, *e = dat->e;
+            int4 p = n < m + 1 ? n : m + 1;
+            if (dat->nct < n)
+                s[dat->nct] = A(dat->nct, dat->nct);
+            if (m < p)
+                s[p - 1] = 0;
+            if (dat->nrt + 1 < p)
+                e[dat->nrt] = A(dat->nrt, p - 1);
+            e[p - 1] = 0;
+            dat->p = p;
+            dat->k = n - 1;
+            dat->state = SVD_GEN_U;
+            return ERR_NONE;
+        }
+        case SVD_GEN_U:
+            if (dat->k >= 0) {
+                svd_gen_u(dat, work);
+                dat->k--;
+                return ERR_NONE;
+            }
+            dat->k = n - 1;
+            dat->state = SVD_GEN_V;
+            return ERR_NONE;
+        case SVD_GEN_V:
+            if (dat->k >= 0) {
+                svd_gen_v(dat, work);
+                dat->k--;
+                return ERR_NONE;
+            }
+            dat->iter = 0;
+            dat->state = SVD_QR;
+            return ERR_NONE;
+        case SVD_QR:
+            if (dat->p > 0) {
+                if (!svd_qr(dat, work))
+                    return ERR_NO_SOLUTION_FOUND;
+                return ERR_NONE;
+            }
+            dat->state = EIG_DONE;
+            return ERR_NONE;
+    }
+    return ERR_INTERNAL_ERROR;
+}
+
+static bool eig_range(const phloat *p, int8 count) {
+    for (int8 i = 0; i < count; i++)
+        if (p_isinf(p[i]) || p_isnan(p[i]))
+            return false;
+    return true;
+}
+
+/* Builds the EIG results: a column vector of eigenvalues, and a matrix
+ * with the corresponding eigenvectors as its columns.
+ */
+static int eig_results(eig_data_struct *dat, vartype **values,
+                       vartype **vectors) {
+    int4 n = dat->n, i, j;
+    bool real = !dat->cinput;
+    if (real)
+        for (i = 0; i < n; i++)
+            if (dat->e[i] != 0) {
+                real = false;
+                break;
+            }
+    if (!eig_range(dat->d, n) || !eig_range(dat->e, n)
+            || !eig_range(dat->complex ? dat->w : dat->z,
+                          (int8) n * n * (dat->complex ? 2 : 1)))
+        return ERR_OUT_OF_RANGE;
+    if (real) {
+        *values = new_realmatrix(n, 1);
+        *vectors = new_realmatrix(n, n);
+    } else {
+        *values = new_complexmatrix(n, 1);
+        *vectors = new_complexmatrix(n, n);
+    }
+    if (*values == NULL || *vectors == NULL) {
+        free_vartype(*values);
+        free_vartype(*vectors);
+        return ERR_INSUFFICIENT_MEMORY;
+    }
+    if (real) {
+        phloat *vd = ((vartype_realmatrix *) *values)->array->data;
+        phloat *xd = ((vartype_realmatrix *) *vectors)->array->data;
+        for (i = 0; i < n; i++)
+            vd[i] = dat->d[i];
+        if (dat->complex) {
+            for (int8 p = 0; p < (int8) n * n; p++)
+                xd[p] = dat->w[2 * p];
+        } else {
+            /* Make the largest element of each vector positive */
+            phloat *v = dat->z;
+            for (j = 0; j < n; j++) {
+                phloat max = -1;
+                bool neg = false;
+                for (i = 0; i < n; i++) {
+                    phloat t = fabs(V(i, j));
+                    if (t > max) {
+                        max = t;
+                        neg = V(i, j) < 0;
+                    }
+                }
+                for (i = 0; i < n; i++)
+                    xd[(int8) i * n + j] = neg ? -V(i, j) : V(i, j);
+            }
+        }
+    } else {
+        phloat *vd = ((vartype_complexmatrix *) *values)->array->data;
+        phloat *xd = ((vartype_complexmatrix *) *vectors)->array->data;
+        for (i = 0; i < n; i++) {
+            vd[2 * i] = dat->d[i];
+            vd[2 * i + 1] = dat->e[i];
+        }
+        for (int8 p = 0; p < (int8) 2 * n * n; p++)
+            xd[p] = dat->w[p];
+    }
+    return ERR_NONE;
+}
+
+/* Builds the SVD results: U, V transposed, and the singular values as a
+ * column vector, for the original matrix, undoing the transposition if
+ * there was one.
+ */
+static int svd_results(eig_data_struct *dat, vartype **s, vartype **u,
+                       vartype **vt) {
+    int4 m = dat->m, n = dat->n, i, j;
+    if (!eig_range(dat->d, n) || !eig_range(dat->u, (int8) m * n)
+            || !eig_range(dat->z, (int8) n * n))
+        return ERR_OUT_OF_RANGE;
+    /* Without the transposition, U is m x n and V' is n x n; with it,
+     * the roles of the two are swapped.
+     */
+    int4 ur = dat->trans ? n : m;
+    int4 vc = dat->trans ? m : n;
+    *s = new_realmatrix(n, 1);
+    *u = new_realmatrix(ur, n);
+    *vt = new_realmatrix(n, vc);
+    if (*s == NULL || *u == NULL || *vt == NULL) {
+        free_vartype(*s);
+        free_vartype(*u);
+        free_vartype(*vt);
+        return ERR_INSUFFICIENT_MEMORY;
+    }
+    phloat *sd = ((vartype_realmatrix *) *s)->array->data;
+    phloat *ud = ((vartype_realmatrix *) *u)->array->data;
+    phloat *vd = ((vartype_realmatrix *) *vt)->array->data;
+    for (i = 0; i < n; i++)
+        sd[i] = dat->d[i];
+    phloat *uu = dat->u, *vv = dat->z;
+    if (!dat->trans) {
+        for (int8 p = 0; p < (int8) m * n; p++)
+            ud[p] = uu[p];
+        for (i = 0; i < n; i++)
+            for (j = 0; j < n; j++)
+                vd[(int8) i * n + j] = vv[(int8) j * n + i];
+    } else {
+        for (int8 p = 0; p < (int8) n * n; p++)
+            ud[p] = vv[p];
+        for (i = 0; i < n; i++)
+            for (j = 0; j < m; j++)
+                vd[(int8) i * m + j] = uu[(int8) j * n + i];
+    }
+    return ERR_NONE;
+}
+
+static int eig_worker(bool interrupted) {
+    eig_data_struct *dat = eig_data;
+    uint4 start = shell_milliseconds();
+    int8 work = 0;
+    int err;
+    vartype *r1 = NULL, *r2 = NULL, *r3 = NULL;
+
+    if (interrupted) {
+        err = ERR_INTERRUPTED;
+        goto done;
+    }
+    while (dat->state != EIG_DONE) {
+        err = eig_step(dat, &work);
+        if (err != ERR_NONE)
+            goto done;
+        if (work >= dat->slice) {
+            linalg_slice_adjust(&dat->slice, start);
+            return ERR_INTERRUPTIBLE;
+        }
+    }
+    if (dat->svd)
+        err = svd_results(dat, &r1, &r2, &r3);
+    else
+        err = eig_results(dat, &r1, &r2);
+
+    done:
+    bool svd = dat->svd;
+    int (*eig_completion)(int, vartype *, vartype *) = dat->eig_completion;
+    int (*svd_completion)(int, vartype *, vartype *, vartype *)
+                                                    = dat->svd_completion;
+    eig_free(dat);
+    if (svd)
+        return svd_completion(err, r1, r2, r3);
+    else
+        return eig_completion(err, r1, r2);
+}
+
+static eig_data_struct *eig_new(int4 m, int4 n, bool cpx) {
+    eig_data_struct *dat = (eig_data_struct *) malloc(sizeof(eig_data_struct));
+    if (dat == NULL)
+        return NULL;
+    int8 sz = (int8) m * n * (cpx ? 2 : 1);
+    dat->a = eig_alloc(sz);
+    dat->z = eig_alloc((int8) n * n * (cpx ? 2 : 1));
+    dat->u = NULL;
+    dat->d = eig_alloc(n);
+    dat->e = eig_alloc(n);
+    dat->w = NULL;
+    dat->y = eig_alloc(3 * (int8) n);
+    if (dat->a == NULL || dat->z == NULL || dat->d == NULL || dat->e == NULL
+            || dat->y == NULL) {
+        eig_free(dat);
+        return NULL;
+    }
+    dat->m = m;
+    dat->n = n;
+    dat->cinput = cpx;
+    dat->complex = cpx;
+    dat->trans = false;
+    #ifdef BCD_MATH
+        dat->eps = phloat("1e-33");
+    #else
+        dat->eps = DBL_EPSILON;
+    #endif
+    dat->tiny = POS_TINY_PHLOAT / dat->eps;
+    dat->k = 0;
+    dat->iter = 0;
+    dat->slice = EIG_SLICE;
+    return dat;
+}
+
+int linalg_eig(const vartype *src,
+               int (*completion)(int, vartype *values, vartype *vectors)) {
+    int4 n, i, j;
+    eig_data_struct *dat;
+    if (src->type == TYPE_REALMATRIX) {
+        const vartype_realmatrix *rm = (const vartype_realmatrix *) src;
+        if (contains_strings(rm))
+            return completion(ERR_ALPHA_DATA_IS_INVALID, NULL, NULL);
+        n = rm->rows;
+        if (rm->columns != n)
+            return completion(ERR_DIMENSION_ERROR, NULL, NULL);
+        dat = eig_new(n, n, false);
+        if (dat == NULL)
+            return completion(ERR_INSUFFICIENT_MEMORY, NULL, NULL);
+        phloat *s = rm->array->data;
+        bool sym = true;
+        for (i = 0; i < n && sym; i++)
+            for (j = 0; j < i; j++)
+                if (s[(int8) i * n + j] != s[(int8) j * n + i]) {
+                    sym = false;
+                    break;
+                }
+        if (sym) {
+            /* The symmetric case works on the lower triangle, in z */
+            phloat *v = dat->z;
+            for (int8 p = 0; p < (int8) n * n; p++)
+                v[p] = s[p];
+            for (j = 0; j < n; j++)
+                dat->d[j] = V(n - 1, j);
+            dat->k = n - 1;
+            dat->state = EIG_TRED2;
+        } else {
+            for (int8 p = 0; p < (int8) n * n; p++)
+                dat->a[p] = s[p];
+            dat->k = 1;
+            dat->state = EIG_ORTHES;
+        }
+    } else if (src->type == TYPE_COMPLEXMATRIX) {
+        const vartype_complexmatrix *cm = (const vartype_complexmatrix *) src;
+        n = cm->rows;
+        if (cm->columns != n)
+            return completion(ERR_DIMENSION_ERROR, NULL, NULL);
+        dat = eig_new(n, n, true);
+        if (dat == NULL)
+            return completion(ERR_INSUFFICIENT_MEMORY, NULL, NULL);
+        phloat *v = dat->z;
+        for (int8 p = 0; p < (int8) 2 * n * n; p++)
+            dat->a[p] = cm->array->data[p];
+        for (i = 0; i < n; i++)
+            for (j = 0; j < n; j++) {
+                VR(i, j) = i == j ? 1 : 0;
+                VI(i, j) = 0;
+            }
+        dat->k = 1;
+        dat->state = EIG_CORTH;
+    } else
+        return completion(ERR_INVALID_TYPE, NULL, NULL);
+
+    if (dat->state != EIG_TRED2) {
+        /* The non-symmetric cases need room for complex eigenvectors */
+        dat->w = eig_alloc((int8) 2 * n * n);
+        if (dat->w == NULL) {
+            eig_free(dat);
+            return completion(ERR_INSUFFICIENT_MEMORY, NULL, NULL);
+        }
+    }
+    dat->svd = false;
+    dat->eig_completion = completion;
+    eig_data = dat;
+    mode_interruptible = eig_worker;
+    mode_stoppable = false;
+    return ERR_INTERRUPTIBLE;
+}
+
+int linalg_svd(const vartype *src,
+               int (*completion)(int, vartype *s, vartype *u, vartype *vt)) {
+    if (src->type != TYPE_REALMATRIX)
+        return completion(ERR_INVALID_TYPE, NULL, NULL, NULL);
+    const vartype_realmatrix *rm = (const vartype_realmatrix *) src;
+    if (contains_strings(rm))
+        return completion(ERR_ALPHA_DATA_IS_INVALID, NULL, NULL, NULL);
+    /* The bidiagonalization needs at least as many rows as columns, so
+     * wide matrices are decomposed by way of their transpose.
+     */
+    bool trans = rm->rows < rm->columns;
+    int4 m = trans ? rm->columns : rm->rows;
+    int4 n = trans ? rm->rows : rm->columns;
+    eig_data_struct *dat = eig_new(m, n, false);
+    if (dat == NULL)
+        return completion(ERR_INSUFFICIENT_MEMORY, NULL, NULL, NULL);
+    dat->u = eig_alloc((int8) m * n);
+    dat->w = eig_alloc(m);
+    if (dat->u == NULL || dat->w == NULL) {
+        eig_free(dat);
+        return completion(ERR_INSUFFICIENT_MEMORY, NULL, NULL, NULL);
+    }
+    phloat *s = rm->array->data, *a = dat->a, *u = dat->u;
+    for (int4 i = 0; i < m; i++)
+        for (int4 j = 0; j < n; j++) {
+            A(i, j) = trans ? s[(int8) j * m + i] : s[(int8) i * n + j];
+            U(i, j) = 0;
+        }
+    dat->trans = trans;
+    dat->nct = m - 1 < n ? m - 1 : n;
+    dat->nrt = n - 2 < m ? n - 2 : m;
+    if (dat->nrt < 0)
+        dat->nrt = 0;
+    dat->state = SVD_BIDIAG;
+    dat->svd = true;
+    dat->svd_completion = completion;
+    eig_data = dat;
+    mode_interruptible = eig_worker;
+    mode_stoppable = false;
+    return ERR_INTERRUPTIBLE;
+}
+
+#undef A
+#undef V
+#undef U
+#undef AR
+#undef AI
+#undef VR
+#undef VI
+
+
+/******************************/
+/***** Fourier transforms *****/
+/******************************/
+
+/* FFT and IFFT use the iterative radix-2 algorithm when the length is a
+ * power of two, and Bluestein's algorithm otherwise, which turns a DFT of
+ * any length into a cyclic convolution, done with radix-2 transforms of at
+ * least twice that length. Matrices that aren't vectors get a 2-D
+ * transform: all the rows, and then all the columns, which are divided
+ * among the worker threads.
+ * The real and imaginary parts are kept in separate arrays, and every
+ * stage of the butterflies has its own table of twiddle factors, so the
+ * inner loops run over consecutive elements, and the compiler can
+ * vectorize them in the binary build.
+ * Only the forward transform is done directly; the inverse transform is
+ * the conjugate of the forward transform of the conjugate, divided by n.
+ */
+
+/* Number of elements a thread should get at least, in the 2-D case */
+#define FFT_PAR_GRAIN 4096
+/* CONV adds up the products directly when the shorter operand has at most
+ * this many elements
+ */
+#define CONV_DIRECT_MAX 32
+
+struct fft_plan {
+    int4 n;
+    /* Length of the radix-2 transforms: n, or at least 2n - 1 when using
+     * Bluestein's algorithm
+     */
+    int4 m;
+    /* Twiddle factors; the ones for the stage with butterflies of span h
+     * start at h - 1, so there are m - 1 in all
+     */
+    phloat *wr, *wi;
+    /* Bluestein only: the chirp exp(-pi*i*k^2/n), n elements, and the
+     * transform of its conjugate, divided by m, m elements
+     */
+    phloat *cr, *ci;
+    phloat *br, *bi;
+};
+
+static void fft_plan_free(fft_plan *p) {
+    if (p == NULL)
+        return;
+    free(p->wr);
+    free(p->wi);
+    free(p->cr);
+    free(p->ci);
+    free(p->br);
+    free(p->bi);
+    free(p);
+}
+
+static void fft_radix2(const fft_plan *p, phloat *re, phloat *im) {
+    int4 m = p->m;
+    for (int4 i = 1, j = 0; i < m; i++) {
+        int4 bit = m >> 1;
+        while (j & bit) {
+            j ^= bit;
+            bit >>= 1;
+        }
+        j |= bit;
+        if (i < j) {
+            phloat t = re[i];
+            re[i] = re[j];
+            re[j] = t;
+            t = im[i];
+            im[i] = im[j];
+            im[j] = t;
+        }
+    }
+    for (int4 h = 1; h < m; h <<= 1) {
+        const phloat *wr = p->wr + h - 1;
+        const phloat *wi = p->wi + h - 1;
+        for (int4 s = 0; s < m; s += 2 * h) {
+            phloat *ar = re + s, *ai = im + s;
+            phloat *br = ar + h, *bi = ai + h;
+            for (int4 j = 0; j < h; j++) {
+                phloat tr = br[j] * wr[j] - bi[j] * wi[j];
+                phloat ti = br[j] * wi[j] + bi[j] * wr[j];
+                br[j] = ar[j] - tr;
+                bi[j] = ai[j] - ti;
+                ar[j] += tr;
+                ai[j] += ti;
+            }
+        }
+    }
+}
+
+/* In-place forward transform of p->n elements; 'scratch' must have room
+ * for 2 * p->m elements when p->m != p->n.
+ */
+static void fft_forward(const fft_plan *p, phloat *re, phloat *im,
+                        phloat *scratch) {
+    int4 n = p->n, m = p->m;
+    if (m == n) {
+        fft_radix2(p, re, im);
+        return;
+    }
+    phloat *xr = scratch, *xi = scratch + m;
+    for (int4 k = 0; k < n; k++) {
+        xr[k] = re[k] * p->cr[k] - im[k] * p->ci[k];
+        xi[k] = re[k] * p->ci[k] + im[k] * p->cr[k];
+    }
+    for (int4 k = n; k < m; k++) {
+        xr[k] = 0;
+        xi[k] = 0;
+    }
+    fft_radix2(p, xr, xi);
+    /* Multiply by the transform of the conjugate chirp, and conjugate, for
+     * the inverse transform
+     */
+    for (int4 k = 0; k < m; k++) {
+        phloat tr = xr[k] * p->br[k] - xi[k] * p->bi[k];
+        phloat ti = xr[k] * p->bi[k] + xi[k] * p->br[k];
+        xr[k] = tr;
+        xi[k] = -ti;
+    }
+    fft_radix2(p, xr, xi);
+    for (int4 k = 0; k < n; k++) {
+        phloat yi = -xi[k];
+        re[k] = xr[k] * p->cr[k] - yi * p->ci[k];
+        im[k] = xr[k] * p->ci[k] + yi * p->cr[k];
+    }
+}
+
+/* Sets *re and *im to exp(-pi*i*r/n), for 0 <= r < 2n. The angle is
+ * reduced to the first octant, and the result is obtained from that by
+ * symmetry, so the values at multiples of pi/4 are exact (0, +-1, or
+ * +-sqrt(1/2)), and values that should be equal in magnitude are.
+ */
+static void fft_twiddle(int4 r, int4 n, phloat *re, phloat *im) {
+    int8 t = 4 * (int8) r;
+    int oct = (int) (t / n);
+    int4 u = (int4) (t - (int8) oct * n);
+    if ((oct & 1) != 0)
+        u = n - u;
+    phloat c, s;
+    if (u == 0) {
+        c = 1;
+        s = 0;
+    } else if (u == n) {
+        c = s = sqrt(phloat(0.5));
+    } else
+        p_sincos(PI * u / n / 4, &s, &c);
+    switch (oct) {
+        case 0: *re = c; *im = -s; break;
+        case 1: *re = s; *im = -c; break;
+        case 2: *re = -s; *im = -c; break;
+        case 3: *re = -c; *im = -s; break;
+        case 4: *re = -c; *im = s; break;
+        case 5: *re = -s; *im = c; break;
+        case 6: *re = s; *im = c; break;
+        default: *re = c; *im = s; break;
+    }
+    /* No negative zeros */
+    if (*re == 0)
+        *re = 0;
+    if (*im == 0)
+        *im = 0;
+}
+
+static fft_plan *fft_plan_new(int4 n) {
+    if (n > 0x20000000)
+        return NULL;
+    bool pow2 = (n & (n - 1)) == 0;
+    int4 min = pow2 ? n : 2 * n - 1;
+    int4 m = 1;
+    while (m < min)
+        m <<= 1;
+    fft_plan *p = (fft_plan *) malloc(sizeof(fft_plan));
+    if (p == NULL)
+        return NULL;
+    p->n = n;
+    p->m = m;
+    p->wr = eig_alloc(m);
+    p->wi = eig_alloc(m);
+    p->cr = p->ci = p->br = p->bi = NULL;
+    if (p->wr == NULL || p->wi == NULL)
+        goto nomem;
+    if (m > 1) {
+        /* The last stage needs exp(-pi*i*j/h) for j = 0 .. h - 1, and the
+         * earlier stages need every other one of the stage after them.
+         */
+        int4 h = m / 2;
+        phloat *wr = p->wr + h - 1, *wi = p->wi + h - 1;
+        for (int4 j = 0; j < h; j++)
+            fft_twiddle(j, h, wr + j, wi + j);
+        for (int4 g = h / 2; g >= 1; g /= 2)
+            for (int4 j = 0; j < g; j++) {
+                p->wr[g - 1 + j] = p->wr[2 * g - 1 + 2 * j];
+                p->wi[g - 1 + j] = p->wi[2 * g - 1 + 2 * j];
+            }
+    }
+    if (!pow2) {
+        p->cr = eig_alloc(n);
+        p->ci = eig_alloc(n);
+        p->br = eig_alloc(m);
+        p->bi = eig_alloc(m);
+        if (p->cr == NULL || p->ci == NULL || p->br == NULL || p->bi == NULL)
+            goto nomem;
+        for (int4 k = 0; k < n; k++) {
+            /* Reducing k^2 modulo 2n keeps r in the range fft_twiddle() takes */
+            int4 r = (int4) ((int8) k * k % (2 * n));
+            fft_twiddle(r, n, p->cr + k, p->ci + k);
+        }
+        for (int4 k = 0; k < m; k++) {
+            p->br[k] = 0;
+            p->bi[k] = 0;
+        }
+        p->br[0] = p->cr[0];
+        p->bi[0] = -p->ci[0];
+        for (int4 k = 1; k < n; k++) {
+            p->br[k] = p->br[m - k] = p->cr[k];
+            p->bi[k] = p->bi[m - k] = -p->ci[k];
+        }
+        fft_radix2(p, p->br, p->bi);
+        for (int4 k = 0; k < m; k++) {
+            p->br[k] /= m;
+            p->bi[k] /= m;
+        }
+    }
+    return p;
+
+    nomem:
+    fft_plan_free(p);
+    return NULL;
+}
+
+struct fft_job {
+    const fft_plan *plan;
+    phloat *re, *im;
+    int4 rows, columns;
+};
+
+static int fft_rows(void *ctx, int4 from, int4 to) {
+    fft_job *job = (fft_job *) ctx;
+    const fft_plan *p = job->plan;
+    phloat *scratch = NULL;
+    if (p->m != p->n) {
+        scratch = eig_alloc((int8) 2 * p->m);
+        if (scratch == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+    }
+    for (int4 i = from; i < to; i++) {
+        int8 off = (int8) i * job->columns;
+        fft_forward(p, job->re + off, job->im + off, scratch);
+    }
+    free(scratch);
+    return ERR_NONE;
+}
+
+static int fft_columns(void *ctx, int4 from, int4 to) {
+    fft_job *job = (fft_job *) ctx;
+    const fft_plan *p = job->plan;
+    int4 rows = job->rows, columns = job->columns;
+    phloat *buf = eig_alloc((int8) 2 * rows + (p->m != p->n ? 2 * p->m : 0));
+    if (buf == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    phloat *cr = buf, *ci = buf + rows, *scratch = buf + 2 * rows;
+    for (int4 j = from; j < to; j++) {
+        for (int4 i = 0; i < rows; i++) {
+            cr[i] = job->re[(int8) i * columns + j];
+            ci[i] = job->im[(int8) i * columns + j];
+        }
+        fft_forward(p, cr, ci, scratch);
+        for (int4 i = 0; i < rows; i++) {
+            job->re[(int8) i * columns + j] = cr[i];
+            job->im[(int8) i * columns + j] = ci[i];
+        }
+    }
+    free(buf);
+    return ERR_NONE;
+}
+
+/* Copies a real or complex matrix into separate arrays of real and
+ * imaginary parts
+ */
+static void fft_load(const vartype *v, phloat *re, phloat *im) {
+    if (v->type == TYPE_REALMATRIX) {
+        const vartype_realmatrix *rm = (const vartype_realmatrix *) v;
+        int8 n = (int8) rm->rows * rm->columns;
+        for (int8 i = 0; i < n; i++) {
+            re[i] = rm->array->data[i];
+            im[i] = 0;
+        }
+    } else {
+        const vartype_complexmatrix *cm = (const vartype_complexmatrix *) v;
+        int8 n = (int8) cm->rows * cm->columns;
+        for (int8 i = 0; i < n; i++) {
+            re[i] = cm->array->data[2 * i];
+            im[i] = cm->array->data[2 * i + 1];
+        }
+    }
+}
+
+static int fft_result(const phloat *re, const phloat *im, int4 rows,
+                      int4 columns, bool real, vartype **res) {
+    int8 n = (int8) rows * columns;
+    if (!eig_range(re, n) || (!real && !eig_range(im, n)))
+        return ERR_OUT_OF_RANGE;
+    if (real) {
+        vartype_realmatrix *rm = (vartype_realmatrix *) new_realmatrix(rows, columns);
+        if (rm == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        for (int8 i = 0; i < n; i++)
+            rm->array->data[i] = re[i];
+        *res = (vartype *) rm;
+    } else {
+        vartype_complexmatrix *cm = (vartype_complexmatrix *) new_complexmatrix(rows, columns);
+        if (cm == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        for (int8 i = 0; i < n; i++) {
+            cm->array->data[2 * i] = re[i];
+            cm->array->data[2 * i + 1] = im[i];
+        }
+        *res = (vartype *) cm;
+    }
+    return ERR_NONE;
+}
+
+static int fft_check(const vartype *v) {
+    if (v->type == TYPE_REALMATRIX) {
+        if (contains_strings((const vartype_realmatrix *) v))
+            return ERR_ALPHA_DATA_IS_INVALID;
+        return ERR_NONE;
+    } else if (v->type == TYPE_COMPLEXMATRIX)
+        return ERR_NONE;
+    else
+        return ERR_INVALID_TYPE;
+}
+
+int linalg_fft(const vartype *src, bool inverse, vartype **res) {
+    int err = fft_check(src);
+    if (err != ERR_NONE)
+        return err;
+    /* The two matrix types have the same layout up to the array pointer */
+    const vartype_realmatrix *m = (const vartype_realmatrix *) src;
+    int4 rows = m->rows, columns = m->columns;
+    int8 n = (int8) rows * columns;
+    phloat *re = eig_alloc(n);
+    phloat *im = eig_alloc(n);
+    fft_plan *rp = NULL, *cp = NULL;
+    fft_job job;
+    if (re == NULL || im == NULL)
+        goto nomem;
+    fft_load(src, re, im);
+    if (inverse)
+        for (int8 i = 0; i < n; i++)
+            im[i] = -im[i];
+
+    job.re = re;
+    job.im = im;
+    if (rows == 1 || columns == 1) {
+        rp = fft_plan_new((int4) n);
+        if (rp == NULL)
+            goto nomem;
+        job.plan = rp;
+        job.rows = 1;
+        job.columns = (int4) n;
+        err = fft_rows(&job, 0, 1);
+    } else {
+        rp = fft_plan_new(columns);
+        cp = rows == columns ? rp : fft_plan_new(rows);
+        if (rp == NULL || cp == NULL)
+            goto nomem;
+        job.rows = rows;
+        job.columns = columns;
+        job.plan = rp;
+        err = linalg_parallel(rows, FFT_PAR_GRAIN / columns, fft_rows, &job);
+        if (err == ERR_NONE) {
+            job.plan = cp;
+            err = linalg_parallel(columns, FFT_PAR_GRAIN / rows, fft_columns, &job);
+        }
+    }
+    if (err != ERR_NONE)
+        goto done;
+
+    if (inverse)
+        for (int8 i = 0; i < n; i++) {
+            re[i] /= n;
+            im[i] = -im[i] / n;
+        }
+    err = fft_result(re, im, rows, columns, false, res);
+    goto done;
+
+    nomem:
+    err = ERR_INSUFFICIENT_MEMORY;
+    done:
+    if (cp != rp)
+        fft_plan_free(cp);
+    fft_plan_free(rp);
+    free(re);
+    free(im);
+    return err;
+}
+
+/* Linear convolution of two vectors. The result is a row vector if the
+ * first operand is one, and a column vector otherwise; it is real if both
+ * operands are real.
+ */
+int linalg_conv(const vartype *a, const vartype *b, vartype **res) {
+    int err = fft_check(a);
+    if (err == ERR_NONE)
+        err = fft_check(b);
+    if (err != ERR_NONE)
+        return err;
+    const vartype_realmatrix *ma = (const vartype_realmatrix *) a;
+    const vartype_realmatrix *mb = (const vartype_realmatrix *) b;
+    if ((ma->rows != 1 && ma->columns != 1) || (mb->rows != 1 && mb->columns != 1))
+        return ERR_DIMENSION_ERROR;
+    int4 na = ma->rows * ma->columns;
+    int4 nb = mb->rows * mb->columns;
+    if ((int8) na + nb - 1 > 0x20000000)
+        return ERR_INSUFFICIENT_MEMORY;
+    int4 n = na + nb - 1;
+    bool row = ma->rows == 1 && (ma->columns > 1 || mb->rows == 1);
+    bool real = a->type == TYPE_REALMATRIX && b->type == TYPE_REALMATRIX;
+
+    phloat *ar = NULL, *ai = NULL, *br = NULL, *bi = NULL, *cr = NULL, *ci = NULL;
+    fft_plan *p = NULL;
+    if (na <= CONV_DIRECT_MAX || nb <= CONV_DIRECT_MAX) {
+        ar = eig_alloc(na);
+        ai = eig_alloc(na);
+        br = eig_alloc(nb);
+        bi = eig_alloc(nb);
+        cr = eig_alloc(n);
+        ci = eig_alloc(n);
+        if (ar == NULL || ai == NULL || br == NULL || bi == NULL
+                || cr == NULL || ci == NULL)
+            goto nomem;
+        fft_load(a, ar, ai);
+        fft_load(b, br, bi);
+        for (int4 k = 0; k < n; k++) {
+            phloat sr = 0, si = 0;
+            int4 i0 = k < nb ? 0 : k - nb + 1;
+            int4 i1 = k < na ? k : na - 1;
+            for (int4 i = i0; i <= i1; i++) {
+                sr += ar[i] * br[k - i] - ai[i] * bi[k - i];
+                si += ar[i] * bi[k - i] + ai[i] * br[k - i];
+            }
+            cr[k] = sr;
+            ci[k] = si;
+        }
+    } else {
+        /* Zero-padding to a power of two makes the cyclic convolution
+         * linear, and avoids Bluestein
+         */
+        int4 m = 1;
+        while (m < n)
+            m <<= 1;
+        p = fft_plan_new(m);
+        if (p == NULL)
+            goto nomem;
+        ar = eig_alloc(m);
+        ai = eig_alloc(m);
+        br = eig_alloc(m);
+        bi = eig_alloc(m);
+        if (ar == NULL || ai == NULL || br == NULL || bi == NULL)
+            goto nomem;
+        fft_load(a, ar, ai);
+        fft_load(b, br, bi);
+        for (int4 k = na; k < m; k++) {
+            ar[k] = 0;
+            ai[k] = 0;
+        }
+        for (int4 k = nb; k < m; k++) {
+            br[k] = 0;
+            bi[k] = 0;
+        }
+        fft_radix2(p, ar, ai);
+        fft_radix2(p, br, bi);
+        for (int4 k = 0; k < m; k++) {
+            phloat tr = ar[k] * br[k] - ai[k] * bi[k];
+            phloat ti = ar[k] * bi[k] + ai[k] * br[k];
+            ar[k] = tr;
+            ai[k] = -ti;
+        }
+        fft_radix2(p, ar, ai);
+        for (int4 k = 0; k < n; k++) {
+            ar[k] /= m;
+            ai[k] = -ai[k] / m;
+        }
+        cr = ar;
+        ci = ai;
+        ar = ai = NULL;
+    }
+    err = fft_result(cr, ci, row ? 1 : n, row ? n : 1, real, res);
+    goto done;
+
+    nomem:
+    err = ERR_INSUFFICIENT_MEMORY;
+    done:
+    fft_plan_free(p);
+    free(ar);
+    free(ai);
+    free(br);
+    free(bi);
+    free(cr);
+    free(ci);
+    return err;
+}
@@ -20,6 +20,11 @@
 
 #include "core_variables.h"
 
+int linalg_threads();
+int linalg_parallel(int4 count, int4 grain,
+                    int (*fn)(void *ctx, int4 from, int4 to), void *ctx);
+void linalg_slice_adjust(int4 *budget, uint4 start);
+
 int lu_decomp_r(vartype_realmatrix *a, int4 *perm,
                        int (*completion)(int, vartype_realmatrix *,
                                           int4 *, phloat));
@@ -46,4 +51,26 @@ int lu_backsubst_cc(vartype_complexmatrix *a,
                             int (*completion)(int, vartype_complexmatrix *,
                                 int4 *, vartype_complexmatrix *));
 
+#ifdef BCD_MATH
+int lu_solve_mixed(vartype_realmatrix *a, vartype_realmatrix *b,
+                        int (*completion)(int, vartype_realmatrix *));
+#endif
+
+int sparse_from_dense(const vartype_realmatrix *m, vartype **res);
+int sparse_from_triples(int4 rows, int4 columns, const vartype_realmatrix *t,
+                        vartype **res);
+int sparse_to_dense(const vartype_sparsematrix *sm, vartype **res);
+int sparse_mul(const vartype *left, const vartype *right,
+               int (*completion)(int, vartype *));
+int sparse_div(const vartype *left, const vartype *right,
+               int (*completion)(int, vartype *));
+
+int linalg_eig(const vartype *src,
+               int (*completion)(int, vartype *values, vartype *vectors));
+int linalg_svd(const vartype *src,
+               int (*completion)(int, vartype *s, vartype *u, vartype *vt));
+
+int linalg_fft(const vartype *src, bool inverse, vartype **res);
+int linalg_conv(const vartype *a, const vartype *b, vartype **res);
+
 #endif
@@ -32,6 +32,7 @@
 #include "core_equations.h"
 #include "core_helpers.h"
 #include "core_keydown.h"
+#include "core_linalg1.h"
 #include "core_math1.h"
 #include "core_sto_rcl.h"
 #include "core_tables.h"
@@ -192,6 +193,9 @@ void core_init(int *rows, int *cols, int read_saved_state, const char *state_fil
         free(state_file_name_crash);
     }
 
+    if (core_settings.matrix_block_size == 0)
+        calibrate_matrix_block_size();
+
     initialized = true;
 
     *rows = requested_disp_r;
@@ -247,6 +251,8 @@ void core_cleanup() {
     free_vartype(lastx);
     lastx = NULL;
     clear_rtns_vars_and_prgms();
+    lu_cache_clear();
+    clear_find_indexes();
     clean_vartype_pools();
 }
 
@@ -864,7 +870,7 @@ bool core_keyup() {
         }
         mode_disable_stack_lift = false;
         set_running(true);
-        error = handle(cmd, &arg);
+        error = handle_tangent(cmd, &arg);
         set_running(false);
         mode_pause = false;
     } else {
@@ -2986,6 +2992,11 @@ static void serialize_list(textbuf *tb, vartype_list *list, int indent) {
                 tb_write(tb, "\"VAR_REF\"\n", 10);
                 break;
             }
+            case TYPE_SPARSEMATRIX: {
+                tb_indent(tb, indent);
+                tb_write(tb, "\"SPARSE\"\n", 9);
+                break;
+            }
         }
     }
     indent -= 2;
@@ -3097,6 +3108,28 @@ char *core_copy() {
                 tb_write(&tb, "\n", 1);
         }
         goto textbuf_finish;
+    } else if (stack[sp]->type == TYPE_SPARSEMATRIX) {
+        /* Copied as (row, column, value) triples, one per line, the same
+         * form SPMAT takes after pasting
+         */
+        const char *format = core_settings.localized_copy_paste ? number_format() : NULL;
+        vartype_sparsematrix *sm = (vartype_sparsematrix *) stack[sp];
+        sparsematrix_data *sd = sm->array;
+        char buf[50];
+        for (int4 r = 0; r < sm->rows; r++) {
+            for (int4 k = sd->rowptr[r]; k < sd->rowptr[r + 1]; k++) {
+                int bufptr = int2string(r + 1, buf, 50);
+                buf[bufptr++] = '\t';
+                bufptr += int2string(sd->col[k] + 1, buf + bufptr, 50 - bufptr);
+                buf[bufptr++] = '\t';
+                tb_write(&tb, buf, bufptr);
+                bufptr = real2buf(buf, sd->val[k], format);
+                tb_write(&tb, buf, bufptr);
+                if (k < sd->nnz - 1)
+                    tb_write(&tb, "\n", 1);
+            }
+        }
+        goto textbuf_finish;
     } else if (stack[sp]->type == TYPE_LIST) {
         serialize_list(&tb, (vartype_list *) stack[sp], 0);
         goto textbuf_finish;
@@ -5298,6 +5331,8 @@ void core_paste(const char *buf) {
                 rm->columns = cols;
                 rm->array->data = data;
                 rm->array->is_string = is_string;
+                rm->array->strings = count_strings(is_string, p);
+                rm->array->capacity = n;
                 rm->array->refcount = 1;
                 v = (vartype *) rm;
             } else {
@@ -5322,6 +5357,7 @@ void core_paste(const char *buf) {
                 cm->rows = rows;
                 cm->columns = cols;
                 cm->array->data = data;
+                cm->array->capacity = n;
                 cm->array->refcount = 1;
                 v = (vartype *) cm;
             }
@@ -5499,7 +5535,7 @@ static void continue_running() {
             print_program_line(current_prgm, oldpc);
         }
         mode_disable_stack_lift = false;
-        error = handle(cmd, &arg);
+        error = handle_tangent(cmd, &arg);
         if (mode_pause) {
             shell_request_timeout3(1000);
             return;
@@ -339,12 +339,21 @@ void core_get_char_pixels(const char *ch, char *pixels);
  * This is a struct that stores user-configurable core settings. The shell
  * should provide the appropriate controls in a "Preferences" dialog box to
  * allow the user to view and change these settings.
+ * matrix_block_size is not user-configurable; it is determined by the core
+ * in core_init(), the first time it runs on a host, and the shell should
+ * just persist it. Initialize it to 0 to have it determined again.
+ * matrix_mixedprecision only affects the decimal build: it makes matrix
+ * division and SIMQ factor real matrices in binary and refine the solution
+ * in decimal, falling back on a fully decimal solution when that doesn't
+ * converge.
  */
 struct core_settings_struct {
     bool matrix_singularmatrix;
     bool matrix_outofrange;
     bool auto_repeat;
     bool localized_copy_paste;
+    int matrix_block_size;
+    bool matrix_mixedprecision;
 };
 
 extern core_settings_struct core_settings;
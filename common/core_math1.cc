@@ -16,6 +16,7 @@
  *****************************************************************************/
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "core_math1.h"
 #include "core_commands2.h"
@@ -26,6 +27,7 @@
 #include "core_helpers.h"
 #include "core_main.h"
 #include "core_parser.h"
+#include "core_sto_rcl.h"
 #include "core_variables.h"
 #include "shell.h"
 
@@ -47,6 +49,10 @@ struct caller_info {
     int ret(int err) {
         if (prev_prgm.idx == -5) {
             return return_to_plot(err != ERR_NONE, err == ERR_NONE && !keep_running);
+        } else if (prev_prgm.idx == -6) {
+            return err != ERR_NONE ? err : return_to_table(!keep_running);
+        } else if (prev_prgm.idx == -8) {
+            return err != ERR_NONE ? err : return_to_root_scan(!keep_running);
         } else if (prev_prgm.idx == -3) {
             return return_to_integ(err == ERR_NONE && !keep_running);
         } else {
@@ -96,6 +102,10 @@ struct solve_state {
     vartype *param_unit;
     phloat f_gap;
     int f_gap_worsening_counter;
+    int use_tangents;
+    phloat curr_df;
+    phloat newton_step;
+    int4 evals;
     solve_state() : eq(NULL), active_eq(NULL), saved_t(NULL), param_unit(NULL) {
         prgm_length = 0;
         for (int i = 0; i < NUM_SHADOWS; i++) {
@@ -146,9 +156,130 @@ struct integ_state {
 
 static integ_state integ;
 
+/* Table */
+#define TABLE_EVAL 0
+#define TABLE_SOLVE 1
+#define TABLE_INTEG 2
+
+struct table_state {
+    int state;
+    int mode;
+    vartype *fun;
+    char var_name[7];
+    int var_length;
+    vartype *names;
+    vartype *values;
+    vartype *result;
+    int4 row;
+    int prev_sp;
+    table_state() : state(0), fun(NULL), names(NULL), values(NULL), result(NULL) {}
+};
+
+static table_state table;
+
+/* Cubature */
+#define CUBA_MAX_DIM 10
+#define CUBA_MAX_EVALS 100000
+
+struct cuba_state {
+    int state;
+    vartype *fun;
+    vartype *names;
+    vartype *regions;
+    int4 nregions;
+    int n;
+    phloat acc;
+    int4 cur, next;
+    int4 point;
+    int4 evals;
+    phloat f0, sum2, sum3, sum4, sum5;
+    phloat f2[CUBA_MAX_DIM], f3[CUBA_MAX_DIM];
+    int prev_sp;
+    cuba_state() : state(0), fun(NULL), names(NULL), regions(NULL) {}
+};
+
+static cuba_state cuba;
+
+/* Root scan */
+#define SCAN_INTERVALS 64
+#define SCAN_MAX_DEPTH 6
+#define SCAN_MAX_SAMPLES 2000
+
+struct scan_state {
+    int state;
+    vartype *fun;
+    char var_name[7];
+    int var_length;
+    phloat a, b;
+    vartype *samples;
+    int4 nsamples;
+    int4 pos;
+    vartype *roots;
+    int4 nroots;
+    int prev_sp;
+    scan_state() : state(0), fun(NULL), samples(NULL), roots(NULL) {}
+};
+
+static scan_state rscan;
+
+/* Map, filter, reduce */
+struct map_state {
+    int state;
+    int op;
+    vartype *fun;
+    vartype *src;
+    vartype *result;
+    int4 pos;
+    int4 count;
+    int prev_sp;
+    map_state() : state(0), fun(NULL), src(NULL), result(NULL) {}
+};
+
+static map_state lmap;
+
 
 static void reset_solve();
 static void reset_integ();
+static void reset_table();
+static void reset_cuba();
+static void reset_scan();
+static void free_tangents();
+static void reset_map();
+
+/* Root cache: remembers recent roots found by SOLVE, keyed by equation or
+ * program and unknown, along with the values of the other parameters at
+ * the time. When the same problem is solved again, the starting guesses are
+ * taken from the cached root whose parameters are nearest to the current
+ * ones, or extrapolated from the last two roots, if the parameters are
+ * moving along a straight line. See SCACHE.
+ */
+
+#define ROOT_CACHE_KEYS 8
+#define ROOT_CACHE_MAX 100
+
+struct root_cache {
+    char prgm_name[7];
+    int prgm_length;
+    char *eqn_text;
+    int4 eqn_length;
+    char var_name[7];
+    int var_length;
+    int nparams;
+    int count;
+    int next;
+    uint4 last_used;
+    // count entries of nparams + 2 phloats each: the parameters,
+    // the root, and the second-best guess
+    phloat *data;
+};
+
+static int root_cache_size = 0;
+static root_cache root_caches[ROOT_CACHE_KEYS];
+static uint4 root_cache_clock = 0;
+static phloat *solve_params = NULL;
+static int solve_nparams = -1;
+
+static void clear_root_caches();
 
 
 bool persist_math() {
@@ -200,6 +331,11 @@ bool persist_math() {
     if (!write_int4(solve.last_disp_time)) return false;
     if (!write_int(solve.prev_sp)) return false;
     if (!persist_vartype(solve.param_unit)) return false;
+    if (!write_int(solve.use_tangents)) return false;
+    if (!write_phloat(solve.curr_df)) return false;
+    if (!write_phloat(solve.newton_step)) return false;
+    if (!write_int4(solve.evals)) return false;
+    if (!write_int(root_cache_size)) return false;
 
     if (!write_int(integ.version)) return false;
     if (!persist_vartype(integ.eq)) return false;
@@ -247,6 +383,61 @@ bool persist_math() {
     if (!write_int(integ.prev_sp)) return false;
     if (!persist_vartype(integ.param_unit)) return false;
     if (!persist_vartype(integ.result_unit)) return false;
+
+    if (!write_int(table.state)) return false;
+    if (!write_int(table.mode)) return false;
+    if (!persist_vartype(table.fun)) return false;
+    if (fwrite(table.var_name, 1, 7, gfile) != 7) return false;
+    if (!write_int(table.var_length)) return false;
+    if (!persist_vartype(table.names)) return false;
+    if (!persist_vartype(table.values)) return false;
+    if (!persist_vartype(table.result)) return false;
+    if (!write_int4(table.row)) return false;
+    if (!write_int(table.prev_sp)) return false;
+
+    if (!write_int(cuba.state)) return false;
+    if (!persist_vartype(cuba.fun)) return false;
+    if (!persist_vartype(cuba.names)) return false;
+    if (!persist_vartype(cuba.regions)) return false;
+    if (!write_int4(cuba.nregions)) return false;
+    if (!write_int(cuba.n)) return false;
+    if (!write_phloat(cuba.acc)) return false;
+    if (!write_int4(cuba.cur)) return false;
+    if (!write_int4(cuba.next)) return false;
+    if (!write_int4(cuba.point)) return false;
+    if (!write_int4(cuba.evals)) return false;
+    if (!write_phloat(cuba.f0)) return false;
+    if (!write_phloat(cuba.sum2)) return false;
+    if (!write_phloat(cuba.sum3)) return false;
+    if (!write_phloat(cuba.sum4)) return false;
+    if (!write_phloat(cuba.sum5)) return false;
+    for (int i = 0; i < CUBA_MAX_DIM; i++) {
+        if (!write_phloat(cuba.f2[i])) return false;
+        if (!write_phloat(cuba.f3[i])) return false;
+    }
+    if (!write_int(cuba.prev_sp)) return false;
+
+    if (!write_int(rscan.state)) return false;
+    if (!persist_vartype(rscan.fun)) return false;
+    if (fwrite(rscan.var_name, 1, 7, gfile) != 7) return false;
+    if (!write_int(rscan.var_length)) return false;
+    if (!write_phloat(rscan.a)) return false;
+    if (!write_phloat(rscan.b)) return false;
+    if (!persist_vartype(rscan.samples)) return false;
+    if (!write_int4(rscan.nsamples)) return false;
+    if (!write_int4(rscan.pos)) return false;
+    if (!persist_vartype(rscan.roots)) return false;
+    if (!write_int4(rscan.nroots)) return false;
+    if (!write_int(rscan.prev_sp)) return false;
+
+    if (!write_int(lmap.state)) return false;
+    if (!write_int(lmap.op)) return false;
+    if (!persist_vartype(lmap.fun)) return false;
+    if (!persist_vartype(lmap.src)) return false;
+    if (!persist_vartype(lmap.result)) return false;
+    if (!write_int4(lmap.pos)) return false;
+    if (!write_int4(lmap.count)) return false;
+    if (!write_int(lmap.prev_sp)) return false;
     return true;
 }
 
@@ -318,6 +509,23 @@ bool unpersist_math(int ver) {
     } else {
         if (!unpersist_vartype(&solve.param_unit)) return false;
     }
+    if (ver < 55) {
+        solve.use_tangents = 0;
+        solve.curr_df = NAN_PHLOAT;
+        solve.newton_step = POS_HUGE_PHLOAT;
+    } else {
+        if (!read_int(&solve.use_tangents)) return false;
+        if (!read_phloat(&solve.curr_df)) return false;
+        if (!read_phloat(&solve.newton_step)) return false;
+    }
+    clear_root_caches();
+    if (ver < 56) {
+        solve.evals = 0;
+        root_cache_size = 0;
+    } else {
+        if (!read_int4(&solve.evals)) return false;
+        if (!read_int(&root_cache_size)) return false;
+    }
     solve.f_gap = NAN_PHLOAT;
 
     if (!read_int(&integ.version)) return false;
@@ -372,12 +580,86 @@ bool unpersist_math(int ver) {
         if (!unpersist_vartype(&integ.param_unit)) return false;
         if (!unpersist_vartype(&integ.result_unit)) return false;
     }
+
+    reset_table();
+    if (ver >= 57) {
+        if (!read_int(&table.state)) return false;
+        if (!read_int(&table.mode)) return false;
+        if (!unpersist_vartype(&table.fun)) return false;
+        if (fread(table.var_name, 1, 7, gfile) != 7) return false;
+        if (!read_int(&table.var_length)) return false;
+        if (!unpersist_vartype(&table.names)) return false;
+        if (!unpersist_vartype(&table.values)) return false;
+        if (!unpersist_vartype(&table.result)) return false;
+        if (!read_int4(&table.row)) return false;
+        if (!read_int(&table.prev_sp)) return false;
+    }
+
+    reset_cuba();
+    if (ver >= 58) {
+        if (!read_int(&cuba.state)) return false;
+        if (!unpersist_vartype(&cuba.fun)) return false;
+        if (!unpersist_vartype(&cuba.names)) return false;
+        if (!unpersist_vartype(&cuba.regions)) return false;
+        if (!read_int4(&cuba.nregions)) return false;
+        if (!read_int(&cuba.n)) return false;
+        if (!read_phloat(&cuba.acc)) return false;
+        if (!read_int4(&cuba.cur)) return false;
+        if (!read_int4(&cuba.next)) return false;
+        if (!read_int4(&cuba.point)) return false;
+        if (!read_int4(&cuba.evals)) return false;
+        if (!read_phloat(&cuba.f0)) return false;
+        if (!read_phloat(&cuba.sum2)) return false;
+        if (!read_phloat(&cuba.sum3)) return false;
+        if (!read_phloat(&cuba.sum4)) return false;
+        if (!read_phloat(&cuba.sum5)) return false;
+        for (int i = 0; i < CUBA_MAX_DIM; i++) {
+            if (!read_phloat(&cuba.f2[i])) return false;
+            if (!read_phloat(&cuba.f3[i])) return false;
+        }
+        if (!read_int(&cuba.prev_sp)) return false;
+    }
+
+    reset_scan();
+    if (ver >= 59) {
+        if (!read_int(&rscan.state)) return false;
+        if (!unpersist_vartype(&rscan.fun)) return false;
+        if (fread(rscan.var_name, 1, 7, gfile) != 7) return false;
+        if (!read_int(&rscan.var_length)) return false;
+        if (!read_phloat(&rscan.a)) return false;
+        if (!read_phloat(&rscan.b)) return false;
+        if (!unpersist_vartype(&rscan.samples)) return false;
+        if (!read_int4(&rscan.nsamples)) return false;
+        if (!read_int4(&rscan.pos)) return false;
+        if (!unpersist_vartype(&rscan.roots)) return false;
+        if (!read_int4(&rscan.nroots)) return false;
+        if (!read_int(&rscan.prev_sp)) return false;
+    }
+
+    reset_map();
+    if (ver >= 61) {
+        if (!read_int(&lmap.state)) return false;
+        if (!read_int(&lmap.op)) return false;
+        if (!unpersist_vartype(&lmap.fun)) return false;
+        if (!unpersist_vartype(&lmap.src)) return false;
+        if (!unpersist_vartype(&lmap.result)) return false;
+        if (!read_int4(&lmap.pos)) return false;
+        if (!read_int4(&lmap.count)) return false;
+        if (!read_int(&lmap.prev_sp)) return false;
+    }
     return true;
 }
 
 void reset_math() {
+    clear_root_caches();
+    root_cache_size = 0;
+    solve.evals = 0;
     reset_solve();
     reset_integ();
+    reset_table();
+    reset_cuba();
+    reset_scan();
+    reset_map();
 }
 
 void math_equation_deleted(int eqn_index) {
@@ -422,6 +704,7 @@ static void reset_solve() {
     solve.state = 0;
     free_vartype(solve.param_unit);
     solve.param_unit = NULL;
+    free_tangents();
     if (mode_appmenu == MENU_SOLVE)
         set_menu_return_err(MENULEVEL_APP, MENU_NONE, true);
     solve.caller.prev_prgm.set(root->id, 0);
@@ -491,6 +774,372 @@ int set_solve_eqn(vartype *eq) {
     return solve.eq == NULL ? ERR_INSUFFICIENT_MEMORY : ERR_NONE;
 }
 
+static void clear_root_cache(root_cache *rc) {
+    free(rc->eqn_text);
+    rc->eqn_text = NULL;
+    free(rc->data);
+    rc->data = NULL;
+    rc->count = 0;
+    rc->next = 0;
+}
+
+static void clear_root_caches() {
+    for (int i = 0; i < ROOT_CACHE_KEYS; i++)
+        clear_root_cache(&root_caches[i]);
+    free(solve_params);
+    solve_params = NULL;
+    solve_nparams = -1;
+}
+
+int set_root_cache_size(int size) {
+    if (size < 0 || size > ROOT_CACHE_MAX)
+        return ERR_INVALID_DATA;
+    clear_root_caches();
+    root_cache_size = size;
+    return ERR_NONE;
+}
+
+int4 get_solve_evals() {
+    return solve.evals;
+}
+
+/* Save the values of the parameters of the equation or program being
+ * solved, other than the unknown itself. If any of them is not a real
+ * number or a unit, the root cache is not used for this solve.
+ */
+static void capture_solve_params() {
+    free(solve_params);
+    solve_params = NULL;
+    solve_nparams = -1;
+    if (root_cache_size == 0 || solve.caller.prev_prgm.idx == -5
+            || solve.caller.prev_prgm.idx == -8)
+        return;
+    std::vector<std::string> names;
+    if (solve.active_eq != NULL)
+        names = get_parameters(((vartype_equation *) solve.active_eq)->data);
+    else
+        names = get_mvars(solve.active_prgm_name, solve.active_prgm_length);
+    phloat *p = (phloat *) malloc((names.size() + 1) * sizeof(phloat));
+    if (p == NULL)
+        return;
+    int n = 0;
+    for (size_t i = 0; i < names.size(); i++) {
+        const char *name = names[i].c_str();
+        int length = (int) names[i].length();
+        if (string_equals(name, length, solve.var_name, solve.var_length))
+            continue;
+        vartype *v = recall_var(name, length);
+        if (v == NULL || v->type != TYPE_REAL && v->type != TYPE_UNIT) {
+            free(p);
+            return;
+        }
+        p[n++] = ((vartype_real *) v)->x;
+    }
+    solve_params = p;
+    solve_nparams = n;
+}
+
+static bool root_cache_matches(root_cache *rc) {
+    if (rc->nparams != solve_nparams
+            || !string_equals(rc->var_name, rc->var_length, solve.var_name, solve.var_length))
+        return false;
+    if (solve.active_eq != NULL) {
+        equation_data *eqd = ((vartype_equation *) solve.active_eq)->data;
+        return rc->eqn_text != NULL && rc->eqn_length == eqd->length
+                && memcmp(rc->eqn_text, eqd->text, eqd->length) == 0;
+    } else {
+        return rc->eqn_text == NULL
+                && string_equals(rc->prgm_name, rc->prgm_length,
+                                 solve.active_prgm_name, solve.active_prgm_length);
+    }
+}
+
+static root_cache *find_root_cache(bool create) {
+    root_cache *victim = NULL;
+    for (int i = 0; i < ROOT_CACHE_KEYS; i++) {
+        root_cache *rc = &root_caches[i];
+        if (rc->data == NULL) {
+            if (victim == NULL || victim->data != NULL)
+                victim = rc;
+            continue;
+        }
+        if (root_cache_matches(rc))
+            return rc;
+        if (victim == NULL || victim->data != NULL && rc->last_used < victim->last_used)
+            victim = rc;
+    }
+    if (!create)
+        return NULL;
+
+    clear_root_cache(victim);
+    victim->data = (phloat *) malloc(root_cache_size * (solve_nparams + 2) * sizeof(phloat));
+    if (victim->data == NULL)
+        return NULL;
+    if (solve.active_eq != NULL) {
+        equation_data *eqd = ((vartype_equation *) solve.active_eq)->data;
+        victim->eqn_text = (char *) malloc(eqd->length);
+        if (victim->eqn_text == NULL && eqd->length > 0) {
+            clear_root_cache(victim);
+            return NULL;
+        }
+        memcpy(victim->eqn_text, eqd->text, eqd->length);
+        victim->eqn_length = eqd->length;
+        victim->prgm_length = 0;
+    } else {
+        string_copy(victim->prgm_name, &victim->prgm_length,
+                    solve.active_prgm_name, solve.active_prgm_length);
+    }
+    string_copy(victim->var_name, &victim->var_length, solve.var_name, solve.var_length);
+    victim->nparams = solve_nparams;
+    return victim;
+}
+
+static phloat *root_cache_entry(root_cache *rc, int age) {
+    int i = (rc->next - 1 - age + 2 * root_cache_size) % root_cache_size;
+    return rc->data + i * (rc->nparams + 2);
+}
+
+/* Pick starting guesses for a solve from the root cache. If the last two
+ * parameter vectors and the current one lie on a line, the root is
+ * extrapolated along that line; otherwise, the root and second-best guess
+ * of the nearest cached parameter vector are used.
+ */
+static bool seed_from_root_cache(phloat *x1, phloat *x2) {
+    if (solve_nparams == -1)
+        return false;
+    root_cache *rc = find_root_cache(false);
+    if (rc == NULL || rc->count == 0)
+        return false;
+    rc->last_used = ++root_cache_clock;
+    int n = rc->nparams;
+    phloat *p = solve_params;
+    phloat *e1 = root_cache_entry(rc, 0);
+
+    if (rc->count >= 2) {
+        phloat *e0 = root_cache_entry(rc, 1);
+        phloat t;
+        if (n == 0) {
+            // No visible parameters; assume they are changing steadily
+            t = 1;
+        } else {
+            phloat dd = 0, dp = 0;
+            for (int i = 0; i < n; i++) {
+                phloat d = e1[i] - e0[i];
+                dd += d * d;
+                dp += (p[i] - e1[i]) * d;
+            }
+            if (dd == 0)
+                t = 0;
+            else
+                t = dp / dd;
+            if (t > 0 && t <= 4) {
+                phloat rr = 0;
+                for (int i = 0; i < n; i++) {
+                    phloat r = p[i] - e1[i] - t * (e1[i] - e0[i]);
+                    rr += r * r;
+                }
+                if (rr > t * t * dd * 1e-8)
+                    t = 0;
+            } else
+                t = 0;
+        }
+        if (t != 0) {
+            phloat x = e1[n] + t * (e1[n] - e0[n]);
+            if (x != e1[n] && !p_isnan(x) && !p_isinf(x)) {
+                *x1 = x;
+                *x2 = e1[n];
+                return true;
+            }
+        }
+    }
+
+    phloat *best = e1;
+    phloat best_d = POS_HUGE_PHLOAT;
+    for (int k = 0; k < rc->count; k++) {
+        phloat *e = root_cache_entry(rc, k);
+        phloat d = 0;
+        for (int i = 0; i < n; i++) {
+            phloat scale = fabs(p[i]) > fabs(e[i]) ? fabs(p[i]) : fabs(e[i]);
+            if (scale == 0)
+                continue;
+            phloat r = (p[i] - e[i]) / scale;
+            d += r * r;
+        }
+        if (d < best_d) {
+            best_d = d;
+            best = e;
+        }
+    }
+    *x1 = best[n];
+    *x2 = best[n + 1];
+    return true;
+}
+
+static void remember_root(phloat root, phloat other) {
+    if (solve_nparams == -1 || root_cache_size == 0 || p_isnan(root) || p_isinf(root))
+        return;
+    root_cache *rc = find_root_cache(true);
+    if (rc == NULL)
+        return;
+    int n = rc->nparams;
+    phloat *e = NULL;
+    if (rc->count > 0) {
+        // Same parameters as last time: just update the root
+        e = root_cache_entry(rc, 0);
+        for (int i = 0; i < n; i++)
+            if (e[i] != solve_params[i]) {
+                e = NULL;
+                break;
+            }
+    }
+    if (e == NULL) {
+        e = rc->data + rc->next * (n + 2);
+        rc->next = (rc->next + 1) % root_cache_size;
+        if (rc->count < root_cache_size)
+            rc->count++;
+    }
+    for (int i = 0; i < n; i++)
+        e[i] = solve_params[i];
+    e[n] = root;
+    e[n + 1] = p_isnan(other) || p_isinf(other) ? root : other;
+    rc->last_used = ++root_cache_clock;
+}
+
+/* Forward-mode differentiation for SOLVE
+ *
+ * When solving a program, the unknown is seeded with a tangent of 1, and
+ * while the program runs, handle_tangent() propagates tangents
+ * through real-valued results, so that the solver gets f'(x) along with
+ * f(x), and can use Newton steps instead of secant steps. Tangents are
+ * only valid while their tag matches tangent_tag, which changes with every
+ * evaluation, so stale tangents left in variables are never picked up.
+ * Any command that consumes a value with a tangent, and that does not know
+ * how to propagate it, disables Newton steps for the rest of the solve.
+ *
+ * The tangents themselves are kept in a hash table owned by the solver,
+ * keyed by the address of the vartype_real they belong to, so that reals
+ * don't carry any extra baggage. new_real() and dup_vartype() call
+ * forget_tangent() and copy_tangent() to keep the table in sync while an
+ * evaluation is in progress. Entries with an old tag are treated as free
+ * slots, so starting a new evaluation clears the table implicitly.
+ */
+
+static bool tangents_active = false;
+static bool tangents_failed;
+static uint4 tangent_tag = 0;
+
+struct tangent_entry {
+    const vartype *v;
+    uint4 tag;
+    phloat dx;
+};
+
+static tangent_entry *tangent_table = NULL;
+static int4 tangent_size = 0;
+static int4 tangent_used = 0;
+
+static void free_tangents() {
+    tangents_active = false;
+    delete[] tangent_table;
+    tangent_table = NULL;
+    tangent_size = 0;
+    tangent_used = 0;
+}
+
+static int4 tangent_hash(const vartype *v) {
+    uint8 h = (uint8) (size_t) v * 0x9e3779b97f4a7c15ULL;
+    return (int4) (h >> 32) & (tangent_size - 1);
+}
+
+static tangent_entry *find_tangent(const vartype *v) {
+    if (tangent_table == NULL)
+        return NULL;
+    int4 i = tangent_hash(v);
+    while (tangent_table[i].v != NULL) {
+        if (tangent_table[i].v == v)
+            return tangent_table[i].tag == tangent_tag ? &tangent_table[i] : NULL;
+        i = (i + 1) & (tangent_size - 1);
+    }
+    return NULL;
+}
+
+static bool grow_tangents() {
+    int4 live = 0;
+    for (int4 i = 0; i < tangent_size; i++)
+        if (tangent_table[i].v != NULL && tangent_table[i].tag == tangent_tag)
+            live++;
+    int4 size = 64;
+    while (size < live * 2 + 2)
+        size *= 2;
+    tangent_entry *t = new (std::nothrow) tangent_entry[size];
+    if (t == NULL)
+        return false;
+    for (int4 i = 0; i < size; i++)
+        t[i].v = NULL;
+    tangent_entry *old = tangent_table;
+    int4 old_size = tangent_size;
+    tangent_table = t;
+    tangent_size = size;
+    tangent_used = live;
+    for (int4 i = 0; i < old_size; i++) {
+        if (old[i].v == NULL || old[i].tag != tangent_tag)
+            continue;
+        int4 j = tangent_hash(old[i].v);
+        while (t[j].v != NULL)
+            j = (j + 1) & (size - 1);
+        t[j] = old[i];
+    }
+    delete[] old;
+    return true;
+}
+
+static void put_tangent(const vartype *v, phloat dx) {
+    if (tangent_used * 4 >= tangent_size * 3 && !grow_tangents()) {
+        tangents_failed = true;
+        return;
+    }
+    int4 i = tangent_hash(v);
+    tangent_entry *slot = NULL;
+    while (tangent_table[i].v != NULL) {
+        if (tangent_table[i].v == v) {
+            slot = &tangent_table[i];
+            break;
+        }
+        if (slot == NULL && tangent_table[i].tag != tangent_tag)
+            slot = &tangent_table[i];
+        i = (i + 1) & (tangent_size - 1);
+    }
+    if (slot == NULL) {
+        slot = &tangent_table[i];
+        tangent_used++;
+    }
+    slot->v = v;
+    slot->tag = tangent_tag;
+    slot->dx = dx;
+}
+
+void forget_tangent(vartype *v) {
+    if (!tangents_active)
+        return;
+    tangent_entry *e = find_tangent(v);
+    if (e != NULL)
+        e->tag = 0;
+}
+
+void copy_tangent(const vartype *src, vartype *dst) {
+    if (!tangents_active)
+        return;
+    tangent_entry *e = find_tangent(src);
+    if (e != NULL)
+        put_tangent(dst, e->dx);
+}
+
+static void seed_tangent(vartype *v) {
+    if (!tangents_active)
+        return;
+    put_tangent(v, 1);
+}
+
 static int call_solve_fn(int which, int state) {
     if (solve.active_eq == NULL && solve.active_prgm_length == 0)
         return ERR_NONEXISTENT;
@@ -500,9 +1149,19 @@ static int call_solve_fn(int which, int state) {
     phloat x = which == 1 ? solve.x1 : which == 2 ? solve.x2 : solve.x3;
     solve.prev_x = solve.curr_x;
     solve.curr_x = x;
+    solve.evals++;
+    tangents_active = solve.use_tangents && solve.active_eq == NULL
+                                         && solve.param_unit == NULL;
+    if (tangents_active) {
+        if (++tangent_tag == 0)
+            tangent_tag = 1;
+        tangents_failed = false;
+    }
     if (solve.var_length == 0) {
         if (solve.param_unit == 0) {
             v = new_real(x);
+            if (v != NULL)
+                seed_tangent(v);
         } else {
             vartype_unit *u = (vartype_unit *) solve.param_unit;
             v = new_unit(x, u->text, u->length);
@@ -515,13 +1174,16 @@ static int call_solve_fn(int which, int state) {
             v = new_real(x);
             if (v == NULL)
                 return ERR_INSUFFICIENT_MEMORY;
+            seed_tangent(v);
             err = store_var(solve.var_name, solve.var_length, v);
             if (err != ERR_NONE) {
                 free_vartype(v);
                 return err;
             }
-        } else
+        } else {
             ((vartype_real *) v)->x = x;
+            seed_tangent(v);
+        }
     } else {
         vartype_unit *u = (vartype_unit *) solve.param_unit;
         v = new_unit(x, u->text, u->length);
@@ -579,6 +1241,13 @@ int start_solve(int prev, const char *name, int length, vartype *v1, vartype *v2
     string_copy(solve.var_name, &solve.var_length, name, length);
     string_copy(solve.active_prgm_name, &solve.active_prgm_length,
                 solve.prgm_name, solve.prgm_length);
+    free_vartype(solve.active_eq);
+    if (solve.eq != NULL) {
+        solve.active_eq = dup_vartype(solve.eq);
+        if (solve.active_eq == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+    } else
+        solve.active_eq = NULL;
     free_vartype(solve.saved_t);
     if (!flags.f.big_stack && solve.eq != NULL)
         solve.saved_t = dup_vartype(stack[REG_T]);
@@ -586,9 +1255,11 @@ int start_solve(int prev, const char *name, int length, vartype *v1, vartype *v2
         solve.saved_t = NULL;
     solve.caller.set(prev);
     solve.prev_sp = flags.f.big_stack ? sp : -2;
+    solve.evals = 0;
 
-    // Try direct solution
-    if (solve.eq != NULL && flags.f.direct_solver) {
+    // Try direct solution; not when scanning for all roots, since that
+    // would only find one of them, and not necessarily in the interval.
+    if (solve.eq != NULL && flags.f.direct_solver && prev != -8) {
         vartype *inv;
         if (saved_inv != NULL && *saved_inv != NULL) {
             inv = *saved_inv;
@@ -673,16 +1344,8 @@ static int start_solve_2(vartype *v1, vartype *v2, bool after_direct) {
         return ERR_INVALID_TYPE;
     }
 
-    if (solve.eq != NULL) {
-        vartype *eq = dup_vartype(solve.eq);
-        if (eq == NULL)
-            return ERR_INSUFFICIENT_MEMORY;
-        free_vartype(solve.active_eq);
-        solve.active_eq = eq;
-    } else {
-        free_vartype(solve.active_eq);
-        solve.active_eq = NULL;
-    }
+    capture_solve_params();
+    seed_from_root_cache(&x1, &x2);
 
     if (x1 == x2) {
         if (x1 == 0) {
@@ -713,6 +1376,9 @@ static int start_solve_2(vartype *v1, vartype *v2, bool after_direct) {
     solve.toggle = 1;
     solve.secant_impatience = 0;
     solve.f_gap = NAN_PHLOAT;
+    solve.use_tangents = solve.active_eq == NULL;
+    solve.curr_df = NAN_PHLOAT;
+    solve.newton_step = POS_HUGE_PHLOAT;
     if (!after_direct)
         solve.caller.keep_running = !should_i_stop_at_this_level() && program_running();
     return call_solve_fn(1, 1);
@@ -734,6 +1400,7 @@ static int finish_solve(int message) {
     int dummy, print;
 
     phloat final_f = solve.curr_f;
+    free_tangents();
 
     if (message == SOLVE_NOT_SURE)
         if (!p_isnan(solve.f_gap) && solve.f_gap_worsening_counter >= 3)
@@ -779,6 +1446,12 @@ static int finish_solve(int message) {
 
     solve.state = 0;
 
+    if (message == SOLVE_ROOT)
+        remember_root(b, s);
+    free(solve_params);
+    solve_params = NULL;
+    solve_nparams = -1;
+
     free_vartype(solve.active_eq);
     solve.active_eq = NULL;
     free_vartype(solve.saved_t);
@@ -857,6 +1530,17 @@ static int finish_solve(int message) {
     return solve.caller.ret(ERR_NONE);
 }
 
+/* Newton steps are taken from the most recently evaluated point, provided
+ * we have its derivative, and it is one of the current end points; that
+ * way, the Newton step always starts from an up-to-date x1 or x2.
+ */
+static bool have_newton_step() {
+    if (p_isnan(solve.curr_df) || solve.curr_df == 0)
+        return false;
+    return solve.curr_x == solve.x1 && solve.curr_f == solve.fx1
+            || solve.curr_x == solve.x2 && solve.curr_f == solve.fx2;
+}
+
 static void track_f_gap() {
     phloat gap = solve.fx2 - solve.fx1;
     if (gap == 0 || p_isnan(gap)) {
@@ -957,6 +1641,20 @@ int return_to_solve(bool failure, bool stop) {
 
     if (solve.state == 0)
         return ERR_INTERNAL_ERROR;
+    solve.curr_df = NAN_PHLOAT;
+    if (tangents_active) {
+        tangents_active = false;
+        if (tangents_failed)
+            /* The function uses commands we can't differentiate;
+             * stick to the secant method from now on.
+             */
+            solve.use_tangents = 0;
+        else if (!failure && sp != -1 && stack[sp]->type == TYPE_REAL) {
+            tangent_entry *e = find_tangent(stack[sp]);
+            if (e != NULL && !p_isnan(e->dx) && !p_isinf(e->dx))
+                solve.curr_df = e->dx;
+        }
+    }
     if (!failure) {
         if (sp == -1)
             return ERR_TOO_FEW_ARGUMENTS;
@@ -1215,6 +1913,12 @@ int return_to_solve(bool failure, bool stop) {
             if ((solve.fx1 > 0 && solve.fx2 < 0)
                     || (solve.fx1 < 0 && solve.fx2 > 0))
                 goto do_ridders;
+            if (have_newton_step()) {
+                /* Use the tangent instead of the secant */
+                slope = solve.curr_df;
+                solve.x3 = solve.curr_x - solve.curr_f / slope;
+                goto finish_secant;
+            }
             slope = (solve.fx2 - solve.fx1) / (solve.x2 - solve.x1);
             if (p_isinf(slope)) {
                 solve.x3 = (solve.x1 + solve.x2) / 2;
@@ -1371,6 +2075,27 @@ int return_to_solve(bool failure, bool stop) {
             }
             track_f_gap();
             do_ridders:
+            if (have_newton_step()) {
+                /* Safeguarded Newton: only take the step if it stays
+                 * inside the bracket, and if it is less than half the
+                 * size of the previous step; otherwise, the bracket is
+                 * shrinking faster with Ridders' method.
+                 */
+                xnew = solve.curr_x - solve.curr_f / solve.curr_df;
+                if (xnew == solve.curr_x) {
+                    solve.which = solve.curr_x == solve.x1 ? 1 : 2;
+                    return finish_solve(SOLVE_NOT_SURE);
+                }
+                s = fabs(xnew - solve.curr_x);
+                if (xnew > solve.x1 && xnew < solve.x2
+                        && s <= solve.newton_step / 2) {
+                    solve.newton_step = s;
+                    solve.x3 = xnew;
+                    return call_solve_fn(3, 9);
+                }
+            }
+            do_ridders_2:
+            solve.newton_step = solve.x2 - solve.x1;
             solve.x3 = (solve.x1 + solve.x2) / 2;
             // TODO: The following termination condition should really be
             //
@@ -1390,6 +2115,20 @@ int return_to_solve(bool failure, bool stop) {
             } else
                 return call_solve_fn(3, 6);
 
+        case 9:
+            /* Newton step inside [x1, x2] */
+            if (failure)
+                goto do_ridders_2;
+            if ((f > 0 && solve.fx1 > 0) || (f < 0 && solve.fx1 < 0)) {
+                solve.x1 = solve.x3;
+                solve.fx1 = f;
+            } else {
+                solve.x2 = solve.x3;
+                solve.fx2 = f;
+            }
+            track_f_gap();
+            goto do_ridders;
+
         default:
             return ERR_INTERNAL_ERROR;
     }
@@ -1399,6 +2138,260 @@ bool is_solve_var(const char *name, int length) {
     return string_equals(solve.var_name, solve.var_length, name, length);
 }
 
+struct tangent_arg {
+    bool real;
+    bool tagged;
+    phloat x;
+    phloat dx;
+};
+
+static tangent_arg targ_x, targ_y;
+
+static void get_tangent(vartype *v, tangent_arg *ta) {
+    ta->real = v != NULL && v->type == TYPE_REAL;
+    if (ta->real) {
+        tangent_entry *e = find_tangent(v);
+        ta->x = ((vartype_real *) v)->x;
+        ta->tagged = e != NULL;
+        ta->dx = ta->tagged ? e->dx : 0;
+    } else
+        ta->tagged = false;
+}
+
+static bool is_tagged(vartype *v) {
+    return v != NULL && v->type == TYPE_REAL && find_tangent(v) != NULL;
+}
+
+static vartype **stk_ref(char stk) {
+    int lvl;
+    switch (stk) {
+        case 'X': lvl = 0; break;
+        case 'Y': lvl = 1; break;
+        case 'Z': lvl = 2; break;
+        case 'T': lvl = 3; break;
+        case 'L': return &lastx;
+        default: return NULL;
+    }
+    return lvl <= sp ? &stack[sp - lvl] : NULL;
+}
+
+static vartype *sto_target(arg_struct *arg) {
+    if (arg->type == ARGTYPE_STR)
+        return recall_var(arg->val.text, arg->length);
+    if (arg->type == ARGTYPE_STK) {
+        vartype **v = stk_ref(arg->val.stk);
+        return v == NULL ? NULL : *v;
+    }
+    return NULL;
+}
+
+static void set_tangent(vartype *v, phloat dx) {
+    if (v == NULL || v->type != TYPE_REAL) {
+        tangents_failed = true;
+        return;
+    }
+    put_tangent(v, dx);
+}
+
+static bool binary_tangent(char op, tangent_arg *y, tangent_arg *x, phloat r, phloat *dr) {
+    switch (op) {
+        case '+': *dr = y->dx + x->dx; return true;
+        case '-': *dr = y->dx - x->dx; return true;
+        case '*': *dr = y->dx * x->x + y->x * x->dx; return true;
+        case '/': *dr = (y->dx - r * x->dx) / x->x; return true;
+        case '^':
+            if (x->dx == 0) {
+                *dr = x->x * pow(y->x, x->x - 1) * y->dx;
+                return true;
+            } else if (y->x > 0) {
+                *dr = r * (x->dx * log(y->x) + x->x * y->dx / y->x);
+                return true;
+            } else
+                return false;
+        default:
+            return false;
+    }
+}
+
+static bool unary_tangent(int cmd, phloat x, phloat r, phloat *d) {
+    phloat k;
+    switch (cmd) {
+        case CMD_CHS: *d = -1; break;
+        case CMD_ABS: *d = x < 0 ? -1 : 1; break;
+        case CMD_SIGN:
+        case CMD_IP:
+        case CMD_RND: *d = 0; break;
+        case CMD_FP: *d = 1; break;
+        case CMD_SQRT: *d = 0.5 / r; break;
+        case CMD_SQUARE: *d = 2 * x; break;
+        case CMD_INV: *d = -r * r; break;
+        case CMD_E_POW_X: *d = r; break;
+        case CMD_E_POW_X_1: *d = r + 1; break;
+        case CMD_10_POW_X: *d = r * log(phloat(10)); break;
+        case CMD_LN: *d = 1 / x; break;
+        case CMD_LN_1_X: *d = 1 / (1 + x); break;
+        case CMD_LOG: *d = 1 / (x * log(phloat(10))); break;
+        case CMD_SINH: *d = cosh(x); break;
+        case CMD_COSH: *d = sinh(x); break;
+        case CMD_TANH: *d = 1 - r * r; break;
+        case CMD_ASINH: *d = 1 / sqrt(x * x + 1); break;
+        case CMD_ACOSH: *d = 1 / sqrt(x * x - 1); break;
+        case CMD_ATANH: *d = 1 / (1 - x * x); break;
+        case CMD_TO_RAD: *d = PI / 180; break;
+        case CMD_TO_DEG: *d = 180 / PI; break;
+        case CMD_SIN:
+            k = 1 / rad_to_angle(1);
+            *d = cos(x * k) * k;
+            break;
+        case CMD_COS:
+            k = 1 / rad_to_angle(1);
+            *d = -sin(x * k) * k;
+            break;
+        case CMD_TAN:
+            *d = (1 + r * r) / rad_to_angle(1);
+            break;
+        case CMD_ASIN: *d = rad_to_angle(1) / sqrt(1 - x * x); break;
+        case CMD_ACOS: *d = -rad_to_angle(1) / sqrt(1 - x * x); break;
+        case CMD_ATAN: *d = rad_to_angle(1) / (1 + x * x); break;
+        default: return false;
+    }
+    return true;
+}
+
+static bool is_transparent(int cmd) {
+    switch (cmd) {
+        case CMD_CLX: case CMD_ENTER: case CMD_SWAP: case CMD_RDN:
+        case CMD_RUP: case CMD_LASTX: case CMD_RCL: case CMD_LSTO:
+        case CMD_DROP: case CMD_DROPN: case CMD_DUP: case CMD_DUPN:
+        case CMD_PICK: case CMD_UNPICK: case CMD_RDNN: case CMD_RUPN:
+        case CMD_CLST: case CMD_DEPTH:
+        case CMD_LBL: case CMD_RTN: case CMD_GTO: case CMD_XEQ:
+        case CMD_END: case CMD_NUMBER: case CMD_STRING: case CMD_NOP:
+        case CMD_STOP: case CMD_PSE: case CMD_VIEW: case CMD_AVIEW:
+        case CMD_PROMPT: case CMD_ARCL: case CMD_MVAR: case CMD_VARMENU:
+        case CMD_RTNYES: case CMD_RTNNO: case CMD_RTNERR: case CMD_SKIP:
+        case CMD_FUNC: case CMD_LNSTK: case CMD_L4STK:
+        case CMD_X_EQ_0: case CMD_X_NE_0: case CMD_X_LT_0:
+        case CMD_X_GT_0: case CMD_X_LE_0: case CMD_X_GE_0:
+        case CMD_X_EQ_Y: case CMD_X_NE_Y: case CMD_X_LT_Y:
+        case CMD_X_GT_Y: case CMD_X_LE_Y: case CMD_X_GE_Y:
+        case CMD_X_EQ_NN: case CMD_X_NE_NN: case CMD_X_LT_NN:
+        case CMD_X_GT_NN: case CMD_X_LE_NN: case CMD_X_GE_NN:
+        case CMD_0_EQ_NN: case CMD_0_NE_NN: case CMD_0_LT_NN:
+        case CMD_0_GT_NN: case CMD_0_LE_NN: case CMD_0_GE_NN:
+        case CMD_REAL_T: case CMD_CPX_T: case CMD_STR_T: case CMD_MAT_T:
+        case CMD_UNIT_T: case CMD_LIST_T: case CMD_TYPE_T:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static char arith_op(int cmd) {
+    switch (cmd) {
+        case CMD_ADD: case CMD_STO_ADD: case CMD_RCL_ADD: return '+';
+        case CMD_SUB: case CMD_STO_SUB: case CMD_RCL_SUB: return '-';
+        case CMD_MUL: case CMD_STO_MUL: case CMD_RCL_MUL: return '*';
+        case CMD_DIV: case CMD_STO_DIV: case CMD_RCL_DIV: return '/';
+        case CMD_Y_POW_X: return '^';
+        default: return 0;
+    }
+}
+
+int handle_tangent(int cmd, arg_struct *arg) {
+    if (!tangents_active || tangents_failed || is_transparent(cmd))
+        return handle(cmd, arg);
+
+    char op = arith_op(cmd);
+    bool sto = false;
+    phloat d;
+    int err;
+
+    switch (cmd) {
+        case CMD_STO:
+        case CMD_X_SWAP:
+            if (arg->type == ARGTYPE_IND_NUM
+                    || arg->type == ARGTYPE_IND_STK
+                    || arg->type == ARGTYPE_IND_STR) {
+                err = resolve_ind_arg(arg);
+                if (err != ERR_NONE)
+                    return err;
+            }
+            /* Storing in numbered registers loses the tangent */
+            if (arg->type != ARGTYPE_STR && arg->type != ARGTYPE_STK
+                    && sp != -1 && is_tagged(stack[sp]))
+                tangents_failed = true;
+            return handle(cmd, arg);
+        case CMD_STO_ADD: case CMD_STO_SUB:
+        case CMD_STO_MUL: case CMD_STO_DIV:
+            sto = true;
+            goto sto_rcl;
+        case CMD_RCL_ADD: case CMD_RCL_SUB:
+        case CMD_RCL_MUL: case CMD_RCL_DIV:
+            sto_rcl: {
+                vartype *v;
+                if (sp == -1)
+                    return handle(cmd, arg);
+                err = generic_rcl(arg, &v);
+                if (err != ERR_NONE)
+                    return err;
+                get_tangent(sto ? v : stack[sp], &targ_y);
+                get_tangent(sto ? stack[sp] : v, &targ_x);
+                free_vartype(v);
+            }
+            break;
+        case CMD_EVAL:
+        case CMD_EVALN:
+        case CMD_INTEG:
+            tangents_failed = true;
+            return handle(cmd, arg);
+        default:
+            if (sp == -1)
+                return handle(cmd, arg);
+            get_tangent(stack[sp], &targ_x);
+            if (op != 0 && sp >= 1)
+                get_tangent(stack[sp - 1], &targ_y);
+            else
+                targ_y.tagged = false;
+            if (op == 0 && !unary_tangent(cmd, 1, 1, &d)) {
+                /* Not a command we can differentiate */
+                int n = cmd_array[cmd].argcount;
+                if (n < 0 || n > 4)
+                    n = 4;
+                for (int i = 0; i < n && i <= sp; i++)
+                    if (is_tagged(stack[sp - i])) {
+                        tangents_failed = true;
+                        break;
+                    }
+                return handle(cmd, arg);
+            }
+            break;
+    }
+
+    if (!targ_x.tagged && !targ_y.tagged)
+        return handle(cmd, arg);
+    err = handle(cmd, arg);
+    if (err != ERR_NONE)
+        return err;
+
+    vartype *res = sto ? sto_target(arg) : stack[sp];
+    if (res == NULL || res->type != TYPE_REAL
+            || op != 0 && (!targ_x.real || !targ_y.real)) {
+        tangents_failed = true;
+        return err;
+    }
+    phloat r = ((vartype_real *) res)->x;
+    bool ok = op != 0 ? binary_tangent(op, &targ_y, &targ_x, r, &d)
+                      : unary_tangent(cmd, targ_x.x, r, &d);
+    if (ok) {
+        if (op == 0)
+            d *= targ_x.dx;
+        set_tangent(res, d);
+    } else
+        tangents_failed = true;
+    return err;
+}
+
 static void reset_integ() {
     free_vartype(integ.eq);
     integ.eq = NULL;
@@ -1534,14 +2527,42 @@ static int call_integ_fn() {
     }
 }
 
-int start_integ(int prev, const char *name, int length, vartype *solve_info) {
-    if (integ_active())
-        return ERR_INTEG_INTEG;
-
-    vartype *llim = recall_var("LLIM", 4);
-    if (llim == NULL)
-        return ERR_NONEXISTENT;
-    else if (llim->type == TYPE_STRING)
+/* Get the relative accuracy for INTEG and INTEGN from ACC, limited to
+ * [a few ulps, 1].
+ */
+static int get_integ_acc(phloat *res) {
+    vartype *acc = recall_var("ACC", 3);
+    if (acc == NULL)
+        *res = 0;
+    else if (acc->type == TYPE_STRING)
+        return ERR_ALPHA_DATA_IS_INVALID;
+    else if (acc->type != TYPE_REAL)
+        return ERR_INVALID_TYPE;
+    else
+        *res = ((vartype_real *) acc)->x;
+    if (*res > 1)
+        *res = 1;
+    else {
+        phloat eps = phloat(1) - nextafter(phloat(1), phloat(0));
+        #ifdef BCD_MATH
+            eps *= 10;
+        #else
+            eps *= 8;
+        #endif
+        if (*res < eps)
+            *res = eps;
+    }
+    return ERR_NONE;
+}
+
+int start_integ(int prev, const char *name, int length, vartype *solve_info) {
+    if (integ_active())
+        return ERR_INTEG_INTEG;
+
+    vartype *llim = recall_var("LLIM", 4);
+    if (llim == NULL)
+        return ERR_NONEXISTENT;
+    else if (llim->type == TYPE_STRING)
         return ERR_ALPHA_DATA_IS_INVALID;
     else if (llim->type != TYPE_REAL && llim->type != TYPE_UNIT)
         return ERR_INVALID_TYPE;
@@ -1569,27 +2590,9 @@ int start_integ(int prev, const char *name, int length, vartype *solve_info) {
     free_vartype(integ.result_unit);
     integ.result_unit = NULL;
 
-    vartype *acc = recall_var("ACC", 3);
-    if (acc == NULL)
-        integ.acc = 0;
-    else if (acc->type == TYPE_STRING)
-        return ERR_ALPHA_DATA_IS_INVALID;
-    else if (acc->type != TYPE_REAL)
-        return ERR_INVALID_TYPE;
-    else
-        integ.acc = ((vartype_real *) acc)->x;
-    if (integ.acc > 1)
-        integ.acc = 1;
-    else {
-        phloat eps = phloat(1) - nextafter(phloat(1), phloat(0));
-        #ifdef BCD_MATH
-            eps *= 10;
-        #else
-            eps *= 8;
-        #endif
-        if (integ.acc < eps)
-            integ.acc = eps;
-    }
+    err = get_integ_acc(&integ.acc);
+    if (err != ERR_NONE)
+        return err;
     string_copy(integ.var_name, &integ.var_length, name, length);
     string_copy(integ.active_prgm_name, &integ.active_prgm_length,
                 integ.prgm_name, integ.prgm_length);
@@ -1786,3 +2789,1447 @@ int return_to_integ(bool stop) {
         return ERR_INTERNAL_ERROR;
     }
 }
+
+
+/* Table: evaluates, solves, or integrates a function over a grid of
+ * parameter values. Each parameter has a vector of values, and the grid
+ * is their outer product, with the last parameter varying fastest. The
+ * result is a matrix with one row per grid point, containing the
+ * parameter values followed by the result(s) for that point.
+ */
+
+static void reset_table() {
+    table.state = 0;
+    free_vartype(table.fun);
+    table.fun = NULL;
+    free_vartype(table.names);
+    table.names = NULL;
+    free_vartype(table.values);
+    table.values = NULL;
+    free_vartype(table.result);
+    table.result = NULL;
+}
+
+/* Check that a function to be evaluated by TABLE or INTEGN is either an
+ * equation or the name of a global label.
+ */
+static int check_fun(vartype *fun) {
+    if (fun->type == TYPE_STRING) {
+        vartype_string *s = (vartype_string *) fun;
+        if (s->length == 0)
+            return ERR_LABEL_NOT_FOUND;
+        if (s->length > 7)
+            return ERR_NAME_TOO_LONG;
+        arg_struct arg;
+        arg.type = ARGTYPE_STR;
+        string_copy(arg.val.text, &arg.length, s->txt(), s->length);
+        pgm_index dummy_idx;
+        int4 dummy_pc;
+        if (!find_global_label(&arg, &dummy_idx, &dummy_pc))
+            return ERR_LABEL_NOT_FOUND;
+    } else if (fun->type != TYPE_EQUATION)
+        return ERR_INVALID_TYPE;
+    return ERR_NONE;
+}
+
+/* Evaluate a function, which is either an equation or the name of a global
+ * label, returning to the pseudo-program 'prev' when it's done.
+ */
+static int call_fun(vartype *fun, int prev) {
+    vartype *eq = NULL;
+    pgm_index prev_prgm = current_prgm;
+    int4 prev_pc = pc;
+    int err;
+    if (fun->type == TYPE_STRING) {
+        vartype_string *s = (vartype_string *) fun;
+        arg_struct arg;
+        arg.type = ARGTYPE_STR;
+        string_copy(arg.val.text, &arg.length, s->txt(), s->length);
+        err = docmd_gto(&arg);
+        if (err != ERR_NONE)
+            return err;
+    } else {
+        eq = fun;
+        equation_data *eqd = ((vartype_equation *) eq)->data;
+        current_prgm.set(eq_dir->id, eqd->eqn_index);
+        pc = 0;
+    }
+    pgm_index prev_index;
+    prev_index.set(0, prev);
+    err = push_rtn_addr(prev_index, 0);
+    if (err == ERR_NONE) {
+        if (eq != NULL) {
+            err = store_stack_reference(eq);
+            if (err != ERR_NONE)
+                goto fail;
+        }
+        return ERR_RUN;
+    } else {
+        fail:
+        current_prgm = prev_prgm;
+        pc = prev_pc;
+        return err;
+    }
+}
+
+/* Start SOLVE or INTEG on 'fun', which is either an equation or the name of
+ * a global label, returning to the pseudo-program 'prev'. The function is
+ * only selected while start_solve() or start_integ() copy it into their
+ * active state, so the user's own PGMSLV and PGMINT selections are left
+ * alone.
+ */
+static int solve_fun(vartype *fun, int prev, const char *name, int length,
+                     vartype *v1, vartype *v2) {
+    char prgm_name[7];
+    int prgm_length;
+    string_copy(prgm_name, &prgm_length, solve.prgm_name, solve.prgm_length);
+    vartype *eq = solve.eq;
+    if (fun->type == TYPE_STRING) {
+        vartype_string *s = (vartype_string *) fun;
+        string_copy(solve.prgm_name, &solve.prgm_length, s->txt(), s->length);
+        solve.eq = NULL;
+    } else
+        solve.eq = fun;
+    int err = start_solve(prev, name, length, v1, v2);
+    string_copy(solve.prgm_name, &solve.prgm_length, prgm_name, prgm_length);
+    solve.eq = eq;
+    return err;
+}
+
+static int integ_fun(vartype *fun, int prev, const char *name, int length) {
+    char prgm_name[7];
+    int prgm_length;
+    string_copy(prgm_name, &prgm_length, integ.prgm_name, integ.prgm_length);
+    vartype *eq = integ.eq;
+    if (fun->type == TYPE_STRING) {
+        vartype_string *s = (vartype_string *) fun;
+        string_copy(integ.prgm_name, &integ.prgm_length, s->txt(), s->length);
+        integ.eq = NULL;
+    } else
+        integ.eq = fun;
+    int err = start_integ(prev, name, length);
+    string_copy(integ.prgm_name, &integ.prgm_length, prgm_name, prgm_length);
+    integ.eq = eq;
+    return err;
+}
+
+/* Get the values for one parameter: { "NAME" [values] }, { "NAME" { values } },
+ * or { "NAME" start stop step }.
+ */
+static int get_table_values(vartype *spec, vartype **name, vartype **values) {
+    if (spec->type != TYPE_LIST)
+        return ERR_INVALID_TYPE;
+    vartype_list *list = (vartype_list *) spec;
+    if (list->size != 2 && list->size != 4)
+        return ERR_INVALID_DATA;
+    vartype **data = list->array->data;
+    if (data[0]->type != TYPE_STRING)
+        return ERR_INVALID_TYPE;
+    vartype_string *s = (vartype_string *) data[0];
+    if (s->length == 0)
+        return ERR_INVALID_DATA;
+    if (s->length > 7)
+        return ERR_NAME_TOO_LONG;
+
+    vartype_realmatrix *rm;
+    if (list->size == 4) {
+        for (int i = 1; i < 4; i++)
+            if (data[i]->type != TYPE_REAL)
+                return ERR_INVALID_TYPE;
+        phloat start = ((vartype_real *) data[1])->x;
+        phloat stop = ((vartype_real *) data[2])->x;
+        phloat step = ((vartype_real *) data[3])->x;
+        if (step == 0 || (stop - start) / step < 0)
+            return ERR_INVALID_DATA;
+        phloat n = floor((stop - start) / step + 1e-9) + 1;
+        if (n > 1000000)
+            return ERR_INSUFFICIENT_MEMORY;
+        int4 count = to_int4(n);
+        rm = (vartype_realmatrix *) new_realmatrix(1, count);
+        if (rm == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        for (int4 i = 0; i < count; i++)
+            rm->array->data[i] = start + step * i;
+    } else if (data[1]->type == TYPE_REALMATRIX) {
+        vartype_realmatrix *src = (vartype_realmatrix *) data[1];
+        if (contains_strings(src))
+            return ERR_ALPHA_DATA_IS_INVALID;
+        int4 count = src->rows * src->columns;
+        rm = (vartype_realmatrix *) new_realmatrix(1, count);
+        if (rm == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        for (int4 i = 0; i < count; i++)
+            rm->array->data[i] = src->array->data[i];
+    } else if (data[1]->type == TYPE_LIST) {
+        vartype_list *src = (vartype_list *) data[1];
+        if (src->size == 0)
+            return ERR_INVALID_DATA;
+        for (int4 i = 0; i < src->size; i++)
+            if (src->array->data[i]->type != TYPE_REAL)
+                return ERR_INVALID_TYPE;
+        rm = (vartype_realmatrix *) new_realmatrix(1, src->size);
+        if (rm == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        for (int4 i = 0; i < src->size; i++)
+            rm->array->data[i] = ((vartype_real *) src->array->data[i])->x;
+    } else
+        return ERR_INVALID_TYPE;
+
+    *name = dup_vartype(data[0]);
+    if (*name == NULL) {
+        free_vartype((vartype *) rm);
+        return ERR_INSUFFICIENT_MEMORY;
+    }
+    *values = (vartype *) rm;
+    return ERR_NONE;
+}
+
+static int call_table_fn() {
+    vartype_list *names = (vartype_list *) table.names;
+    vartype_list *values = (vartype_list *) table.values;
+    vartype_realmatrix *res = (vartype_realmatrix *) table.result;
+    int n = names->size;
+    int4 r = table.row;
+    int err;
+
+    clean_stack(table.prev_sp);
+    for (int i = n - 1; i >= 0; i--) {
+        vartype_realmatrix *vals = (vartype_realmatrix *) values->array->data[i];
+        int4 count = vals->columns;
+        phloat x = vals->array->data[r % count];
+        r /= count;
+        res->array->data[table.row * res->columns + i] = x;
+        vartype *v = new_real(x);
+        if (v == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        vartype_string *s = (vartype_string *) names->array->data[i];
+        err = store_var(s->txt(), s->length, v);
+        if (err != ERR_NONE) {
+            free_vartype(v);
+            return err;
+        }
+    }
+
+    switch (table.mode) {
+        case TABLE_SOLVE: {
+            // Start from the previous root; the first point
+            // starts from the unknown's current value.
+            vartype *v = recall_var(table.var_name, table.var_length);
+            return solve_fun(table.fun, -6, table.var_name, table.var_length, v, NULL);
+        }
+        case TABLE_INTEG:
+            return integ_fun(table.fun, -6, table.var_name, table.var_length);
+    }
+
+    return call_fun(table.fun, -6);
+}
+
+int start_table(vartype *fun, vartype *mode, vartype *spec) {
+    if (table_active())
+        return ERR_INVALID_CONTEXT;
+
+    int err = check_fun(fun);
+    if (err != ERR_NONE)
+        return err;
+
+    int m;
+    const char *var_name = NULL;
+    int var_length = 0;
+    if (mode->type == TYPE_REAL) {
+        if (((vartype_real *) mode)->x != 0)
+            return ERR_INVALID_DATA;
+        m = TABLE_EVAL;
+    } else if (mode->type == TYPE_LIST) {
+        vartype_list *list = (vartype_list *) mode;
+        if (list->size != 2)
+            return ERR_INVALID_DATA;
+        vartype_string *ms = (vartype_string *) list->array->data[0];
+        vartype_string *vs = (vartype_string *) list->array->data[1];
+        if (ms->type != TYPE_STRING || vs->type != TYPE_STRING)
+            return ERR_INVALID_TYPE;
+        if (string_equals(ms->txt(), ms->length, "SOLVE", 5))
+            m = TABLE_SOLVE;
+        else if (string_equals(ms->txt(), ms->length, "INTEG", 5))
+            m = TABLE_INTEG;
+        else
+            return ERR_INVALID_DATA;
+        if (vs->length == 0)
+            return ERR_INVALID_DATA;
+        if (vs->length > 7)
+            return ERR_NAME_TOO_LONG;
+        var_name = vs->txt();
+        var_length = vs->length;
+    } else
+        return ERR_INVALID_TYPE;
+
+    if (spec->type != TYPE_LIST)
+        return ERR_INVALID_TYPE;
+    vartype_list *specs = (vartype_list *) spec;
+    int n;
+    bool single = specs->size > 0 && specs->array->data[0]->type == TYPE_STRING;
+    n = single ? 1 : specs->size;
+    if (n == 0)
+        return ERR_INVALID_DATA;
+
+    vartype *names = new_list(n);
+    vartype *values = new_list(n);
+    vartype *fun_copy = dup_vartype(fun);
+    vartype *result = NULL;
+    if (names == NULL || values == NULL || fun_copy == NULL) {
+        err = ERR_INSUFFICIENT_MEMORY;
+        goto fail;
+    }
+    {
+        double rows = 1;
+        for (int i = 0; i < n; i++) {
+            vartype *item = single ? spec : specs->array->data[i];
+            vartype **np = ((vartype_list *) names)->array->data + i;
+            vartype **vp = ((vartype_list *) values)->array->data + i;
+            err = get_table_values(item, np, vp);
+            if (err != ERR_NONE)
+                goto fail;
+            rows *= ((vartype_realmatrix *) *vp)->columns;
+        }
+        int cols = n + (m == TABLE_EVAL ? 1 : 2);
+        if (rows * cols > 1e7) {
+            err = ERR_INSUFFICIENT_MEMORY;
+            goto fail;
+        }
+        result = new_realmatrix((int4) rows, cols);
+        if (result == NULL) {
+            err = ERR_INSUFFICIENT_MEMORY;
+            goto fail;
+        }
+    }
+
+    /* Preserve stack, and program location; the three arguments are
+     * replaced by the result matrix when we're done, as with FUNC 31.
+     */
+    if (program_running()) {
+        err = push_rtn_addr(current_prgm, pc);
+        if (err != ERR_NONE)
+            goto fail;
+    } else {
+        clear_all_rtns();
+        return_here_after_last_rtn();
+        set_running(true);
+    }
+    err = push_func_state(31);
+    if (err != ERR_NONE)
+        goto fail;
+
+    reset_table();
+    table.mode = m;
+    table.fun = fun_copy;
+    string_copy(table.var_name, &table.var_length, var_name, var_length);
+    table.names = names;
+    table.values = values;
+    table.result = result;
+    table.row = 0;
+    table.prev_sp = flags.f.big_stack ? sp : -2;
+    table.state = 1;
+    return call_table_fn();
+
+    fail:
+    free_vartype(names);
+    free_vartype(values);
+    free_vartype(fun_copy);
+    free_vartype(result);
+    return err;
+}
+
+int return_to_table(bool stop) {
+    if (table.state != 1)
+        return ERR_INTERNAL_ERROR;
+    if (sp == -1)
+        return ERR_TOO_FEW_ARGUMENTS;
+    vartype *x = stack[sp];
+    if (x->type == TYPE_STRING)
+        return ERR_ALPHA_DATA_IS_INVALID;
+    if (x->type != TYPE_REAL && x->type != TYPE_UNIT)
+        return ERR_INVALID_TYPE;
+
+    vartype_realmatrix *res = (vartype_realmatrix *) table.result;
+    phloat *row = res->array->data + table.row * res->columns;
+    int n = ((vartype_list *) table.names)->size;
+    row[n] = ((vartype_real *) x)->x;
+    if (table.mode == TABLE_SOLVE) {
+        // Root, and how it was found: 0 = root, 1 = sign reversal,
+        // 2 = extremum, etc., as in the T register after SOLVE.
+        if (sp >= 1 && stack[sp - 1]->type == TYPE_STRING)
+            row[n + 1] = 0;
+        else if (sp >= 3 && stack[sp - 3]->type == TYPE_REAL)
+            row[n + 1] = ((vartype_real *) stack[sp - 3])->x;
+        else
+            row[n + 1] = 0;
+    } else if (table.mode == TABLE_INTEG) {
+        // Integral, and error estimate
+        if (sp >= 1 && (stack[sp - 1]->type == TYPE_REAL || stack[sp - 1]->type == TYPE_UNIT))
+            row[n + 1] = ((vartype_real *) stack[sp - 1])->x;
+        else
+            row[n + 1] = 0;
+    }
+
+    int err;
+    if (++table.row < res->rows) {
+        err = call_table_fn();
+        if (err == ERR_RUN && stop)
+            err = ERR_STOP;
+        return err;
+    }
+
+    clean_stack(table.prev_sp);
+    table.state = 0;
+    vartype *result = table.result;
+    table.result = NULL;
+    reset_table();
+    err = recall_result(result);
+    if (err != ERR_NONE)
+        return err;
+    err = docmd_rtn(NULL);
+    if (err == ERR_NONE && stop)
+        err = ERR_STOP;
+    return err;
+}
+
+
+/* Cubature: adaptive integration over a hyperrectangle in 1 to
+ * CUBA_MAX_DIM dimensions. Each subregion is integrated with the degree 7
+ * Genz-Malik rule, and the difference with the embedded degree 5 rule is
+ * used as its error estimate. The subregion with the largest error is then
+ * bisected, along the axis where the integrand has the largest fourth
+ * difference, until the total error is within ACC relative to the total,
+ * as with INTEG, or the evaluation budget runs out. Genz-Malik requires at
+ * least two dimensions, so one-dimensional integrals use the 7-point Gauss
+ * and 15-point Kronrod pair instead.
+ * The regions matrix has one row per subregion: its center (n columns),
+ * half-widths (n columns), integral, error estimate, and split axis.
+ */
+
+#ifdef BCD_MATH
+#define GK_CONST(x) Phloat(#x)
+#else
+#define GK_CONST(x) x
+#endif
+
+// Kronrod nodes and weights; the odd-numbered nodes, and the center,
+// are the Gauss nodes.
+static const phloat gk_x[8] = {
+    GK_CONST(0.991455371120812639206854697526329),
+    GK_CONST(0.949107912342758524526189684047851),
+    GK_CONST(0.864864423359769072789712788640926),
+    GK_CONST(0.741531185599394439863864773280788),
+    GK_CONST(0.586087235467691130294144845693013),
+    GK_CONST(0.405845151377397166906606412076961),
+    GK_CONST(0.207784955007898467600689403773245),
+    GK_CONST(0.0)
+};
+static const phloat gk_wk[8] = {
+    GK_CONST(0.022935322010529224963732008058970),
+    GK_CONST(0.063092092629978553290700663189204),
+    GK_CONST(0.104790010322250183839876322541518),
+    GK_CONST(0.140653259715525918745189590510238),
+    GK_CONST(0.169004726639267902826583426598550),
+    GK_CONST(0.190350578064785409913256402421014),
+    GK_CONST(0.204432940075298892414161999234649),
+    GK_CONST(0.209482141084727828012999174891714)
+};
+static const phloat gk_wg[4] = {
+    GK_CONST(0.129484966168869693270611432679082),
+    GK_CONST(0.279705391489276667901467771423780),
+    GK_CONST(0.381830050505118944950369775488975),
+    GK_CONST(0.417959183673469387755102040816327)
+};
+
+static void reset_cuba() {
+    cuba.state = 0;
+    free_vartype(cuba.fun);
+    cuba.fun = NULL;
+    free_vartype(cuba.names);
+    cuba.names = NULL;
+    free_vartype(cuba.regions);
+    cuba.regions = NULL;
+}
+
+static int4 cuba_points() {
+    int n = cuba.n;
+    return n == 1 ? 15 : 1 + 2 * n * (n + 1) + (1 << n);
+}
+
+/* Get the coordinates of point k of the rule for the current region, and
+ * return which sum its value goes into: 0 for the center; 1 or 2 for the
+ * points at +-l2 or +-l3 along *axis; 3 for the points at +-l4 along a pair
+ * of axes; 4 for the corners at +-l5. In one dimension, the points are
+ * the Kronrod nodes, and *axis is the node number.
+ */
+static int cuba_node(int4 k, phloat *x, int *axis) {
+    int n = cuba.n;
+    vartype_realmatrix *rm = (vartype_realmatrix *) cuba.regions;
+    phloat *c = rm->array->data + cuba.cur * rm->columns;
+    phloat *h = c + n;
+    for (int i = 0; i < n; i++)
+        x[i] = c[i];
+    if (k == 0)
+        return 0;
+    k--;
+    if (n == 1) {
+        *axis = (int) (k / 2);
+        x[0] += (k & 1 ? -h[0] : h[0]) * gk_x[*axis];
+        return 1;
+    }
+    if (k < 4 * n) {
+        int i = (int) (k / 4);
+        phloat l = k & 2 ? sqrt(phloat(9) / 10) : sqrt(phloat(9) / 70);
+        x[i] += (k & 1 ? -h[i] : h[i]) * l;
+        *axis = i;
+        return k & 2 ? 2 : 1;
+    }
+    k -= 4 * n;
+    if (k < 2 * n * (n - 1)) {
+        int p = (int) (k / 4);
+        int i = 0;
+        while (p >= n - 1 - i)
+            p -= n - 1 - i++;
+        int j = i + 1 + p;
+        phloat l = sqrt(phloat(9) / 10);
+        x[i] += (k & 1 ? -h[i] : h[i]) * l;
+        x[j] += (k & 2 ? -h[j] : h[j]) * l;
+        return 3;
+    }
+    k -= 2 * n * (n - 1);
+    phloat l = sqrt(phloat(9) / 19);
+    for (int i = 0; i < n; i++)
+        x[i] += (k >> i & 1 ? -h[i] : h[i]) * l;
+    return 4;
+}
+
+static void cuba_start_region(int4 r) {
+    cuba.cur = r;
+    cuba.point = 0;
+    cuba.f0 = cuba.sum2 = cuba.sum3 = cuba.sum4 = cuba.sum5 = 0;
+    for (int i = 0; i < CUBA_MAX_DIM; i++)
+        cuba.f2[i] = cuba.f3[i] = 0;
+}
+
+static void cuba_add(phloat f) {
+    phloat x[CUBA_MAX_DIM];
+    int axis;
+    switch (cuba_node(cuba.point, x, &axis)) {
+        case 0:
+            cuba.f0 = f;
+            break;
+        case 1:
+            if (cuba.n == 1) {
+                // sum2: Gauss, sum3: Kronrod
+                cuba.sum3 += gk_wk[axis] * f;
+                if (axis & 1)
+                    cuba.sum2 += gk_wg[axis / 2] * f;
+            } else
+                cuba.f2[axis] += f;
+            break;
+        case 2:
+            cuba.f3[axis] += f;
+            break;
+        case 3:
+            cuba.sum4 += f;
+            break;
+        case 4:
+            cuba.sum5 += f;
+            break;
+    }
+}
+
+static void cuba_finish_region() {
+    int n = cuba.n;
+    vartype_realmatrix *rm = (vartype_realmatrix *) cuba.regions;
+    phloat *c = rm->array->data + cuba.cur * rm->columns;
+    phloat *h = c + n;
+    phloat res, res5;
+    int split = 0;
+    if (n == 1) {
+        res = (cuba.sum3 + gk_wk[7] * cuba.f0) * h[0];
+        res5 = (cuba.sum2 + gk_wg[3] * cuba.f0) * h[0];
+    } else {
+        phloat vol = 1, s2 = 0, s3 = 0, maxdiff = -1;
+        for (int i = 0; i < n; i++) {
+            vol *= h[i] * 2;
+            s2 += cuba.f2[i];
+            s3 += cuba.f3[i];
+            // Fourth difference along this axis; on ties, split the wider side
+            phloat diff = fabs(cuba.f2[i] - cuba.f0 * 2 - (cuba.f3[i] - cuba.f0 * 2) / 7);
+            if (diff > maxdiff || (diff == maxdiff && fabs(h[i]) > fabs(h[split]))) {
+                maxdiff = diff;
+                split = i;
+            }
+        }
+        res = vol * ((phloat(12824 - 9120 * n + 400 * n * n) * cuba.f0
+                        + phloat(1820 - 400 * n) * s3
+                        + 200 * cuba.sum4) / 19683
+                    + 980 * s2 / 6561
+                    + 6859 * cuba.sum5 / 19683 / (1 << n));
+        res5 = vol * (phloat(729 - 950 * n + 50 * n * n) * cuba.f0 / 729
+                    + 245 * s2 / 486
+                    + phloat(265 - 100 * n) * s3 / 1458
+                    + 25 * cuba.sum4 / 729);
+    }
+    c[2 * n] = res;
+    c[2 * n + 1] = fabs(res - res5);
+    c[2 * n + 2] = split;
+}
+
+static int call_cuba_fn() {
+    phloat x[CUBA_MAX_DIM];
+    int axis;
+    cuba_node(cuba.point, x, &axis);
+    clean_stack(cuba.prev_sp);
+    vartype_list *names = (vartype_list *) cuba.names;
+    for (int i = 0; i < cuba.n; i++) {
+        vartype_string *s = (vartype_string *) names->array->data[i];
+        vartype *v = recall_var(s->txt(), s->length);
+        if (v != NULL && v->type == TYPE_REAL) {
+            ((vartype_real *) v)->x = x[i];
+            continue;
+        }
+        v = new_real(x[i]);
+        if (v == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        int err = store_var(s->txt(), s->length, v);
+        if (err != ERR_NONE) {
+            free_vartype(v);
+            return err;
+        }
+    }
+    return call_fun(cuba.fun, -7);
+}
+
+int start_cubature(vartype *fun, vartype *vars, vartype *lims) {
+    if (cubature_active())
+        return ERR_INTEG_INTEG;
+
+    int err = check_fun(fun);
+    if (err != ERR_NONE)
+        return err;
+
+    int n;
+    if (vars->type == TYPE_STRING)
+        n = 1;
+    else if (vars->type == TYPE_LIST) {
+        n = ((vartype_list *) vars)->size;
+        if (n == 0)
+            return ERR_INVALID_DATA;
+        if (n > CUBA_MAX_DIM)
+            return ERR_DIMENSION_ERROR;
+    } else
+        return ERR_INVALID_TYPE;
+    for (int i = 0; i < n; i++) {
+        vartype *v = vars->type == TYPE_STRING ? vars : ((vartype_list *) vars)->array->data[i];
+        if (v->type != TYPE_STRING)
+            return ERR_INVALID_TYPE;
+        vartype_string *s = (vartype_string *) v;
+        if (s->length == 0)
+            return ERR_INVALID_DATA;
+        if (s->length > 7)
+            return ERR_NAME_TOO_LONG;
+    }
+
+    if (lims->type == TYPE_STRING)
+        return ERR_ALPHA_DATA_IS_INVALID;
+    if (lims->type != TYPE_REALMATRIX)
+        return ERR_INVALID_TYPE;
+    vartype_realmatrix *lm = (vartype_realmatrix *) lims;
+    if (lm->rows != n || lm->columns != 2)
+        return ERR_DIMENSION_ERROR;
+    if (contains_strings(lm))
+        return ERR_ALPHA_DATA_IS_INVALID;
+
+    phloat acc;
+    err = get_integ_acc(&acc);
+    if (err != ERR_NONE)
+        return err;
+
+    vartype *names = new_list(n);
+    vartype *fun_copy = dup_vartype(fun);
+    vartype *regions = new_realmatrix(16, 2 * n + 3);
+    if (names == NULL || fun_copy == NULL || regions == NULL) {
+        err = ERR_INSUFFICIENT_MEMORY;
+        goto fail;
+    }
+    for (int i = 0; i < n; i++) {
+        vartype *v = vars->type == TYPE_STRING ? vars : ((vartype_list *) vars)->array->data[i];
+        v = dup_vartype(v);
+        if (v == NULL) {
+            err = ERR_INSUFFICIENT_MEMORY;
+            goto fail;
+        }
+        ((vartype_list *) names)->array->data[i] = v;
+    }
+
+    /* Preserve stack, and program location; the three arguments are
+     * replaced by the integral and error estimate when we're done,
+     * as with FUNC 32.
+     */
+    if (program_running()) {
+        err = push_rtn_addr(current_prgm, pc);
+        if (err != ERR_NONE)
+            goto fail;
+    } else {
+        clear_all_rtns();
+        return_here_after_last_rtn();
+        set_running(true);
+    }
+    err = push_func_state(32);
+    if (err != ERR_NONE)
+        goto fail;
+
+    reset_cuba();
+    cuba.fun = fun_copy;
+    cuba.names = names;
+    cuba.regions = regions;
+    {
+        phloat *r = ((vartype_realmatrix *) regions)->array->data;
+        for (int i = 0; i < n; i++) {
+            phloat a = lm->array->data[2 * i];
+            phloat b = lm->array->data[2 * i + 1];
+            r[i] = (a + b) / 2;
+            r[n + i] = (b - a) / 2;
+        }
+    }
+    cuba.nregions = 1;
+    cuba.n = n;
+    cuba.acc = acc;
+    cuba.next = -1;
+    cuba.evals = 0;
+    cuba.prev_sp = flags.f.big_stack ? sp : -2;
+    cuba.state = 1;
+    cuba_start_region(0);
+    return call_cuba_fn();
+
+    fail:
+    free_vartype(names);
+    free_vartype(fun_copy);
+    free_vartype(regions);
+    return err;
+}
+
+int return_to_cubature(bool stop) {
+    if (cuba.state != 1)
+        return ERR_INTERNAL_ERROR;
+    if (sp == -1)
+        return ERR_TOO_FEW_ARGUMENTS;
+    vartype *x = stack[sp];
+    if (x->type == TYPE_STRING)
+        return ERR_ALPHA_DATA_IS_INVALID;
+    if (x->type != TYPE_REAL)
+        return ERR_INVALID_TYPE;
+    cuba_add(((vartype_real *) x)->x);
+    cuba.evals++;
+
+    int err;
+    int4 npoints = cuba_points();
+    if (++cuba.point < npoints)
+        goto next;
+
+    cuba_finish_region();
+    if (cuba.next != -1) {
+        // Second half of a bisected region
+        cuba_start_region(cuba.next);
+        cuba.next = -1;
+        goto next;
+    }
+
+    {
+        int n = cuba.n;
+        vartype_realmatrix *rm = (vartype_realmatrix *) cuba.regions;
+        int cols = rm->columns;
+        phloat total = 0, error = 0, maxerr = -1;
+        int4 worst = 0;
+        for (int4 r = 0; r < cuba.nregions; r++) {
+            phloat *row = rm->array->data + r * cols;
+            total += row[2 * n];
+            error += row[2 * n + 1];
+            if (row[2 * n + 1] > maxerr) {
+                maxerr = row[2 * n + 1];
+                worst = r;
+            }
+        }
+
+        if (error <= cuba.acc * fabs(total) || cuba.evals + 2 * npoints > CUBA_MAX_EVALS) {
+            clean_stack(cuba.prev_sp);
+            reset_cuba();
+            vartype *v = new_real(total);
+            vartype *e = new_real(error);
+            if (v == NULL || e == NULL) {
+                free_vartype(v);
+                free_vartype(e);
+                return ERR_INSUFFICIENT_MEMORY;
+            }
+            err = recall_two_results(v, e);
+            if (err != ERR_NONE)
+                return err;
+            err = docmd_rtn(NULL);
+            if (err == ERR_NONE && stop)
+                err = ERR_STOP;
+            return err;
+        }
+
+        // Bisect the region with the largest error
+        if (cuba.nregions == rm->rows) {
+            vartype_realmatrix *nm = (vartype_realmatrix *) new_realmatrix(rm->rows * 2, cols);
+            if (nm == NULL)
+                return ERR_INSUFFICIENT_MEMORY;
+            for (int4 i = 0; i < cuba.nregions * cols; i++)
+                nm->array->data[i] = rm->array->data[i];
+            free_vartype(cuba.regions);
+            cuba.regions = (vartype *) nm;
+            rm = nm;
+        }
+        phloat *a = rm->array->data + worst * cols;
+        phloat *b = rm->array->data + cuba.nregions * cols;
+        int axis = to_int(a[2 * n + 2]);
+        a[n + axis] /= 2;
+        for (int i = 0; i < cols; i++)
+            b[i] = a[i];
+        a[axis] -= a[n + axis];
+        b[axis] += a[n + axis];
+        cuba_start_region(worst);
+        cuba.next = cuba.nregions++;
+    }
+
+    next:
+    err = call_cuba_fn();
+    if (err == ERR_RUN && stop)
+        err = ERR_STOP;
+    return err;
+}
+
+
+/* Root scan: finds all the roots of a function in an interval. The function
+ * is sampled at SCAN_INTERVALS + 1 evenly spaced points, and around each
+ * local minimum of |f| that does not straddle a sign change, extra samples
+ * are added, up to SCAN_MAX_DEPTH times, to find pairs of roots that are
+ * close together. Then, each sign change is handed to the solver as a
+ * bracket, and each remaining local minimum of |f| as a pair of starting
+ * guesses, and the results are collected, along with the solver's
+ * classification: root, sign reversal, or extremum. Extrema are only kept
+ * when f is near zero there, relative to the largest sampled |f|.
+ * The samples matrix has one row per sample: x, f(x), refinement depth,
+ * and whether f(x) has been evaluated yet. While solving, pos / 2 is the
+ * sample being examined, and pos % 2 selects a minimum at that sample (0)
+ * or a sign change between it and the next one (1).
+ */
+
+static void reset_scan() {
+    rscan.state = 0;
+    free_vartype(rscan.fun);
+    rscan.fun = NULL;
+    free_vartype(rscan.samples);
+    rscan.samples = NULL;
+    free_vartype(rscan.roots);
+    rscan.roots = NULL;
+}
+
+static int call_scan_fn() {
+    phloat *s = ((vartype_realmatrix *) rscan.samples)->array->data + rscan.pos * 4;
+    clean_stack(rscan.prev_sp);
+    vartype *v = recall_var(rscan.var_name, rscan.var_length);
+    if (v != NULL && v->type == TYPE_REAL)
+        ((vartype_real *) v)->x = s[0];
+    else {
+        v = new_real(s[0]);
+        if (v == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        int err = store_var(rscan.var_name, rscan.var_length, v);
+        if (err != ERR_NONE) {
+            free_vartype(v);
+            return err;
+        }
+    }
+    return call_fun(rscan.fun, -8);
+}
+
+static bool scan_is_min(phloat *s, int4 i) {
+    if (i == 0 || i == rscan.nsamples - 1)
+        return false;
+    phloat f0 = s[(i - 1) * 4 + 1];
+    phloat f1 = s[i * 4 + 1];
+    phloat f2 = s[(i + 1) * 4 + 1];
+    if (f1 == 0 || f0 * f1 <= 0 || f1 * f2 <= 0)
+        return false;
+    return fabs(f1) < fabs(f0) && fabs(f1) <= fabs(f2);
+}
+
+/* Add samples on both sides of each local minimum of |f| that hasn't been
+ * refined SCAN_MAX_DEPTH times yet, as long as the total stays within
+ * SCAN_MAX_SAMPLES.
+ */
+static int scan_refine(bool *added) {
+    vartype_realmatrix *rm = (vartype_realmatrix *) rscan.samples;
+    phloat *s = rm->array->data;
+    int4 n = rscan.nsamples;
+    int4 extra = 0;
+    for (int4 i = 0; i < n; i++)
+        if (scan_is_min(s, i) && s[i * 4 + 2] < SCAN_MAX_DEPTH)
+            extra += 2;
+    if (extra == 0 || n + extra > SCAN_MAX_SAMPLES) {
+        *added = false;
+        return ERR_NONE;
+    }
+    vartype_realmatrix *nm = (vartype_realmatrix *) new_realmatrix(n + extra, 4);
+    if (nm == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    phloat *d = nm->array->data;
+    int4 j = 0;
+    for (int4 i = 0; i < n; i++) {
+        bool refine = scan_is_min(s, i) && s[i * 4 + 2] < SCAN_MAX_DEPTH;
+        phloat depth = s[i * 4 + 2] + 1;
+        if (refine) {
+            d[j * 4] = (s[(i - 1) * 4] + s[i * 4]) / 2;
+            d[j * 4 + 2] = depth;
+            j++;
+        }
+        for (int k = 0; k < 4; k++)
+            d[j * 4 + k] = s[i * 4 + k];
+        if (refine)
+            d[j * 4 + 2] = depth;
+        j++;
+        if (refine) {
+            d[j * 4] = (s[i * 4] + s[(i + 1) * 4]) / 2;
+            d[j * 4 + 2] = depth;
+            j++;
+        }
+    }
+    free_vartype(rscan.samples);
+    rscan.samples = (vartype *) nm;
+    rscan.nsamples = n + extra;
+    *added = true;
+    return ERR_NONE;
+}
+
+static int scan_add_root(phloat x, int code) {
+    phloat tol = fabs(rscan.b - rscan.a) * 1e-10;
+    vartype_realmatrix *rm = (vartype_realmatrix *) rscan.roots;
+    for (int4 i = 0; i < rscan.nroots; i++)
+        if (fabs(rm->array->data[i * 2] - x) <= tol)
+            return ERR_NONE;
+    if (rscan.nroots == rm->rows) {
+        vartype_realmatrix *nm = (vartype_realmatrix *) new_realmatrix(rm->rows * 2, 2);
+        if (nm == NULL)
+            return ERR_INSUFFICIENT_MEMORY;
+        for (int4 i = 0; i < rscan.nroots * 2; i++)
+            nm->array->data[i] = rm->array->data[i];
+        free_vartype(rscan.roots);
+        rscan.roots = (vartype *) nm;
+        rm = nm;
+    }
+    // Keep the roots sorted
+    phloat *r = rm->array->data;
+    int4 i = rscan.nroots++;
+    while (i > 0 && r[(i - 1) * 2] > x) {
+        r[i * 2] = r[(i - 1) * 2];
+        r[i * 2 + 1] = r[(i - 1) * 2 + 1];
+        i--;
+    }
+    r[i * 2] = x;
+    r[i * 2 + 1] = code;
+    return ERR_NONE;
+}
+
+static int finish_scan(bool stop) {
+    clean_stack(rscan.prev_sp);
+    vartype_realmatrix *rm = (vartype_realmatrix *) rscan.roots;
+    int4 n = rscan.nroots;
+    vartype *roots = new_list(n);
+    vartype *codes = new_list(n);
+    if (roots == NULL || codes == NULL)
+        goto nomem;
+    for (int4 i = 0; i < n; i++) {
+        vartype *r = new_real(rm->array->data[i * 2]);
+        vartype *c = new_real(rm->array->data[i * 2 + 1]);
+        ((vartype_list *) roots)->array->data[i] = r;
+        ((vartype_list *) codes)->array->data[i] = c;
+        if (r == NULL || c == NULL)
+            goto nomem;
+    }
+    reset_scan();
+    int err;
+    err = recall_two_results(roots, codes);
+    if (err != ERR_NONE)
+        return err;
+    err = docmd_rtn(NULL);
+    if (err == ERR_NONE && stop)
+        err = ERR_STOP;
+    return err;
+
+    nomem:
+    free_vartype(roots);
+    free_vartype(codes);
+    return ERR_INSUFFICIENT_MEMORY;
+}
+
+/* Find the next sign change or minimum, starting at rscan.pos, and start
+ * solving it; exact zeros found along the way are recorded directly.
+ */
+static int scan_next(bool stop) {
+    phloat *s = ((vartype_realmatrix *) rscan.samples)->array->data;
+    int4 n = rscan.nsamples;
+    int err;
+    for (; rscan.pos < n * 2; rscan.pos++) {
+        int4 i = rscan.pos / 2;
+        phloat x1, x2;
+        if ((rscan.pos & 1) == 0) {
+            if (s[i * 4 + 1] == 0) {
+                err = scan_add_root(s[i * 4], SOLVE_ROOT);
+                if (err != ERR_NONE)
+                    return err;
+                continue;
+            }
+            if (!scan_is_min(s, i))
+                continue;
+            x1 = s[(i - 1) * 4];
+            x2 = s[(i + 1) * 4];
+        } else {
+            if (i == n - 1 || s[i * 4 + 1] * s[(i + 1) * 4 + 1] >= 0)
+                continue;
+            x1 = s[i * 4];
+            x2 = s[(i + 1) * 4];
+        }
+        vartype *v1 = new_real(x1);
+        vartype *v2 = new_real(x2);
+        if (v1 == NULL || v2 == NULL) {
+            free_vartype(v1);
+            free_vartype(v2);
+            return ERR_INSUFFICIENT_MEMORY;
+        }
+        clean_stack(rscan.prev_sp);
+        err = solve_fun(rscan.fun, -8, rscan.var_name, rscan.var_length, v1, v2);
+        free_vartype(v1);
+        free_vartype(v2);
+        if (err == ERR_RUN && stop)
+            err = ERR_STOP;
+        return err;
+    }
+    return finish_scan(stop);
+}
+
+int start_root_scan(vartype *fun, vartype *var, vartype *lims) {
+    if (solve_active())
+        return ERR_SOLVE_SOLVE;
+    if (root_scan_active())
+        return ERR_INVALID_CONTEXT;
+
+    int err = check_fun(fun);
+    if (err != ERR_NONE)
+        return err;
+    if (var->type != TYPE_STRING)
+        return ERR_INVALID_TYPE;
+    vartype_string *vs = (vartype_string *) var;
+    if (vs->length == 0)
+        return ERR_INVALID_DATA;
+    if (vs->length > 7)
+        return ERR_NAME_TOO_LONG;
+
+    phloat a, b;
+    if (lims->type == TYPE_REALMATRIX) {
+        vartype_realmatrix *rm = (vartype_realmatrix *) lims;
+        if (rm->rows * rm->columns != 2)
+            return ERR_DIMENSION_ERROR;
+        if (contains_strings(rm))
+            return ERR_ALPHA_DATA_IS_INVALID;
+        a = rm->array->data[0];
+        b = rm->array->data[1];
+    } else if (lims->type == TYPE_LIST) {
+        vartype_list *list = (vartype_list *) lims;
+        if (list->size != 2)
+            return ERR_DIMENSION_ERROR;
+        if (list->array->data[0]->type != TYPE_REAL || list->array->data[1]->type != TYPE_REAL)
+            return ERR_INVALID_TYPE;
+        a = ((vartype_real *) list->array->data[0])->x;
+        b = ((vartype_real *) list->array->data[1])->x;
+    } else if (lims->type == TYPE_STRING)
+        return ERR_ALPHA_DATA_IS_INVALID;
+    else
+        return ERR_INVALID_TYPE;
+    if (a == b)
+        return ERR_INVALID_DATA;
+    if (a > b) {
+        phloat t = a;
+        a = b;
+        b = t;
+    }
+
+    vartype *fun_copy = dup_vartype(fun);
+    vartype *samples = new_realmatrix(SCAN_INTERVALS + 1, 4);
+    vartype *roots = new_realmatrix(8, 2);
+    if (fun_copy == NULL || samples == NULL || roots == NULL) {
+        err = ERR_INSUFFICIENT_MEMORY;
+        goto fail;
+    }
+
+    /* Preserve stack, and program location; the three arguments are
+     * replaced by the lists of roots and their classifications when
+     * we're done, as with FUNC 32.
+     */
+    if (program_running()) {
+        err = push_rtn_addr(current_prgm, pc);
+        if (err != ERR_NONE)
+            goto fail;
+    } else {
+        clear_all_rtns();
+        return_here_after_last_rtn();
+        set_running(true);
+    }
+    err = push_func_state(32);
+    if (err != ERR_NONE)
+        goto fail;
+
+    reset_scan();
+    rscan.fun = fun_copy;
+    string_copy(rscan.var_name, &rscan.var_length, vs->txt(), vs->length);
+    rscan.a = a;
+    rscan.b = b;
+    rscan.samples = samples;
+    rscan.nsamples = SCAN_INTERVALS + 1;
+    for (int i = 0; i <= SCAN_INTERVALS; i++) {
+        phloat *s = ((vartype_realmatrix *) samples)->array->data + i * 4;
+        s[0] = i == SCAN_INTERVALS ? b : a + (b - a) * i / SCAN_INTERVALS;
+    }
+    rscan.pos = 0;
+    rscan.roots = roots;
+    rscan.nroots = 0;
+    rscan.prev_sp = flags.f.big_stack ? sp : -2;
+    rscan.state = 1;
+    return call_scan_fn();
+
+    fail:
+    free_vartype(fun_copy);
+    free_vartype(samples);
+    free_vartype(roots);
+    return err;
+}
+
+int return_to_root_scan(bool stop) {
+    int err;
+    if (rscan.state == 1) {
+        // Sampling
+        bool added;
+        if (sp == -1)
+            return ERR_TOO_FEW_ARGUMENTS;
+        vartype *x = stack[sp];
+        if (x->type == TYPE_STRING)
+            return ERR_ALPHA_DATA_IS_INVALID;
+        if (x->type != TYPE_REAL)
+            return ERR_INVALID_TYPE;
+        phloat *s = ((vartype_realmatrix *) rscan.samples)->array->data;
+        s[rscan.pos * 4 + 1] = ((vartype_real *) x)->x;
+        s[rscan.pos * 4 + 3] = 1;
+        while (++rscan.pos < rscan.nsamples)
+            if (s[rscan.pos * 4 + 3] == 0)
+                goto next;
+        err = scan_refine(&added);
+        if (err != ERR_NONE)
+            return err;
+        if (added) {
+            s = ((vartype_realmatrix *) rscan.samples)->array->data;
+            for (rscan.pos = 0; s[rscan.pos * 4 + 3] != 0; rscan.pos++);
+            goto next;
+        }
+        rscan.state = 2;
+        rscan.pos = 0;
+        return scan_next(stop);
+
+        next:
+        err = call_scan_fn();
+        if (err == ERR_RUN && stop)
+            err = ERR_STOP;
+        return err;
+    } else if (rscan.state == 2) {
+        // Solving; X = root, Z = f(root), T = how it was found
+        if (sp < 3 || stack[sp]->type != TYPE_REAL
+                || stack[sp - 2]->type != TYPE_REAL
+                || stack[sp - 3]->type != TYPE_REAL)
+            return ERR_INTERNAL_ERROR;
+        phloat x = ((vartype_real *) stack[sp])->x;
+        phloat fx = ((vartype_real *) stack[sp - 2])->x;
+        int code = to_int(((vartype_real *) stack[sp - 3])->x);
+        bool keep = x >= rscan.a && x <= rscan.b;
+        if (code == SOLVE_EXTREMUM) {
+            phloat fmax = 0;
+            phloat *s = ((vartype_realmatrix *) rscan.samples)->array->data;
+            for (int4 i = 0; i < rscan.nsamples; i++)
+                if (fabs(s[i * 4 + 1]) > fmax)
+                    fmax = fabs(s[i * 4 + 1]);
+            keep = keep && fabs(fx) <= fmax * 1e-9;
+        } else if (code != SOLVE_ROOT && code != SOLVE_SIGN_REVERSAL)
+            keep = false;
+        if (keep) {
+            err = scan_add_root(x, code);
+            if (err != ERR_NONE)
+                return err;
+        }
+        rscan.pos++;
+        return scan_next(stop);
+    } else
+        return ERR_INTERNAL_ERROR;
+}
+
+
+/* Map, filter, and reduce: call a function once for each element of a list
+ * or matrix. The element is passed in X; for REDUCE, the result so far is
+ * passed in Y. The result of MAP has the same shape as the source; FILTER
+ * returns a list of the elements for which the function returned nonzero.
+ * The results are collected in place, in a list or matrix allocated up
+ * front, so nothing else needs to be on the stack between calls; a list
+ * result only grows as far as the elements that are done, so it can be
+ * persisted at any time. For
+ * REDUCE, the result so far is kept in 'result'.
+ * Matrices are traversed in row-major order.
+ */
+
+static void reset_map() {
+    lmap.state = 0;
+    free_vartype(lmap.fun);
+    lmap.fun = NULL;
+    free_vartype(lmap.src);
+    lmap.src = NULL;
+    free_vartype(lmap.result);
+    lmap.result = NULL;
+}
+
+static int4 map_size(vartype *v) {
+    switch (v->type) {
+        case TYPE_LIST:
+            return ((vartype_list *) v)->size;
+        case TYPE_REALMATRIX: {
+            vartype_realmatrix *rm = (vartype_realmatrix *) v;
+            return rm->rows * rm->columns;
+        }
+        case TYPE_COMPLEXMATRIX: {
+            vartype_complexmatrix *cm = (vartype_complexmatrix *) v;
+            return cm->rows * cm->columns;
+        }
+        default:
+            return -1;
+    }
+}
+
+static vartype *map_element(vartype *v, int4 i) {
+    switch (v->type) {
+        case TYPE_LIST:
+            return dup_vartype(((vartype_list *) v)->array->data[i]);
+        case TYPE_REALMATRIX: {
+            vartype_realmatrix *rm = (vartype_realmatrix *) v;
+            if (rm->array->is_string[i] == 0)
+                return new_real(rm->array->data[i]);
+            const char *text;
+            int4 length;
+            get_matrix_string(rm, i, &text, &length);
+            return new_string(text, length);
+        }
+        case TYPE_COMPLEXMATRIX: {
+            vartype_complexmatrix *cm = (vartype_complexmatrix *) v;
+            return new_complex(cm->array->data[2 * i], cm->array->data[2 * i + 1]);
+        }
+        default:
+            return NULL;
+    }
+}
+
+static int call_map_fn() {
+    clean_stack(lmap.prev_sp);
+    vartype *x = map_element(lmap.src, lmap.pos);
+    if (x == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    int err;
+    flags.f.stack_lift_disable = 0;
+    if (lmap.op == MAP_REDUCE) {
+        vartype *y = dup_vartype(lmap.result);
+        if (y == NULL) {
+            free_vartype(x);
+            return ERR_INSUFFICIENT_MEMORY;
+        }
+        err = recall_two_results(x, y);
+    } else
+        err = recall_result_silently(x);
+    if (err != ERR_NONE)
+        return err;
+    return call_fun(lmap.fun, -9);
+}
+
+int start_map(int op, vartype *src, vartype *fun) {
+    if (map_active())
+        return ERR_INVALID_CONTEXT;
+    int err = check_fun(fun);
+    if (err != ERR_NONE)
+        return err;
+    int4 count = map_size(src);
+    if (count == -1)
+        return src->type == TYPE_STRING ? ERR_ALPHA_DATA_IS_INVALID
+                                        : ERR_INVALID_TYPE;
+
+    vartype *fun_copy = NULL;
+    vartype *src_copy = NULL;
+    vartype *result = NULL;
+    int4 pos = 0;
+    switch (op) {
+        case MAP_MAP:
+            if (src->type == TYPE_LIST) {
+                result = new_list(0);
+                if (result != NULL && !list_reserve((vartype_list *) result, count)) {
+                    free_vartype(result);
+                    result = NULL;
+                }
+            } else if (src->type == TYPE_REALMATRIX)
+                result = new_realmatrix(((vartype_realmatrix *) src)->rows,
+                                        ((vartype_realmatrix *) src)->columns);
+            else
+                result = new_complexmatrix(((vartype_complexmatrix *) src)->rows,
+                                           ((vartype_complexmatrix *) src)->columns);
+            break;
+        case MAP_FILTER:
+            result = new_list(0);
+            break;
+        case MAP_REDUCE:
+            // Start with the first element, so the function
+            // is called count - 1 times
+            if (count == 0)
+                return ERR_INVALID_DATA;
+            result = map_element(src, 0);
+            pos = 1;
+            break;
+    }
+    if (result == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    if (pos == count)
+        // Nothing to do: an empty list, or REDUCE of a single element
+        return binary_result(result);
+
+    fun_copy = dup_vartype(fun);
+    src_copy = dup_vartype(src);
+    if (fun_copy == NULL || src_copy == NULL) {
+        err = ERR_INSUFFICIENT_MEMORY;
+        goto fail;
+    }
+
+    /* Preserve stack, and program location; the two arguments are
+     * replaced by the result when we're done, as with FUNC 21.
+     */
+    if (program_running()) {
+        err = push_rtn_addr(current_prgm, pc);
+        if (err != ERR_NONE)
+            goto fail;
+    } else {
+        clear_all_rtns();
+        return_here_after_last_rtn();
+        set_running(true);
+    }
+    err = push_func_state(21);
+    if (err != ERR_NONE)
+        goto fail;
+
+    reset_map();
+    lmap.op = op;
+    lmap.fun = fun_copy;
+    lmap.src = src_copy;
+    lmap.result = result;
+    lmap.pos = pos;
+    lmap.count = count;
+    lmap.prev_sp = flags.f.big_stack ? sp : -2;
+    lmap.state = 1;
+    return call_map_fn();
+
+    fail:
+    free_vartype(fun_copy);
+    free_vartype(src_copy);
+    free_vartype(result);
+    return err;
+}
+
+int return_to_map(bool stop) {
+    if (lmap.state != 1)
+        return ERR_INTERNAL_ERROR;
+    if (sp == -1)
+        return ERR_TOO_FEW_ARGUMENTS;
+    vartype *x = stack[sp];
+    int4 pos = lmap.pos;
+
+    switch (lmap.op) {
+        case MAP_MAP: {
+            if (lmap.result->type == TYPE_LIST) {
+                vartype_list *list = (vartype_list *) lmap.result;
+                if (!list_reserve(list, list->size + 1))
+                    return ERR_INSUFFICIENT_MEMORY;
+                vartype *v = dup_vartype(x);
+                if (v == NULL)
+                    return ERR_INSUFFICIENT_MEMORY;
+                list->array->data[list->size++] = v;
+            } else if (lmap.result->type == TYPE_REALMATRIX) {
+                vartype_realmatrix *rm = (vartype_realmatrix *) lmap.result;
+                if (x->type == TYPE_REAL)
+                    put_matrix_phloat(rm, pos, ((vartype_real *) x)->x);
+                else if (x->type == TYPE_STRING) {
+                    vartype_string *s = (vartype_string *) x;
+                    if (!put_matrix_string(rm, pos, s->txt(), s->length))
+                        return ERR_INSUFFICIENT_MEMORY;
+                } else
+                    return ERR_INVALID_TYPE;
+            } else {
+                phloat *d = ((vartype_complexmatrix *) lmap.result)->array->data + 2 * pos;
+                if (x->type == TYPE_REAL) {
+                    d[0] = ((vartype_real *) x)->x;
+                    d[1] = 0;
+                } else if (x->type == TYPE_COMPLEX) {
+                    d[0] = ((vartype_complex *) x)->re;
+                    d[1] = ((vartype_complex *) x)->im;
+                } else
+                    return x->type == TYPE_STRING ? ERR_ALPHA_DATA_IS_INVALID
+                                                  : ERR_INVALID_TYPE;
+            }
+            break;
+        }
+        case MAP_FILTER: {
+            if (x->type == TYPE_STRING)
+                return ERR_ALPHA_DATA_IS_INVALID;
+            if (x->type != TYPE_REAL)
+                return ERR_INVALID_TYPE;
+            if (((vartype_real *) x)->x == 0)
+                break;
+            vartype_list *list = (vartype_list *) lmap.result;
+            if (!list_reserve(list, list->size + 1))
+                return ERR_INSUFFICIENT_MEMORY;
+            vartype *v = map_element(lmap.src, pos);
+            if (v == NULL)
+                return ERR_INSUFFICIENT_MEMORY;
+            list->array->data[list->size++] = v;
+            break;
+        }
+        case MAP_REDUCE: {
+            vartype *v = dup_vartype(x);
+            if (v == NULL)
+                return ERR_INSUFFICIENT_MEMORY;
+            free_vartype(lmap.result);
+            lmap.result = v;
+            break;
+        }
+    }
+
+    int err;
+    if (++lmap.pos < lmap.count) {
+        err = call_map_fn();
+        if (err == ERR_RUN && stop)
+            err = ERR_STOP;
+        return err;
+    }
+
+    clean_stack(lmap.prev_sp);
+    lmap.state = 0;
+    vartype *result = lmap.result;
+    lmap.result = NULL;
+    reset_map();
+    err = recall_result(result);
+    if (err != ERR_NONE)
+        return err;
+    err = docmd_rtn(NULL);
+    if (err == ERR_NONE && stop)
+        err = ERR_STOP;
+    return err;
+}
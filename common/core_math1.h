@@ -20,6 +20,7 @@
 
 #include "free42.h"
 #include "core_phloat.h"
+#include "core_tables.h"
 #include "core_variables.h"
 
 bool persist_math();
@@ -49,6 +50,11 @@ int set_solve_eqn(vartype *eq);
 int start_solve(int prev, const char *name, int length, vartype *v1, vartype *v2, vartype **saved_inv = NULL);
 int return_to_solve(bool failure, bool stop);
 bool is_solve_var(const char *name, int length);
+int set_root_cache_size(int size);
+int4 get_solve_evals();
+int handle_tangent(int cmd, arg_struct *arg);
+void forget_tangent(vartype *v);
+void copy_tangent(const vartype *src, vartype *dst);
 
 void set_integ_prgm(const char *name, int length);
 int set_integ_eqn(vartype *eq);
@@ -58,4 +64,17 @@ void get_integ_var(char *name, int *length);
 int start_integ(int prev, const char *name, int length, vartype *solve_info = NULL);
 int return_to_integ(bool stop);
 
+int start_table(vartype *fun, vartype *mode, vartype *spec);
+int return_to_table(bool stop);
+int start_cubature(vartype *fun, vartype *vars, vartype *lims);
+int return_to_cubature(bool stop);
+int start_root_scan(vartype *fun, vartype *var, vartype *lims);
+int return_to_root_scan(bool stop);
+#define MAP_MAP    0
+#define MAP_FILTER 1
+#define MAP_REDUCE 2
+
+int start_map(int op, vartype *src, vartype *fun);
+int return_to_map(bool stop);
+
 #endif
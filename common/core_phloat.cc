@@ -753,6 +753,21 @@ Phloat fma(Phloat x, Phloat y, Phloat z) {
     return Phloat(res);
 }
 
+/* Returns sum + x[0] * y[0] + ... + x[n - 1] * y[n - 1], adding the terms
+ * one at a time with bid128_fma(). That takes one library call per term
+ * instead of two, and the products aren't rounded before they're added,
+ * so this is both faster and more accurate than a loop using * and +=.
+ */
+Phloat dot_fma(const Phloat *x, const Phloat *y, int4 n, Phloat sum) {
+    BID_UINT128 s = sum.val;
+    BID_UINT128 t;
+    for (int4 i = 0; i < n; i++) {
+        bid128_fma(&t, (BID_UINT128 *) &x[i].val, (BID_UINT128 *) &y[i].val, &s);
+        s = t;
+    }
+    return Phloat(s);
+}
+
 Phloat nextafter(Phloat x, Phloat y) {
     BID_UINT128 res;
     bid128_nextafter(&res, &x.val, &y.val);
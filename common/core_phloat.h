@@ -158,6 +158,7 @@ Phloat pow(Phloat x, Phloat y);
 Phloat floor(Phloat x);
 Phloat ceil(Phloat x);
 Phloat fma(Phloat x, Phloat y, Phloat z);
+Phloat dot_fma(const Phloat *x, const Phloat *y, int4 n, Phloat sum);
 Phloat nextafter(Phloat x, Phloat y);
 int ilogb(Phloat x);
 Phloat scalbn(Phloat x, int y);
@@ -22,6 +22,7 @@
 #include "core_commands8.h"
 #include "core_helpers.h"
 #include "core_linalg1.h"
+#include "core_linalg2.h"
 #include "core_sto_rcl.h"
 #include "core_variables.h"
 
@@ -235,10 +236,7 @@ int generic_sto(arg_struct *arg, char operation) {
                     if (!disentangle((vartype *) rm))
                         return ERR_INSUFFICIENT_MEMORY;
                     if (operation == 0) {
-                        if (rm->array->is_string[num] == 2)
-                            free(*(void **) &rm->array->data[num]);
-                        rm->array->data[num] = ((vartype_real *) stack[sp])->x;
-                        rm->array->is_string[num] = 0;
+                        put_matrix_phloat(rm, num, ((vartype_real *) stack[sp])->x);
                     } else {
                         phloat x, n;
                         int inf;
@@ -551,6 +549,32 @@ int map_unary(const vartype *src, vartype **dst, mappable_r mr, mappable_c mc, b
     }
 }
 
+/* Like map_unary(), but in the binary build, real matrices are handled by
+ * the vector kernel 'op' (VEC_SQRT etc.), falling back on 'mr' only if the
+ * kernel reports trouble.
+ */
+int map_unary_vec(const vartype *src, vartype **dst, mappable_r mr,
+                  mappable_c mc, int op) {
+    #ifndef BCD_MATH
+        if (src->type == TYPE_REALMATRIX) {
+            vartype_realmatrix *sm = (vartype_realmatrix *) src;
+            if (!contains_strings(sm)) {
+                vartype_realmatrix *dm = (vartype_realmatrix *)
+                                        new_realmatrix(sm->rows, sm->columns);
+                if (dm == NULL)
+                    return ERR_INSUFFICIENT_MEMORY;
+                if (vec_unary(op, sm->array->data, dm->array->data,
+                              sm->rows * sm->columns)) {
+                    *dst = (vartype *) dm;
+                    return ERR_NONE;
+                }
+                free_vartype((vartype *) dm);
+            }
+        }
+    #endif
+    return map_unary(src, dst, mr, mc);
+}
+
 int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
         mappable_rr mrr, mappable_rc mrc, mappable_cr mcr, mappable_cc mcc) {
     int error;
@@ -1303,6 +1327,95 @@ static int add_cc(phloat xre, phloat xim, phloat yre, phloat yim,
     return ERR_NONE;
 }
 
+#ifndef BCD_MATH
+/* Element-wise arithmetic on real matrices, or on a real matrix and a real
+ * scalar, using the vector kernels. Returns false if the operands are of
+ * any other kind, or if the regular code should do the work because some
+ * elements need special attention; see vec_binary().
+ */
+static bool vec_map_binary(const vartype *src1, const vartype *src2,
+                           vartype **dst, int op) {
+    const phloat *x, *y;
+    int4 rows, columns;
+    if (src1->type == TYPE_REALMATRIX) {
+        vartype_realmatrix *rm = (vartype_realmatrix *) src1;
+        x = rm->array->data;
+        rows = rm->rows;
+        columns = rm->columns;
+        if (src2->type == TYPE_REALMATRIX) {
+            vartype_realmatrix *rm2 = (vartype_realmatrix *) src2;
+            if (rm2->rows != rows || rm2->columns != columns
+                    || contains_strings(rm2))
+                return false;
+            y = rm2->array->data;
+        } else if (src2->type == TYPE_REAL)
+            y = &((vartype_real *) src2)->x;
+        else
+            return false;
+        if (contains_strings(rm))
+            return false;
+    } else if (src1->type == TYPE_REAL && src2->type == TYPE_REALMATRIX) {
+        vartype_realmatrix *rm = (vartype_realmatrix *) src2;
+        if (contains_strings(rm))
+            return false;
+        x = &((vartype_real *) src1)->x;
+        y = rm->array->data;
+        rows = rm->rows;
+        columns = rm->columns;
+    } else
+        return false;
+    vartype_realmatrix *dm = (vartype_realmatrix *) new_realmatrix(rows, columns);
+    if (dm == NULL)
+        return false;
+    if (!vec_binary(op, x, src1->type == TYPE_REALMATRIX,
+                    y, src2->type == TYPE_REALMATRIX,
+                    dm->array->data, rows * columns)) {
+        free_vartype((vartype *) dm);
+        return false;
+    }
+    *dst = (vartype *) dm;
+    return true;
+}
+#endif
+
+/* Scalar times or divided by sparse matrix; the result is sparse again, with
+ * any elements that come out as zero dropped.
+ */
+static int map_sparse(const vartype *src1, const vartype *src2, vartype **dst,
+                      mappable_rr mrr) {
+    bool sparse1 = src1->type == TYPE_SPARSEMATRIX;
+    const vartype_sparsematrix *sm = (const vartype_sparsematrix *)
+                                            (sparse1 ? src1 : src2);
+    phloat x = ((const vartype_real *) (sparse1 ? src2 : src1))->x;
+    sparsematrix_data *sd = sm->array;
+    vartype_sparsematrix *dm = (vartype_sparsematrix *)
+                        new_sparsematrix(sm->rows, sm->columns, sd->nnz);
+    if (dm == NULL)
+        return ERR_INSUFFICIENT_MEMORY;
+    sparsematrix_data *dd = dm->array;
+    int4 nnz = 0;
+    for (int4 i = 0; i < sm->rows; i++) {
+        dd->rowptr[i] = nnz;
+        for (int4 k = sd->rowptr[i]; k < sd->rowptr[i + 1]; k++) {
+            phloat r;
+            int error = sparse1 ? mrr(sd->val[k], x, &r)
+                                : mrr(x, sd->val[k], &r);
+            if (error != ERR_NONE) {
+                free_vartype((vartype *) dm);
+                return error;
+            }
+            if (r != 0) {
+                dd->col[nnz] = sd->col[k];
+                dd->val[nnz++] = r;
+            }
+        }
+    }
+    dd->rowptr[sm->rows] = nnz;
+    dd->nnz = nnz;
+    *dst = (vartype *) dm;
+    return ERR_NONE;
+}
+
 int generic_div(const vartype *px, const vartype *py, int (*completion)(int, vartype *)) {
     if (px->type == TYPE_UNIT) {
         if (py->type == TYPE_UNIT || py->type == TYPE_REAL) {
@@ -1322,8 +1435,19 @@ int generic_div(const vartype *px, const vartype *py, int (*completion)(int, var
     } else if ((px->type == TYPE_REALMATRIX || px->type == TYPE_COMPLEXMATRIX)
             && (py->type == TYPE_REALMATRIX || py->type == TYPE_COMPLEXMATRIX)) {
         return linalg_div(py, px, completion);
+    } else if (px->type == TYPE_SPARSEMATRIX || py->type == TYPE_SPARSEMATRIX) {
+        if (px->type == TYPE_REAL && py->type == TYPE_SPARSEMATRIX) {
+            vartype *dst;
+            int error = map_sparse(px, py, &dst, div_rr);
+            return completion(error, dst);
+        }
+        return sparse_div(py, px, completion);
     } else {
         vartype *dst;
+        #ifndef BCD_MATH
+            if (vec_map_binary(px, py, &dst, VEC_DIV))
+                return completion(ERR_NONE, dst);
+        #endif
         int error = map_binary(px, py, &dst, div_rr, div_rc, div_cr, div_cc);
         return completion(error, dst);
     }
@@ -1348,8 +1472,19 @@ int generic_mul(const vartype *px, const vartype *py, int (*completion)(int, var
     } else if ((px->type == TYPE_REALMATRIX || px->type == TYPE_COMPLEXMATRIX)
             && (py->type == TYPE_REALMATRIX || py->type == TYPE_COMPLEXMATRIX)) {
         return linalg_mul(py, px, completion);
+    } else if (px->type == TYPE_SPARSEMATRIX || py->type == TYPE_SPARSEMATRIX) {
+        if (px->type == TYPE_REAL || py->type == TYPE_REAL) {
+            vartype *dst;
+            int error = map_sparse(px, py, &dst, mul_rr);
+            return completion(error, dst);
+        }
+        return sparse_mul(py, px, completion);
     } else {
         vartype *dst;
+        #ifndef BCD_MATH
+            if (vec_map_binary(px, py, &dst, VEC_MUL))
+                return completion(ERR_NONE, dst);
+        #endif
         int error = map_binary(px, py, &dst, mul_rr, mul_rc, mul_cr, mul_cc);
         return completion(error, dst);
     }
@@ -1366,8 +1501,13 @@ int generic_sub(const vartype *px, const vartype *py, vartype **dst) {
             return unit_sub(px, py, dst);
         else
             return ERR_INVALID_TYPE;
-    } else
+    } else {
+        #ifndef BCD_MATH
+            if (vec_map_binary(px, py, dst, VEC_SUB))
+                return ERR_NONE;
+        #endif
         return map_binary(px, py, dst, sub_rr, sub_rc, sub_cr, sub_cc);
+    }
 }
 
 int generic_add(const vartype *px, const vartype *py, vartype **dst) {
@@ -1381,6 +1521,11 @@ int generic_add(const vartype *px, const vartype *py, vartype **dst) {
             return unit_add(px, py, dst);
         else
             return ERR_INVALID_TYPE;
-    } else
+    } else {
+        #ifndef BCD_MATH
+            if (vec_map_binary(px, py, dst, VEC_ADD))
+                return ERR_NONE;
+        #endif
         return map_binary(px, py, dst, add_rr, add_rc, add_cr, add_cc);
+    }
 }
@@ -68,6 +68,8 @@ int generic_sto(arg_struct *arg, char operation);
 
 int map_unary(const vartype *src, vartype **dst, mappable_r mr, mappable_c mc,
             bool do_units = false);
+int map_unary_vec(const vartype *src, vartype **dst, mappable_r mr,
+            mappable_c mc, int op);
 int map_binary(const vartype *src1, const vartype *src2, vartype **dst,
             mappable_rr mrr, mappable_rc mrc, mappable_cr mcr, mappable_cc mcc);
 
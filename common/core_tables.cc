@@ -53,7 +53,7 @@
  */
 #define UNIM 0x00
 
-// Available XROMs: a776-a77f
+// Available XROMs: a0b8-a0bf
 // When these run out, look for other ones in
 // https://www.hpmuseum.org/software/xroms.htm
 // Make sure to check any new ranges against the codes already in use
@@ -67,8 +67,8 @@ const command_spec cmd_array[] =
     { /* SWAP */        docmd_swap,        "X<>Y",                0x00, 0x00, 0x00, 0x71,  4, ARG_NONE,   2, ALLT },
     { /* RDN */         docmd_rdn,         "R\16",                0x00, 0x00, 0x00, 0x75,  2, ARG_NONE,   0, NA_T },
     { /* CHS */         docmd_chs,         "+/-",                 0x00, 0x00, 0x00, 0x54,  3, ARG_NONE,   1, 0x8f },
-    { /* DIV */         docmd_div,         "\0",                  0x00, 0x00, 0x00, 0x43,  1, ARG_NONE,   2, 0x8f },
-    { /* MUL */         docmd_mul,         "\1",                  0x00, 0x00, 0x00, 0x42,  1, ARG_NONE,   2, 0x8f },
+    { /* DIV */         docmd_div,         "\0",                  0x00, 0x00, 0x00, 0x43,  1, ARG_NONE,   2, FUNC },
+    { /* MUL */         docmd_mul,         "\1",                  0x00, 0x00, 0x00, 0x42,  1, ARG_NONE,   2, FUNC },
     { /* SUB */         docmd_sub,         "-",                   0x00, 0x00, 0x00, 0x41,  1, ARG_NONE,   2, 0x8f },
     { /* ADD */         docmd_add,         "+",                   0x00, 0x00, 0x00, 0x40,  1, ARG_NONE,   2, 0x8f },
     { /* LASTX */       docmd_lastx,       "LASTX",               0x00, 0x00, 0x00, 0x76,  5, ARG_NONE,   0, NA_T },
@@ -718,6 +718,25 @@ const command_spec cmd_array[] =
     { /* PLOT */        docmd_plot,        "PLOT",                0x00, 0x00, 0xa7, 0x1a,  4, ARG_NONE,   0, NA_T },
     { /* LINE */        docmd_line,        "LINE",                0x00, 0x00, 0xa7, 0x23,  4, ARG_NONE,   2, FUNC },
     { /* LIFE */        docmd_life,        "LIFE",                0x00, 0x00, 0xa7, 0x24,  4, ARG_NONE,   0, NA_T },
+    { /* SCACHE */      docmd_scache,      "SCACHE",              0x00, 0x00, 0xa7, 0x76,  6, ARG_NONE,   1, 0x01 },
+    { /* NEVAL_T */     docmd_neval_t,     "NEVAL?",              0x00, 0x00, 0xa7, 0x77,  6, ARG_NONE,   0, NA_T },
+    { /* TABLE */       docmd_table,       "TABLE",               0x00, 0x00, 0xa7, 0x78,  5, ARG_NONE,   3, FUNC },
+    { /* INTEGN */      docmd_integn,      "INTEGN",              0x00, 0x00, 0xa7, 0x79,  6, ARG_NONE,   3, FUNC },
+    { /* ROOTS */       docmd_roots,       "ROOTS",               0x00, 0x00, 0xa7, 0x7a,  5, ARG_NONE,   3, FUNC },
+    { /* SPARSE */      docmd_sparse,      "SPARSE",              0x00, 0x00, 0xa7, 0x7b,  6, ARG_NONE,   1, 0x04 },
+    { /* DENSE */       docmd_dense,       "DENSE",               0x00, 0x00, 0xa7, 0x7c,  5, ARG_NONE,   1, FUNC },
+    { /* SPMAT */       docmd_spmat,       "SPMAT",               0x00, 0x00, 0xa7, 0x7d,  5, ARG_NONE,   3, FUNC },
+    { /* EIG */         docmd_eig,         "EIG",                 0x00, 0x00, 0xa7, 0x7e,  3, ARG_NONE,   1, 0x0c },
+    { /* SVD */         docmd_svd,         "SVD",                 0x00, 0x00, 0xa7, 0x7f,  3, ARG_NONE,   1, 0x04 },
+    { /* SORT */        docmd_sort,        "SORT",                0x00, 0x00, 0xa0, 0xaf,  4, ARG_NONE,   1, 0x24 },
+    { /* SORTK */       docmd_sortk,       "SORTK",               0x00, 0x00, 0xa0, 0xb0,  5, ARG_NONE,   2, FUNC },
+    { /* SORTI */       docmd_sorti,       "SORTI",               0x00, 0x00, 0xa0, 0xb1,  5, ARG_NONE,   2, FUNC },
+    { /* MAP */         docmd_map,         "MAP",                 0x00, 0x00, 0xa0, 0xb2,  3, ARG_NONE,   2, FUNC },
+    { /* FILTER */      docmd_filter,      "FILTER",              0x00, 0x00, 0xa0, 0xb3,  6, ARG_NONE,   2, FUNC },
+    { /* REDUCE */      docmd_reduce,      "REDUCE",              0x00, 0x00, 0xa0, 0xb4,  6, ARG_NONE,   2, FUNC },
+    { /* FFT */         docmd_fft,         "FFT",                 0x00, 0x00, 0xa0, 0xb5,  3, ARG_NONE,   1, 0x0c },
+    { /* IFFT */        docmd_ifft,        "IFFT",                0x00, 0x00, 0xa0, 0xb6,  4, ARG_NONE,   1, 0x0c },
+    { /* CONV */        docmd_conv,        "CONV",                0x00, 0x00, 0xa0, 0xb7,  4, ARG_NONE,   2, 0x0c },
 };
 
 /*
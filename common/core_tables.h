@@ -671,8 +671,27 @@
 #define CMD_PLOT        615
 #define CMD_LINE        616
 #define CMD_LIFE        617
+#define CMD_SCACHE      618
+#define CMD_NEVAL_T     619
+#define CMD_TABLE       620
+#define CMD_INTEGN      621
+#define CMD_ROOTS       622
+#define CMD_SPARSE      623
+#define CMD_DENSE       624
+#define CMD_SPMAT       625
+#define CMD_EIG         626
+#define CMD_SVD         627
+#define CMD_SORT        628
+#define CMD_SORTK       629
+#define CMD_SORTI       630
+#define CMD_MAP         631
+#define CMD_FILTER      632
+#define CMD_REDUCE      633
+#define CMD_FFT         634
+#define CMD_IFFT        635
+#define CMD_CONV        636
 
-#define CMD_SENTINEL    618
+#define CMD_SENTINEL    637
 
 
 /* command_spec.argtype */
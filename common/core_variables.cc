@@ -21,6 +21,7 @@
 #include "core_globals.h"
 #include "core_helpers.h"
 #include "core_display.h"
+#include "core_math1.h"
 #include "core_parser.h"
 #include "core_variables.h"
 
@@ -60,6 +61,7 @@ vartype *new_real(phloat value) {
             return NULL;
         r->type = TYPE_REAL;
     }
+    forget_tangent((vartype *) r);
     r->x = value;
     return (vartype *) r;
 }
@@ -79,10 +81,31 @@ vartype *new_complex(phloat re, phloat im) {
     return (vartype *) c;
 }
 
+/* Long strings are allocated with some room to spare, so APPEND can extend
+ * them in place. The allocated size is a function of the length, so it
+ * doesn't need to be stored: up to 64 characters, strings are allocated
+ * exactly; beyond that, the size is rounded up to a multiple of a quarter of
+ * the largest power of two not exceeding the length. That wastes at most 25%,
+ * and makes appending to a string take amortized linear time.
+ * Note that the length of a long string may shrink without reallocating, as
+ * in vartype_string::trim1(); that's OK, since this function never decreases
+ * as the length grows, so the buffer will always be at least this large.
+ */
+int4 string_capacity(int4 length) {
+    if (length <= 64)
+        return length;
+    int4 q = 16;
+    while (q <= length / 8)
+        q *= 2;
+    if (length > 2147483647 - q)
+        return length;
+    return (length + q - 1) / q * q;
+}
+
 vartype *new_string(const char *text, int length) {
     char *dbuf;
     if (length > SSLENV) {
-        dbuf = (char *) malloc(length);
+        dbuf = (char *) malloc(string_capacity(length));
         if (dbuf == NULL)
             return NULL;
     }
@@ -141,6 +164,8 @@ vartype *new_realmatrix(int4 rows, int4 columns) {
     for (i = 0; i < sz; i++)
         rm->array->data[i] = 0;
     memset(rm->array->is_string, 0, sz);
+    rm->array->strings = 0;
+    rm->array->capacity = sz;
     rm->array->refcount = 1;
     return (vartype *) rm;
 }
@@ -172,6 +197,7 @@ vartype *new_complexmatrix(int4 rows, int4 columns) {
     }
     for (i = 0; i < sz; i++)
         cm->array->data[i] = 0;
+    cm->array->capacity = sz / 2;
     cm->array->refcount = 1;
     return (vartype *) cm;
 }
@@ -194,10 +220,130 @@ vartype *new_list(int4 size) {
         return NULL;
     }
     memset(list->array->data, 0, size * sizeof(vartype *));
+    list->array->capacity = size;
     list->array->refcount = 1;
+    list->array->owner = NULL;
     return (vartype *) list;
 }
 
+/* Returns a new slice of 'size' elements of 'array', starting at 'begin';
+ * 'array_size' is the number of elements in 'array'. Slices of slices refer
+ * to the original owner directly.
+ */
+static list_data *slice_list_data(list_data *array, int4 array_size, int4 begin, int4 size) {
+    list_data *ld = (list_data *) malloc(sizeof(list_data));
+    if (ld == NULL)
+        return NULL;
+    ld->refcount = 1;
+    ld->data = array->data + begin;
+    ld->capacity = size;
+    if (array->owner == NULL) {
+        ld->owner = array;
+        ld->owner_size = array_size;
+    } else {
+        ld->owner = array->owner;
+        ld->owner_size = array->owner_size;
+    }
+    ld->owner->refcount++;
+    return ld;
+}
+
+static void release_list_data(list_data *array, int4 size) {
+    if (--(array->refcount) > 0)
+        return;
+    if (array->owner != NULL) {
+        release_list_data(array->owner, array->owner_size);
+    } else {
+        for (int4 i = 0; i < size; i++)
+            free_vartype(array->data[i]);
+        free(array->data);
+    }
+    free(array);
+}
+
+/* Returns a list holding elements begin..begin+size-1 of 'list'. The
+ * result shares the array of 'list' instead of duplicating the elements, so
+ * this takes constant time, regardless of the size of the slice.
+ */
+vartype *list_slice(const vartype_list *list, int4 begin, int4 size) {
+    if (size == 0)
+        return new_list(0);
+    vartype_list *r = (vartype_list *) malloc(sizeof(vartype_list));
+    if (r == NULL)
+        return NULL;
+    r->type = TYPE_LIST;
+    r->size = size;
+    r->array = slice_list_data(list->array, list->size, begin, size);
+    if (r->array == NULL) {
+        free(r);
+        return NULL;
+    }
+    return (vartype *) r;
+}
+
+/* Makes sure the data array of an unshared list has room for at least 'size'
+ * elements, without changing the list's size. The array grows by 1.5x at a
+ * time, so that building a list one element at a time takes amortized
+ * constant time per element. Returns false, leaving the list unchanged, if
+ * there isn't enough memory.
+ */
+bool list_reserve(vartype_list *list, int4 size) {
+    if (list->array->owner != NULL && !disentangle((vartype *) list))
+        return false;
+    list_data *array = list->array;
+    if (size <= array->capacity)
+        return true;
+    int4 max = (int4) (2147483647 / sizeof(vartype *));
+    int4 cap = array->capacity > max / 3 * 2 ? max : array->capacity + array->capacity / 2;
+    if (cap < size)
+        cap = size;
+    if (cap < 4)
+        cap = 4;
+    vartype **new_data = (vartype **) realloc(array->data, cap * sizeof(vartype *));
+    if (new_data == NULL) {
+        /* Try again without the spare room */
+        cap = size;
+        new_data = (vartype **) realloc(array->data, cap * sizeof(vartype *));
+        if (new_data == NULL)
+            return false;
+    }
+    array->data = new_data;
+    array->capacity = cap;
+    return true;
+}
+
+/* Removes the first element from a non-empty list, and returns it. Instead
+ * of moving the remaining elements, the list becomes a slice of its old
+ * array, if it isn't one already, so this takes constant time, even if the
+ * array is shared. Returns NULL, leaving the contents of the list unchanged,
+ * if there isn't enough memory.
+ */
+vartype *list_take_first(vartype_list *list) {
+    list_data *array = list->array;
+    if (array->owner == NULL || array->refcount > 1) {
+        list_data *ld = slice_list_data(array, list->size, 0, list->size);
+        if (ld == NULL)
+            return NULL;
+        release_list_data(array, list->size);
+        list->array = array = ld;
+    }
+    vartype *v = array->data[0];
+    if (array->owner->refcount == 1) {
+        /* No one else can see the owner's array, so we can take the element
+         * instead of copying it.
+         */
+        array->data[0] = NULL;
+    } else {
+        v = dup_vartype(v);
+        if (v == NULL)
+            return NULL;
+    }
+    array->data++;
+    array->capacity--;
+    list->size--;
+    return v;
+}
+
 equation_data *new_equation_data(const char *text, int4 length, bool compat_mode, int *errpos, int eqn_index) {
     *errpos = -1;
     if (eqn_index == -1) {
@@ -339,6 +485,33 @@ vartype *new_var_ref(int4 dir, const char *name, int length) {
     return (vartype *) r;
 }
 
+vartype *new_sparsematrix(int4 rows, int4 columns, int4 nnz) {
+    vartype_sparsematrix *sm = (vartype_sparsematrix *)
+                                        malloc(sizeof(vartype_sparsematrix));
+    if (sm == NULL)
+        return NULL;
+    sm->type = TYPE_SPARSEMATRIX;
+    sm->rows = rows;
+    sm->columns = columns;
+    sm->array = (sparsematrix_data *) malloc(sizeof(sparsematrix_data));
+    if (sm->array == NULL) {
+        free(sm);
+        return NULL;
+    }
+    sm->array->refcount = 1;
+    sm->array->nnz = nnz;
+    sm->array->rowptr = (int4 *) malloc((rows + 1) * sizeof(int4));
+    /* Allocating at least one element, so NULL always means failure */
+    sm->array->col = (int4 *) malloc((nnz == 0 ? 1 : nnz) * sizeof(int4));
+    sm->array->val = (phloat *) malloc((nnz == 0 ? 1 : nnz) * sizeof(phloat));
+    if (sm->array->rowptr == NULL || sm->array->col == NULL
+            || sm->array->val == NULL) {
+        free_vartype((vartype *) sm);
+        return NULL;
+    }
+    return (vartype *) sm;
+}
+
 void free_vartype(vartype *v) {
     if (v == NULL)
         return;
@@ -390,12 +563,7 @@ void free_vartype(vartype *v) {
         }
         case TYPE_LIST: {
             vartype_list *list = (vartype_list *) v;
-            if (--(list->array->refcount) == 0) {
-                for (int4 i = 0; i < list->size; i++)
-                    free_vartype(list->array->data[i]);
-                free(list->array->data);
-                free(list->array);
-            }
+            release_list_data(list->array, list->size);
             free(list);
             break;
         }
@@ -417,6 +585,17 @@ void free_vartype(vartype *v) {
             free(v);
             break;
         }
+        case TYPE_SPARSEMATRIX: {
+            vartype_sparsematrix *sm = (vartype_sparsematrix *) v;
+            if (--(sm->array->refcount) == 0) {
+                free(sm->array->rowptr);
+                free(sm->array->col);
+                free(sm->array->val);
+                free(sm->array);
+            }
+            free(sm);
+            break;
+        }
     }
 }
 
@@ -470,12 +649,16 @@ bool put_matrix_string(vartype_realmatrix *rm, int i, const char *text, int4 len
         if (rm->array->is_string[i] == 2)
             free(*(void **) &rm->array->data[i]);
         *(int4 **) &rm->array->data[i] = p;
+        if (rm->array->is_string[i] == 0)
+            rm->array->strings++;
         rm->array->is_string[i] = 2;
     } else {
         void *oldptr = rm->array->is_string[i] == 2 ? *(void **) &rm->array->data[i] : NULL;
         char *t = (char *) &rm->array->data[i];
         t[0] = length;
         memmove(t + 1, text, length);
+        if (rm->array->is_string[i] == 0)
+            rm->array->strings++;
         rm->array->is_string[i] = 1;
         if (oldptr != NULL)
             free(oldptr);
@@ -484,8 +667,11 @@ bool put_matrix_string(vartype_realmatrix *rm, int i, const char *text, int4 len
 }
 
 void put_matrix_phloat(vartype_realmatrix *rm, int i, phloat value) {
-    if (rm->array->is_string[i] == 2)
-        free(*(void **) &rm->array->data[i]);
+    if (rm->array->is_string[i] != 0) {
+        if (rm->array->is_string[i] == 2)
+            free(*(void **) &rm->array->data[i]);
+        rm->array->strings--;
+    }
     rm->array->is_string[i] = 0;
     rm->array->data[i] = value;
 }
@@ -496,7 +682,10 @@ vartype *dup_vartype(const vartype *v) {
     switch (v->type) {
         case TYPE_REAL: {
             vartype_real *r = (vartype_real *) v;
-            return new_real(r->x);
+            vartype *r2 = new_real(r->x);
+            if (r2 != NULL)
+                copy_tangent(v, r2);
+            return r2;
         }
         case TYPE_COMPLEX: {
             vartype_complex *c = (vartype_complex *) v;
@@ -582,6 +771,16 @@ vartype *dup_vartype(const vartype *v) {
             *r2 = *r;
             return (vartype *) r2;
         }
+        case TYPE_SPARSEMATRIX: {
+            vartype_sparsematrix *sm = (vartype_sparsematrix *) v;
+            vartype_sparsematrix *sm2 = (vartype_sparsematrix *)
+                                        malloc(sizeof(vartype_sparsematrix));
+            if (sm2 == NULL)
+                return NULL;
+            *sm2 = *sm;
+            sm->array->refcount++;
+            return (vartype *) sm2;
+        }
         default:
             return NULL;
     }
@@ -630,6 +829,8 @@ bool disentangle(vartype *v) {
                         md->data[i] = rm->array->data[i];
                     }
                 }
+                md->strings = rm->array->strings;
+                md->capacity = sz;
                 md->refcount = 1;
                 rm->array->refcount--;
                 rm->array = md;
@@ -654,6 +855,7 @@ bool disentangle(vartype *v) {
                 }
                 for (i = 0; i < sz; i++)
                     md->data[i] = cm->array->data[i];
+                md->capacity = sz / 2;
                 md->refcount = 1;
                 cm->array->refcount--;
                 cm->array = md;
@@ -662,36 +864,55 @@ bool disentangle(vartype *v) {
         }
         case TYPE_LIST: {
             vartype_list *list = (vartype_list *) v;
-            if (list->array->refcount == 1)
+            list_data *array = list->array;
+            if (array->owner == NULL) {
+                if (array->refcount == 1)
+                    return true;
+            } else if (array->refcount == 1 && array->owner->refcount == 1) {
+                /* The only slice of an array no one else is using; take the
+                 * array over, dropping the elements outside the slice.
+                 */
+                list_data *owner = array->owner;
+                int4 begin = (int4) (array->data - owner->data);
+                for (int4 i = 0; i < begin; i++)
+                    free_vartype(owner->data[i]);
+                for (int4 i = begin + list->size; i < array->owner_size; i++)
+                    free_vartype(owner->data[i]);
+                memmove(owner->data, array->data, list->size * sizeof(vartype *));
+                array->data = owner->data;
+                array->capacity = owner->capacity;
+                array->owner = NULL;
+                free(owner);
                 return true;
-            else {
-                list_data *ld = (list_data *) malloc(sizeof(list_data));
-                if (ld == NULL)
-                    return false;
-                ld->data = (vartype **) malloc(list->size * sizeof(vartype *));
-                if (ld->data == NULL && list->size != 0) {
-                    free(ld);
-                    return false;
-                }
-                for (int4 i = 0; i < list->size; i++) {
-                    vartype *vv = list->array->data[i];
-                    if (vv != NULL) {
-                        vv = dup_vartype(vv);
-                        if (vv == NULL) {
-                            for (int4 j = 0; j < i; j++)
-                                free_vartype(ld->data[j]);
-                            free(ld->data);
-                            free(ld);
-                            return false;
-                        }
+            }
+            list_data *ld = (list_data *) malloc(sizeof(list_data));
+            if (ld == NULL)
+                return false;
+            ld->data = (vartype **) malloc(list->size * sizeof(vartype *));
+            if (ld->data == NULL && list->size != 0) {
+                free(ld);
+                return false;
+            }
+            for (int4 i = 0; i < list->size; i++) {
+                vartype *vv = list->array->data[i];
+                if (vv != NULL) {
+                    vv = dup_vartype(vv);
+                    if (vv == NULL) {
+                        for (int4 j = 0; j < i; j++)
+                            free_vartype(ld->data[j]);
+                        free(ld->data);
+                        free(ld);
+                        return false;
                     }
-                    ld->data[i] = vv;
                 }
-                ld->refcount = 1;
-                list->array->refcount--;
-                list->array = ld;
-                return true;
+                ld->data[i] = vv;
             }
+            ld->capacity = list->size;
+            ld->refcount = 1;
+            ld->owner = NULL;
+            release_list_data(array, list->size);
+            list->array = ld;
+            return true;
         }
         case TYPE_REAL:
         case TYPE_COMPLEX:
@@ -1068,6 +1289,7 @@ static bool var_exists(int section, int type) {
         case TYPE_DIR_REF:
         case TYPE_PGM_REF:
         case TYPE_VAR_REF:
+        case TYPE_SPARSEMATRIX:
             return section == CATSECT_OTHER;
     }
     return false;
@@ -1125,11 +1347,27 @@ bool named_eqns_exist() {
 }
 
 bool contains_strings(const vartype_realmatrix *rm) {
-    int4 size = rm->rows * rm->columns;
-    for (int4 i = 0; i < size; i++)
-        if (rm->array->is_string[i] != 0)
-            return true;
-    return false;
+    return rm->array->strings != 0;
+}
+
+int4 count_strings(const char *is_string, int4 n) {
+    int4 count = 0;
+    int4 i = 0;
+    /* Eight flags at a time; each is 0, 1, or 2, so summing the bytes of
+     * a word of (x | x >> 1) & 1 counts the nonzero ones.
+     */
+    for (; i + 8 <= n; i += 8) {
+        uint8 w;
+        memcpy(&w, is_string + i, 8);
+        if (w == 0)
+            continue;
+        w = (w | (w >> 1)) & 0x0101010101010101ULL;
+        count += (int4) ((w * 0x0101010101010101ULL) >> 56);
+    }
+    for (; i < n; i++)
+        if (is_string[i] != 0)
+            count++;
+    return count;
 }
 
 /* This is only used by core_linalg1, and does not deal with strings,
@@ -1148,6 +1386,7 @@ int matrix_copy(vartype *dst, const vartype *src) {
             int4 size = s->rows * s->columns;
             free_long_strings(d->array->is_string, d->array->data, size);
             memset(d->array->is_string, 0, size);
+            d->array->strings = 0;
             memcpy((void *) d->array->data, (const void *) s->array->data, size * sizeof(phloat));
             return ERR_NONE;
         } else if (dst->type == TYPE_COMPLEXMATRIX) {
@@ -75,7 +75,8 @@ struct pgm_index {
 #define TYPE_DIR_REF 9
 #define TYPE_PGM_REF 10
 #define TYPE_VAR_REF 11
-#define TYPE_SENTINEL 12
+#define TYPE_SPARSEMATRIX 12
+#define TYPE_SENTINEL 13
 
 struct vartype {
     int type;
@@ -98,6 +99,17 @@ struct realmatrix_data {
     int refcount;
     phloat *data;
     char *is_string;
+    /* Number of elements with is_string != 0; code that writes is_string
+     * directly must keep this in sync, so contains_strings() can simply
+     * test it instead of scanning the whole matrix.
+     */
+    int4 strings;
+    /* Number of elements allocated in data and is_string; this can be more
+     * than rows * columns, so that growing a matrix one row at a time
+     * doesn't have to reallocate every time. The elements past the end of
+     * the matrix are not initialized.
+     */
+    int4 capacity;
 };
 
 struct vartype_realmatrix {
@@ -111,6 +123,8 @@ struct vartype_realmatrix {
 struct complexmatrix_data {
     int refcount;
     phloat *data;
+    /* Number of complex elements allocated; see realmatrix_data */
+    int4 capacity;
 };
 
 struct vartype_complexmatrix {
@@ -147,6 +161,17 @@ struct vartype_string {
 struct list_data {
     int refcount;
     vartype **data;
+    /* Number of elements allocated in data; see realmatrix_data. Use
+     * list_reserve() to make room for more elements.
+     */
+    int4 capacity;
+    /* If owner is not NULL, this is a slice, made by list_slice() or
+     * list_take_first(): data points into the owner's array, and the
+     * elements belong to the owner, which holds owner_size of them. Slices
+     * are read-only; disentangle() gives them an array of their own.
+     */
+    list_data *owner;
+    int4 owner_size;
 };
 
 struct vartype_list {
@@ -188,6 +213,28 @@ struct vartype_var_ref {
     char name[7];
 };
 
+/* Sparse real matrix, in compressed sparse row format: the nonzero elements
+ * of row i are val[rowptr[i]] through val[rowptr[i + 1] - 1], in columns
+ * col[rowptr[i]] etc., sorted by column. Explicit zeros are not stored.
+ * Sparse matrices are never modified in place, so the data can be shared
+ * freely.
+ */
+struct sparsematrix_data {
+    int refcount;
+    int4 nnz;
+    int4 *rowptr;
+    int4 *col;
+    phloat *val;
+};
+
+struct vartype_sparsematrix {
+    int type;
+    int4 rows;
+    int4 columns;
+    sparsematrix_data *array;
+};
+
+
 struct vloc {
     int dir;
     int idx;
@@ -204,15 +251,20 @@ struct vloc {
 vartype *new_real(phloat value);
 vartype *new_complex(phloat re, phloat im);
 vartype *new_string(const char *s, int slen);
+int4 string_capacity(int4 length);
 vartype *new_realmatrix(int4 rows, int4 columns);
 vartype *new_complexmatrix(int4 rows, int4 columns);
 vartype *new_list(int4 size);
+vartype *list_slice(const vartype_list *list, int4 begin, int4 size);
+bool list_reserve(vartype_list *list, int4 size);
+vartype *list_take_first(vartype_list *list);
 vartype *new_equation(const char *text, int4 length, bool compat_mode, int *errpos);
 vartype *new_equation(equation_data *eqd);
 vartype *new_unit(phloat value, const char *text, int4 length);
 vartype *new_dir_ref(int4 dir);
 vartype *new_pgm_ref(int4 dir, int4 pgm);
 vartype *new_var_ref(int4 dir, const char *name, int length);
+vartype *new_sparsematrix(int4 rows, int4 columns, int4 nnz);
 void free_vartype(vartype *v);
 void clean_vartype_pools();
 void free_long_strings(char *is_string, phloat *data, int4 n);
@@ -237,6 +289,7 @@ bool purge_var(const char *name, int namelength, bool force = false, bool global
 bool vars_exist(int section);
 bool named_eqns_exist();
 bool contains_strings(const vartype_realmatrix *rm);
+int4 count_strings(const char *is_string, int4 n);
 int matrix_copy(vartype *dst, const vartype *src);
 vartype *recall_private_var(const char *name, int namelength, bool allow_calling_frames = false);
 vartype *recall_and_purge_private_var(const char *name, int namelength);
@@ -0,0 +1,185 @@
+#include <chrono>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "core_main.h"
+#include "core_globals.h"
+#include "core_helpers.h"
+
+/* Compares the decimal dot product kernel, dot_fma(), with the plain loop
+ * using * and += that it replaced, for speed and for accuracy.
+ * Usage: dotbench [length [repetitions]]
+ */
+
+#ifdef BCD_MATH
+
+static double now() {
+    return std::chrono::duration<double>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static phloat loop_dot(const phloat *x, const phloat *y, int4 n) {
+    phloat sum = 0;
+    for (int4 i = 0; i < n; i++)
+        sum += x[i] * y[i];
+    return sum;
+}
+
+static void print(const char *label, phloat x) {
+    char buf[100];
+    int len = real2buf(buf, x);
+    printf("%s%.*s\n", label, len, buf);
+}
+
+int main(int argc, char *argv[]) {
+    int4 n = argc > 1 ? atoi(argv[1]) : 1000;
+    int reps = argc > 2 ? atoi(argv[2]) : 1000;
+    if (n < 1 || reps < 1) {
+        fprintf(stderr, "Usage: %s [length [repetitions]]\n", argv[0]);
+        return 1;
+    }
+
+    int rows = 8, cols = 22;
+    core_init(&rows, &cols, 0, NULL);
+
+    phloat *x = new phloat[n];
+    phloat *y = new phloat[n];
+    srand(42);
+    for (int4 i = 0; i < n; i++) {
+        x[i] = phloat(rand() - RAND_MAX / 2) / phloat(rand() + 1);
+        y[i] = phloat(rand() - RAND_MAX / 2) / phloat(rand() + 1);
+    }
+
+    phloat r1 = 0, r2 = 0;
+    double t0 = now();
+    for (int r = 0; r < reps; r++)
+        r1 = loop_dot(x, y, n);
+    double t1 = now();
+    for (int r = 0; r < reps; r++)
+        r2 = dot_fma(x, y, n, 0);
+    double t2 = now();
+
+    double terms = (double) n * reps;
+    printf("%d terms, %d repetitions\n", n, reps);
+    printf("loop:    %8.1f ns/term\n", (t1 - t0) / terms * 1e9);
+    printf("dot_fma: %8.1f ns/term (%.2fx)\n", (t2 - t1) / terms * 1e9,
+                                            (t1 - t0) / (t2 - t1));
+    print("loop:    ", r1);
+    print("dot_fma: ", r2);
+
+    /* (-1) * 1 + (1 + 10^-20) * (1 - 10^-20) is exactly -10^-40, but the
+     * second product has 41 significant digits, so rounding it first loses
+     * the answer entirely.
+     */
+    phloat a[2], b[2];
+    a[0] = -1;
+    b[0] = 1;
+    a[1] = 1 + phloat("1e-20");
+    b[1] = 1 - phloat("1e-20");
+    print("cancellation, loop:    ", loop_dot(a, b, 2));
+    print("cancellation, dot_fma: ", dot_fma(a, b, 2, 0));
+
+    delete[] x;
+    delete[] y;
+    return 0;
+}
+
+#else
+
+int main(int argc, char *argv[]) {
+    fprintf(stderr, "%s: this benchmark is only meaningful in the decimal build\n", argv[0]);
+    return 1;
+}
+
+#endif
+
+const char *shell_platform() {
+    return NULL;
+}
+
+void shell_blitter(const char *bits, int bytesperline, int x, int y,
+                             int width, int height) {
+    //
+}
+
+void shell_beeper(int tone) {
+    //
+}
+
+void shell_annunciators(int updn, int shf, int prt, int run, int g, int rad) {
+    //
+}
+
+bool shell_wants_cpu() {
+    return false;
+}
+
+void shell_delay(int duration) {
+    //
+}
+
+void shell_request_timeout3(int delay) {
+    //
+}
+
+void shell_request_display_size(int rows, int cols) {
+    //
+}
+
+uint8 shell_get_mem() {
+    return 0;
+}
+
+bool shell_low_battery() {
+    return false;
+}
+
+void shell_powerdown() {
+    //
+}
+
+int8 shell_random_seed() {
+    return 0;
+}
+
+uint4 shell_milliseconds() {
+    return (uint4) std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char *shell_number_format() {
+    return ".";
+}
+
+void shell_set_skin_mode(int mode) {
+    //
+}
+
+int shell_date_format() {
+    return 0;
+}
+
+bool shell_clk24() {
+    return false;
+}
+
+void shell_print(const char *text, int length,
+                 const char *bits, int bytesperline,
+                 int x, int y, int width, int height) {
+    //
+}
+
+void shell_get_time_date(uint4 *time, uint4 *date, int *weekday) {
+    *time = 0;
+    *date = 15821015;
+    *weekday = 5;
+}
+
+void shell_message(const char *message) {
+    //
+}
+
+void shell_log(const char *message) {
+    //
+}
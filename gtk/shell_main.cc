@@ -1070,7 +1070,13 @@ static void init_shell_state(int4 version) {
             state.mainWindowHeight = 0;
             /* fall through */
         case 10:
-            /* current version (SHELL_VERSION = 10),
+            core_settings.matrix_block_size = 0;
+            /* fall through */
+        case 11:
+            core_settings.matrix_mixedprecision = true;
+            /* fall through */
+        case 12:
+            /* current version (SHELL_VERSION = 12),
              * so nothing to do here since everything
              * was initialized from the state file.
              */
@@ -1108,6 +1114,10 @@ static int read_shell_state() {
     }
     if (state_version >= 9)
         core_settings.localized_copy_paste = state.localized_copy_paste;
+    if (state_version >= 11)
+        core_settings.matrix_block_size = state.matrix_block_size;
+    if (state_version >= 12)
+        core_settings.matrix_mixedprecision = state.matrix_mixedprecision;
 
     init_shell_state(state_version);
     return 1;
@@ -1131,6 +1141,8 @@ static int write_shell_state() {
     state.matrix_outofrange = core_settings.matrix_outofrange;
     state.auto_repeat = core_settings.auto_repeat;
     state.localized_copy_paste = core_settings.localized_copy_paste;
+    state.matrix_block_size = core_settings.matrix_block_size;
+    state.matrix_mixedprecision = core_settings.matrix_mixedprecision;
     if (fwrite(&state, 1, sizeof(state_type), statefile) != sizeof(int4))
         return 0;
 
@@ -2346,6 +2358,9 @@ static void preferencesCB() {
     static GtkWidget *printtogif;
     static GtkWidget *gifpath;
     static GtkWidget *gifheight;
+#ifdef BCD_MATH
+    static GtkWidget *mixedprecision;
+#endif
 
     if (dialog == NULL) {
         dialog = gtk_dialog_new_with_buttons(
@@ -2388,6 +2403,10 @@ static void preferencesCB() {
         gifheight = gtk_entry_new();
         gtk_entry_set_max_length(GTK_ENTRY(gifheight), 5);
         gtk_grid_attach(GTK_GRID(grid), gifheight, 2, 7, 1, 1);
+#ifdef BCD_MATH
+        mixedprecision = gtk_check_button_new_with_label("Solve linear systems in binary, refining the solution to full decimal precision");
+        gtk_grid_attach(GTK_GRID(grid), mixedprecision, 0, 8, 4, 1);
+#endif
 
         g_signal_connect(G_OBJECT(browse1), "clicked", G_CALLBACK(browse_file),
                 (gpointer) new browse_file_info("Select Text File Name",
@@ -2413,6 +2432,9 @@ static void preferencesCB() {
     snprintf(maxlen, 6, "%d", state.printerGifMaxLength);
         gtk_entry_set_text(GTK_ENTRY(gifheight), maxlen);
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(repaintwholedisplay), !state.old_repaint);
+#ifdef BCD_MATH
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(mixedprecision), core_settings.matrix_mixedprecision);
+#endif
 
     gtk_window_set_role(GTK_WINDOW(dialog), "Plus42 Dialog");
     if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
@@ -2420,6 +2442,9 @@ static void preferencesCB() {
         core_settings.matrix_outofrange = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(matrixoutofrange));
         core_settings.auto_repeat = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(autorepeat));
         core_settings.localized_copy_paste = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(localizedcopypaste));
+#ifdef BCD_MATH
+        core_settings.matrix_mixedprecision = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(mixedprecision));
+#endif
 
         state.printerToTxtFile = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(printtotext));
         char *old = strclone(state.printerTxtFileName);
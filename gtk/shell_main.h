@@ -27,7 +27,7 @@ extern GtkWidget *mainwindow;
 extern bool allow_paint;
 extern int disp_rows, disp_cols;
 
-#define SHELL_VERSION 10
+#define SHELL_VERSION 12
 
 struct state_type {
     int extras;
@@ -48,6 +48,8 @@ struct state_type {
     bool old_repaint;
     bool localized_copy_paste;
     int mainWindowWidth, mainWindowHeight;
+    int matrix_block_size;
+    bool matrix_mixedprecision;
 };
 
 extern state_type state;
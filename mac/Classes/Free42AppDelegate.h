@@ -20,7 +20,7 @@
 #import "shell_skin.h"
 
 #define FILENAMELEN 256
-#define SHELL_VERSION 5
+#define SHELL_VERSION 7
 
 struct state_type {
     int printerToTxtFile;
@@ -38,6 +38,8 @@ struct state_type {
     bool auto_repeat;
     bool localized_copy_paste;
     int mainWindowWidth, mainWindowHeight;
+    int matrix_block_size;
+    bool matrix_mixedprecision;
 };
 
 extern state_type state;
@@ -1928,7 +1928,13 @@ static void init_shell_state(int4 version) {
             state.mainWindowHeight = 0;
             /* fall through */
         case 5:
-            /* current version (SHELL_VERSION = 5),
+            core_settings.matrix_block_size = 0;
+            /* fall through */
+        case 6:
+            core_settings.matrix_mixedprecision = true;
+            /* fall through */
+        case 7:
+            /* current version (SHELL_VERSION = 7),
              * so nothing to do here since everything
              * was initialized from the state file.
              */
@@ -1969,6 +1975,10 @@ static int read_shell_state() {
 
     if (state_version >= 4)
         core_settings.localized_copy_paste = state.localized_copy_paste;
+    if (state_version >= 6)
+        core_settings.matrix_block_size = state.matrix_block_size;
+    if (state_version >= 7)
+        core_settings.matrix_mixedprecision = state.matrix_mixedprecision;
 
     init_shell_state(state_version);
     return 1;
@@ -1992,6 +2002,8 @@ static int write_shell_state() {
     state.matrix_outofrange = core_settings.matrix_outofrange;
     state.auto_repeat = core_settings.auto_repeat;
     state.localized_copy_paste = core_settings.localized_copy_paste;
+    state.matrix_block_size = core_settings.matrix_block_size;
+    state.matrix_mixedprecision = core_settings.matrix_mixedprecision;
     if (fwrite(&state, 1, sizeof(state_type), statefile) != sizeof(state_type))
         return 0;
     
@@ -113,7 +113,7 @@ static int keymap_length = 0;
 static keymap_entry *keymap = NULL;
 
 
-#define SHELL_VERSION 13
+#define SHELL_VERSION 15
 
 state_type state;
 static int placement_saved = 0;
@@ -2748,7 +2748,13 @@ static void init_shell_state(int4 version) {
             state.mainWindowHeight = 0;
             // fall through
         case 13:
-            // current version (SHELL_VERSION = 13),
+            core_settings.matrix_block_size = 0;
+            // fall through
+        case 14:
+            core_settings.matrix_mixedprecision = true;
+            // fall through
+        case 15:
+            // current version (SHELL_VERSION = 15),
             // so nothing to do here since everything
             // was initialized from the state file.
             ;
@@ -2805,6 +2811,8 @@ static int read_shell_state() {
     core_settings.matrix_outofrange = state.matrix_outofrange;
     core_settings.auto_repeat = state.auto_repeat;
     core_settings.localized_copy_paste = state.localized_copy_paste;
+    core_settings.matrix_block_size = state.matrix_block_size;
+    core_settings.matrix_mixedprecision = state.matrix_mixedprecision;
 
     // Initialize the parts of the shell state
     // that were NOT read from the state file
@@ -2832,6 +2840,8 @@ static int write_shell_state() {
     state.auto_repeat = core_settings.auto_repeat;
     state.dummy1 = TRUE;
     state.localized_copy_paste = core_settings.localized_copy_paste;
+    state.matrix_block_size = core_settings.matrix_block_size;
+    state.matrix_mixedprecision = core_settings.matrix_mixedprecision;
     if (fwrite(&state, 1, sizeof(state_type), statefile) != sizeof(state_type))
         return 0;
 
@@ -71,6 +71,8 @@ struct state_type {
     bool auto_repeat;
     bool localized_copy_paste;
     int mainWindowWidth, mainWindowHeight;
+    int matrix_block_size;
+    bool matrix_mixedprecision;
 };
 
 extern state_type state;